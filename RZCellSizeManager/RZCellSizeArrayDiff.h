@@ -0,0 +1,99 @@
+//
+//  RZCellSizeArrayDiff.h
+//
+
+
+// Copyright 2014 Raizlabs and other contributors
+// http://raizlabs.com/
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+#import <Foundation/Foundation.h>
+
+/**
+ *  RZCellSizeArrayDiff
+ *
+ *  The differences between two arrays of object identities, found in linear time with Paul Heckel's algorithm.
+ *  Identities that appear once in each array are matched first, and matches are then extended to equal neighbors,
+ *  which pairs up most repeated identities as well.  Every identity that is left over was deleted or inserted.
+ *
+ *  Identities are compared with isEqual: and hash.  For the sizes of a changed object to be recomputed, its identity
+ *  must change along with anything that affects its size, the same as a content key.
+ **/
+@interface RZCellSizeArrayDiff : NSObject
+
+/**
+ *  Diff two arrays of identities.
+ *
+ *  @param oldIdentities Identities of the objects before the change, in order.  Must not be nil.
+ *  @param newIdentities Identities of the objects after the change, in order.  Must not be nil.
+ *
+ *  @return A diff from oldIdentities to newIdentities.
+ */
+- (instancetype)initWithOldIdentities:(NSArray *)oldIdentities newIdentities:(NSArray *)newIdentities;
+
+/**
+ *  Number of objects before and after the change.
+ */
+@property (nonatomic, readonly) NSUInteger oldCount;
+@property (nonatomic, readonly) NSUInteger newCount;
+
+/**
+ *  Indexes of the deleted objects, in the old array.
+ */
+@property (nonatomic, readonly) NSIndexSet* deletedIndexes;
+
+/**
+ *  Indexes of the inserted objects, in the new array.
+ */
+@property (nonatomic, readonly) NSIndexSet* insertedIndexes;
+
+/**
+ *  Indexes of the moved objects, in the new array.  These are the fewest matched objects that have to move for every
+ *  other matched object to keep its order, so the others only shift with the deletions and insertions.  Found the
+ *  first time they are asked for, in O(n log n).
+ */
+@property (nonatomic, readonly) NSIndexSet* movedIndexes;
+
+/**
+ *  oldIndexes[i] is the old index of the object at new index i, or NSNotFound if it was inserted.  The array has
+ *  newCount elements and lives as long as the diff.
+ */
+@property (nonatomic, readonly) const NSUInteger* oldIndexes;
+
+/**
+ *  The old index of the object at a new index.
+ *
+ *  @param index Index in the new array.
+ *
+ *  @return The index of the same object in the old array, or NSNotFound if it was inserted.
+ */
+- (NSUInteger)oldIndexForNewIndex:(NSUInteger)index;
+
+/**
+ *  The new index of the object at an old index.
+ *
+ *  @param index Index in the old array.
+ *
+ *  @return The index of the same object in the new array, or NSNotFound if it was deleted.
+ */
+- (NSUInteger)newIndexForOldIndex:(NSUInteger)index;
+
+@end
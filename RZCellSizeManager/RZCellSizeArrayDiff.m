@@ -0,0 +1,264 @@
+//
+//  RZCellSizeArrayDiff.m
+//
+
+
+// Copyright 2014 Raizlabs and other contributors
+// http://raizlabs.com/
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+#import "RZCellSizeArrayDiff.h"
+
+/**
+ *  One entry per distinct identity.  The counts only need to tell none, one and many apart, so they stop at 2.
+ **/
+typedef struct {
+    uint8_t oldCount;
+    uint8_t newCount;
+    NSUInteger oldIndex;
+} RZCellSizeArrayDiffSymbol;
+
+@interface RZCellSizeArrayDiff ()
+{
+    NSUInteger *_oldIndexes;
+    NSUInteger *_newIndexes;
+}
+
+@property (nonatomic, assign, readwrite) NSUInteger oldCount;
+@property (nonatomic, assign, readwrite) NSUInteger newCount;
+@property (nonatomic, strong, readwrite) NSIndexSet* deletedIndexes;
+@property (nonatomic, strong, readwrite) NSIndexSet* insertedIndexes;
+@property (nonatomic, strong, readwrite) NSIndexSet* movedIndexes;
+
+@end
+
+@implementation RZCellSizeArrayDiff
+
+- (instancetype)initWithOldIdentities:(NSArray *)oldIdentities newIdentities:(NSArray *)newIdentities
+{
+    NSParameterAssert(oldIdentities);
+    NSParameterAssert(newIdentities);
+    
+    self = [super init];
+    if ( self ) {
+        _oldCount = oldIdentities.count;
+        _newCount = newIdentities.count;
+        _oldIndexes = malloc(MAX(_newCount, 1) * sizeof(NSUInteger));
+        _newIndexes = malloc(MAX(_oldCount, 1) * sizeof(NSUInteger));
+        NSAssert(_oldIndexes != NULL && _newIndexes != NULL, @"Unable to allocate array diff indexes");
+        [self diffOldIdentities:oldIdentities newIdentities:newIdentities];
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    free(_oldIndexes);
+    free(_newIndexes);
+}
+
+#pragma mark - Public Methods
+
+- (NSIndexSet *)movedIndexes
+{
+    if (_movedIndexes == nil)
+    {
+        _movedIndexes = [self findMovedIndexes];
+    }
+    return _movedIndexes;
+}
+
+- (const NSUInteger *)oldIndexes
+{
+    return _oldIndexes;
+}
+
+- (NSUInteger)oldIndexForNewIndex:(NSUInteger)index
+{
+    NSParameterAssert(index < self.newCount);
+    return _oldIndexes[index];
+}
+
+- (NSUInteger)newIndexForOldIndex:(NSUInteger)index
+{
+    NSParameterAssert(index < self.oldCount);
+    return _newIndexes[index];
+}
+
+#pragma mark - Private Methods
+
+/**
+ *  Every matched object outside a longest run of matches whose old indexes increase, found by patience sorting.
+ *  runEnds[k] is the new index that ends the best run of length k + 1 so far, and previous links each new index to
+ *  the one before it in its run.
+ **/
+- (NSIndexSet *)findMovedIndexes
+{
+    NSUInteger newCount = self.newCount;
+    NSUInteger *runEnds = malloc(MAX(newCount, 1) * sizeof(NSUInteger));
+    NSUInteger *previous = malloc(MAX(newCount, 1) * sizeof(NSUInteger));
+    NSAssert(runEnds != NULL && previous != NULL, @"Unable to allocate array diff runs");
+    
+    NSMutableIndexSet* movedIndexes = [NSMutableIndexSet indexSet];
+    NSUInteger runLength = 0;
+    for (NSUInteger i = 0; i < newCount; i++)
+    {
+        NSUInteger oldIndex = _oldIndexes[i];
+        if (oldIndex == NSNotFound)
+        {
+            continue;
+        }
+        [movedIndexes addIndex:i];
+        
+        NSUInteger low = 0;
+        NSUInteger high = runLength;
+        while (low < high)
+        {
+            NSUInteger middle = (low + high) / 2;
+            if (_oldIndexes[runEnds[middle]] < oldIndex)
+            {
+                low = middle + 1;
+            }
+            else
+            {
+                high = middle;
+            }
+        }
+        previous[i] = (low > 0) ? runEnds[low - 1] : NSNotFound;
+        runEnds[low] = i;
+        runLength = MAX(runLength, low + 1);
+    }
+    
+    for (NSUInteger i = (runLength > 0) ? runEnds[runLength - 1] : NSNotFound; i != NSNotFound; i = previous[i])
+    {
+        [movedIndexes removeIndex:i];
+    }
+    free(runEnds);
+    free(previous);
+    return movedIndexes;
+}
+
+/**
+ *  Heckel's six passes.  Pass 1 and 2 build the symbol table, pass 3 matches the identities that are unique in both
+ *  arrays, and pass 4 and 5 extend every match forwards and then backwards to neighbors with the same identity.
+ *  The ends of the arrays count as matched to each other, so runs of repeated identities at either end pair up too.
+ *  Pass 6 collects what is left.
+ **/
+- (void)diffOldIdentities:(NSArray *)oldIdentities newIdentities:(NSArray *)newIdentities
+{
+    NSUInteger oldCount = self.oldCount;
+    NSUInteger newCount = self.newCount;
+    // A map table rather than a dictionary, since identities do not need to be copyable.
+    NSMapTable* symbolsByIdentity = [NSMapTable strongToStrongObjectsMapTable];
+    RZCellSizeArrayDiffSymbol *symbols = calloc(MAX(oldCount + newCount, 1), sizeof(RZCellSizeArrayDiffSymbol));
+    NSUInteger *oldSymbols = malloc(MAX(oldCount, 1) * sizeof(NSUInteger));
+    NSUInteger *newSymbols = malloc(MAX(newCount, 1) * sizeof(NSUInteger));
+    NSAssert(symbols != NULL && oldSymbols != NULL && newSymbols != NULL, @"Unable to allocate array diff symbols");
+    __block NSUInteger symbolCount = 0;
+    
+    NSUInteger (^symbolForIdentity)(id) = ^NSUInteger(id identity) {
+        NSNumber* symbol = [symbolsByIdentity objectForKey:identity];
+        if (symbol == nil)
+        {
+            symbol = @(symbolCount++);
+            [symbolsByIdentity setObject:symbol forKey:identity];
+        }
+        return [symbol unsignedIntegerValue];
+    };
+    
+    [newIdentities enumerateObjectsUsingBlock:^(id identity, NSUInteger i, BOOL *stop) {
+        NSUInteger symbol = symbolForIdentity(identity);
+        symbols[symbol].newCount = MIN(symbols[symbol].newCount + 1, 2);
+        newSymbols[i] = symbol;
+    }];
+    [oldIdentities enumerateObjectsUsingBlock:^(id identity, NSUInteger j, BOOL *stop) {
+        NSUInteger symbol = symbolForIdentity(identity);
+        symbols[symbol].oldCount = MIN(symbols[symbol].oldCount + 1, 2);
+        symbols[symbol].oldIndex = j;
+        oldSymbols[j] = symbol;
+    }];
+    
+    NSUInteger *oldIndexes = _oldIndexes;
+    NSUInteger *newIndexes = _newIndexes;
+    for (NSUInteger j = 0; j < oldCount; j++)
+    {
+        newIndexes[j] = NSNotFound;
+    }
+    for (NSUInteger i = 0; i < newCount; i++)
+    {
+        RZCellSizeArrayDiffSymbol symbol = symbols[newSymbols[i]];
+        oldIndexes[i] = NSNotFound;
+        if (symbol.oldCount == 1 && symbol.newCount == 1)
+        {
+            oldIndexes[i] = symbol.oldIndex;
+            newIndexes[symbol.oldIndex] = i;
+        }
+    }
+    
+    // Forwards, starting from the matched beginnings of the arrays.
+    for (NSUInteger i = 0; i < newCount; i++)
+    {
+        NSUInteger j = (i == 0) ? 0 : oldIndexes[i - 1] + 1;
+        if ((i == 0 || oldIndexes[i - 1] != NSNotFound) && j < oldCount &&
+            oldIndexes[i] == NSNotFound && newIndexes[j] == NSNotFound && newSymbols[i] == oldSymbols[j])
+        {
+            oldIndexes[i] = j;
+            newIndexes[j] = i;
+        }
+    }
+    
+    // Backwards, starting from the matched ends of the arrays.
+    for (NSUInteger i = newCount; i > 0; i--)
+    {
+        NSUInteger next = (i == newCount) ? oldCount : oldIndexes[i];
+        if ((i == newCount || next != NSNotFound) && next > 0 &&
+            oldIndexes[i - 1] == NSNotFound && newIndexes[next - 1] == NSNotFound && newSymbols[i - 1] == oldSymbols[next - 1])
+        {
+            oldIndexes[i - 1] = next - 1;
+            newIndexes[next - 1] = i - 1;
+        }
+    }
+    
+    NSMutableIndexSet* deletedIndexes = [NSMutableIndexSet indexSet];
+    for (NSUInteger j = 0; j < oldCount; j++)
+    {
+        if (newIndexes[j] == NSNotFound)
+        {
+            [deletedIndexes addIndex:j];
+        }
+    }
+    NSMutableIndexSet* insertedIndexes = [NSMutableIndexSet indexSet];
+    for (NSUInteger i = 0; i < newCount; i++)
+    {
+        if (oldIndexes[i] == NSNotFound)
+        {
+            [insertedIndexes addIndex:i];
+        }
+    }
+    self.deletedIndexes = deletedIndexes;
+    self.insertedIndexes = insertedIndexes;
+    
+    free(symbols);
+    free(oldSymbols);
+    free(newSymbols);
+}
+
+@end
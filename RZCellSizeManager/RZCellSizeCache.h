@@ -0,0 +1,445 @@
+//
+//  RZCellSizeCache.h
+//
+
+
+// Copyright 2014 Raizlabs and other contributors
+// http://raizlabs.com/
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+#import <Foundation/Foundation.h>
+#import <CoreGraphics/CoreGraphics.h>
+
+#define kRZCellSizeCacheMaximumClassTag 255
+
+/**
+ *  RZCellSizeCache
+ *
+ *  Storage for the sizes computed by RZCellSizeManager.  Sizes are kept in dense per-section arrays indexed by row,
+ *  so a lookup is an array access rather than a hash of an NSIndexPath and an unboxing of an NSNumber or NSValue.
+ *  Rows that have not been computed hold a sentinel value.  Each section only stores a contiguous range of rows, which
+ *  a byte budget can keep to the rows around the visible ones, at 12 bytes per row plus 8 for the offset index.
+ *
+ *  Invalidation is O(1): every size is stamped with the epoch it was computed in and a class tag, and invalidating
+ *  the whole cache, a section or a class tag only records the current epoch for it.  Sizes older than that are stale.
+ *  They are no longer returned by getSize:forRow:inSection:, but they are kept as the estimate for their rows until
+ *  the rows are computed again.
+ *
+ *  This class only depends on Foundation and CoreGraphics so it can be used and profiled without any UIKit objects.
+ *
+ *  The cache is not thread safe, with one exception: getSizeFromAnyThread:forRow:inSection: may be called from any
+ *  thread while the owning thread keeps using the cache.  Every other method must be called from the owning thread.
+ **/
+@interface RZCellSizeCache : NSObject
+
+/**
+ *  Retrieve a cached size.
+ *
+ *  @param size    On return, the cached size if there is one.  May be NULL if only checking for existence.
+ *  @param row     Row of the cell.
+ *  @param section Section of the cell.
+ *
+ *  @return YES if a size has been cached for the row, NO otherwise.
+ */
+- (BOOL)getSize:(CGSize *)size forRow:(NSUInteger)row inSection:(NSUInteger)section;
+
+/**
+ *  Retrieve the cached sizes of a range of rows in one pass.
+ *
+ *  @param sizes   Buffer with room for rows.length sizes.  sizes[i] is set to the size of row rows.location + i if
+ *                 it has one and left untouched otherwise.
+ *  @param rows    Range of rows to look up.
+ *  @param section Section of the rows.
+ *
+ *  @return Indexes of the rows, relative to rows.location, that do not have a cached size.
+ */
+- (NSIndexSet *)getSizes:(CGSize *)sizes forRowsInRange:(NSRange)rows inSection:(NSUInteger)section;
+
+/**
+ *  Cache a size for a row, growing the section storage if needed.
+ *
+ *  @param size    Size to cache.  Sizes must not be negative.
+ *  @param row     Row of the cell.
+ *  @param section Section of the cell.
+ */
+- (void)setSize:(CGSize)size forRow:(NSUInteger)row inSection:(NSUInteger)section;
+
+/**
+ *  Cache a size for a row with a class tag, so that it can be invalidated along with the other sizes of its class.
+ *
+ *  @param size     Size to cache.  Sizes must not be negative.
+ *  @param row      Row of the cell.
+ *  @param section  Section of the cell.
+ *  @param classTag Tag of the cell class, from 1 to kRZCellSizeCacheMaximumClassTag, or 0 for none.
+ */
+- (void)setSize:(CGSize)size forRow:(NSUInteger)row inSection:(NSUInteger)section classTag:(uint8_t)classTag;
+
+/**
+ *  Retrieve a cached size along with its class tag.
+ *
+ *  @param size     On return, the cached size if there is one.  May be NULL.
+ *  @param classTag On return, the class tag of the size if there is one.  May be NULL.
+ *  @param row      Row of the cell.
+ *  @param section  Section of the cell.
+ *
+ *  @return YES if a valid size has been cached for the row, NO otherwise.
+ */
+- (BOOL)getSize:(CGSize *)size classTag:(uint8_t *)classTag forRow:(NSUInteger)row inSection:(NSUInteger)section;
+
+/**
+ *  Retrieve the last size computed for a row, even if it has been invalidated since.
+ *
+ *  @param size    On return, the last computed size if there is one.  May be NULL.
+ *  @param row     Row of the cell.
+ *  @param section Section of the cell.
+ *
+ *  @return YES if a size has ever been computed for the row and not removed, NO otherwise.
+ */
+- (BOOL)getEstimatedSize:(CGSize *)size forRow:(NSUInteger)row inSection:(NSUInteger)section;
+
+/**
+ *  Mark the cached size of a row as stale, keeping it as an estimate.
+ *
+ *  @param row     Row of the cell.
+ *  @param section Section of the cell.
+ *
+ *  @return YES if the row had a valid size.
+ */
+- (BOOL)invalidateSizeForRow:(NSUInteger)row inSection:(NSUInteger)section;
+
+/**
+ *  Mark every size cached by row as stale in O(1).
+ */
+- (void)invalidateAllSizes;
+
+/**
+ *  Mark every size in a section as stale in O(1).
+ *
+ *  @param section Section to invalidate.
+ */
+- (void)invalidateSizesInSection:(NSUInteger)section;
+
+/**
+ *  Mark every size with a class tag as stale in O(1).  Tag 0 invalidates every size.
+ *
+ *  @param classTag Tag of the cell class.
+ */
+- (void)invalidateSizesWithClassTag:(uint8_t)classTag;
+
+/**
+ *  Remove the cached size for a row, along with its estimate.  The storage for the row is kept.
+ *
+ *  @param row     Row of the cell.
+ *  @param section Section of the cell.
+ */
+- (void)removeSizeForRow:(NSUInteger)row inSection:(NSUInteger)section;
+
+/**
+ *  Remove all sizes cached by row and release the storage.  Sizes cached by content key are kept.
+ */
+- (void)removeAllSizes;
+
+/**
+ *  Retrieve a size cached by content key.
+ *
+ *  @param size          On return, the cached size if there is one.  May be NULL if only checking for existence.
+ *  @param contentKey    Key identifying the content the size was computed for.
+ *  @param cellClassName Name of the cell class the size was computed with.
+ *
+ *  @return YES if a size has been cached for the key, NO otherwise.
+ */
+- (BOOL)getSize:(CGSize *)size forContentKey:(id<NSCopying>)contentKey cellClassName:(NSString *)cellClassName;
+
+/**
+ *  Cache a size by content key.
+ *
+ *  @param size          Size to cache.
+ *  @param contentKey    Key identifying the content the size was computed for.
+ *  @param cellClassName Name of the cell class the size was computed with.
+ */
+- (void)setSize:(CGSize)size forContentKey:(id<NSCopying>)contentKey cellClassName:(NSString *)cellClassName;
+
+/**
+ *  Remove every size cached by content key.
+ */
+- (void)removeAllContentKeyedSizes;
+
+/**
+ *  Remove the sizes cached by content key for one cell class.
+ *
+ *  @param cellClassName The class name of the cell.
+ */
+- (void)removeContentKeyedSizesForCellClassName:(NSString *)cellClassName;
+
+/**
+ *  Retrieve a size cached by layout signature.  Unlike content-keyed sizes, these are shared by every object whose
+ *  cell lays out the same way.
+ *
+ *  @param size            On return, the cached size if there is one.  May be NULL if only checking for existence.
+ *  @param layoutSignature Key describing the shape of the cell the size was computed for.
+ *  @param cellClassName   Name of the cell class the size was computed with.
+ *
+ *  @return YES if a size has been cached for the signature, NO otherwise.
+ */
+- (BOOL)getSize:(CGSize *)size forLayoutSignature:(id<NSCopying>)layoutSignature cellClassName:(NSString *)cellClassName;
+
+/**
+ *  Cache a size by layout signature.
+ *
+ *  @param size            Size to cache.
+ *  @param layoutSignature Key describing the shape of the cell the size was computed for.
+ *  @param cellClassName   Name of the cell class the size was computed with.
+ */
+- (void)setSize:(CGSize)size forLayoutSignature:(id<NSCopying>)layoutSignature cellClassName:(NSString *)cellClassName;
+
+/**
+ *  Remove every size cached by layout signature.
+ */
+- (void)removeAllLayoutSignatureSizes;
+
+/**
+ *  Remove the sizes cached by layout signature for one cell class.
+ *
+ *  @param cellClassName The class name of the cell.
+ */
+- (void)removeLayoutSignatureSizesForCellClassName:(NSString *)cellClassName;
+
+/**
+ *  Open unmeasured rows in a section, shifting the cached sizes of the rows after them.
+ *
+ *  @param rows    Indexes of the inserted rows, in post-insertion coordinates.
+ *  @param section Section the rows are inserted into.
+ */
+- (void)insertRowsAtIndexes:(NSIndexSet *)rows inSection:(NSUInteger)section;
+
+/**
+ *  Remove rows from a section, shifting the cached sizes of the rows after them.
+ *
+ *  @param rows    Indexes of the deleted rows, in pre-deletion coordinates.
+ *  @param section Section the rows are deleted from.
+ */
+- (void)deleteRowsAtIndexes:(NSIndexSet *)rows inSection:(NSUInteger)section;
+
+/**
+ *  Move a row, and its cached size if there is one, to a new position.
+ *
+ *  @param row        Current row.
+ *  @param section    Current section.
+ *  @param newRow     Row after the move.
+ *  @param newSection Section after the move.  May be the same as section.
+ */
+- (void)moveRow:(NSUInteger)row inSection:(NSUInteger)section toRow:(NSUInteger)newRow inSection:(NSUInteger)newSection;
+
+/**
+ *  Rearrange the cached sizes of a section in one pass, for example after the array behind it was replaced.  Sizes
+ *  keep their stamps, so stale sizes stay stale.  Rows that did not exist before are left unmeasured.
+ *
+ *  @param section Section to rearrange.
+ *  @param oldRows oldRows[i] is the row that row i used to be, or NSNotFound if it is new.
+ *  @param count   Number of rows in the section after the change, and of elements in oldRows.
+ */
+- (void)moveRowsInSection:(NSUInteger)section fromOldRows:(const NSUInteger *)oldRows count:(NSUInteger)count;
+
+/**
+ *  Open empty sections, shifting the sections after them.
+ *
+ *  @param sections Indexes of the inserted sections, in post-insertion coordinates.
+ */
+- (void)insertSections:(NSIndexSet *)sections;
+
+/**
+ *  Remove sections and their cached sizes, shifting the sections after them.
+ *
+ *  @param sections Indexes of the deleted sections, in pre-deletion coordinates.
+ */
+- (void)deleteSections:(NSIndexSet *)sections;
+
+/**
+ *  Height used for rows that have not been computed when answering offset queries.
+ */
+@property (nonatomic, assign) CGFloat estimatedHeight;
+
+/**
+ *  Offset of the top of a row from the top of its section, mixing cached and estimated heights.
+ *  Offsets are answered from a prefix sum index in O(log n).
+ *
+ *  @param row     Row of the cell.
+ *  @param section Section of the cell.
+ *
+ *  @return The total height of the rows before the row.
+ */
+- (CGFloat)offsetOfRow:(NSUInteger)row inSection:(NSUInteger)section;
+
+/**
+ *  Total height of a section, mixing cached and estimated heights.
+ *
+ *  @param section      Section to measure.
+ *  @param numberOfRows Number of rows in the section.
+ *
+ *  @return The total height of the rows in the section.
+ */
+- (CGFloat)heightOfSection:(NSUInteger)section numberOfRows:(NSUInteger)numberOfRows;
+
+/**
+ *  Find the row that contains an offset from the top of its section, in O(log n).
+ *
+ *  @param offset       Offset from the top of the section.  Offsets past the end return the last row.
+ *  @param section      Section to search.
+ *  @param numberOfRows Number of rows in the section.
+ *
+ *  @return The row containing the offset, or NSNotFound if the section is empty.
+ */
+- (NSUInteger)rowAtOffset:(CGFloat)offset inSection:(NSUInteger)section numberOfRows:(NSUInteger)numberOfRows;
+
+/**
+ *  Number of sections that currently have storage.
+ */
+@property (nonatomic, readonly) NSUInteger numberOfSections;
+
+/**
+ *  End of the range of rows that currently have storage in a section.  Rows past it have not been cached.
+ *
+ *  @param section Section to check.
+ *
+ *  @return The row after the last row with storage in the section, or 0 if the section has no storage.
+ */
+- (NSUInteger)numberOfRowsInSection:(NSUInteger)section;
+
+/**
+ *  Number of sizes currently stored by row, including stale ones.
+ */
+@property (nonatomic, readonly) NSUInteger countOfSizes;
+
+/**
+ *  Number of sizes currently stored by row that have not been invalidated.  This visits every stored row, so it is
+ *  meant for statistics rather than for every lookup.
+ */
+@property (nonatomic, readonly) NSUInteger countOfValidSizes;
+
+/**
+ *  Number of sizes currently cached by content key.
+ */
+@property (nonatomic, readonly) NSUInteger countOfContentKeyedSizes;
+
+/**
+ *  Number of bytes allocated for size storage and offset indexes.
+ */
+@property (nonatomic, readonly) NSUInteger byteCount;
+
+/**
+ *  Average number of bytes allocated per cached size, including empty rows and offset indexes.
+ */
+@property (nonatomic, readonly) double bytesPerSize;
+
+/**
+ *  Maximum number of bytes for size storage and offset indexes, or 0 for no limit.  When a write grows the storage
+ *  past the budget, the cache is trimmed to three quarters of it with trimToByteCount:.  Defaults to 0.
+ */
+@property (nonatomic, assign) NSUInteger byteBudget;
+
+/**
+ *  Set the row that trimming keeps sizes around.  This should be kept at the visible rows.  Until it is set, or after
+ *  it is set to NSNotFound, trimming keeps sizes around the last row written, so a write never drops its own size.
+ *
+ *  @param row     Row to keep sizes around, or NSNotFound to follow the last row written.
+ *  @param section Section of the row, or NSNotFound to follow the last row written.
+ */
+- (void)setFocusRow:(NSUInteger)row inSection:(NSUInteger)section;
+
+/**
+ *  Drop the sizes farthest from the focus row until the storage fits in a number of bytes.  Distance is counted in
+ *  rows across section boundaries, so the rows at the end of the section before the focus are as near as the rows
+ *  just after the focus row.  Every row within the widest distance that fits is kept, and a section is only released
+ *  whole when none of its rows are that near.
+ *
+ *  @param byteCount Number of bytes to fit in.
+ */
+- (void)trimToByteCount:(NSUInteger)byteCount;
+
+/**
+ *  Retrieve a cached size from any thread without taking a lock or blocking the owning thread.  The result is the
+ *  size as of some point during the call.  If updates keep overlapping the read, it gives up and returns NO, so a
+ *  miss does not mean the size is not cached.
+ *
+ *  @param size    On return, the cached size if there is one.  May be NULL if only checking for existence.
+ *  @param row     Row of the cell.
+ *  @param section Section of the cell.
+ *
+ *  @return YES if a valid size was read for the row, NO otherwise.
+ */
+- (BOOL)getSizeFromAnyThread:(CGSize *)size forRow:(NSUInteger)row inSection:(NSUInteger)section;
+
+/**
+ *  Group changes so that getSizeFromAnyThread:forRow:inSection: sees either none or all of them.  Each change is
+ *  already grouped on its own; this is for changes that only make sense together, like a batch of deletions and
+ *  insertions.  Calls can be nested.  Arrays released by the changes are freed at the end of a later group once
+ *  every read that started before they were released has finished, so reads that keep starting do not hold them.
+ */
+- (void)beginUpdates;
+
+/**
+ *  End a group of changes started with beginUpdates.
+ */
+- (void)endUpdates;
+
+/**
+ *  Number of released arrays still waiting for reads on other threads to finish.
+ */
+@property (nonatomic, readonly) NSUInteger countOfRetiredArrays;
+
+@end
+
+
+/**
+ *  RZCellSizeCacheUpdates
+ *
+ *  Structural changes collected during a batch and applied to a cache together, with the semantics of a UITableView
+ *  batch update: sizes are invalidated first, then rows and sections are deleted in pre-update coordinates and
+ *  inserted in post-update coordinates.  Moved rows keep their cached sizes.
+ **/
+@interface RZCellSizeCacheUpdates : NSObject
+
+@property (nonatomic, readonly) NSMutableArray* invalidatedIndexPaths;
+@property (nonatomic, readonly) NSMutableIndexSet* invalidatedSections;
+@property (nonatomic, readonly) NSMutableArray* deletedIndexPaths;
+@property (nonatomic, readonly) NSMutableArray* insertedIndexPaths;
+@property (nonatomic, readonly) NSMutableArray* movedFromIndexPaths;
+@property (nonatomic, readonly) NSMutableArray* movedToIndexPaths;
+@property (nonatomic, readonly) NSMutableIndexSet* deletedSections;
+@property (nonatomic, readonly) NSMutableIndexSet* insertedSections;
+
+/**
+ *  Group index paths by section.
+ *
+ *  @param indexPaths Array of two-level index paths.
+ *
+ *  @return Dictionary of section number to an index set of rows.
+ */
++ (NSDictionary *)rowsBySectionForIndexPaths:(NSArray *)indexPaths;
+
+/**
+ *  Apply the changes to a cache.
+ *
+ *  @param cache Cache to update.
+ */
+- (void)applyToCache:(RZCellSizeCache *)cache;
+
+@end
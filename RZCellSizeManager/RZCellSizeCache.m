@@ -0,0 +1,1573 @@
+//
+//  RZCellSizeCache.m
+//
+
+
+// Copyright 2014 Raizlabs and other contributors
+// http://raizlabs.com/
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#import "RZCellSizeCache.h"
+#import <pthread.h>
+
+#define kRZCellSizeCacheNotComputed         -1.0f
+#define kRZCellSizeCacheMinimumRowCapacity  16
+#define kRZCellSizeCacheEpochBits           24
+#define kRZCellSizeCacheEpochMask           ((1u << kRZCellSizeCacheEpochBits) - 1)
+#define kRZCellSizeCacheArrayHeaderSize     16
+#define kRZCellSizeCacheMaximumReadAttempts 4
+#define kRZCellSizeCacheReaderSlotCount     64
+
+/**
+ *  Sizes are stored as floats, which is plenty of precision for a point value and halves the
+ *  storage of a CGSize on 64 bit devices.
+ *
+ *  stamp holds the epoch the size was computed in, in its low 24 bits, and the class tag in its high 8 bits.
+ *  A computed size is valid while its epoch is newer than the last invalidation of the whole cache, of its section
+ *  and of its class tag.  An invalid size is stale: it is kept as an estimate until the row is computed again.
+ **/
+typedef struct {
+    float width;
+    float height;
+    uint32_t stamp;
+} RZCellSizeCacheEntry;
+
+static const RZCellSizeCacheEntry kRZCellSizeCacheEmptyEntry = { 0.0f, kRZCellSizeCacheNotComputed, 0 };
+
+/**
+ *  Storage covers the rows from origin to origin + count; entries[0] is the size of row origin.  Rows outside that
+ *  range have not been computed, which lets a long section keep only the rows around the visible ones.
+ *
+ *  offsetTree is a Fenwick tree over the row heights of the stored range, using the estimated height for rows that
+ *  have not been computed.  It is built the first time an offset is asked for, kept up to date when a single row
+ *  changes, and rebuilt lazily after anything shifts rows.
+ **/
+typedef struct {
+    RZCellSizeCacheEntry *entries;
+    NSUInteger origin;
+    NSUInteger count;
+    NSUInteger capacity;
+    NSUInteger sizeCount;
+    double *offsetTree;
+    NSUInteger offsetTreeCapacity;
+    BOOL offsetTreeValid;
+    uint32_t invalidatedEpoch;
+} RZCellSizeCacheSection;
+
+static inline BOOL RZCellSizeCacheEntryIsComputed(RZCellSizeCacheEntry entry)
+{
+    return entry.height != kRZCellSizeCacheNotComputed;
+}
+
+static inline uint32_t RZCellSizeCacheEntryEpoch(RZCellSizeCacheEntry entry)
+{
+    return entry.stamp & kRZCellSizeCacheEpochMask;
+}
+
+static inline uint8_t RZCellSizeCacheEntryClassTag(RZCellSizeCacheEntry entry)
+{
+    return (uint8_t)(entry.stamp >> kRZCellSizeCacheEpochBits);
+}
+
+/**
+ *  Stale sizes are still the best estimate there is, so offsets use every computed height whether it is valid or not.
+ **/
+static inline double RZCellSizeCacheEntryHeight(RZCellSizeCacheEntry entry, double estimatedHeight)
+{
+    return RZCellSizeCacheEntryIsComputed(entry) ? entry.height : estimatedHeight;
+}
+
+static inline NSUInteger RZCellSizeCacheSectionByteCount(const RZCellSizeCacheSection *section)
+{
+    return section->capacity * sizeof(RZCellSizeCacheEntry) + section->offsetTreeCapacity * sizeof(double);
+}
+
+/**
+ *  Returns the stored entry of a row, or NULL if the row is outside the stored range.
+ **/
+static inline const RZCellSizeCacheEntry *RZCellSizeCacheSectionEntryForRow(const RZCellSizeCacheSection *section, NSUInteger row)
+{
+    return (row >= section->origin && row - section->origin < section->count) ? &section->entries[row - section->origin] : NULL;
+}
+
+/**
+ *  The stored rows of a section that are within radius of the focus position, with the section laid out from base.
+ *  Returns NO if there are none.
+ **/
+static BOOL RZCellSizeCacheKeptRows(const RZCellSizeCacheSection *section, NSUInteger base, NSUInteger focusPosition, NSUInteger radius, NSRange *rows)
+{
+    if (section->count == 0)
+    {
+        return NO;
+    }
+    NSUInteger start = MAX(base + section->origin, (focusPosition > radius) ? focusPosition - radius : 0);
+    NSUInteger end = MIN(base + section->origin + section->count, focusPosition + radius + 1);
+    if (start >= end)
+    {
+        return NO;
+    }
+    *rows = NSMakeRange(start - base, end - start);
+    return YES;
+}
+
+/**
+ *  Row and section arrays are allocated zeroed, with their capacity stored in front of them.  A reader on another
+ *  thread may see a pointer and a count from different writes, but it never indexes an array past the capacity that
+ *  array was allocated with.
+ **/
+static void *RZCellSizeCacheAllocateArray(NSUInteger capacity, size_t elementSize)
+{
+    uint8_t *bytes = calloc(1, kRZCellSizeCacheArrayHeaderSize + capacity * elementSize);
+    if (bytes == NULL)
+    {
+        return NULL;
+    }
+    *(NSUInteger *)bytes = capacity;
+    return bytes + kRZCellSizeCacheArrayHeaderSize;
+}
+
+static inline NSUInteger RZCellSizeCacheArrayCapacity(const void *array)
+{
+    return array ? *(const NSUInteger *)((const uint8_t *)array - kRZCellSizeCacheArrayHeaderSize) : 0;
+}
+
+static inline void RZCellSizeCacheFreeArray(void *array)
+{
+    if (array)
+    {
+        free((uint8_t *)array - kRZCellSizeCacheArrayHeaderSize);
+    }
+}
+
+static inline NSUInteger RZCellSizeCacheLowestBit(NSUInteger i)
+{
+    return i & (~i + 1);
+}
+
+static void RZCellSizeCacheOffsetTreeAdd(double *tree, NSUInteger count, NSUInteger row, double delta)
+{
+    for (NSUInteger i = row + 1; i <= count; i += RZCellSizeCacheLowestBit(i))
+    {
+        tree[i] += delta;
+    }
+}
+
+static double RZCellSizeCacheOffsetTreeSum(const double *tree, NSUInteger rowCount)
+{
+    double sum = 0.0;
+    for (NSUInteger i = rowCount; i > 0; i -= RZCellSizeCacheLowestBit(i))
+    {
+        sum += tree[i];
+    }
+    return sum;
+}
+
+/**
+ *  Returns the number of leading rows whose total height is not greater than offset.
+ *  remainingOffset is set to the part of offset past those rows.
+ **/
+static NSUInteger RZCellSizeCacheOffsetTreeSearch(const double *tree, NSUInteger count, double offset, double *remainingOffset)
+{
+    NSUInteger step = 1;
+    while (step * 2 <= count)
+    {
+        step *= 2;
+    }
+    
+    NSUInteger rows = 0;
+    for (; step > 0 && count > 0; step /= 2)
+    {
+        if (rows + step <= count && tree[rows + step] <= offset)
+        {
+            rows += step;
+            offset -= tree[rows];
+        }
+    }
+    *remainingOffset = offset;
+    return rows;
+}
+
+@interface RZCellSizeCache ()
+{
+    RZCellSizeCacheSection *_sections;
+    NSUInteger _sectionCount;
+    NSUInteger _sectionCapacity;
+    NSUInteger _focusRow;
+    NSUInteger _focusSection;
+    BOOL _focusFollowsWrites;
+    uint32_t _epoch;
+    uint32_t _invalidatedEpoch;
+    uint32_t _classInvalidatedEpochs[kRZCellSizeCacheMaximumClassTag + 1];
+    NSUInteger _updatesNestingLevel;
+    NSUInteger _sequence;
+    NSUInteger _reclaimEpoch;
+    NSUInteger _readerEpochs[kRZCellSizeCacheReaderSlotCount];
+    NSUInteger _unslottedReaderCount;
+    void **_retiredArrays;
+    NSUInteger *_retiredEpochs;
+    NSUInteger _retiredCount;
+    NSUInteger _retiredCapacity;
+}
+
+@property (nonatomic, assign, readwrite) NSUInteger countOfSizes;
+@property (nonatomic, strong) NSMutableDictionary* contentKeyedSizes;
+@property (nonatomic, strong) NSMutableDictionary* layoutSignatureSizes;
+
+@end
+
+@implementation RZCellSizeCache
+
+- (instancetype)init
+{
+    self = [super init];
+    if ( self ) {
+        _contentKeyedSizes = [NSMutableDictionary dictionary];
+        _layoutSignatureSizes = [NSMutableDictionary dictionary];
+        _focusFollowsWrites = YES;
+        _epoch = 1;
+        _reclaimEpoch = 1;
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    [self removeAllSizes];
+    
+    // Nothing can be reading a cache that is being deallocated.
+    for (NSUInteger i = 0; i < _retiredCount; i++)
+    {
+        RZCellSizeCacheFreeArray(_retiredArrays[i]);
+    }
+    free(_retiredArrays);
+    free(_retiredEpochs);
+}
+
+#pragma mark - Public Methods
+
+- (BOOL)getSize:(CGSize *)size forRow:(NSUInteger)row inSection:(NSUInteger)section
+{
+    return [self getSize:size classTag:NULL forRow:row inSection:section];
+}
+
+- (BOOL)getSize:(CGSize *)size classTag:(uint8_t *)classTag forRow:(NSUInteger)row inSection:(NSUInteger)section
+{
+    RZCellSizeCacheEntry entry;
+    if (![self getEntry:&entry forRow:row inSection:section] || ![self entryIsValid:entry inSection:section])
+    {
+        return NO;
+    }
+
+    if (size)
+    {
+        *size = CGSizeMake(entry.width, entry.height);
+    }
+    if (classTag)
+    {
+        *classTag = RZCellSizeCacheEntryClassTag(entry);
+    }
+    return YES;
+}
+
+/**
+ *  Publishes the reclaim epoch a read started in, so arrays released since then are kept until it finishes.  Each
+ *  thread starts looking at its own slot, so readers on different threads rarely compete for one.  Returns
+ *  NSNotFound when every slot is taken, and the read is counted instead, which holds every released array.
+ **/
+static NSUInteger RZCellSizeCacheBeginRead(RZCellSizeCache *cache)
+{
+    NSUInteger epoch = __atomic_load_n(&cache->_reclaimEpoch, __ATOMIC_ACQUIRE);
+    NSUInteger first = ((uintptr_t)pthread_self() >> 4) % kRZCellSizeCacheReaderSlotCount;
+    for (NSUInteger i = 0; i < kRZCellSizeCacheReaderSlotCount; i++)
+    {
+        NSUInteger slot = (first + i) % kRZCellSizeCacheReaderSlotCount;
+        NSUInteger emptySlot = 0;
+        if (__atomic_compare_exchange_n(&cache->_readerEpochs[slot], &emptySlot, epoch, NO, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+        {
+            __atomic_thread_fence(__ATOMIC_SEQ_CST);
+            return slot;
+        }
+    }
+    __atomic_add_fetch(&cache->_unslottedReaderCount, 1, __ATOMIC_SEQ_CST);
+    return NSNotFound;
+}
+
+static void RZCellSizeCacheEndRead(RZCellSizeCache *cache, NSUInteger slot)
+{
+    if (slot != NSNotFound)
+    {
+        __atomic_store_n(&cache->_readerEpochs[slot], 0, __ATOMIC_RELEASE);
+    }
+    else
+    {
+        __atomic_sub_fetch(&cache->_unslottedReaderCount, 1, __ATOMIC_RELEASE);
+    }
+}
+
+/**
+ *  A seqlock read: the fields are loaded without locking, and the result is only used if no update started or ended
+ *  while they were loaded.  After a few attempts that overlap updates it reports a miss rather than wait.
+ *
+ *  Updates write the same memory with plain stores, which is the race a seqlock is built on, so this function is
+ *  excluded from the thread sanitizer.  Every load it makes stays within an allocated array whatever it reads.
+ **/
+__attribute__((no_sanitize("thread")))
+static BOOL RZCellSizeCacheReadSize(RZCellSizeCache *cache, CGSize *size, NSUInteger row, NSUInteger section)
+{
+    NSUInteger slot = RZCellSizeCacheBeginRead(cache);
+    
+    BOOL found = NO;
+    for (NSUInteger attempt = 0; attempt < kRZCellSizeCacheMaximumReadAttempts; attempt++)
+    {
+        NSUInteger sequence = __atomic_load_n(&cache->_sequence, __ATOMIC_ACQUIRE);
+        if (sequence & 1)
+        {
+            continue;
+        }
+        
+        found = NO;
+        float width = 0.0f;
+        float height = kRZCellSizeCacheNotComputed;
+        RZCellSizeCacheSection *sections = __atomic_load_n(&cache->_sections, __ATOMIC_ACQUIRE);
+        NSUInteger sectionCount = MIN(__atomic_load_n(&cache->_sectionCount, __ATOMIC_RELAXED), RZCellSizeCacheArrayCapacity(sections));
+        if (section < sectionCount)
+        {
+            RZCellSizeCacheSection *cacheSection = &sections[section];
+            RZCellSizeCacheEntry *entries = __atomic_load_n(&cacheSection->entries, __ATOMIC_ACQUIRE);
+            NSUInteger origin = __atomic_load_n(&cacheSection->origin, __ATOMIC_RELAXED);
+            NSUInteger count = MIN(__atomic_load_n(&cacheSection->count, __ATOMIC_RELAXED), RZCellSizeCacheArrayCapacity(entries));
+            if (row >= origin && row - origin < count)
+            {
+                RZCellSizeCacheEntry *entry = &entries[row - origin];
+                uint32_t stamp = __atomic_load_n(&entry->stamp, __ATOMIC_RELAXED);
+                __atomic_load(&entry->width, &width, __ATOMIC_RELAXED);
+                __atomic_load(&entry->height, &height, __ATOMIC_RELAXED);
+                
+                uint32_t epoch = stamp & kRZCellSizeCacheEpochMask;
+                uint8_t classTag = (uint8_t)(stamp >> kRZCellSizeCacheEpochBits);
+                found = (height != kRZCellSizeCacheNotComputed &&
+                         epoch > __atomic_load_n(&cache->_invalidatedEpoch, __ATOMIC_RELAXED) &&
+                         epoch > __atomic_load_n(&cacheSection->invalidatedEpoch, __ATOMIC_RELAXED) &&
+                         epoch > __atomic_load_n(&cache->_classInvalidatedEpochs[classTag], __ATOMIC_RELAXED));
+            }
+        }
+        
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&cache->_sequence, __ATOMIC_RELAXED) == sequence)
+        {
+            if (found && size)
+            {
+                *size = CGSizeMake(width, height);
+            }
+            break;
+        }
+        found = NO;
+    }
+    
+    RZCellSizeCacheEndRead(cache, slot);
+    return found;
+}
+
+- (BOOL)getSizeFromAnyThread:(CGSize *)size forRow:(NSUInteger)row inSection:(NSUInteger)section
+{
+    return RZCellSizeCacheReadSize(self, size, row, section);
+}
+
+- (NSIndexSet *)getSizes:(CGSize *)sizes forRowsInRange:(NSRange)rows inSection:(NSUInteger)section
+{
+    if (section >= _sectionCount)
+    {
+        return [NSIndexSet indexSetWithIndexesInRange:NSMakeRange(0, rows.length)];
+    }
+    
+    // Only the class epochs differ between rows, so the section-wide checks are done once.
+    RZCellSizeCacheSection *cacheSection = &_sections[section];
+    uint32_t invalidatedEpoch = MAX(_invalidatedEpoch, cacheSection->invalidatedEpoch);
+    NSUInteger first = MIN(MAX(rows.location, cacheSection->origin), NSMaxRange(rows));
+    NSUInteger end = MAX(MIN(NSMaxRange(rows), cacheSection->origin + cacheSection->count), first);
+    
+    NSMutableIndexSet* missingRows = [NSMutableIndexSet indexSetWithIndexesInRange:NSMakeRange(0, first - rows.location)];
+    for (NSUInteger row = first; row < end; row++)
+    {
+        RZCellSizeCacheEntry entry = cacheSection->entries[row - cacheSection->origin];
+        uint32_t epoch = RZCellSizeCacheEntryEpoch(entry);
+        if (RZCellSizeCacheEntryIsComputed(entry) && epoch > invalidatedEpoch && epoch > _classInvalidatedEpochs[RZCellSizeCacheEntryClassTag(entry)])
+        {
+            sizes[row - rows.location] = CGSizeMake(entry.width, entry.height);
+        }
+        else
+        {
+            [missingRows addIndex:row - rows.location];
+        }
+    }
+    [missingRows addIndexesInRange:NSMakeRange(end - rows.location, NSMaxRange(rows) - end)];
+    return missingRows;
+}
+
+- (BOOL)getEstimatedSize:(CGSize *)size forRow:(NSUInteger)row inSection:(NSUInteger)section
+{
+    RZCellSizeCacheEntry entry;
+    if (![self getEntry:&entry forRow:row inSection:section])
+    {
+        return NO;
+    }
+
+    if (size)
+    {
+        *size = CGSizeMake(entry.width, entry.height);
+    }
+    return YES;
+}
+
+- (void)setSize:(CGSize)size forRow:(NSUInteger)row inSection:(NSUInteger)section
+{
+    [self setSize:size forRow:row inSection:section classTag:0];
+}
+
+- (void)setSize:(CGSize)size forRow:(NSUInteger)row inSection:(NSUInteger)section classTag:(uint8_t)classTag
+{
+    NSAssert(size.width >= 0 && size.height >= 0, @"Cached sizes must not be negative: {%f, %f}", size.width, size.height);
+
+    RZCellSizeCacheEntry entry = { size.width, size.height, ((uint32_t)classTag << kRZCellSizeCacheEpochBits) | _epoch };
+    [self beginUpdates];
+    [self setEntry:entry forRow:row inSection:section];
+    [self endUpdates];
+}
+
+- (BOOL)invalidateSizeForRow:(NSUInteger)row inSection:(NSUInteger)section
+{
+    RZCellSizeCacheEntry entry;
+    if (![self getEntry:&entry forRow:row inSection:section] || ![self entryIsValid:entry inSection:section])
+    {
+        return NO;
+    }
+
+    // Epoch 0 is older than every invalidation.
+    [self beginUpdates];
+    _sections[section].entries[row - _sections[section].origin].stamp = entry.stamp & ~kRZCellSizeCacheEpochMask;
+    [self endUpdates];
+    return YES;
+}
+
+- (void)invalidateAllSizes
+{
+    [self beginUpdates];
+    _invalidatedEpoch = [self advanceEpoch];
+    [self endUpdates];
+}
+
+- (void)invalidateSizesInSection:(NSUInteger)section
+{
+    if (section < _sectionCount)
+    {
+        [self beginUpdates];
+        uint32_t epoch = [self advanceEpoch];
+        _sections[section].invalidatedEpoch = epoch;
+        [self endUpdates];
+    }
+}
+
+- (void)invalidateSizesWithClassTag:(uint8_t)classTag
+{
+    if (classTag == 0)
+    {
+        [self invalidateAllSizes];
+    }
+    else
+    {
+        [self beginUpdates];
+        uint32_t epoch = [self advanceEpoch];
+        _classInvalidatedEpochs[classTag] = epoch;
+        [self endUpdates];
+    }
+}
+
+- (void)removeSizeForRow:(NSUInteger)row inSection:(NSUInteger)section
+{
+    if (section >= _sectionCount || row < _sections[section].origin || row - _sections[section].origin >= _sections[section].count)
+    {
+        return;
+    }
+
+    NSUInteger storedRow = row - _sections[section].origin;
+    RZCellSizeCacheEntry *entry = &_sections[section].entries[storedRow];
+    if (RZCellSizeCacheEntryIsComputed(*entry))
+    {
+        [self beginUpdates];
+        [self updateOffsetTreeOfSection:&_sections[section] row:storedRow fromEntry:*entry toEntry:kRZCellSizeCacheEmptyEntry];
+        *entry = kRZCellSizeCacheEmptyEntry;
+        _sections[section].sizeCount--;
+        self.countOfSizes--;
+        [self endUpdates];
+    }
+}
+
+- (void)setEstimatedHeight:(CGFloat)estimatedHeight
+{
+    if (estimatedHeight != _estimatedHeight)
+    {
+        _estimatedHeight = estimatedHeight;
+        for (NSUInteger i = 0; i < _sectionCount; i++)
+        {
+            _sections[i].offsetTreeValid = NO;
+        }
+    }
+}
+
+- (CGFloat)offsetOfRow:(NSUInteger)row inSection:(NSUInteger)section
+{
+    RZCellSizeCacheSection *cacheSection = [self sectionWithValidOffsetTree:section];
+    NSUInteger storedRows = 0;
+    if (cacheSection && row > cacheSection->origin)
+    {
+        storedRows = MIN(row - cacheSection->origin, cacheSection->count);
+    }
+    double offset = storedRows > 0 ? RZCellSizeCacheOffsetTreeSum(cacheSection->offsetTree, storedRows) : 0.0;
+    return offset + (row - storedRows) * self.estimatedHeight;
+}
+
+- (CGFloat)heightOfSection:(NSUInteger)section numberOfRows:(NSUInteger)numberOfRows
+{
+    return [self offsetOfRow:numberOfRows inSection:section];
+}
+
+- (NSUInteger)rowAtOffset:(CGFloat)offset inSection:(NSUInteger)section numberOfRows:(NSUInteger)numberOfRows
+{
+    if (numberOfRows == 0)
+    {
+        return NSNotFound;
+    }
+    
+    RZCellSizeCacheSection *cacheSection = [self sectionWithValidOffsetTree:section];
+    double estimatedHeight = self.estimatedHeight;
+    double remainingOffset = MAX(offset, 0.0);
+    NSUInteger row = 0;
+    if (cacheSection && cacheSection->count > 0 && cacheSection->origin < numberOfRows &&
+        remainingOffset >= cacheSection->origin * estimatedHeight)
+    {
+        // Past the estimated rows before the stored range, so search the stored range.
+        NSUInteger storedRows = MIN(numberOfRows - cacheSection->origin, cacheSection->count);
+        remainingOffset -= cacheSection->origin * estimatedHeight;
+        row = RZCellSizeCacheOffsetTreeSearch(cacheSection->offsetTree, storedRows, remainingOffset, &remainingOffset);
+        if (row < storedRows)
+        {
+            return cacheSection->origin + row;
+        }
+        row += cacheSection->origin;
+    }
+    if (estimatedHeight > 0)
+    {
+        row += (NSUInteger)(remainingOffset / estimatedHeight);
+    }
+    return MIN(row, numberOfRows - 1);
+}
+
+- (void)insertRowsAtIndexes:(NSIndexSet *)rows inSection:(NSUInteger)section
+{
+    [self beginUpdates];
+    [self remapSection:section deletedRows:[NSIndexSet indexSet] insertedRows:rows];
+    [self endUpdates];
+}
+
+- (void)deleteRowsAtIndexes:(NSIndexSet *)rows inSection:(NSUInteger)section
+{
+    [self beginUpdates];
+    [self remapSection:section deletedRows:rows insertedRows:[NSIndexSet indexSet]];
+    [self endUpdates];
+}
+
+- (void)moveRow:(NSUInteger)row inSection:(NSUInteger)section toRow:(NSUInteger)newRow inSection:(NSUInteger)newSection
+{
+    // One update, so other threads never see the row deleted but not yet inserted.
+    [self beginUpdates];
+    if (section == newSection && section < _sectionCount && MIN(row, newRow) >= _sections[section].origin &&
+        MAX(row, newRow) - _sections[section].origin < _sections[section].count)
+    {
+        // Within a section only the rows between the two positions shift.
+        RZCellSizeCacheEntry *entries = _sections[section].entries;
+        row -= _sections[section].origin;
+        newRow -= _sections[section].origin;
+        RZCellSizeCacheEntry moved = entries[row];
+        if (row < newRow)
+        {
+            memmove(&entries[row], &entries[row + 1], (newRow - row) * sizeof(RZCellSizeCacheEntry));
+        }
+        else
+        {
+            memmove(&entries[newRow + 1], &entries[newRow], (row - newRow) * sizeof(RZCellSizeCacheEntry));
+        }
+        entries[newRow] = moved;
+        _sections[section].offsetTreeValid = NO;
+        [self endUpdates];
+        return;
+    }
+
+    // Stamps are only compared with the invalidations of their own section, so a size moving to another section is
+    // restamped with the current epoch, and a stale one is left behind.
+    RZCellSizeCacheEntry entry;
+    BOOL cached = [self getEntry:&entry forRow:row inSection:section] && [self entryIsValid:entry inSection:section];
+    [self deleteRowsAtIndexes:[NSIndexSet indexSetWithIndex:row] inSection:section];
+    [self insertRowsAtIndexes:[NSIndexSet indexSetWithIndex:newRow] inSection:newSection];
+    if (cached)
+    {
+        entry.stamp = (entry.stamp & ~kRZCellSizeCacheEpochMask) | _epoch;
+        [self setEntry:entry forRow:newRow inSection:newSection];
+    }
+    [self endUpdates];
+}
+
+- (void)moveRowsInSection:(NSUInteger)section fromOldRows:(const NSUInteger *)oldRows count:(NSUInteger)count
+{
+    NSParameterAssert(oldRows != NULL || count == 0);
+    if (section >= _sectionCount || _sections[section].count == 0)
+    {
+        return;
+    }
+    
+    // Only rows that bring a computed size need storage, so the new stored range spans the first to the last of them.
+    RZCellSizeCacheSection *cacheSection = &_sections[section];
+    NSUInteger first = NSNotFound;
+    NSUInteger end = 0;
+    for (NSUInteger row = 0; row < count; row++)
+    {
+        const RZCellSizeCacheEntry *entry = RZCellSizeCacheSectionEntryForRow(cacheSection, oldRows[row]);
+        if (entry && RZCellSizeCacheEntryIsComputed(*entry))
+        {
+            first = MIN(first, row);
+            end = row + 1;
+        }
+    }
+    
+    [self beginUpdates];
+    if (first == NSNotFound)
+    {
+        [self freeSection:section];
+        [self endUpdates];
+        return;
+    }
+    
+    NSUInteger capacity = MAX(end - first, kRZCellSizeCacheMinimumRowCapacity);
+    RZCellSizeCacheEntry *entries = RZCellSizeCacheAllocateArray(capacity, sizeof(RZCellSizeCacheEntry));
+    NSAssert(entries != NULL, @"Unable to allocate cell size cache rows");
+    NSUInteger sizeCount = 0;
+    for (NSUInteger row = first; row < end; row++)
+    {
+        const RZCellSizeCacheEntry *entry = RZCellSizeCacheSectionEntryForRow(cacheSection, oldRows[row]);
+        if (entry && RZCellSizeCacheEntryIsComputed(*entry))
+        {
+            entries[row - first] = *entry;
+            sizeCount++;
+        }
+        else
+        {
+            entries[row - first] = kRZCellSizeCacheEmptyEntry;
+        }
+    }
+    
+    self.countOfSizes = self.countOfSizes - cacheSection->sizeCount + sizeCount;
+    RZCellSizeCacheEntry *oldEntries = cacheSection->entries;
+    __atomic_store_n(&cacheSection->entries, entries, __ATOMIC_RELEASE);
+    cacheSection->origin = first;
+    cacheSection->count = end - first;
+    cacheSection->capacity = capacity;
+    cacheSection->sizeCount = sizeCount;
+    cacheSection->offsetTreeValid = NO;
+    [self retireArray:oldEntries];
+    
+    if (self.byteBudget > 0 && self.byteCount > self.byteBudget)
+    {
+        [self trimToByteCount:self.byteBudget * 3 / 4];
+    }
+    [self endUpdates];
+}
+
+- (void)insertSections:(NSIndexSet *)sections
+{
+    NSUInteger count = [self countAfterInsertingIndexes:sections intoCount:_sectionCount];
+    if (count == _sectionCount)
+    {
+        return;
+    }
+
+    [self beginUpdates];
+    NSUInteger source = _sectionCount;
+    [self sectionForWriting:count - 1 minimumRowCount:0];
+
+    NSUInteger inserted = [sections indexLessThanIndex:count];
+    for (NSUInteger section = count; section > 0 && source < section; )
+    {
+        section--;
+        if (section == inserted)
+        {
+            memset(&_sections[section], 0, sizeof(RZCellSizeCacheSection));
+            inserted = [sections indexLessThanIndex:inserted];
+        }
+        else
+        {
+            _sections[section] = _sections[--source];
+        }
+    }
+    [self endUpdates];
+}
+
+- (void)deleteSections:(NSIndexSet *)sections
+{
+    sections = sections ?: [NSIndexSet indexSet];
+    [self beginUpdates];
+    NSUInteger count = 0;
+    NSUInteger deleted = [sections firstIndex];
+    for (NSUInteger section = 0; section < _sectionCount; section++)
+    {
+        if (section == deleted)
+        {
+            self.countOfSizes -= _sections[section].sizeCount;
+            [self retireArray:_sections[section].entries];
+            free(_sections[section].offsetTree);
+            deleted = [sections indexGreaterThanIndex:deleted];
+        }
+        else
+        {
+            _sections[count++] = _sections[section];
+        }
+    }
+    
+    // Clear the slots left behind, since retired rows may be released before another thread next looks at them.
+    if (count < _sectionCount)
+    {
+        memset(&_sections[count], 0, (_sectionCount - count) * sizeof(RZCellSizeCacheSection));
+    }
+    _sectionCount = count;
+    [self endUpdates];
+}
+
+- (BOOL)getSize:(CGSize *)size forContentKey:(id<NSCopying>)contentKey cellClassName:(NSString *)cellClassName
+{
+    return [self getSize:size forKey:contentKey cellClassName:cellClassName inSizes:self.contentKeyedSizes];
+}
+
+- (void)setSize:(CGSize)size forContentKey:(id<NSCopying>)contentKey cellClassName:(NSString *)cellClassName
+{
+    [self setSize:size forKey:contentKey cellClassName:cellClassName inSizes:self.contentKeyedSizes];
+}
+
+- (void)removeAllContentKeyedSizes
+{
+    [self.contentKeyedSizes removeAllObjects];
+}
+
+- (void)removeContentKeyedSizesForCellClassName:(NSString *)cellClassName
+{
+    [self.contentKeyedSizes removeObjectForKey:cellClassName];
+}
+
+- (BOOL)getSize:(CGSize *)size forLayoutSignature:(id<NSCopying>)layoutSignature cellClassName:(NSString *)cellClassName
+{
+    return [self getSize:size forKey:layoutSignature cellClassName:cellClassName inSizes:self.layoutSignatureSizes];
+}
+
+- (void)setSize:(CGSize)size forLayoutSignature:(id<NSCopying>)layoutSignature cellClassName:(NSString *)cellClassName
+{
+    [self setSize:size forKey:layoutSignature cellClassName:cellClassName inSizes:self.layoutSignatureSizes];
+}
+
+- (void)removeAllLayoutSignatureSizes
+{
+    [self.layoutSignatureSizes removeAllObjects];
+}
+
+- (void)removeLayoutSignatureSizesForCellClassName:(NSString *)cellClassName
+{
+    [self.layoutSignatureSizes removeObjectForKey:cellClassName];
+}
+
+- (void)removeAllSizes
+{
+    [self beginUpdates];
+    RZCellSizeCacheSection *sections = _sections;
+    NSUInteger sectionCount = _sectionCount;
+    __atomic_store_n(&_sections, NULL, __ATOMIC_RELEASE);
+    _sectionCount = 0;
+    _sectionCapacity = 0;
+    for (NSUInteger i = 0; i < sectionCount; i++)
+    {
+        [self retireArray:sections[i].entries];
+        free(sections[i].offsetTree);
+    }
+    [self retireArray:sections];
+    self.countOfSizes = 0;
+    [self endUpdates];
+}
+
+- (NSUInteger)numberOfSections
+{
+    return _sectionCount;
+}
+
+- (NSUInteger)numberOfRowsInSection:(NSUInteger)section
+{
+    return (section < _sectionCount && _sections[section].count > 0) ? _sections[section].origin + _sections[section].count : 0;
+}
+
+- (NSUInteger)countOfContentKeyedSizes
+{
+    NSUInteger count = 0;
+    for (NSDictionary* sizes in [self.contentKeyedSizes allValues])
+    {
+        count += sizes.count;
+    }
+    return count;
+}
+
+- (NSUInteger)byteCount
+{
+    NSUInteger bytes = _sectionCapacity * sizeof(RZCellSizeCacheSection);
+    for (NSUInteger i = 0; i < _sectionCount; i++)
+    {
+        bytes += RZCellSizeCacheSectionByteCount(&_sections[i]);
+    }
+    return bytes;
+}
+
+- (NSUInteger)countOfRetiredArrays
+{
+    return _retiredCount;
+}
+
+- (NSUInteger)countOfValidSizes
+{
+    NSUInteger count = 0;
+    for (NSUInteger section = 0; section < _sectionCount; section++)
+    {
+        RZCellSizeCacheSection *cacheSection = &_sections[section];
+        for (NSUInteger i = 0; i < cacheSection->count; i++)
+        {
+            if (RZCellSizeCacheEntryIsComputed(cacheSection->entries[i]) && [self entryIsValid:cacheSection->entries[i] inSection:section])
+            {
+                count++;
+            }
+        }
+    }
+    return count;
+}
+
+- (double)bytesPerSize
+{
+    NSUInteger count = self.countOfSizes;
+    return (count > 0) ? (double)self.byteCount / count : 0.0;
+}
+
+- (void)setFocusRow:(NSUInteger)row inSection:(NSUInteger)section
+{
+    _focusFollowsWrites = (row == NSNotFound || section == NSNotFound);
+    if (!_focusFollowsWrites)
+    {
+        _focusRow = row;
+        _focusSection = section;
+    }
+}
+
+- (void)trimToByteCount:(NSUInteger)byteCount
+{
+    [self beginUpdates];
+    [self trimSizesToByteCount:byteCount];
+    [self endUpdates];
+}
+
+- (void)beginUpdates
+{
+    if (_updatesNestingLevel++ == 0)
+    {
+        // An odd sequence tells readers on other threads that a write is in progress.
+        __atomic_store_n(&_sequence, _sequence + 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+    }
+}
+
+- (void)endUpdates
+{
+    NSAssert(_updatesNestingLevel > 0, @"endUpdates called without a matching beginUpdates");
+    if (--_updatesNestingLevel == 0)
+    {
+        __atomic_store_n(&_sequence, _sequence + 1, __ATOMIC_RELEASE);
+        [self releaseRetiredArrays];
+    }
+}
+
+#pragma mark - Private Methods
+
+/**
+ *  Removes sizes until the byte count is at most byteCount.  Callers bracket this with beginUpdates and endUpdates.
+ *
+ *  Rows are ranked by their distance from the focus row counted across section boundaries, as if every section were
+ *  laid end to end up to the last row it stores.  The cache keeps every row within the widest radius of the focus
+ *  that fits, so the far ends of the focus section and the far parts of its neighbours go before any nearer row, and
+ *  a neighbouring section is only released whole once none of its rows are within the radius.
+ **/
+- (void)trimSizesToByteCount:(NSUInteger)byteCount
+{
+    if (self.byteCount <= byteCount || _sectionCount == 0)
+    {
+        return;
+    }
+    
+    NSUInteger *bases = malloc(_sectionCount * sizeof(NSUInteger));
+    NSAssert(bases != NULL, @"Unable to allocate cell size cache trim positions");
+    NSUInteger focusPosition = 0;
+    NSUInteger endPosition = [self layOutSectionsAtBases:bases focusPosition:&focusPosition];
+    
+    // The byte count only grows with the radius, so the widest radius that fits is found by bisection.
+    NSUInteger low = 0;
+    NSUInteger high = MAX(focusPosition, endPosition);
+    while (low < high)
+    {
+        NSUInteger radius = low + (high - low + 1) / 2;
+        if ([self byteCountKeepingRadius:radius aroundPosition:focusPosition bases:bases] <= byteCount)
+        {
+            low = radius;
+        }
+        else
+        {
+            high = radius - 1;
+        }
+    }
+    
+    for (NSUInteger section = 0; section < _sectionCount; section++)
+    {
+        RZCellSizeCacheSection *cacheSection = &_sections[section];
+        NSRange rows;
+        if (!RZCellSizeCacheKeptRows(cacheSection, bases[section], focusPosition, low, &rows))
+        {
+            if (cacheSection->capacity > 0 || cacheSection->offsetTreeCapacity > 0)
+            {
+                [self freeSection:section];
+            }
+        }
+        else if (rows.location != cacheSection->origin || rows.length != cacheSection->count)
+        {
+            [self trimSection:cacheSection toRows:rows];
+        }
+    }
+    free(bases);
+}
+
+/**
+ *  Fills in where each section starts when the sections are laid end to end, and returns where the last one ends.
+ *  The focus section is taken to reach at least the focus row.
+ **/
+- (NSUInteger)layOutSectionsAtBases:(NSUInteger *)bases focusPosition:(NSUInteger *)focusPosition
+{
+    NSUInteger position = 0;
+    for (NSUInteger section = 0; section < _sectionCount; section++)
+    {
+        bases[section] = position;
+        NSUInteger length = _sections[section].origin + _sections[section].count;
+        if (section == _focusSection)
+        {
+            length = MAX(length, _focusRow + 1);
+        }
+        position += length;
+    }
+    *focusPosition = (_focusSection < _sectionCount) ? bases[_focusSection] + _focusRow : position + _focusRow;
+    return position;
+}
+
+/**
+ *  The byte count the cache would have after trimming to a radius.  A section that keeps all its rows keeps its
+ *  storage as it is, and one that loses some is reallocated to fit the rest without an offset index.
+ **/
+- (NSUInteger)byteCountKeepingRadius:(NSUInteger)radius aroundPosition:(NSUInteger)focusPosition bases:(const NSUInteger *)bases
+{
+    NSUInteger bytes = _sectionCapacity * sizeof(RZCellSizeCacheSection);
+    for (NSUInteger section = 0; section < _sectionCount; section++)
+    {
+        RZCellSizeCacheSection *cacheSection = &_sections[section];
+        NSRange rows;
+        if (!RZCellSizeCacheKeptRows(cacheSection, bases[section], focusPosition, radius, &rows))
+        {
+            continue;
+        }
+        if (rows.location == cacheSection->origin && rows.length == cacheSection->count)
+        {
+            bytes += RZCellSizeCacheSectionByteCount(cacheSection);
+        }
+        else
+        {
+            bytes += MAX(rows.length, kRZCellSizeCacheMinimumRowCapacity) * sizeof(RZCellSizeCacheEntry);
+        }
+    }
+    return bytes;
+}
+
+/**
+ *  Narrows the stored range of a section to rows within it, releasing the sizes outside them.
+ **/
+- (void)trimSection:(RZCellSizeCacheSection *)cacheSection toRows:(NSRange)rows
+{
+    NSUInteger first = rows.location - cacheSection->origin;
+    for (NSUInteger i = 0; i < cacheSection->count; i++)
+    {
+        if ((i < first || i >= first + rows.length) && RZCellSizeCacheEntryIsComputed(cacheSection->entries[i]))
+        {
+            cacheSection->sizeCount--;
+            self.countOfSizes--;
+        }
+    }
+    memmove(cacheSection->entries, &cacheSection->entries[first], rows.length * sizeof(RZCellSizeCacheEntry));
+    cacheSection->origin = rows.location;
+    cacheSection->count = rows.length;
+    cacheSection->capacity = MAX(rows.length, kRZCellSizeCacheMinimumRowCapacity);
+    [self replaceEntriesOfSection:cacheSection];
+    free(cacheSection->offsetTree);
+    cacheSection->offsetTree = NULL;
+    cacheSection->offsetTreeCapacity = 0;
+    cacheSection->offsetTreeValid = NO;
+}
+
+/**
+ * Content-keyed and signature sizes are both stored as cell class name -> key -> entry.
+ **/
+- (BOOL)getSize:(CGSize *)size forKey:(id<NSCopying>)key cellClassName:(NSString *)cellClassName inSizes:(NSDictionary *)sizesByCellClass
+{
+    NSValue* value = [[sizesByCellClass objectForKey:cellClassName] objectForKey:key];
+    if (value == nil)
+    {
+        return NO;
+    }
+    
+    if (size)
+    {
+        RZCellSizeCacheEntry entry;
+        [value getValue:&entry];
+        *size = CGSizeMake(entry.width, entry.height);
+    }
+    return YES;
+}
+
+- (void)setSize:(CGSize)size forKey:(id<NSCopying>)key cellClassName:(NSString *)cellClassName inSizes:(NSMutableDictionary *)sizesByCellClass
+{
+    NSMutableDictionary* sizes = [sizesByCellClass objectForKey:cellClassName];
+    if (sizes == nil)
+    {
+        sizes = [NSMutableDictionary dictionary];
+        [sizesByCellClass setObject:sizes forKey:cellClassName];
+    }
+    
+    RZCellSizeCacheEntry entry = { size.width, size.height };
+    [sizes setObject:[NSValue valueWithBytes:&entry objCType:@encode(RZCellSizeCacheEntry)] forKey:key];
+}
+
+- (BOOL)getEntry:(RZCellSizeCacheEntry *)entry forRow:(NSUInteger)row inSection:(NSUInteger)section
+{
+    if (section >= _sectionCount || row < _sections[section].origin || row - _sections[section].origin >= _sections[section].count)
+    {
+        return NO;
+    }
+
+    *entry = _sections[section].entries[row - _sections[section].origin];
+    return RZCellSizeCacheEntryIsComputed(*entry);
+}
+
+- (BOOL)entryIsValid:(RZCellSizeCacheEntry)entry inSection:(NSUInteger)section
+{
+    uint32_t epoch = RZCellSizeCacheEntryEpoch(entry);
+    return (epoch > _invalidatedEpoch &&
+            epoch > _sections[section].invalidatedEpoch &&
+            epoch > _classInvalidatedEpochs[RZCellSizeCacheEntryClassTag(entry)]);
+}
+
+/**
+ *  Starts a new epoch and returns the one that just ended, which the caller records as invalidated.  When the
+ *  24 bits run out, every stamp is renumbered to 1 if it is valid or 0 if it is stale, and counting starts again.
+ **/
+- (uint32_t)advanceEpoch
+{
+    if (_epoch == kRZCellSizeCacheEpochMask)
+    {
+        for (NSUInteger section = 0; section < _sectionCount; section++)
+        {
+            RZCellSizeCacheSection *cacheSection = &_sections[section];
+            for (NSUInteger i = 0; i < cacheSection->count; i++)
+            {
+                RZCellSizeCacheEntry *entry = &cacheSection->entries[i];
+                uint32_t epoch = [self entryIsValid:*entry inSection:section] ? 1 : 0;
+                entry->stamp = (entry->stamp & ~kRZCellSizeCacheEpochMask) | epoch;
+            }
+            cacheSection->invalidatedEpoch = 0;
+        }
+        _invalidatedEpoch = 0;
+        memset(_classInvalidatedEpochs, 0, sizeof(_classInvalidatedEpochs));
+        _epoch = 1;
+    }
+    return _epoch++;
+}
+
+- (void)setEntry:(RZCellSizeCacheEntry)newEntry forRow:(NSUInteger)row inSection:(NSUInteger)section
+{
+    NSUInteger sectionCapacity = _sectionCapacity;
+    NSUInteger rowCapacity = (section < _sectionCount) ? _sections[section].capacity : 0;
+    RZCellSizeCacheSection *cacheSection = [self sectionForWritingRow:row inSection:section];
+    RZCellSizeCacheEntry *entry = &cacheSection->entries[row - cacheSection->origin];
+    if (!RZCellSizeCacheEntryIsComputed(*entry))
+    {
+        cacheSection->sizeCount++;
+        self.countOfSizes++;
+    }
+    [self updateOffsetTreeOfSection:cacheSection row:row - cacheSection->origin fromEntry:*entry toEntry:newEntry];
+    *entry = newEntry;
+    if (_focusFollowsWrites)
+    {
+        _focusRow = row;
+        _focusSection = section;
+    }
+    
+    // Only growing can go over the budget.  Trimming to below it leaves room for the next rows, so the cost of a
+    // trim is spread over many writes.
+    BOOL grew = (_sectionCapacity != sectionCapacity || cacheSection->capacity != rowCapacity);
+    if (grew && self.byteBudget > 0 && self.byteCount > self.byteBudget)
+    {
+        [self trimToByteCount:self.byteBudget * 3 / 4];
+    }
+}
+
+/**
+ *  Releases the storage of a section and returns the number of bytes released.
+ **/
+- (NSUInteger)freeSection:(NSUInteger)section
+{
+    RZCellSizeCacheSection *cacheSection = &_sections[section];
+    NSUInteger bytes = RZCellSizeCacheSectionByteCount(cacheSection);
+    self.countOfSizes -= cacheSection->sizeCount;
+    RZCellSizeCacheEntry *entries = cacheSection->entries;
+    free(cacheSection->offsetTree);
+    memset(cacheSection, 0, sizeof(RZCellSizeCacheSection));
+    [self retireArray:entries];
+    return bytes;
+}
+
+/**
+ *  Returns the storage for a section with its stored range extended to cover a row.  An empty section starts its
+ *  range at the row.  Extending the range backwards at least doubles it, so scrolling up through a section that was
+ *  first measured at the bottom only moves the stored rows a logarithmic number of times.
+ **/
+- (RZCellSizeCacheSection *)sectionForWritingRow:(NSUInteger)row inSection:(NSUInteger)section
+{
+    RZCellSizeCacheSection *cacheSection = [self sectionForWriting:section minimumRowCount:0];
+    if (cacheSection->count == 0)
+    {
+        cacheSection->origin = row;
+    }
+    else if (row < cacheSection->origin)
+    {
+        NSUInteger count = cacheSection->count;
+        NSUInteger prepended = MAX(cacheSection->origin - row, MIN(cacheSection->origin, count));
+        cacheSection = [self sectionForWriting:section minimumRowCount:count + prepended];
+        memmove(&cacheSection->entries[prepended], cacheSection->entries, count * sizeof(RZCellSizeCacheEntry));
+        for (NSUInteger i = 0; i < prepended; i++)
+        {
+            cacheSection->entries[i] = kRZCellSizeCacheEmptyEntry;
+        }
+        cacheSection->origin -= prepended;
+    }
+    return [self sectionForWriting:section minimumRowCount:row - cacheSection->origin + 1];
+}
+
+/**
+ *  Returns the storage for a section, creating sections and growing the stored range to at least rowCount rows.
+ *  New rows are filled with the not computed sentinel.
+ **/
+- (RZCellSizeCacheSection *)sectionForWriting:(NSUInteger)section minimumRowCount:(NSUInteger)rowCount
+{
+    if (section >= _sectionCapacity)
+    {
+        NSUInteger capacity = MAX(section + 1, _sectionCapacity * 2);
+        RZCellSizeCacheSection *sections = RZCellSizeCacheAllocateArray(capacity, sizeof(RZCellSizeCacheSection));
+        NSAssert(sections != NULL, @"Unable to allocate cell size cache sections");
+        if (_sections)
+        {
+            memcpy(sections, _sections, _sectionCount * sizeof(RZCellSizeCacheSection));
+        }
+        RZCellSizeCacheSection *oldSections = _sections;
+        __atomic_store_n(&_sections, sections, __ATOMIC_RELEASE);
+        _sectionCapacity = capacity;
+        [self retireArray:oldSections];
+    }
+    if (section >= _sectionCount)
+    {
+        memset(&_sections[_sectionCount], 0, (section + 1 - _sectionCount) * sizeof(RZCellSizeCacheSection));
+        _sectionCount = section + 1;
+    }
+
+    RZCellSizeCacheSection *cacheSection = &_sections[section];
+    if (rowCount > cacheSection->capacity)
+    {
+        cacheSection->capacity = MAX(MAX(rowCount, cacheSection->capacity * 2), kRZCellSizeCacheMinimumRowCapacity);
+        [self replaceEntriesOfSection:cacheSection];
+    }
+    for (NSUInteger i = cacheSection->count; i < rowCount; i++)
+    {
+        cacheSection->entries[i] = kRZCellSizeCacheEmptyEntry;
+    }
+    if (rowCount > cacheSection->count)
+    {
+        cacheSection->count = rowCount;
+        cacheSection->offsetTreeValid = NO;
+    }
+    return cacheSection;
+}
+
+/**
+ *  Moves the stored rows of a section into a new array of the section's capacity.  The old array is retired rather
+ *  than released, since another thread may still be reading it.
+ **/
+- (void)replaceEntriesOfSection:(RZCellSizeCacheSection *)cacheSection
+{
+    RZCellSizeCacheEntry *entries = RZCellSizeCacheAllocateArray(cacheSection->capacity, sizeof(RZCellSizeCacheEntry));
+    NSAssert(entries != NULL, @"Unable to allocate cell size cache rows");
+    NSUInteger count = MIN(cacheSection->count, cacheSection->capacity);
+    if (cacheSection->entries)
+    {
+        memcpy(entries, cacheSection->entries, count * sizeof(RZCellSizeCacheEntry));
+    }
+    RZCellSizeCacheEntry *oldEntries = cacheSection->entries;
+    __atomic_store_n(&cacheSection->entries, entries, __ATOMIC_RELEASE);
+    [self retireArray:oldEntries];
+}
+
+/**
+ *  Queues an array that is no longer reachable from the cache, tagged with the reclaim epoch it was released in.
+ **/
+- (void)retireArray:(void *)array
+{
+    if (array == NULL)
+    {
+        return;
+    }
+    if (_retiredCount == _retiredCapacity)
+    {
+        _retiredCapacity = MAX(_retiredCapacity * 2, 8);
+        _retiredArrays = reallocf(_retiredArrays, _retiredCapacity * sizeof(void *));
+        _retiredEpochs = reallocf(_retiredEpochs, _retiredCapacity * sizeof(NSUInteger));
+        NSAssert(_retiredArrays != NULL && _retiredEpochs != NULL, @"Unable to allocate retired cell size arrays");
+    }
+    _retiredArrays[_retiredCount] = array;
+    _retiredEpochs[_retiredCount] = _reclaimEpoch;
+    _retiredCount++;
+}
+
+/**
+ *  Starts a new reclaim epoch and frees the arrays released before the oldest epoch a read is still in.  The arrays
+ *  were unpublished before the epoch changed, so a read that started in a later epoch can not reach them, and reads
+ *  that keep starting only hold back the arrays of the last epoch or two.  A read that found no slot holds every
+ *  array until it finishes.
+ **/
+- (void)releaseRetiredArrays
+{
+    if (_retiredCount == 0)
+    {
+        return;
+    }
+    __atomic_store_n(&_reclaimEpoch, _reclaimEpoch + 1, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&_unslottedReaderCount, __ATOMIC_RELAXED) > 0)
+    {
+        return;
+    }
+    
+    NSUInteger oldestReaderEpoch = NSUIntegerMax;
+    for (NSUInteger slot = 0; slot < kRZCellSizeCacheReaderSlotCount; slot++)
+    {
+        NSUInteger readerEpoch = __atomic_load_n(&_readerEpochs[slot], __ATOMIC_RELAXED);
+        if (readerEpoch != 0)
+        {
+            oldestReaderEpoch = MIN(oldestReaderEpoch, readerEpoch);
+        }
+    }
+    
+    NSUInteger keptCount = 0;
+    for (NSUInteger i = 0; i < _retiredCount; i++)
+    {
+        if (_retiredEpochs[i] < oldestReaderEpoch)
+        {
+            RZCellSizeCacheFreeArray(_retiredArrays[i]);
+        }
+        else
+        {
+            _retiredArrays[keptCount] = _retiredArrays[i];
+            _retiredEpochs[keptCount] = _retiredEpochs[i];
+            keptCount++;
+        }
+    }
+    _retiredCount = keptCount;
+}
+
+/**
+ *  Returns the section with its offset tree built, or NULL if the section has no storage.
+ **/
+- (RZCellSizeCacheSection *)sectionWithValidOffsetTree:(NSUInteger)section
+{
+    if (section >= _sectionCount)
+    {
+        return NULL;
+    }
+    
+    RZCellSizeCacheSection *cacheSection = &_sections[section];
+    if (!cacheSection->offsetTreeValid)
+    {
+        NSUInteger count = cacheSection->count;
+        if (count + 1 > cacheSection->offsetTreeCapacity)
+        {
+            cacheSection->offsetTree = reallocf(cacheSection->offsetTree, (count + 1) * sizeof(double));
+            NSAssert(cacheSection->offsetTree != NULL, @"Unable to allocate cell size offset index");
+            cacheSection->offsetTreeCapacity = count + 1;
+        }
+        
+        // Linear time construction: each node pushes its partial sum to its parent.
+        double *tree = cacheSection->offsetTree;
+        double estimatedHeight = self.estimatedHeight;
+        tree[0] = 0.0;
+        for (NSUInteger i = 1; i <= count; i++)
+        {
+            tree[i] = RZCellSizeCacheEntryHeight(cacheSection->entries[i - 1], estimatedHeight);
+        }
+        for (NSUInteger i = 1; i <= count; i++)
+        {
+            NSUInteger parent = i + RZCellSizeCacheLowestBit(i);
+            if (parent <= count)
+            {
+                tree[parent] += tree[i];
+            }
+        }
+        cacheSection->offsetTreeValid = YES;
+    }
+    return cacheSection;
+}
+
+- (void)updateOffsetTreeOfSection:(RZCellSizeCacheSection *)cacheSection row:(NSUInteger)row fromEntry:(RZCellSizeCacheEntry)oldEntry toEntry:(RZCellSizeCacheEntry)newEntry
+{
+    if (cacheSection->offsetTreeValid)
+    {
+        double estimatedHeight = self.estimatedHeight;
+        double delta = RZCellSizeCacheEntryHeight(newEntry, estimatedHeight) - RZCellSizeCacheEntryHeight(oldEntry, estimatedHeight);
+        if (delta != 0.0)
+        {
+            RZCellSizeCacheOffsetTreeAdd(cacheSection->offsetTree, cacheSection->count, row, delta);
+        }
+    }
+}
+
+/**
+ *  Indexes past the end of the stored range never need storage, since nothing after them has been cached.
+ *  This returns the stored count once the indexes that land inside it have been opened.
+ **/
+- (NSUInteger)countAfterInsertingIndexes:(NSIndexSet *)indexes intoCount:(NSUInteger)count
+{
+    // Messaging a nil set returns 0 rather than NSNotFound, which would never end the loop.
+    if (indexes.count == 0)
+    {
+        return count;
+    }
+    
+    NSUInteger index = [indexes firstIndex];
+    while (index != NSNotFound && index < count)
+    {
+        count++;
+        index = [indexes indexGreaterThanIndex:index];
+    }
+    return count;
+}
+
+/**
+ *  Applies deletions (in old coordinates) and then insertions (in new coordinates) to a section in a single pass,
+ *  the same way a UITableView applies a batch of updates.
+ **/
+- (void)remapSection:(NSUInteger)section deletedRows:(NSIndexSet *)deletedRows insertedRows:(NSIndexSet *)insertedRows
+{
+    if (section >= _sectionCount)
+    {
+        return;
+    }
+    // A nil set would report a first index of 0 rather than NSNotFound, so the origin loop would never end.
+    deletedRows = deletedRows ?: [NSIndexSet indexSet];
+    insertedRows = insertedRows ?: [NSIndexSet indexSet];
+
+    RZCellSizeCacheSection *cacheSection = &_sections[section];
+    RZCellSizeCacheEntry *entries = cacheSection->entries;
+    if (cacheSection->origin > 0 && cacheSection->count > 0)
+    {
+        // Rows before the stored range only move its origin.  The rest are translated into stored row indexes.
+        NSUInteger oldOrigin = cacheSection->origin;
+        NSUInteger origin = oldOrigin - [deletedRows countOfIndexesInRange:NSMakeRange(0, oldOrigin)];
+        NSUInteger inserted = [insertedRows firstIndex];
+        while (inserted != NSNotFound && inserted <= origin)
+        {
+            origin++;
+            inserted = [insertedRows indexGreaterThanIndex:inserted];
+        }
+        cacheSection->origin = origin;
+        
+        NSMutableIndexSet* storedDeletedRows = [deletedRows mutableCopy];
+        [storedDeletedRows removeIndexesInRange:NSMakeRange(0, oldOrigin)];
+        [storedDeletedRows shiftIndexesStartingAtIndex:oldOrigin by:-(NSInteger)oldOrigin];
+        deletedRows = storedDeletedRows;
+        
+        NSMutableIndexSet* storedInsertedRows = [insertedRows mutableCopy];
+        [storedInsertedRows removeIndexesInRange:NSMakeRange(0, origin)];
+        [storedInsertedRows shiftIndexesStartingAtIndex:origin by:-(NSInteger)origin];
+        insertedRows = storedInsertedRows;
+    }
+
+    // Compact out the deleted rows.
+    NSUInteger count = cacheSection->count;
+    if (deletedRows.count > 0)
+    {
+        count = 0;
+        NSUInteger deleted = [deletedRows firstIndex];
+        for (NSUInteger row = 0; row < cacheSection->count; row++)
+        {
+            if (row == deleted)
+            {
+                if (RZCellSizeCacheEntryIsComputed(entries[row]))
+                {
+                    cacheSection->sizeCount--;
+                    self.countOfSizes--;
+                }
+                deleted = [deletedRows indexGreaterThanIndex:deleted];
+            }
+            else
+            {
+                entries[count++] = entries[row];
+            }
+        }
+        cacheSection->count = count;
+        cacheSection->offsetTreeValid = NO;
+    }
+
+    // Open the inserted rows, working back from the end so every entry moves at most once.
+    NSUInteger newCount = [self countAfterInsertingIndexes:insertedRows intoCount:count];
+    if (newCount == count)
+    {
+        return;
+    }
+
+    cacheSection = [self sectionForWriting:section minimumRowCount:newCount];
+    entries = cacheSection->entries;
+
+    NSUInteger source = count;
+    NSUInteger inserted = [insertedRows indexLessThanIndex:newCount];
+    for (NSUInteger row = newCount; row > 0 && source < row; )
+    {
+        row--;
+        if (row == inserted)
+        {
+            entries[row] = kRZCellSizeCacheEmptyEntry;
+            inserted = [insertedRows indexLessThanIndex:inserted];
+        }
+        else
+        {
+            entries[row] = entries[--source];
+        }
+    }
+}
+
+@end
+
+
+@implementation RZCellSizeCacheUpdates
+
+- (instancetype)init
+{
+    self = [super init];
+    if ( self ) {
+        _invalidatedIndexPaths = [NSMutableArray array];
+        _invalidatedSections = [NSMutableIndexSet indexSet];
+        _deletedIndexPaths = [NSMutableArray array];
+        _insertedIndexPaths = [NSMutableArray array];
+        _movedFromIndexPaths = [NSMutableArray array];
+        _movedToIndexPaths = [NSMutableArray array];
+        _deletedSections = [NSMutableIndexSet indexSet];
+        _insertedSections = [NSMutableIndexSet indexSet];
+    }
+    return self;
+}
+
+// indexAtPosition: rather than section and row, which come from UIKit, so the cache only needs Foundation.
++ (NSDictionary *)rowsBySectionForIndexPaths:(NSArray *)indexPaths
+{
+    NSMutableDictionary* rowsBySection = [NSMutableDictionary dictionary];
+    for (NSIndexPath* indexPath in indexPaths)
+    {
+        NSNumber* section = @([indexPath indexAtPosition:0]);
+        NSMutableIndexSet* rows = [rowsBySection objectForKey:section];
+        if (!rows)
+        {
+            rows = [NSMutableIndexSet indexSet];
+            [rowsBySection setObject:rows forKey:section];
+        }
+        [rows addIndex:[indexPath indexAtPosition:1]];
+    }
+    return rowsBySection;
+}
+
+- (void)applyToCache:(RZCellSizeCache *)cache
+{
+    [cache beginUpdates];
+    for (NSIndexPath* indexPath in self.invalidatedIndexPaths)
+    {
+        [cache invalidateSizeForRow:[indexPath indexAtPosition:1] inSection:[indexPath indexAtPosition:0]];
+    }
+    [self.invalidatedSections enumerateIndexesUsingBlock:^(NSUInteger section, BOOL *stop) {
+        [cache invalidateSizesInSection:section];
+    }];
+    
+    NSUInteger moveCount = self.movedFromIndexPaths.count;
+    CGSize* movedSizes = calloc(MAX(moveCount, 1), sizeof(CGSize));
+    uint8_t* movedClassTags = calloc(MAX(moveCount, 1), sizeof(uint8_t));
+    BOOL* movedSizeIsCached = calloc(MAX(moveCount, 1), sizeof(BOOL));
+    [self.movedFromIndexPaths enumerateObjectsUsingBlock:^(NSIndexPath* indexPath, NSUInteger idx, BOOL *stop) {
+        movedSizeIsCached[idx] = [cache getSize:&movedSizes[idx] classTag:&movedClassTags[idx] forRow:[indexPath indexAtPosition:1] inSection:[indexPath indexAtPosition:0]];
+    }];
+    
+    NSArray* deletedIndexPaths = [self.deletedIndexPaths arrayByAddingObjectsFromArray:self.movedFromIndexPaths];
+    [[[self class] rowsBySectionForIndexPaths:deletedIndexPaths] enumerateKeysAndObjectsUsingBlock:^(NSNumber* section, NSIndexSet* rows, BOOL *stop) {
+        [cache deleteRowsAtIndexes:rows inSection:[section unsignedIntegerValue]];
+    }];
+    [cache deleteSections:self.deletedSections];
+    [cache insertSections:self.insertedSections];
+    
+    NSArray* insertedIndexPaths = [self.insertedIndexPaths arrayByAddingObjectsFromArray:self.movedToIndexPaths];
+    [[[self class] rowsBySectionForIndexPaths:insertedIndexPaths] enumerateKeysAndObjectsUsingBlock:^(NSNumber* section, NSIndexSet* rows, BOOL *stop) {
+        [cache insertRowsAtIndexes:rows inSection:[section unsignedIntegerValue]];
+    }];
+    [self.movedToIndexPaths enumerateObjectsUsingBlock:^(NSIndexPath* indexPath, NSUInteger idx, BOOL *stop) {
+        if (movedSizeIsCached[idx])
+        {
+            [cache setSize:movedSizes[idx] forRow:[indexPath indexAtPosition:1] inSection:[indexPath indexAtPosition:0] classTag:movedClassTags[idx]];
+        }
+    }];
+    
+    free(movedSizes);
+    free(movedClassTags);
+    free(movedSizeIsCached);
+    [cache endUpdates];
+}
+
+@end
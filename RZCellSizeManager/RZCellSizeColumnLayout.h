@@ -0,0 +1,169 @@
+//
+//  RZCellSizeColumnLayout.h
+//
+
+
+// Copyright 2014 Raizlabs and other contributors
+// http://raizlabs.com/
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#import <UIKit/UIKit.h>
+
+typedef NS_ENUM(NSUInteger, RZCellSizeColumnLayoutStyle) {
+    /**
+     *  Items fill rows from left to right, and each row is as tall as its tallest item.
+     */
+    RZCellSizeColumnLayoutStyleGrid,
+    /**
+     *  Each item is placed below the shortest column, as in a waterfall of photos.
+     */
+    RZCellSizeColumnLayoutStyleMasonry
+};
+
+/**
+ *  RZCellSizeColumnLayout
+ *
+ *  Frames for a vertically scrolling collection view whose items are arranged in columns of equal width, either as a
+ *  grid or as a masonry layout.  Item sizes are given as they become known, usually from
+ *  getCellSizes:forObjects:inSection:cellReuseIdentifier:, and only the frames they affect are updated.  Appending
+ *  items places them after the existing ones, and changing the size of an item moves the items below it in its own
+ *  column, or the rows below it in a grid.  Items keep their column once placed, so nothing jumps sideways when a
+ *  size changes.  Sections are stacked vertically.
+ *
+ *  Only the height of each size is used; every item is as wide as a column.  A UICollectionViewLayout subclass can
+ *  hold a column layout and return its contentSize and attributes.
+ **/
+@interface RZCellSizeColumnLayout : NSObject
+
+/**
+ *  Create an empty column layout.
+ *
+ *  @param style           Grid or masonry.
+ *  @param numberOfColumns Number of columns. Must be greater than 0.
+ *  @param width           Width of the collection view.
+ *
+ *  @return New column layout.
+ */
+- (instancetype)initWithStyle:(RZCellSizeColumnLayoutStyle)style numberOfColumns:(NSUInteger)numberOfColumns width:(CGFloat)width;
+
+@property (nonatomic, readonly) RZCellSizeColumnLayoutStyle style;
+@property (nonatomic, readonly) NSUInteger numberOfColumns;
+@property (nonatomic, readonly) CGFloat width;
+
+/**
+ *  Horizontal space between columns.  Defaults to 0.
+ */
+@property (nonatomic, assign) CGFloat interitemSpacing;
+
+/**
+ *  Vertical space between the items of a column.  Changing it places every item again.  Defaults to 0.
+ */
+@property (nonatomic, assign) CGFloat lineSpacing;
+
+/**
+ *  Insets around the items of each section that has items.  Defaults to UIEdgeInsetsZero.
+ */
+@property (nonatomic, assign) UIEdgeInsets sectionInset;
+
+/**
+ *  Width of every item, which is the width the cells should be measured at.
+ */
+@property (nonatomic, readonly) CGFloat columnWidth;
+
+/**
+ *  Size of all the sections, for collectionViewContentSize.
+ */
+@property (nonatomic, readonly) CGSize contentSize;
+
+@property (nonatomic, readonly) NSUInteger numberOfSections;
+
+- (NSUInteger)numberOfItemsInSection:(NSUInteger)section;
+
+/**
+ *  Add items to the end of a section.  Sections up to this one are created if they do not exist yet.
+ *
+ *  @param sizes   Sizes of the new items.
+ *  @param count   Number of new items.
+ *  @param section Section to add the items to.
+ */
+- (void)appendItemsWithSizes:(const CGSize *)sizes count:(NSUInteger)count toSection:(NSUInteger)section;
+
+/**
+ *  Change the size of an item, for example after it was invalidated and measured again.
+ *
+ *  @param size    New size of the item.
+ *  @param item    Index of the item.
+ *  @param section Section of the item.
+ */
+- (void)setSize:(CGSize)size forItem:(NSUInteger)item inSection:(NSUInteger)section;
+
+/**
+ *  Remove the items of a section from an index to the end.  Items inserted, deleted or moved in the middle of a
+ *  section are handled by removing the items from the first change and appending them again.
+ *
+ *  @param item    Index of the first item to remove.
+ *  @param section Section of the items.
+ */
+- (void)removeItemsFromIndex:(NSUInteger)item inSection:(NSUInteger)section;
+
+/**
+ *  Remove the sections from an index to the end, with their items.
+ *
+ *  @param section Index of the first section to remove.
+ */
+- (void)removeSectionsFromIndex:(NSUInteger)section;
+
+/**
+ *  Remove every section.
+ */
+- (void)removeAllSections;
+
+/**
+ *  Frame of an item in the collection view.
+ *
+ *  @param item    Index of the item.
+ *  @param section Section of the item.
+ *
+ *  @return The frame of the item.
+ */
+- (CGRect)frameForItem:(NSUInteger)item inSection:(NSUInteger)section;
+
+/**
+ *  Attributes of the items whose frames intersect a rectangle, for layoutAttributesForElementsInRect:.  Only the
+ *  rows or column entries that overlap the rectangle are visited.
+ *
+ *  @param rect Rectangle in the coordinates of the collection view.
+ *
+ *  @return Array of UICollectionViewLayoutAttributes.
+ */
+- (NSArray *)layoutAttributesForElementsInRect:(CGRect)rect;
+
+/**
+ *  Attributes of a single item, for layoutAttributesForItemAtIndexPath:.
+ *
+ *  @param indexPath Index path of the item.
+ *
+ *  @return Attributes of the item.
+ */
+- (UICollectionViewLayoutAttributes *)layoutAttributesForItemAtIndexPath:(NSIndexPath *)indexPath;
+
+@end
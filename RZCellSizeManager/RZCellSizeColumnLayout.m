@@ -0,0 +1,584 @@
+//
+//  RZCellSizeColumnLayout.m
+//
+
+
+// Copyright 2014 Raizlabs and other contributors
+// http://raizlabs.com/
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#import "RZCellSizeColumnLayout.h"
+
+#define kRZCellSizeColumnLayoutMinimumCapacity  16
+
+/**
+ *  heights holds the height of every item.  A masonry section also keeps the top and column of every item, the
+ *  items of each column from top to bottom and the position of every item within its column, so changing one height
+ *  only moves the items below it.  columnHeights is the bottom of each column including the line spacing after its
+ *  last item.
+ *
+ *  A grid section keeps the height of each row instead.  rowTops is filled in lazily up to validRowCount, so
+ *  appending rows or changing a row only costs the rows below it the next time they are asked for.
+ **/
+typedef struct {
+    CGFloat *heights;
+    NSUInteger count;
+    NSUInteger capacity;
+    
+    CGFloat *tops;
+    NSUInteger *columns;
+    NSUInteger *positions;
+    NSUInteger **columnItems;
+    NSUInteger *columnCounts;
+    NSUInteger *columnCapacities;
+    CGFloat *columnHeights;
+    
+    CGFloat *rowHeights;
+    CGFloat *rowTops;
+    NSUInteger validRowCount;
+} RZCellSizeColumnLayoutSection;
+
+@interface RZCellSizeColumnLayout ()
+{
+    RZCellSizeColumnLayoutSection *_sections;
+    NSUInteger _sectionCount;
+    CGFloat *_sectionTops;
+    NSUInteger _validSectionCount;
+}
+
+@end
+
+@implementation RZCellSizeColumnLayout
+
+- (instancetype)initWithStyle:(RZCellSizeColumnLayoutStyle)style numberOfColumns:(NSUInteger)numberOfColumns width:(CGFloat)width
+{
+    NSParameterAssert(numberOfColumns > 0);
+    
+    self = [super init];
+    if ( self ) {
+        _style = style;
+        _numberOfColumns = numberOfColumns;
+        _width = width;
+        _sectionInset = UIEdgeInsetsZero;
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    [self removeAllSections];
+}
+
+#pragma mark - Public Methods
+
+- (void)setLineSpacing:(CGFloat)lineSpacing
+{
+    _lineSpacing = lineSpacing;
+    for (NSUInteger section = 0; section < _sectionCount; section++)
+    {
+        [self placeItemsFromIndex:0 inSection:section];
+    }
+    _validSectionCount = 0;
+}
+
+- (void)setSectionInset:(UIEdgeInsets)sectionInset
+{
+    _sectionInset = sectionInset;
+    _validSectionCount = 0;
+}
+
+- (CGFloat)columnWidth
+{
+    CGFloat availableWidth = self.width - self.sectionInset.left - self.sectionInset.right - self.interitemSpacing * (self.numberOfColumns - 1);
+    return MAX(availableWidth / self.numberOfColumns, 0.0f);
+}
+
+- (CGSize)contentSize
+{
+    return CGSizeMake(self.width, [self topOfSection:_sectionCount]);
+}
+
+- (NSUInteger)numberOfSections
+{
+    return _sectionCount;
+}
+
+- (NSUInteger)numberOfItemsInSection:(NSUInteger)section
+{
+    return (section < _sectionCount) ? _sections[section].count : 0;
+}
+
+- (void)appendItemsWithSizes:(const CGSize *)sizes count:(NSUInteger)count toSection:(NSUInteger)section
+{
+    NSParameterAssert(sizes || count == 0);
+    
+    if (section >= _sectionCount)
+    {
+        [self growToSectionCount:section + 1];
+    }
+    
+    RZCellSizeColumnLayoutSection *layoutSection = &_sections[section];
+    NSUInteger first = layoutSection->count;
+    [self growSection:layoutSection toCapacity:first + count];
+    for (NSUInteger i = 0; i < count; i++)
+    {
+        layoutSection->heights[first + i] = sizes[i].height;
+    }
+    layoutSection->count = first + count;
+    [self placeItemsFromIndex:first inSection:section];
+    _validSectionCount = MIN(_validSectionCount, section + 1);
+}
+
+- (void)setSize:(CGSize)size forItem:(NSUInteger)item inSection:(NSUInteger)section
+{
+    NSAssert(section < _sectionCount && item < _sections[section].count, @"Item %lu is not in section %lu", (unsigned long)item, (unsigned long)section);
+    
+    RZCellSizeColumnLayoutSection *layoutSection = &_sections[section];
+    CGFloat delta = size.height - layoutSection->heights[item];
+    if (delta == 0.0f)
+    {
+        return;
+    }
+    
+    layoutSection->heights[item] = size.height;
+    if (self.style == RZCellSizeColumnLayoutStyleMasonry)
+    {
+        NSUInteger column = layoutSection->columns[item];
+        NSUInteger *columnItems = layoutSection->columnItems[column];
+        for (NSUInteger position = layoutSection->positions[item] + 1; position < layoutSection->columnCounts[column]; position++)
+        {
+            layoutSection->tops[columnItems[position]] += delta;
+        }
+        layoutSection->columnHeights[column] += delta;
+    }
+    else
+    {
+        [self updateRow:item / self.numberOfColumns ofSection:layoutSection];
+    }
+    _validSectionCount = MIN(_validSectionCount, section + 1);
+}
+
+- (void)removeItemsFromIndex:(NSUInteger)item inSection:(NSUInteger)section
+{
+    if (section >= _sectionCount || item >= _sections[section].count)
+    {
+        return;
+    }
+    
+    RZCellSizeColumnLayoutSection *layoutSection = &_sections[section];
+    layoutSection->count = item;
+    if (self.style == RZCellSizeColumnLayoutStyleMasonry)
+    {
+        // Items are added to the columns in order, so the removed ones are at the end of each column.
+        for (NSUInteger column = 0; column < self.numberOfColumns; column++)
+        {
+            NSUInteger columnCount = layoutSection->columnCounts[column];
+            while (columnCount > 0 && layoutSection->columnItems[column][columnCount - 1] >= item)
+            {
+                columnCount--;
+            }
+            layoutSection->columnCounts[column] = columnCount;
+            layoutSection->columnHeights[column] = [self bottomOfColumn:column inSection:layoutSection];
+        }
+    }
+    else
+    {
+        NSUInteger rowCount = [self rowCountOfSection:layoutSection];
+        if (rowCount > 0)
+        {
+            [self updateRow:rowCount - 1 ofSection:layoutSection];
+        }
+        layoutSection->validRowCount = MIN(layoutSection->validRowCount, rowCount);
+    }
+    _validSectionCount = MIN(_validSectionCount, section + 1);
+}
+
+- (void)removeSectionsFromIndex:(NSUInteger)section
+{
+    for (NSUInteger i = section; i < _sectionCount; i++)
+    {
+        [self freeSection:&_sections[i]];
+    }
+    _sectionCount = MIN(_sectionCount, section);
+    _validSectionCount = MIN(_validSectionCount, _sectionCount);
+}
+
+- (void)removeAllSections
+{
+    [self removeSectionsFromIndex:0];
+    free(_sections);
+    free(_sectionTops);
+    _sections = NULL;
+    _sectionTops = NULL;
+}
+
+- (CGRect)frameForItem:(NSUInteger)item inSection:(NSUInteger)section
+{
+    NSAssert(section < _sectionCount && item < _sections[section].count, @"Item %lu is not in section %lu", (unsigned long)item, (unsigned long)section);
+    
+    RZCellSizeColumnLayoutSection *layoutSection = &_sections[section];
+    CGFloat contentTop = [self topOfSection:section] + self.sectionInset.top;
+    NSUInteger column = 0;
+    CGFloat top = 0.0f;
+    if (self.style == RZCellSizeColumnLayoutStyleMasonry)
+    {
+        column = layoutSection->columns[item];
+        top = layoutSection->tops[item];
+    }
+    else
+    {
+        column = item % self.numberOfColumns;
+        top = [self topOfRow:item / self.numberOfColumns ofSection:layoutSection];
+    }
+    
+    CGFloat columnWidth = self.columnWidth;
+    return CGRectMake(self.sectionInset.left + column * (columnWidth + self.interitemSpacing),
+                      contentTop + top,
+                      columnWidth,
+                      layoutSection->heights[item]);
+}
+
+- (NSArray *)layoutAttributesForElementsInRect:(CGRect)rect
+{
+    NSMutableArray* attributes = [NSMutableArray array];
+    for (NSUInteger section = [self sectionAtOffset:CGRectGetMinY(rect)]; section < _sectionCount; section++)
+    {
+        CGFloat contentTop = [self topOfSection:section] + self.sectionInset.top;
+        if (contentTop > CGRectGetMaxY(rect))
+        {
+            break;
+        }
+        
+        NSMutableIndexSet* items = [NSMutableIndexSet indexSet];
+        [self addItemsBetweenOffset:CGRectGetMinY(rect) - contentTop
+                          andOffset:CGRectGetMaxY(rect) - contentTop
+                          ofSection:&_sections[section]
+                              toSet:items];
+        [items enumerateIndexesUsingBlock:^(NSUInteger item, BOOL *stop) {
+            CGRect frame = [self frameForItem:item inSection:section];
+            if (CGRectIntersectsRect(frame, rect))
+            {
+                UICollectionViewLayoutAttributes* itemAttributes = [UICollectionViewLayoutAttributes layoutAttributesForCellWithIndexPath:[NSIndexPath indexPathForItem:item inSection:section]];
+                itemAttributes.frame = frame;
+                [attributes addObject:itemAttributes];
+            }
+        }];
+    }
+    return attributes;
+}
+
+- (UICollectionViewLayoutAttributes *)layoutAttributesForItemAtIndexPath:(NSIndexPath *)indexPath
+{
+    NSParameterAssert(indexPath);
+    
+    UICollectionViewLayoutAttributes* attributes = [UICollectionViewLayoutAttributes layoutAttributesForCellWithIndexPath:indexPath];
+    attributes.frame = [self frameForItem:indexPath.item inSection:indexPath.section];
+    return attributes;
+}
+
+#pragma mark - Private Methods
+
+- (void)growToSectionCount:(NSUInteger)sectionCount
+{
+    _sections = realloc(_sections, sectionCount * sizeof(RZCellSizeColumnLayoutSection));
+    _sectionTops = realloc(_sectionTops, (sectionCount + 1) * sizeof(CGFloat));
+    memset(&_sections[_sectionCount], 0, (sectionCount - _sectionCount) * sizeof(RZCellSizeColumnLayoutSection));
+    _sectionCount = sectionCount;
+}
+
+- (void)growSection:(RZCellSizeColumnLayoutSection *)layoutSection toCapacity:(NSUInteger)capacity
+{
+    if (capacity <= layoutSection->capacity)
+    {
+        return;
+    }
+    
+    NSUInteger newCapacity = MAX(MAX(layoutSection->capacity * 2, capacity), kRZCellSizeColumnLayoutMinimumCapacity);
+    layoutSection->heights = realloc(layoutSection->heights, newCapacity * sizeof(CGFloat));
+    if (self.style == RZCellSizeColumnLayoutStyleMasonry)
+    {
+        layoutSection->tops = realloc(layoutSection->tops, newCapacity * sizeof(CGFloat));
+        layoutSection->columns = realloc(layoutSection->columns, newCapacity * sizeof(NSUInteger));
+        layoutSection->positions = realloc(layoutSection->positions, newCapacity * sizeof(NSUInteger));
+        if (layoutSection->columnItems == NULL)
+        {
+            layoutSection->columnItems = calloc(self.numberOfColumns, sizeof(NSUInteger *));
+            layoutSection->columnCounts = calloc(self.numberOfColumns, sizeof(NSUInteger));
+            layoutSection->columnCapacities = calloc(self.numberOfColumns, sizeof(NSUInteger));
+            layoutSection->columnHeights = calloc(self.numberOfColumns, sizeof(CGFloat));
+        }
+    }
+    else
+    {
+        NSUInteger rowCapacity = (newCapacity + self.numberOfColumns - 1) / self.numberOfColumns;
+        layoutSection->rowHeights = realloc(layoutSection->rowHeights, rowCapacity * sizeof(CGFloat));
+        layoutSection->rowTops = realloc(layoutSection->rowTops, rowCapacity * sizeof(CGFloat));
+    }
+    layoutSection->capacity = newCapacity;
+}
+
+- (void)freeSection:(RZCellSizeColumnLayoutSection *)layoutSection
+{
+    if (layoutSection->columnItems)
+    {
+        for (NSUInteger column = 0; column < self.numberOfColumns; column++)
+        {
+            free(layoutSection->columnItems[column]);
+        }
+    }
+    free(layoutSection->heights);
+    free(layoutSection->tops);
+    free(layoutSection->columns);
+    free(layoutSection->positions);
+    free(layoutSection->columnItems);
+    free(layoutSection->columnCounts);
+    free(layoutSection->columnCapacities);
+    free(layoutSection->columnHeights);
+    free(layoutSection->rowHeights);
+    free(layoutSection->rowTops);
+    memset(layoutSection, 0, sizeof(RZCellSizeColumnLayoutSection));
+}
+
+/**
+ *  Places the items from an index to the end of a section, after the items before it.
+ **/
+- (void)placeItemsFromIndex:(NSUInteger)first inSection:(NSUInteger)section
+{
+    RZCellSizeColumnLayoutSection *layoutSection = &_sections[section];
+    if (self.style == RZCellSizeColumnLayoutStyleMasonry)
+    {
+        if (first == 0 && layoutSection->columnCounts)
+        {
+            memset(layoutSection->columnCounts, 0, self.numberOfColumns * sizeof(NSUInteger));
+            memset(layoutSection->columnHeights, 0, self.numberOfColumns * sizeof(CGFloat));
+        }
+        for (NSUInteger item = first; item < layoutSection->count; item++)
+        {
+            [self placeMasonryItem:item inSection:layoutSection];
+        }
+    }
+    else
+    {
+        NSUInteger rowCount = [self rowCountOfSection:layoutSection];
+        for (NSUInteger row = first / self.numberOfColumns; row < rowCount; row++)
+        {
+            [self updateRow:row ofSection:layoutSection];
+        }
+        layoutSection->validRowCount = MIN(layoutSection->validRowCount, first / self.numberOfColumns);
+    }
+}
+
+- (void)placeMasonryItem:(NSUInteger)item inSection:(RZCellSizeColumnLayoutSection *)layoutSection
+{
+    NSUInteger column = 0;
+    for (NSUInteger i = 1; i < self.numberOfColumns; i++)
+    {
+        if (layoutSection->columnHeights[i] < layoutSection->columnHeights[column])
+        {
+            column = i;
+        }
+    }
+    
+    NSUInteger position = layoutSection->columnCounts[column];
+    if (position == layoutSection->columnCapacities[column])
+    {
+        layoutSection->columnCapacities[column] = MAX(position * 2, kRZCellSizeColumnLayoutMinimumCapacity);
+        layoutSection->columnItems[column] = realloc(layoutSection->columnItems[column], layoutSection->columnCapacities[column] * sizeof(NSUInteger));
+    }
+    layoutSection->columnItems[column][position] = item;
+    layoutSection->columnCounts[column] = position + 1;
+    
+    layoutSection->tops[item] = layoutSection->columnHeights[column];
+    layoutSection->columns[item] = column;
+    layoutSection->positions[item] = position;
+    layoutSection->columnHeights[column] += layoutSection->heights[item] + self.lineSpacing;
+}
+
+- (CGFloat)bottomOfColumn:(NSUInteger)column inSection:(RZCellSizeColumnLayoutSection *)layoutSection
+{
+    NSUInteger columnCount = layoutSection->columnCounts[column];
+    if (columnCount == 0)
+    {
+        return 0.0f;
+    }
+    NSUInteger lastItem = layoutSection->columnItems[column][columnCount - 1];
+    return layoutSection->tops[lastItem] + layoutSection->heights[lastItem] + self.lineSpacing;
+}
+
+- (NSUInteger)rowCountOfSection:(RZCellSizeColumnLayoutSection *)layoutSection
+{
+    return (layoutSection->count + self.numberOfColumns - 1) / self.numberOfColumns;
+}
+
+/**
+ *  Sets a grid row to the height of its tallest item, and marks the rows below it as moved if that changed it.
+ **/
+- (void)updateRow:(NSUInteger)row ofSection:(RZCellSizeColumnLayoutSection *)layoutSection
+{
+    CGFloat rowHeight = 0.0f;
+    NSUInteger end = MIN((row + 1) * self.numberOfColumns, layoutSection->count);
+    for (NSUInteger item = row * self.numberOfColumns; item < end; item++)
+    {
+        rowHeight = MAX(rowHeight, layoutSection->heights[item]);
+    }
+    if (row >= layoutSection->validRowCount || layoutSection->rowHeights[row] != rowHeight)
+    {
+        layoutSection->rowHeights[row] = rowHeight;
+        layoutSection->validRowCount = MIN(layoutSection->validRowCount, row + 1);
+    }
+}
+
+- (CGFloat)topOfRow:(NSUInteger)row ofSection:(RZCellSizeColumnLayoutSection *)layoutSection
+{
+    for (NSUInteger validRow = layoutSection->validRowCount; validRow <= row; validRow++)
+    {
+        layoutSection->rowTops[validRow] = (validRow == 0) ? 0.0f : layoutSection->rowTops[validRow - 1] + layoutSection->rowHeights[validRow - 1] + self.lineSpacing;
+    }
+    layoutSection->validRowCount = MAX(layoutSection->validRowCount, row + 1);
+    return layoutSection->rowTops[row];
+}
+
+- (CGFloat)contentHeightOfSection:(RZCellSizeColumnLayoutSection *)layoutSection
+{
+    if (layoutSection->count == 0)
+    {
+        return 0.0f;
+    }
+    
+    if (self.style == RZCellSizeColumnLayoutStyleMasonry)
+    {
+        CGFloat height = 0.0f;
+        for (NSUInteger column = 0; column < self.numberOfColumns; column++)
+        {
+            height = MAX(height, layoutSection->columnHeights[column]);
+        }
+        return height - self.lineSpacing;
+    }
+    
+    NSUInteger lastRow = [self rowCountOfSection:layoutSection] - 1;
+    return [self topOfRow:lastRow ofSection:layoutSection] + layoutSection->rowHeights[lastRow];
+}
+
+/**
+ *  Offset of the top of a section.  topOfSection:_sectionCount is the bottom of the last section.
+ **/
+- (CGFloat)topOfSection:(NSUInteger)section
+{
+    if (_sectionCount == 0)
+    {
+        return 0.0f;
+    }
+    
+    for (NSUInteger validSection = _validSectionCount; validSection <= section; validSection++)
+    {
+        CGFloat top = 0.0f;
+        if (validSection > 0)
+        {
+            RZCellSizeColumnLayoutSection *previous = &_sections[validSection - 1];
+            top = _sectionTops[validSection - 1];
+            if (previous->count > 0)
+            {
+                top += self.sectionInset.top + [self contentHeightOfSection:previous] + self.sectionInset.bottom;
+            }
+        }
+        _sectionTops[validSection] = top;
+    }
+    _validSectionCount = MAX(_validSectionCount, section + 1);
+    return _sectionTops[section];
+}
+
+- (NSUInteger)sectionAtOffset:(CGFloat)offset
+{
+    NSUInteger section = 0;
+    while (section + 1 < _sectionCount && [self topOfSection:section + 1] <= offset)
+    {
+        section++;
+    }
+    return section;
+}
+
+/**
+ *  Adds the items of a section that may overlap the offsets, which are relative to the top of its first item.
+ *  Grid rows and the items of a masonry column are both in order of their tops, so a binary search finds the first
+ *  one that reaches the offsets.
+ **/
+- (void)addItemsBetweenOffset:(CGFloat)minOffset andOffset:(CGFloat)maxOffset ofSection:(RZCellSizeColumnLayoutSection *)layoutSection toSet:(NSMutableIndexSet *)items
+{
+    if (layoutSection->count == 0)
+    {
+        return;
+    }
+    
+    if (self.style == RZCellSizeColumnLayoutStyleMasonry)
+    {
+        for (NSUInteger column = 0; column < self.numberOfColumns; column++)
+        {
+            NSUInteger *columnItems = layoutSection->columnItems[column];
+            NSUInteger low = 0;
+            NSUInteger high = layoutSection->columnCounts[column];
+            while (low < high)
+            {
+                NSUInteger middle = low + (high - low) / 2;
+                NSUInteger item = columnItems[middle];
+                if (layoutSection->tops[item] + layoutSection->heights[item] < minOffset)
+                {
+                    low = middle + 1;
+                }
+                else
+                {
+                    high = middle;
+                }
+            }
+            for (NSUInteger position = low; position < layoutSection->columnCounts[column] && layoutSection->tops[columnItems[position]] <= maxOffset; position++)
+            {
+                [items addIndex:columnItems[position]];
+            }
+        }
+    }
+    else
+    {
+        NSUInteger rowCount = [self rowCountOfSection:layoutSection];
+        [self topOfRow:rowCount - 1 ofSection:layoutSection];
+        
+        NSUInteger low = 0;
+        NSUInteger high = rowCount;
+        while (low < high)
+        {
+            NSUInteger middle = low + (high - low) / 2;
+            if (layoutSection->rowTops[middle] + layoutSection->rowHeights[middle] < minOffset)
+            {
+                low = middle + 1;
+            }
+            else
+            {
+                high = middle;
+            }
+        }
+        for (NSUInteger row = low; row < rowCount && layoutSection->rowTops[row] <= maxOffset; row++)
+        {
+            NSUInteger first = row * self.numberOfColumns;
+            [items addIndexesInRange:NSMakeRange(first, MIN(self.numberOfColumns, layoutSection->count - first))];
+        }
+    }
+}
+
+@end
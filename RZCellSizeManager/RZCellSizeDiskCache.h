@@ -0,0 +1,111 @@
+//
+//  RZCellSizeDiskCache.h
+//
+
+
+// Copyright 2014 Raizlabs and other contributors
+// http://raizlabs.com/
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#import <Foundation/Foundation.h>
+#import <CoreGraphics/CoreGraphics.h>
+
+/**
+ *  RZCellSizeDiskCache
+ *
+ *  Persists content-keyed cell sizes between launches so a mostly unchanged list does not have to be measured again.
+ *
+ *  Sizes are stored in a versioned binary file of fixed-size records.  Each record holds a 64 bit hash of the content
+ *  key, cell class name and width along with the size.  Opening the cache only checks the file header; the records are
+ *  then read through a memory map on a background queue, and lookups miss until they have been read.  New sizes are
+ *  appended to the end of the file from the same queue, so saving never rewrites the file or blocks the caller.
+ *
+ *  Content keys must be NSString or NSData objects, since their bytes are the same in every launch.  Any other key
+ *  asserts, and is never stored when assertions are disabled.
+ *
+ *  The salt is stored in the header and the whole file is discarded when it does not match, as it is when the file is
+ *  from another format version or cannot be read.  Use it for anything that changes every size at once, such as the app
+ *  version or the preferred content size category.
+ *
+ *  This class is not thread safe and should be used from the main thread.
+ **/
+@interface RZCellSizeDiskCache : NSObject
+
+/**
+ *  Open or create a disk cache.
+ *
+ *  @param path The path of the cache file.  Intermediate directories are created if needed.  Must not be nil.
+ *  @param salt A string identifying everything the stored sizes depend on besides their keys.  May be nil.
+ *
+ *  @return A disk cache, or nil if the file could not be opened.
+ */
+- (instancetype)initWithPath:(NSString *)path salt:(NSString *)salt;
+
+/**
+ *  The path of the cache file.
+ */
+@property (nonatomic, readonly) NSString* path;
+
+/**
+ *  Number of distinct sizes in the cache.  Waits for the file to be read if it has not been read yet.
+ */
+@property (nonatomic, readonly) NSUInteger count;
+
+/**
+ *  Look up a stored size.
+ *
+ *  @param size          On return, the stored size if there is one.  Must not be NULL.
+ *  @param contentKey    The content key of the object, a string or data.  Must not be nil.
+ *  @param cellClassName The class name of the cell the size was measured with.  Must not be nil.
+ *  @param width         The width the size was measured at, or 0 for the cell's own width.
+ *
+ *  @return YES if a size was stored for the key.
+ */
+- (BOOL)getSize:(CGSize *)size forContentKey:(id)contentKey cellClassName:(NSString *)cellClassName width:(CGFloat)width;
+
+/**
+ *  Store a size.  The size is available to getSize: immediately and is written to the file with the next flush.
+ *
+ *  @param size          The size to store.
+ *  @param contentKey    The content key of the object, a string or data.  Must not be nil.
+ *  @param cellClassName The class name of the cell the size was measured with.  Must not be nil.
+ *  @param width         The width the size was measured at, or 0 for the cell's own width.
+ */
+- (void)setSize:(CGSize)size forContentKey:(id)contentKey cellClassName:(NSString *)cellClassName width:(CGFloat)width;
+
+/**
+ *  Start appending the sizes stored since the last flush to the file in the background.  The cache flushes on its own
+ *  once enough sizes are pending, but this should also be called when the app moves to the background.
+ */
+- (void)flush;
+
+/**
+ *  Flush and wait until the file has been read and everything has been written.
+ */
+- (void)synchronize;
+
+/**
+ *  Remove every size from the cache and truncate the file.
+ */
+- (void)removeAllSizes;
+
+@end
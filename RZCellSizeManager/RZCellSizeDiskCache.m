@@ -0,0 +1,508 @@
+//
+//  RZCellSizeDiskCache.m
+//
+
+
+// Copyright 2014 Raizlabs and other contributors
+// http://raizlabs.com/
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#import "RZCellSizeDiskCache.h"
+#import <errno.h>
+#import <fcntl.h>
+#import <stddef.h>
+#import <sys/mman.h>
+#import <sys/stat.h>
+#import <unistd.h>
+
+#define kRZCellSizeDiskCacheHashSeed 14695981039346656037ULL
+#define kRZCellSizeDiskCacheHashPrime 1099511628211ULL
+
+static const uint32_t kRZCellSizeDiskCacheMagic = 0x53435a52; // "RZCS"
+static const uint32_t kRZCellSizeDiskCacheVersion = 1;
+static const NSUInteger kRZCellSizeDiskCacheFlushThreshold = 64;
+static const NSUInteger kRZCellSizeDiskCacheMinimumCapacity = 16;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t recordSize;
+    uint32_t reserved;
+    uint64_t salt;
+} RZCellSizeDiskCacheHeader;
+
+typedef struct {
+    uint64_t key;
+    float width;
+    float height;
+    uint32_t checksum;
+    uint32_t reserved;
+} RZCellSizeDiskCacheRecord;
+
+typedef struct {
+    uint64_t key;
+    float width;
+    float height;
+} RZCellSizeDiskCacheEntry;
+
+typedef struct {
+    RZCellSizeDiskCacheEntry *entries;
+    NSUInteger capacity;
+    NSUInteger count;
+} RZCellSizeDiskCacheTable;
+
+/**
+ * 64 bit FNV-1a, continued from a previous hash value.
+ **/
+static uint64_t RZCellSizeDiskCacheHash(uint64_t hash, const void *bytes, size_t length)
+{
+    const uint8_t *byte = bytes;
+    for (size_t i = 0; i < length; i++)
+    {
+        hash ^= byte[i];
+        hash *= kRZCellSizeDiskCacheHashPrime;
+    }
+    return hash;
+}
+
+static uint32_t RZCellSizeDiskCacheRecordChecksum(const RZCellSizeDiskCacheRecord *record)
+{
+    uint64_t hash = RZCellSizeDiskCacheHash(kRZCellSizeDiskCacheHashSeed, record, offsetof(RZCellSizeDiskCacheRecord, checksum));
+    return (uint32_t)(hash ^ (hash >> 32)) ^ kRZCellSizeDiskCacheMagic;
+}
+
+/**
+ * Only the bytes of strings and data are hashed, since they are the same in every launch.  The kind of key is hashed
+ *  first so a string and data with the same bytes do not collide.  Zero marks an empty slot in the table, so it is
+ *  never returned as a key, and is returned for a content key that cannot be stored.
+ **/
+static uint64_t RZCellSizeDiskCacheKey(id contentKey, NSString *cellClassName, CGFloat width)
+{
+    uint8_t kind;
+    const void *contentBytes;
+    size_t contentLength;
+    if ([contentKey isKindOfClass:[NSString class]])
+    {
+        kind = 's';
+        const char *contentString = [contentKey UTF8String];
+        contentBytes = contentString;
+        contentLength = strlen(contentString);
+    }
+    else if ([contentKey isKindOfClass:[NSData class]])
+    {
+        kind = 'd';
+        contentBytes = [contentKey bytes];
+        contentLength = [contentKey length];
+    }
+    else
+    {
+        return 0;
+    }
+    
+    // The length and the terminating zero of the class name are hashed too so the fields cannot run together.
+    uint64_t length = contentLength;
+    const char *classString = [cellClassName UTF8String];
+    float widthValue = (float)width;
+    uint64_t hash = RZCellSizeDiskCacheHash(kRZCellSizeDiskCacheHashSeed, &kind, sizeof(kind));
+    hash = RZCellSizeDiskCacheHash(hash, &length, sizeof(length));
+    hash = RZCellSizeDiskCacheHash(hash, contentBytes, contentLength);
+    hash = RZCellSizeDiskCacheHash(hash, classString, strlen(classString) + 1);
+    hash = RZCellSizeDiskCacheHash(hash, &widthValue, sizeof(widthValue));
+    return hash != 0 ? hash : 1;
+}
+
+static RZCellSizeDiskCacheEntry *RZCellSizeDiskCacheTableEntry(RZCellSizeDiskCacheTable *table, uint64_t key, BOOL inserting);
+
+/**
+ * Grows a table so it can hold a number of entries while staying under three quarters full.
+ **/
+static void RZCellSizeDiskCacheTableReserve(RZCellSizeDiskCacheTable *table, NSUInteger count)
+{
+    NSUInteger capacity = MAX(table->capacity, kRZCellSizeDiskCacheMinimumCapacity);
+    while (count * 4 >= capacity * 3)
+    {
+        capacity *= 2;
+    }
+    if (capacity == table->capacity)
+    {
+        return;
+    }
+    
+    RZCellSizeDiskCacheEntry *oldEntries = table->entries;
+    NSUInteger oldCapacity = table->capacity;
+    table->entries = calloc(capacity, sizeof(RZCellSizeDiskCacheEntry));
+    table->capacity = capacity;
+    table->count = 0;
+    for (NSUInteger i = 0; i < oldCapacity; i++)
+    {
+        if (oldEntries[i].key != 0)
+        {
+            *RZCellSizeDiskCacheTableEntry(table, oldEntries[i].key, YES) = oldEntries[i];
+        }
+    }
+    free(oldEntries);
+}
+
+/**
+ * Finds the entry for a key with linear probing.  When inserting, a missing key gets a new entry.
+ **/
+static RZCellSizeDiskCacheEntry *RZCellSizeDiskCacheTableEntry(RZCellSizeDiskCacheTable *table, uint64_t key, BOOL inserting)
+{
+    if (inserting)
+    {
+        RZCellSizeDiskCacheTableReserve(table, table->count + 1);
+    }
+    else if (table->count == 0)
+    {
+        return NULL;
+    }
+    
+    NSUInteger mask = table->capacity - 1;
+    NSUInteger index = (NSUInteger)(key ^ (key >> 32)) & mask;
+    while (table->entries[index].key != 0)
+    {
+        if (table->entries[index].key == key)
+        {
+            return &table->entries[index];
+        }
+        index = (index + 1) & mask;
+    }
+    if (!inserting)
+    {
+        return NULL;
+    }
+    table->entries[index].key = key;
+    table->count++;
+    return &table->entries[index];
+}
+
+static void RZCellSizeDiskCacheTableFree(RZCellSizeDiskCacheTable *table)
+{
+    free(table->entries);
+    table->entries = NULL;
+    table->capacity = 0;
+    table->count = 0;
+}
+
+static BOOL RZCellSizeDiskCacheWrite(int fileDescriptor, const void *bytes, size_t length)
+{
+    const uint8_t *byte = bytes;
+    while (length > 0)
+    {
+        ssize_t written = write(fileDescriptor, byte, length);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return NO;
+        }
+        byte += written;
+        length -= (size_t)written;
+    }
+    return YES;
+}
+
+static RZCellSizeDiskCacheHeader RZCellSizeDiskCacheHeaderMake(uint64_t salt)
+{
+    RZCellSizeDiskCacheHeader header = { kRZCellSizeDiskCacheMagic, kRZCellSizeDiskCacheVersion, sizeof(RZCellSizeDiskCacheRecord), 0, salt };
+    return header;
+}
+
+@interface RZCellSizeDiskCache ()
+{
+    int _fileDescriptor;
+    uint64_t _salt;
+    off_t _openedLength;
+    RZCellSizeDiskCacheTable _table;
+    BOOL _loaded;
+    BOOL _discardsLoadedTable;
+    
+    // Written once on the write queue before _loadFinished is set, then only read or freed on the main thread.
+    RZCellSizeDiskCacheTable _loadedTable;
+    BOOL _loadFinished;
+}
+
+@property (nonatomic, strong) NSMutableData* pendingRecords;
+@property (nonatomic, strong) dispatch_queue_t writeQueue;
+
+@end
+
+@implementation RZCellSizeDiskCache
+
+/**
+ * Only the header is read here, and the records are read on the write queue.  The file is opened for appending, so
+ *  every write, including the ones after the file is truncated, lands at the end of the file.
+ **/
+- (instancetype)initWithPath:(NSString *)path salt:(NSString *)salt
+{
+    NSParameterAssert(path);
+    self = [super init];
+    if ( self ) {
+        _path = [path copy];
+        const char *saltString = [salt UTF8String] ?: "";
+        _salt = RZCellSizeDiskCacheHash(kRZCellSizeDiskCacheHashSeed, saltString, strlen(saltString));
+        
+        [[NSFileManager defaultManager] createDirectoryAtPath:[path stringByDeletingLastPathComponent]
+                                  withIntermediateDirectories:YES
+                                                   attributes:nil
+                                                        error:NULL];
+        _fileDescriptor = open([path fileSystemRepresentation], O_RDWR | O_CREAT | O_APPEND, 0644);
+        if (_fileDescriptor < 0)
+        {
+            return nil;
+        }
+        if (![self openHeader])
+        {
+            close(_fileDescriptor);
+            _fileDescriptor = -1;
+            return nil;
+        }
+        _pendingRecords = [NSMutableData data];
+        _writeQueue = dispatch_queue_create("com.raizlabs.cellsizemanager.diskcache", DISPATCH_QUEUE_SERIAL);
+        
+        // Queued before any write, so the records are read before anything is appended to the file.
+        dispatch_async(_writeQueue, ^{
+            [self loadRecords];
+        });
+    }
+    return self;
+}
+
+/**
+ * The load block retains the cache, so by the time it is deallocated the load has finished.
+ **/
+- (void)dealloc
+{
+    if (_fileDescriptor >= 0)
+    {
+        [self flush];
+        int fileDescriptor = _fileDescriptor;
+        dispatch_async(_writeQueue, ^{
+            close(fileDescriptor);
+        });
+    }
+    RZCellSizeDiskCacheTableFree(&_table);
+    RZCellSizeDiskCacheTableFree(&_loadedTable);
+}
+
+#pragma mark - Public Methods
+
+- (NSUInteger)count
+{
+    [self waitUntilLoaded];
+    return _table.count;
+}
+
+- (BOOL)getSize:(CGSize *)size forContentKey:(id)contentKey cellClassName:(NSString *)cellClassName width:(CGFloat)width
+{
+    NSParameterAssert(size);
+    NSParameterAssert(contentKey);
+    NSParameterAssert(cellClassName);
+    NSAssert([contentKey isKindOfClass:[NSString class]] || [contentKey isKindOfClass:[NSData class]], @"Disk cache content keys must be strings or data");
+    [self installLoadedTableIfNeeded];
+    uint64_t key = RZCellSizeDiskCacheKey(contentKey, cellClassName, width);
+    RZCellSizeDiskCacheEntry* entry = (key != 0) ? RZCellSizeDiskCacheTableEntry(&_table, key, NO) : NULL;
+    if (entry)
+    {
+        *size = CGSizeMake(entry->width, entry->height);
+    }
+    return entry != NULL;
+}
+
+- (void)setSize:(CGSize)size forContentKey:(id)contentKey cellClassName:(NSString *)cellClassName width:(CGFloat)width
+{
+    NSParameterAssert(contentKey);
+    NSParameterAssert(cellClassName);
+    NSAssert([contentKey isKindOfClass:[NSString class]] || [contentKey isKindOfClass:[NSData class]], @"Disk cache content keys must be strings or data");
+    [self installLoadedTableIfNeeded];
+    uint64_t key = RZCellSizeDiskCacheKey(contentKey, cellClassName, width);
+    if (key == 0)
+    {
+        return;
+    }
+    NSUInteger countBefore = _table.count;
+    RZCellSizeDiskCacheEntry* entry = RZCellSizeDiskCacheTableEntry(&_table, key, YES);
+    if (_table.count == countBefore && entry->width == (float)size.width && entry->height == (float)size.height)
+    {
+        return;
+    }
+    entry->width = (float)size.width;
+    entry->height = (float)size.height;
+    
+    RZCellSizeDiskCacheRecord record = { key, entry->width, entry->height, 0, 0 };
+    record.checksum = RZCellSizeDiskCacheRecordChecksum(&record);
+    [self.pendingRecords appendBytes:&record length:sizeof(record)];
+    if (self.pendingRecords.length >= kRZCellSizeDiskCacheFlushThreshold * sizeof(record))
+    {
+        [self flush];
+    }
+}
+
+- (void)flush
+{
+    if (self.pendingRecords.length == 0)
+    {
+        return;
+    }
+    NSData* records = [self.pendingRecords copy];
+    [self.pendingRecords setLength:0];
+    int fileDescriptor = _fileDescriptor;
+    dispatch_async(self.writeQueue, ^{
+        RZCellSizeDiskCacheWrite(fileDescriptor, records.bytes, records.length);
+    });
+}
+
+- (void)synchronize
+{
+    [self flush];
+    [self waitUntilLoaded];
+}
+
+- (void)removeAllSizes
+{
+    [self.pendingRecords setLength:0];
+    RZCellSizeDiskCacheTableFree(&_table);
+    if (!_loaded)
+    {
+        _discardsLoadedTable = YES;
+    }
+    
+    int fileDescriptor = _fileDescriptor;
+    RZCellSizeDiskCacheHeader header = RZCellSizeDiskCacheHeaderMake(_salt);
+    dispatch_async(self.writeQueue, ^{
+        if (ftruncate(fileDescriptor, 0) == 0)
+        {
+            RZCellSizeDiskCacheWrite(fileDescriptor, &header, sizeof(header));
+        }
+    });
+}
+
+#pragma mark - Private Methods
+
+/**
+ * Checks the header of the file and starts a new file if it is missing, from another version or salted differently.
+ **/
+- (BOOL)openHeader
+{
+    struct stat info;
+    if (fstat(_fileDescriptor, &info) != 0)
+    {
+        return NO;
+    }
+    
+    RZCellSizeDiskCacheHeader expectedHeader = RZCellSizeDiskCacheHeaderMake(_salt);
+    RZCellSizeDiskCacheHeader header;
+    if (info.st_size >= (off_t)sizeof(header) &&
+        pread(_fileDescriptor, &header, sizeof(header), 0) == (ssize_t)sizeof(header) &&
+        memcmp(&header, &expectedHeader, sizeof(header)) == 0)
+    {
+        _openedLength = info.st_size;
+        return YES;
+    }
+    
+    _openedLength = sizeof(expectedHeader);
+    return (ftruncate(_fileDescriptor, 0) == 0 &&
+            RZCellSizeDiskCacheWrite(_fileDescriptor, &expectedHeader, sizeof(expectedHeader)));
+}
+
+/**
+ * Runs on the write queue.  Reads every record into a table of its own through a memory map.  Records are read in
+ *  order, so a size that was stored more than once ends up with its latest value.  Reading stops at the first record
+ *  that fails its checksum, and the file is cut there so later records are not appended after the damage.
+ **/
+- (void)loadRecords
+{
+    RZCellSizeDiskCacheTable table = { NULL, 0, 0 };
+    size_t headerLength = sizeof(RZCellSizeDiskCacheHeader);
+    size_t recordCount = (size_t)(_openedLength - (off_t)headerLength) / sizeof(RZCellSizeDiskCacheRecord);
+    size_t validCount = 0;
+    if (recordCount > 0)
+    {
+        void* map = mmap(NULL, (size_t)_openedLength, PROT_READ, MAP_SHARED, _fileDescriptor, 0);
+        if (map != MAP_FAILED)
+        {
+            RZCellSizeDiskCacheTableReserve(&table, recordCount);
+            const RZCellSizeDiskCacheRecord* records = (const RZCellSizeDiskCacheRecord *)((const uint8_t *)map + headerLength);
+            for ( ; validCount < recordCount; validCount++)
+            {
+                const RZCellSizeDiskCacheRecord* record = &records[validCount];
+                if (record->key == 0 || record->checksum != RZCellSizeDiskCacheRecordChecksum(record))
+                {
+                    break;
+                }
+                RZCellSizeDiskCacheEntry* entry = RZCellSizeDiskCacheTableEntry(&table, record->key, YES);
+                entry->width = record->width;
+                entry->height = record->height;
+            }
+            munmap(map, (size_t)_openedLength);
+        }
+    }
+    
+    off_t validLength = (off_t)(headerLength + validCount * sizeof(RZCellSizeDiskCacheRecord));
+    if (validLength != _openedLength)
+    {
+        ftruncate(_fileDescriptor, validLength);
+    }
+    
+    _loadedTable = table;
+    __atomic_store_n(&_loadFinished, YES, __ATOMIC_RELEASE);
+}
+
+/**
+ * Takes over the table read on the write queue once it is ready.  Sizes stored before then are newer than anything in
+ *  the file, so they are copied over the loaded ones.  Until the table is ready every lookup of an older size misses.
+ **/
+- (void)installLoadedTableIfNeeded
+{
+    if (_loaded || !__atomic_load_n(&_loadFinished, __ATOMIC_ACQUIRE))
+    {
+        return;
+    }
+    _loaded = YES;
+    
+    if (_discardsLoadedTable)
+    {
+        RZCellSizeDiskCacheTableFree(&_loadedTable);
+        return;
+    }
+    RZCellSizeDiskCacheTable table = _loadedTable;
+    _loadedTable = (RZCellSizeDiskCacheTable){ NULL, 0, 0 };
+    for (NSUInteger i = 0; i < _table.capacity; i++)
+    {
+        if (_table.entries[i].key != 0)
+        {
+            *RZCellSizeDiskCacheTableEntry(&table, _table.entries[i].key, YES) = _table.entries[i];
+        }
+    }
+    RZCellSizeDiskCacheTableFree(&_table);
+    _table = table;
+}
+
+- (void)waitUntilLoaded
+{
+    dispatch_sync(self.writeQueue, ^{});
+    [self installLoadedTableIfNeeded];
+}
+
+@end
@@ -0,0 +1,99 @@
+//
+//  RZCellSizeEstimator.h
+//
+
+
+// Copyright 2014 Raizlabs and other contributors
+// http://raizlabs.com/
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+#import <Foundation/Foundation.h>
+#import <CoreGraphics/CoreGraphics.h>
+
+#define kRZCellSizeEstimatorDefaultSampleWindow 256
+
+/**
+ *  RZCellSizeEstimator
+ *
+ *  Online statistics of the heights measured for one kind of cell, used to estimate the heights of cells that have
+ *  not been measured yet.  Each height can come with a feature of its object that predicts it, such as the length of
+ *  its text, and the estimate is then a least squares line through the feature.  Without features, or while every
+ *  feature seen is the same, the estimate is the mean height.
+ *
+ *  Adding a height and estimating are both O(1).  The most recent heights count the most: once sampleWindow heights
+ *  have been added, each new one is weighted as if it were one of the last sampleWindow, so the estimate follows
+ *  content that drifts.
+ *
+ *  This class only depends on Foundation and CoreGraphics, so it can be evaluated offline against recorded heights.
+ **/
+@interface RZCellSizeEstimator : NSObject
+
+/**
+ *  Add a measured height without a feature.  This is the same as a feature of 0.
+ *
+ *  @param height The measured height.
+ */
+- (void)addHeight:(CGFloat)height;
+
+/**
+ *  Add a measured height along with the feature of its object.
+ *
+ *  @param height  The measured height.
+ *  @param feature The value of the feature for the object that was measured.
+ */
+- (void)addHeight:(CGFloat)height feature:(double)feature;
+
+/**
+ *  Estimate the height of an object from its feature.  The estimate is kept within the range of the heights seen.
+ *
+ *  @param feature The value of the feature for the object.
+ *
+ *  @return The estimated height, or 0 if no height has been added.
+ */
+- (CGFloat)estimatedHeightForFeature:(double)feature;
+
+/**
+ *  Forget every height added so far.
+ */
+- (void)reset;
+
+/**
+ *  Number of heights added since the last reset.
+ */
+@property (nonatomic, readonly) NSUInteger count;
+
+/**
+ *  Weighted mean of the heights added, or 0 if there are none.
+ */
+@property (nonatomic, readonly) CGFloat meanHeight;
+
+/**
+ *  Weighted standard deviation of the heights added, or 0 if there are fewer than two.
+ */
+@property (nonatomic, readonly) CGFloat heightStandardDeviation;
+
+/**
+ *  Number of recent heights the statistics are weighted over, or 0 to weight every height equally.
+ *  Defaults to kRZCellSizeEstimatorDefaultSampleWindow.
+ */
+@property (nonatomic, assign) NSUInteger sampleWindow;
+
+@end
@@ -0,0 +1,134 @@
+//
+//  RZCellSizeEstimator.m
+//
+
+
+// Copyright 2014 Raizlabs and other contributors
+// http://raizlabs.com/
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+#import "RZCellSizeEstimator.h"
+
+/**
+ *  Below this feature variance the features do not tell the heights apart, and the mean is used instead of the line.
+ **/
+static const double kRZCellSizeEstimatorMinimumFeatureVariance = 1e-9;
+
+@interface RZCellSizeEstimator ()
+{
+    double _meanFeature;
+    double _meanHeight;
+    double _featureVariance;
+    double _heightVariance;
+    double _covariance;
+    double _minimumHeight;
+    double _maximumHeight;
+}
+
+@property (nonatomic, assign, readwrite) NSUInteger count;
+
+@end
+
+@implementation RZCellSizeEstimator
+
+- (instancetype)init
+{
+    self = [super init];
+    if ( self ) {
+        _sampleWindow = kRZCellSizeEstimatorDefaultSampleWindow;
+    }
+    return self;
+}
+
+#pragma mark - Public Methods
+
+- (void)addHeight:(CGFloat)height
+{
+    [self addHeight:height feature:0.0];
+}
+
+/**
+ *  Welford's update, weighted by 1 / count until the window is full and by 1 / sampleWindow after that.  With
+ *  w = 1 / count this gives the exact population moments; with a fixed w it is an exponentially weighted average.
+ **/
+- (void)addHeight:(CGFloat)height feature:(double)feature
+{
+    self.count++;
+    NSUInteger weightCount = (self.sampleWindow > 0) ? MIN(self.count, self.sampleWindow) : self.count;
+    double weight = 1.0 / weightCount;
+    
+    double featureDelta = feature - _meanFeature;
+    double heightDelta = height - _meanHeight;
+    _meanFeature += weight * featureDelta;
+    _meanHeight += weight * heightDelta;
+    _featureVariance = (1.0 - weight) * (_featureVariance + weight * featureDelta * featureDelta);
+    _heightVariance = (1.0 - weight) * (_heightVariance + weight * heightDelta * heightDelta);
+    _covariance = (1.0 - weight) * (_covariance + weight * featureDelta * heightDelta);
+    
+    _minimumHeight = (self.count == 1) ? height : MIN(_minimumHeight, height);
+    _maximumHeight = (self.count == 1) ? height : MAX(_maximumHeight, height);
+}
+
+- (CGFloat)estimatedHeightForFeature:(double)feature
+{
+    if (self.count == 0)
+    {
+        return 0.0f;
+    }
+    
+    double estimate = _meanHeight;
+    if (_featureVariance > kRZCellSizeEstimatorMinimumFeatureVariance)
+    {
+        double slope = _covariance / _featureVariance;
+        estimate += slope * (feature - _meanFeature);
+    }
+    return MIN(MAX(estimate, _minimumHeight), _maximumHeight);
+}
+
+- (void)reset
+{
+    self.count = 0;
+    _meanFeature = 0.0;
+    _meanHeight = 0.0;
+    _featureVariance = 0.0;
+    _heightVariance = 0.0;
+    _covariance = 0.0;
+    _minimumHeight = 0.0;
+    _maximumHeight = 0.0;
+}
+
+- (CGFloat)meanHeight
+{
+    return _meanHeight;
+}
+
+- (CGFloat)heightStandardDeviation
+{
+    return (self.count > 1) ? sqrt(_heightVariance) : 0.0f;
+}
+
+- (NSString *)description
+{
+    return [NSString stringWithFormat:@"<%@: %p> count: %lu, mean: %.1f, standard deviation: %.1f",
+            NSStringFromClass([self class]), self, (unsigned long)self.count, self.meanHeight, self.heightStandardDeviation];
+}
+
+@end
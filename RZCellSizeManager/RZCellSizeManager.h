@@ -27,9 +27,20 @@
 //
 #import <Foundation/Foundation.h>
 
+@class RZCellSizeManagerStatistics;
+@class RZCellSizeDiskCache;
+@class RZCellSizeTraceRecorder;
+@class RZCellSizeArrayDiff;
+@class RZCellSizeTextStack;
+@class RZCellSizeCharacterMetrics;
+@class UIFont;
+
 typedef void    (^RZCellSizeManagerConfigBlock)(id cell, id object);
 typedef CGFloat (^RZCellSizeManagerHeightBlock)(id cell, id object);
 typedef CGSize  (^RZCellSizeManagerSizeBlock)(id cell, id object);
+typedef id<NSCopying> (^RZCellSizeManagerContentKeyBlock)(id object);
+typedef id<NSCopying> (^RZCellSizeManagerLayoutSignatureBlock)(id object);
+typedef double  (^RZCellSizeManagerEstimationFeatureBlock)(id object);
 
 /**
  *  RZCellSizeManager
@@ -37,6 +48,9 @@ typedef CGSize  (^RZCellSizeManagerSizeBlock)(id cell, id object);
  *  RZCellSizeManager is an object that streamlines the management of dynamic UITableViewCell heights or UICollectionViewCell sizes.
  *  All sizes calculated will be cached so that look-up times will be much faster for additional calls for the size of a cell based 
  *  on an index path. The cached heights can be invalidated at any time by indexPath or for the entire cache.
+ *
+ *  Registering a cell class is cheap: the prototype cell used for measuring is only created the first time a size
+ *  is computed for that class, and nibs are loaded once and shared by every manager.
  **/
 @interface RZCellSizeManager : NSObject
 
@@ -159,10 +173,165 @@ typedef CGSize  (^RZCellSizeManagerSizeBlock)(id cell, id object);
                 withSizeBlock:(RZCellSizeManagerSizeBlock)sizeBlock;
 
 /**
- *  Invalidate the entire cache of cell sizes.
+ *  Cache the sizes of a registered cell by a key derived from the model object rather than only by index path.
+ *
+ *  When a cell class has a content key block, the size of a cell is looked up by its key first and the index path is
+ *  only kept as a secondary index.  A size then follows its object across reorders, refetches and sections, and is
+ *  not thrown away by invalidateCellSizeCache.  The key must change whenever the content of the object that affects
+ *  its size changes, for example by combining an object ID with a version or a hash of the content.
+ *
+ *  @param contentKeyBlock Block which is passed the model object and returns a stable key for it, or nil to stop
+ *                         using content keys for this cell class.
+ *  @param cellClass       Name of a cell class that has already been registered. Must not be nil.
+ */
+- (void)setContentKeyBlock:(RZCellSizeManagerContentKeyBlock)contentKeyBlock forCellClassName:(NSString *)cellClass;
+
+/**
+ *  Share measurements between the objects of a registered cell class that lay out the same way.
+ *
+ *  The layout signature of an object describes the shape of its cell rather than its content, for example the number
+ *  of lines in each label, which optional views are hidden, or a bucket for the aspect ratio of an image.  Objects with
+ *  equal signatures must produce the same size.  Once a size has been measured for a signature at the current width,
+ *  every other object with that signature gets it without configuring the cell or running Auto Layout.
+ *
+ *  @param layoutSignatureBlock Block which is passed the model object and returns a compact key for the shape of its
+ *                              cell, or nil to stop using layout signatures for this cell class.
+ *  @param cellClass            Name of a cell class that has already been registered. Must not be nil.
+ */
+- (void)setLayoutSignatureBlock:(RZCellSizeManagerLayoutSignatureBlock)layoutSignatureBlock forCellClassName:(NSString *)cellClass;
+
+/**
+ *  Declare that the height or size block of a registered cell class can be called from any thread, so
+ *  computeCellSizesForObjects:indexPaths:cellReuseIdentifier: can measure its cells in parallel.
+ *
+ *  A thread safe block is passed nil rather than the prototype cell, on every thread, so the prototype is never loaded
+ *  for it.  Sizes must be computed from the object alone.
+ *
+ *  @param threadSafe YES if the block is thread safe.  Registrations are not thread safe by default.
+ *  @param cellClass  Name of a cell class that has already been registered with a height block or a size block.
+ *                    Must not be nil.
+ */
+- (void)setThreadSafe:(BOOL)threadSafe forCellClassName:(NSString *)cellClass;
+
+/**
+ *  Improve the height estimates of a registered cell class with a feature of the model object that predicts its
+ *  height, such as the length of its text.
+ *
+ *  The manager keeps running statistics of the heights it measures for each cell class, and
+ *  estimatedCellHeightForObject:indexPath: answers with their mean.  With a feature block, it instead fits a line
+ *  from the feature to the height as heights are measured, and answers from the feature of the object.
+ *
+ *  @param featureBlock Block which is passed the model object and returns its feature, or nil to go back to the mean.
+ *  @param cellClass    Name of a cell class that has already been registered. Must not be nil.
+ */
+- (void)setEstimationFeatureBlock:(RZCellSizeManagerEstimationFeatureBlock)featureBlock forCellClassName:(NSString *)cellClass;
+
+/**
+ *  Compute the heights of a registered cell from its text instead of configuring the cell and running Auto Layout.
+ *
+ *  This suits cells that are a stack of multiline labels inside fixed margins.  The text stack describes the labels
+ *  and margins, and the height is worked out from the line count of each label at the width of the cell.  The normal
+ *  registration is still used for any object that one of the text blocks can not measure.
+ *
+ *  @param textStack The text stack of the cell, or nil to stop using it.
+ *  @param cellClass Name of a cell class that has already been registered. Must not be nil.
+ */
+- (void)setTextStack:(RZCellSizeTextStack *)textStack forCellClassName:(NSString *)cellClass;
+
+/**
+ *  Character metrics for a font to use in a text block.  Metrics are shared between every caller using the same font.
+ *
+ *  @param font The font to measure. Must not be nil.
+ *
+ *  @return The metrics of the font.
+ */
++ (RZCellSizeCharacterMetrics *)characterMetricsForFont:(UIFont *)font;
+
+/**
+ *  Optional cache which keeps content-keyed sizes between launches.  Sizes missing from memory are looked up here
+ *  before a cell is measured, and every measured content-keyed size is stored here.  The cache is flushed when the
+ *  app enters the background.  Use defaultDiskCacheSalt as the salt unless the sizes depend on anything else.  The
+ *  content key blocks must return NSString or NSData keys when a disk cache is set.
+ */
+@property (nonatomic, strong) RZCellSizeDiskCache* diskCache;
+
+/**
+ *  Optional recorder which is sent every lookup, invalidation, structural change, registration and width change, so
+ *  that a real session can be replayed offline with RZCellSizeTraceReplayer.  Defaults to nil.
+ */
+@property (nonatomic, strong) RZCellSizeTraceRecorder* traceRecorder;
+
+/**
+ *  A salt for a disk cache made from the app version and build and the preferred content size category, so stored
+ *  sizes are thrown away when any of them change.
+ *
+ *  @return The salt string.
+ */
++ (NSString *)defaultDiskCacheSalt;
+
+/**
+ *  Invalidate the entire cache of cell sizes by index path.  This takes constant time, and the invalidated heights
+ *  are still returned by estimatedCellHeightForIndexPath: until the cells are measured again.
+ *  Sizes cached by content key are kept, since their keys identify the content they were computed for.
  */
 - (void)invalidateCellSizeCache;
 
+/**
+ *  Invalidate the cached sizes of every cell in a section, in constant time.
+ *
+ *  @param section The section to invalidate.
+ */
+- (void)invalidateCellSizesInSection:(NSInteger)section;
+
+/**
+ *  Invalidate the cached sizes of every cell of a registered class, in constant time, for example after changing
+ *  something every one of those cells depends on.  Its sizes cached by content key are removed as well, but not the
+ *  ones in the disk cache.
+ *
+ *  @param cellClass Name of a registered cell class. Must not be nil.
+ */
+- (void)invalidateCellSizesForCellClassName:(NSString *)cellClass;
+
+/**
+ *  The last height computed for a cell, even if it has been invalidated since, or estimatedCellHeight if it has never
+ *  been computed.  Useful for tableView:estimatedHeightForRowAtIndexPath:.
+ *
+ *  @param indexPath Index path of the cell. Must not be nil.
+ *
+ *  @return The estimated height of the cell.
+ */
+- (CGFloat)estimatedCellHeightForIndexPath:(NSIndexPath *)indexPath;
+
+/**
+ *  The last height computed for a cell, or an estimate learned from the heights measured so far for its cell class.
+ *  estimatedCellHeight is only used before any cell of the class has been measured.  This is O(1) and never measures,
+ *  so it suits tableView:estimatedHeightForRowAtIndexPath:, and keeps the content size from jumping as real heights
+ *  replace the estimates.
+ *
+ *  @param object    Optional model object of the cell, used to find its cell class and its estimation feature.
+ *  @param indexPath Index path of the cell. Must not be nil.
+ *
+ *  @return The estimated height of the cell.
+ */
+- (CGFloat)estimatedCellHeightForObject:(id)object indexPath:(NSIndexPath *)indexPath;
+
+/**
+ *  The last height computed for a cell, or an estimate learned from the heights measured so far for the cell class
+ *  registered for a reuse identifier.
+ *
+ *  @param object          Optional model object of the cell, used for its estimation feature.
+ *  @param indexPath       Index path of the cell. Must not be nil.
+ *  @param reuseIdentifier Reuse identifier of the cell.
+ *
+ *  @return The estimated height of the cell.
+ */
+- (CGFloat)estimatedCellHeightForObject:(id)object indexPath:(NSIndexPath *)indexPath cellReuseIdentifier:(NSString *)reuseIdentifier;
+
+/**
+ *  Invalidate every size cached by content key, including the sizes in the disk cache.
+ */
+- (void)invalidateContentKeyedCellSizeCache;
+
 /**
  *  Invalidate the cached size for a cell at a particular index paths.
  *
@@ -177,6 +346,85 @@ typedef CGSize  (^RZCellSizeManagerSizeBlock)(id cell, id object);
  */
 - (void)invalidateCellSizesAtIndexPaths:(NSArray *)indexPaths;
 
+/**
+ *  Shift cached sizes to account for inserted cells.  Cells after the inserted ones keep their cached sizes,
+ *  and the inserted cells will be computed the next time they are asked for.
+ *
+ *  @param indexPaths An array of NSIndexPaths of the inserted cells, after the insertion. Must not be nil.
+ */
+- (void)insertCellSizesAtIndexPaths:(NSArray *)indexPaths;
+
+/**
+ *  Shift cached sizes to account for deleted cells.  Cells after the deleted ones keep their cached sizes.
+ *
+ *  @param indexPaths An array of NSIndexPaths of the deleted cells, before the deletion. Must not be nil.
+ */
+- (void)deleteCellSizesAtIndexPaths:(NSArray *)indexPaths;
+
+/**
+ *  Move the cached size of a cell to a new index path, shifting the cells in between.
+ *
+ *  @param indexPath    The index path of the cell before the move. Must not be nil.
+ *  @param newIndexPath The index path of the cell after the move. Must not be nil.
+ */
+- (void)moveCellSizeAtIndexPath:(NSIndexPath *)indexPath toIndexPath:(NSIndexPath *)newIndexPath;
+
+/**
+ *  Move a cell to a new index path, shifting the cells in between, and optionally invalidate its cached size.
+ *  Pass YES when the move was caused by a change to the object, as with the moves reported by NSFetchedResultsController.
+ *
+ *  @param indexPath    The index path of the cell before the move. Must not be nil.
+ *  @param newIndexPath The index path of the cell after the move. Must not be nil.
+ *  @param invalidate   YES to invalidate the size of the moved cell, NO to keep it.
+ */
+- (void)moveCellSizeAtIndexPath:(NSIndexPath *)indexPath toIndexPath:(NSIndexPath *)newIndexPath invalidate:(BOOL)invalidate;
+
+/**
+ *  Move cached sizes along with their objects when the array behind a section is replaced, for data sources that
+ *  have no change feed.  The two arrays are diffed in linear time and every surviving object keeps its size at its
+ *  new row, so only the inserted objects are measured again.  The model objects themselves can be passed if they
+ *  keep the default identity equality.
+ *
+ *  Must not be called between beginCellSizeUpdates and endCellSizeUpdates.
+ *
+ *  @param section       The section whose array was replaced.
+ *  @param oldIdentities Identities of the objects before the change, in row order. Must not be nil.
+ *  @param newIdentities Identities of the objects after the change, in row order. The identity of an object must
+ *                       change whenever its size does. Must not be nil.
+ *
+ *  @return The diff that was applied, which can also drive the row animations of the table or collection view.
+ */
+- (RZCellSizeArrayDiff *)migrateCellSizesInSection:(NSInteger)section fromIdentities:(NSArray *)oldIdentities toIdentities:(NSArray *)newIdentities;
+
+/**
+ *  Shift cached sizes to account for inserted sections.
+ *
+ *  @param sections The indexes of the inserted sections, after the insertion. Must not be nil.
+ */
+- (void)insertCellSizesForSections:(NSIndexSet *)sections;
+
+/**
+ *  Remove the cached sizes of deleted sections and shift the sections after them.
+ *
+ *  @param sections The indexes of the deleted sections, before the deletion. Must not be nil.
+ */
+- (void)deleteCellSizesForSections:(NSIndexSet *)sections;
+
+/**
+ *  Begin a batch of structural changes, the same way -[UITableView beginUpdates] does.
+ *
+ *  Until the matching endCellSizeUpdates, inserts, deletes, moves and index path invalidations are recorded rather than
+ *  applied.  Invalidations and deletions use index paths from before the batch and insertions use index paths from after it,
+ *  so the changes can be forwarded in whatever order they are reported.  Calls may be nested.
+ */
+- (void)beginCellSizeUpdates;
+
+/**
+ *  End a batch of structural changes and apply all of them to the cache at once.
+ *  Only cells that were invalidated or inserted during the batch lose their cached sizes.
+ */
+- (void)endCellSizeUpdates;
+
 
 /**
  *  Extra padding of the cell height. This defaults to 1 px.  
@@ -186,13 +434,49 @@ typedef CGSize  (^RZCellSizeManagerSizeBlock)(id cell, id object);
  */
 @property (nonatomic, assign) CGFloat cellHeightPadding;
 
+/**
+ *  Extra padding added to the height of cell sizes, for collection views whose cells draw a divider.  Defaults to 0.
+ */
+@property (nonatomic, assign) CGFloat cellSizePadding;
+
 /**
  *   This is used to override a static width for a cell.  
  *   A possible use case would be having a cell created for iPhone at 320.0 pts wide work on an iPad with a width of 768.0 pts.
- *   Setting this automatically invalidates the cache.
+ *   Sizes are cached separately for each width, so setting this switches to the sizes computed at the new width and
+ *   switching back to a recent width, for example on rotation, does not compute anything again.
  *   @warning If you have labels that you want to have a dynamic height you must make sure that the preferredMaxLayoutWidth is correct.
  */
 @property (nonatomic, assign) CGFloat overideWidth;
+
+/**
+ *  Number of widths whose sizes are kept in memory, including the current one.  The least recently used width is
+ *  discarded when another one is needed.  Defaults to 2, which covers portrait and landscape.
+ */
+@property (nonatomic, assign) NSUInteger maximumNumberOfCachedWidths;
+
+/**
+ *  Maximum number of bytes used to store the sizes for each width, or 0 for no limit.  When the storage grows past
+ *  it, the sizes farthest from visibleIndexPath are dropped.  Sizes cached by content key are not counted.
+ *  Defaults to 0.
+ */
+@property (nonatomic, assign) NSUInteger cellSizeCacheByteBudget;
+
+/**
+ *  Index path of a visible cell, such as the first or the middle visible one.  The sizes of the cells around it are
+ *  kept when the cache is trimmed to cellSizeCacheByteBudget or after a memory warning, so this should be updated as
+ *  the view scrolls.
+ */
+@property (nonatomic, strong) NSIndexPath* visibleIndexPath;
+
+/**
+ *  Number of bytes currently used to store the sizes for every cached width.
+ */
+@property (nonatomic, readonly) NSUInteger cellSizeCacheByteCount;
+
+/**
+ *  Average number of bytes used per cached size for every cached width.
+ */
+@property (nonatomic, readonly) double cellSizeCacheBytesPerSize;
  
 
 /**
@@ -237,4 +521,139 @@ typedef CGSize  (^RZCellSizeManagerSizeBlock)(id cell, id object);
  */
 - (CGSize)cellSizeForObject:(id)object indexPath:(NSIndexPath *)indexPath cellReuseIdentifier:(NSString *)reuseIdentifier;
 
+/**
+ *  Fill a buffer with the sizes of every collection view cell in a section.  Cached sizes are copied in one pass over
+ *  the cache and only the missing ones are computed, which is much cheaper than asking for each index path, for
+ *  example when a custom layout prepares a large section.
+ *
+ *  @param sizes           Buffer with room for one size per object.  On return, sizes[i] is the size of item i.
+ *  @param objects         Model objects of the section, in item order.  Use NSNull for cells that have no object. Must not be nil.
+ *  @param section         Section of the cells.
+ *  @param reuseIdentifier Reuse identifier of the cells, or nil to match the registration by object class.
+ */
+- (void)getCellSizes:(CGSize *)sizes forObjects:(NSArray *)objects inSection:(NSInteger)section cellReuseIdentifier:(NSString *)reuseIdentifier;
+
+/**
+ *  Look up a cached size from any thread, for example to prefetch or lay out on a background queue.  This never
+ *  measures, takes a lock or waits for the main thread, which keeps making every other call.  Only sizes cached by
+ *  index path at the current width are seen; content-keyed sizes and the disk cache are not consulted.  A height
+ *  cached for a table view cell is returned as the height of the size.
+ *
+ *  @param size      On return, the cached size if there is one.  May be NULL if only checking for existence.
+ *  @param indexPath Index path of the cell.
+ *
+ *  @return YES if a size was cached for the index path, NO if it was not or if updates kept overlapping the read.
+ */
+- (BOOL)getCachedCellSize:(CGSize *)size forIndexPath:(NSIndexPath *)indexPath;
+
+/**
+ *  If YES, the manager counts cache hits, misses and measurements per registered cell class, records how long the
+ *  configuration, layout and fitting steps of each measurement take, and counts the cached sizes thrown away by
+ *  invalidations.  Collection is cheap enough to leave on in production.  Defaults to NO.
+ *
+ *  The time spent registering each cell class, creating its prototype cell and computing its first size is
+ *  recorded whether or not this is on.
+ */
+@property (nonatomic, assign) BOOL collectsStatistics;
+
+/**
+ *  Return a snapshot of the statistics collected so far.
+ *
+ *  @return An immutable statistics object.
+ */
+- (RZCellSizeManagerStatistics *)statistics;
+
+/**
+ *  Reset every statistics counter to zero.  The one-time registration, prototype and first measurement times are kept.
+ */
+- (void)resetStatistics;
+
+/**
+ *  Height used for cells that have not been computed yet when answering offset queries.  Defaults to 44 pts.
+ */
+@property (nonatomic, assign) CGFloat estimatedCellHeight;
+
+/**
+ *  Return the offset of the top of a table view cell from the top of its section.
+ *  Cached heights are used where they exist and estimatedCellHeight everywhere else.  Nothing is measured.
+ *
+ *  This is answered in O(log n) from an index that is updated as heights are cached, invalidated and shifted.
+ *
+ *  @param indexPath Index path of the cell. Must not be nil.
+ *
+ *  @return Offset of the cell within its section.
+ */
+- (CGFloat)cellOffsetForIndexPath:(NSIndexPath *)indexPath;
+
+/**
+ *  Return the total height of the cells in a section, using cached heights where they exist and estimatedCellHeight everywhere else.
+ *
+ *  @param section      Section to measure.
+ *  @param numberOfRows Number of rows in the section.
+ *
+ *  @return Total height of the cells in the section.
+ */
+- (CGFloat)totalCellHeightForSection:(NSInteger)section numberOfRows:(NSInteger)numberOfRows;
+
+/**
+ *  Return the index path of the cell at an offset from the top of a section, using cached heights where they exist and
+ *  estimatedCellHeight everywhere else.
+ *
+ *  @param offset       Offset from the top of the section.
+ *  @param section      Section to search.
+ *  @param numberOfRows Number of rows in the section.
+ *
+ *  @return Index path of the cell containing the offset, clamped to the last cell, or nil if the section is empty.
+ */
+- (NSIndexPath *)indexPathForCellAtOffset:(CGFloat)offset inSection:(NSInteger)section numberOfRows:(NSInteger)numberOfRows;
+
+/**
+ *  Maximum time spent precomputing heights per run loop turn.  Defaults to 2 ms.
+ */
+@property (nonatomic, assign) NSTimeInterval precomputeTimeBudget;
+
+/**
+ *  Index path that pending precomputation is prioritized around.  This should be kept near the visible cells,
+ *  for example from scrollViewDidScroll:.
+ */
+@property (nonatomic, strong) NSIndexPath* precomputeFocusIndexPath;
+
+/**
+ *  Compute and cache the heights of table view cells ahead of time, a few at a time on each turn of the main run loop,
+ *  so that scrolling into cells that have not been displayed yet does not have to measure them.
+ *  Cells that are already cached are skipped.
+ *
+ *  @warning Pending index paths are not shifted by structural changes.  Call cancelCellSizePrecomputation when the data changes.
+ *
+ *  @param objects         Model objects, one per index path.  Use NSNull for cells that have no object. Must not be nil.
+ *  @param indexPaths      Index paths of the cells. Must not be nil.
+ *  @param reuseIdentifier Reuse identifier of the cells, or nil to match the registration by object class.
+ *  @param completion      Optional block called once every cell has been computed, with the index paths that now have a
+ *                         cached height.  A good place to replace estimated heights with real ones.
+ */
+- (void)precomputeCellHeightsForObjects:(NSArray *)objects
+                             indexPaths:(NSArray *)indexPaths
+                    cellReuseIdentifier:(NSString *)reuseIdentifier
+                             completion:(void (^)(NSArray *indexPaths))completion;
+
+/**
+ *  Compute and cache the sizes of many cells at once, for example to warm the cache after the data is refreshed.
+ *  Cells whose registration is thread safe are measured in parallel on every core and the results are added to the
+ *  cache on the calling thread once they are all done.  Other cells are measured one at a time on the calling thread.
+ *  Cells that are already cached are skipped.  Returns once every cell has been measured.
+ *
+ *  The sizes, layout signatures, text stacks and statistics are the same as measuring the cells one at a time.  Layout
+ *  signatures and text stacks are resolved on the calling thread, so only the height and size blocks run in parallel.
+ *
+ *  @param objects         Model objects, one per index path.  Use NSNull for cells that have no object. Must not be nil.
+ *  @param indexPaths      Index paths of the cells. Must not be nil.
+ *  @param reuseIdentifier Reuse identifier of the cells, or nil to match the registration by object class.
+ */
+- (void)computeCellSizesForObjects:(NSArray *)objects indexPaths:(NSArray *)indexPaths cellReuseIdentifier:(NSString *)reuseIdentifier;
+
+/**
+ *  Drop every pending precomputation.  Completion blocks of unfinished calls are not called.
+ */
+- (void)cancelCellSizePrecomputation;
+
 @end
@@ -28,12 +28,22 @@
 
 
 #import "RZCellSizeManager.h"
+#import "RZCellSizeCache.h"
+#import "RZCellSizePrecomputeQueue.h"
+#import "RZCellSizeStatistics.h"
+#import "RZCellSizeDiskCache.h"
+#import "RZCellSizeTextLayout.h"
+#import "RZCellSizeTrace.h"
+#import "RZCellSizeArrayDiff.h"
+#import "RZCellSizeEstimator.h"
 
 #define kRZCellSizeManagerCellKey               @"RZCellSizeManagerCellKey"
 #define kRZCellSizeManagerObjectClassKey        @"RZCellSizeManagerObjectClassKey"
 #define kRZCellSizeManagerConfigurationBlockKey @"RZCellSizeManagerConfigurationBlockKey"
 
 #define kRZCellSizeManagerDefaultCellHeightPadding  1.0f
+#define kRZCellSizeManagerDefaultEstimatedCellHeight 44.0f
+#define kRZCellSizeManagerDefaultMaximumNumberOfCachedWidths 2
 /**
  * UICollectionViewCell (AutoLayout)
  *
@@ -92,69 +102,185 @@
  *  RZCellSizeManagerCellConfiguration
  **/
 @interface RZCellSizeManagerCellConfiguration : NSObject
-@property (nonatomic, strong) id cell;
+{
+    RZCellSizeConfigurationCounters _counters;
+    id _cell;
+}
+@property (nonatomic, readonly) id cell;
+@property (nonatomic, strong) NSString* cellNibName;
+@property (nonatomic, assign) CGFloat overideWidth;
+@property (nonatomic, assign) BOOL hasMeasured;
 @property (nonatomic, copy) RZCellSizeManagerConfigBlock configurationBlock;
 @property (nonatomic, copy) RZCellSizeManagerHeightBlock heightBlock;
 @property (nonatomic, copy) RZCellSizeManagerSizeBlock sizeBlock;
+@property (nonatomic, copy) RZCellSizeManagerContentKeyBlock contentKeyBlock;
+@property (nonatomic, copy) RZCellSizeManagerLayoutSignatureBlock layoutSignatureBlock;
+@property (nonatomic, copy) RZCellSizeManagerEstimationFeatureBlock estimationFeatureBlock;
+@property (nonatomic, strong) RZCellSizeEstimator* estimator;
+@property (nonatomic, strong) RZCellSizeTextStack* textStack;
+@property (nonatomic, assign, getter = isThreadSafe) BOOL threadSafe;
+@property (nonatomic, assign) uint8_t classTag;
 @property (nonatomic, assign) Class objectClass;
 @property (nonatomic, strong) NSString* cellClass;
 @property (nonatomic, strong) NSString* reuseIdentifier;
 
-+ (instancetype) cellConfigurationWithCell:(id)cell
-                                 cellClass:(NSString *)cellClass
-                               objectClass:(Class)objectClass
-                        configurationBlock:(RZCellSizeManagerConfigBlock)configurationBlock;
-+ (instancetype) cellConfigurationWithCell:(id)cell
-                                 cellClass:(NSString *)cellClass
-                               objectClass:(Class)objectClass
-                               heightBlock:(RZCellSizeManagerHeightBlock)heightBlock;
-+ (instancetype) cellConfigurationWithCell:(id)cell
-                                 cellClass:(NSString *)cellClass
-                               objectClass:(Class)objectClass
-                                 sizeBlock:(RZCellSizeManagerSizeBlock)sizeBlock;
++ (instancetype) cellConfigurationWithCellClass:(NSString *)cellClass
+                                        nibName:(NSString *)nibName
+                                    objectClass:(Class)objectClass
+                             configurationBlock:(RZCellSizeManagerConfigBlock)configurationBlock;
++ (instancetype) cellConfigurationWithCellClass:(NSString *)cellClass
+                                        nibName:(NSString *)nibName
+                                    objectClass:(Class)objectClass
+                                    heightBlock:(RZCellSizeManagerHeightBlock)heightBlock;
++ (instancetype) cellConfigurationWithCellClass:(NSString *)cellClass
+                                        nibName:(NSString *)nibName
+                                    objectClass:(Class)objectClass
+                                      sizeBlock:(RZCellSizeManagerSizeBlock)sizeBlock;
+
++ (UINib *)nibNamed:(NSString *)nibName;
+
+- (CGFloat)cellWidth;
+- (id)blockCell;
+- (RZCellSizeConfigurationCounters *)counters;
 @end
 
 @implementation RZCellSizeManagerCellConfiguration
 
-+ (instancetype) cellConfigurationWithCell:(id)cell
-                                 cellClass:(NSString *)cellClass
-                               objectClass:(Class)objectClass
-                        configurationBlock:(RZCellSizeManagerConfigBlock)configurationBlock
++ (instancetype) cellConfigurationWithCellClass:(NSString *)cellClass
+                                        nibName:(NSString *)nibName
+                                    objectClass:(Class)objectClass
+                             configurationBlock:(RZCellSizeManagerConfigBlock)configurationBlock
 {
     RZCellSizeManagerCellConfiguration* config = [RZCellSizeManagerCellConfiguration new];
-    config.cell = cell;
     config.cellClass = cellClass;
+    config.cellNibName = nibName;
     config.objectClass = objectClass;
     config.configurationBlock = configurationBlock;
     return config;
 }
 
-+ (instancetype) cellConfigurationWithCell:(id)cell
-                                 cellClass:(NSString *)cellClass
-                               objectClass:(Class)objectClass
-                               heightBlock:(RZCellSizeManagerHeightBlock)heightBlock;
++ (instancetype) cellConfigurationWithCellClass:(NSString *)cellClass
+                                        nibName:(NSString *)nibName
+                                    objectClass:(Class)objectClass
+                                    heightBlock:(RZCellSizeManagerHeightBlock)heightBlock;
 {
     RZCellSizeManagerCellConfiguration* config = [RZCellSizeManagerCellConfiguration new];
-    config.cell = cell;
     config.cellClass = cellClass;
+    config.cellNibName = nibName;
     config.objectClass = objectClass;
     config.heightBlock = heightBlock;
     return config;
 }
 
-+ (instancetype) cellConfigurationWithCell:(id)cell
-                                 cellClass:(NSString *)cellClass
-                               objectClass:(Class)objectClass
-                                 sizeBlock:(RZCellSizeManagerSizeBlock)sizeBlock
++ (instancetype) cellConfigurationWithCellClass:(NSString *)cellClass
+                                        nibName:(NSString *)nibName
+                                    objectClass:(Class)objectClass
+                                      sizeBlock:(RZCellSizeManagerSizeBlock)sizeBlock
 {
     RZCellSizeManagerCellConfiguration* config = [RZCellSizeManagerCellConfiguration new];
-    config.cell = cell;
     config.cellClass = cellClass;
+    config.cellNibName = nibName;
     config.objectClass = objectClass;
     config.sizeBlock = sizeBlock;
     return config;
 }
 
+/**
+ * Nibs are shared by every manager in the process, so registering the same cell class with several managers,
+ *  or with one manager again, only reads the nib from disk once.  A missing nib is remembered as NSNull.
+ **/
++ (UINib *)nibNamed:(NSString *)nibName
+{
+    static NSCache* s_nibs = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        s_nibs = [[NSCache alloc] init];
+    });
+    
+    id nib = [s_nibs objectForKey:nibName];
+    if (nib == nil)
+    {
+        BOOL nibExists = ([[NSBundle mainBundle] pathForResource:nibName ofType:@"nib"] != nil);
+        nib = nibExists ? [UINib nibWithNibName:nibName bundle:nil] : [NSNull null];
+        [s_nibs setObject:nib forKey:nibName];
+    }
+    return (nib != [NSNull null]) ? nib : nil;
+}
+
+/**
+ * The prototype cell is created the first time a size is measured rather than when the class is registered,
+ *  so classes that are registered but never shown cost nothing.
+ * The cell is created from a nib that shares the same name as the class passed in.
+ *  If there is none it will then just allocate an instance using the default init.
+ **/
+- (id)cell
+{
+    if (_cell == nil)
+    {
+        uint64_t startTime = RZCellSizeStatisticsNow();
+        
+        UINib* nib = [[self class] nibNamed:(self.cellNibName ?: self.cellClass)];
+        
+        // Try and instantiate the cell from the nib.  If not we shall just call init on it.
+        if ( nib ) {
+            _cell = [[nib instantiateWithOwner:nil options:nil] objectAtIndex:0];
+        }
+        else {
+            // There is a chance that we want to just create it with init.
+            _cell = [[NSClassFromString(self.cellClass) alloc] init];
+        }
+        NSAssert(_cell != nil, @"Cell not created successfully.  Make sure there is a cell with your class name in your project:%@", self.cellClass);
+        
+        [_cell moveConstraintsToContentView];
+        [self applyOverideWidth];
+        
+        _counters.prototypeNanoseconds = RZCellSizeStatisticsNow() - startTime;
+    }
+    return _cell;
+}
+
+- (void)setOverideWidth:(CGFloat)overideWidth
+{
+    _overideWidth = overideWidth;
+    [self applyOverideWidth];
+}
+
+/**
+ * Resizes the prototype cell to the overide width, if the cell has been loaded and there is one.
+ **/
+- (void)applyOverideWidth
+{
+    if (_cell != nil && self.overideWidth != 0)
+    {
+        CGRect overideFrame = [_cell frame];
+        overideFrame.size.width = self.overideWidth;
+        [_cell setFrame:overideFrame];
+        [_cell setNeedsLayout];
+        [_cell layoutIfNeeded];
+    }
+}
+
+/**
+ * The width sizes are measured at.  This does not load the prototype cell when there is an overide width.
+ **/
+- (CGFloat)cellWidth
+{
+    return (self.overideWidth != 0) ? self.overideWidth : CGRectGetWidth([self.cell bounds]);
+}
+
+/**
+ * The cell passed to the height and size blocks.  Thread safe blocks are passed nil, so they never load the prototype.
+ **/
+- (id)blockCell
+{
+    return self.isThreadSafe ? nil : self.cell;
+}
+
+- (RZCellSizeConfigurationCounters *)counters
+{
+    return &_counters;
+}
+
 @end
 
 
@@ -165,11 +291,27 @@
 @interface RZCellSizeManager ()
 
 @property (nonatomic, strong) NSMutableDictionary* cellConfigurations;
+@property (nonatomic, strong) NSMutableArray* orderedCellConfigurations;
+@property (nonatomic, strong) NSMutableDictionary* configurationsByReuseIdentifier;
+@property (nonatomic, strong) NSMutableDictionary* configurationsByObjectClass;
+@property (nonatomic, strong) NSMutableDictionary* resolvedConfigurationsByClass;
+@property (nonatomic, strong) NSMutableDictionary* classTagsByCellClass;
+@property (nonatomic, strong) RZCellSizeManagerCellConfiguration* fallbackConfiguration;
 @property (nonatomic, strong) id offScreenCell;
 @property (nonatomic, strong) NSString* cellClassName;
 @property (nonatomic, strong) NSString* cellNibName;
-@property (nonatomic, strong) NSCache* cellSizeCache;
+@property (nonatomic, strong) RZCellSizeCache* cellSizeCache;
+@property (atomic, strong) RZCellSizeCache* readableCellSizeCache;
+@property (nonatomic, strong) NSMutableDictionary* cellSizeCachesByWidth;
+@property (nonatomic, strong) NSMutableArray* cachedWidths;
+@property (nonatomic, strong) RZCellSizeCacheUpdates* pendingUpdates;
+@property (nonatomic, assign) NSUInteger updatesNestingLevel;
+@property (nonatomic, assign) NSUInteger contentKeyedConfigurationCount;
+@property (nonatomic, strong) RZCellSizePrecomputeQueue* precomputeQueue;
 
+@property (nonatomic, assign) NSUInteger sizesDroppedByCacheInvalidation;
+@property (nonatomic, assign) NSUInteger sizesDroppedByIndexPathInvalidation;
+@property (nonatomic, assign) NSUInteger sizesDroppedByStructuralChanges;
 
 @property (nonatomic, assign) BOOL isUsingObjectTypesForLookup;
 
@@ -185,35 +327,161 @@
 
 /**
  * A common init function
- * Initializes the cellConfigurations dictionary and the cellSizeCache.
+ * Initializes the cellConfigurations dictionary and the cellSizeCache for the default width.
+ * The cache is not purged by the system like an NSCache so we drop it ourselves on a memory warning.
  **/
 - (instancetype)init
 {
     self = [super init];
     if ( self ) {
         _cellConfigurations = [NSMutableDictionary dictionary];
-        _cellSizeCache = [[NSCache alloc] init];
+        _orderedCellConfigurations = [NSMutableArray array];
+        _configurationsByReuseIdentifier = [NSMutableDictionary dictionary];
+        _configurationsByObjectClass = [NSMutableDictionary dictionary];
+        _resolvedConfigurationsByClass = [NSMutableDictionary dictionary];
+        _classTagsByCellClass = [NSMutableDictionary dictionary];
+        _cellSizeCache = [[RZCellSizeCache alloc] init];
+        _cellSizeCache.estimatedHeight = kRZCellSizeManagerDefaultEstimatedCellHeight;
+        _readableCellSizeCache = _cellSizeCache;
+        _cellSizeCachesByWidth = [NSMutableDictionary dictionaryWithObject:_cellSizeCache forKey:@(_overideWidth)];
+        _cachedWidths = [NSMutableArray arrayWithObject:@(_overideWidth)];
+        _maximumNumberOfCachedWidths = kRZCellSizeManagerDefaultMaximumNumberOfCachedWidths;
         _cellHeightPadding = kRZCellSizeManagerDefaultCellHeightPadding;
+        [[NSNotificationCenter defaultCenter] addObserver:self
+                                                 selector:@selector(didReceiveMemoryWarning:)
+                                                     name:UIApplicationDidReceiveMemoryWarningNotification
+                                                   object:nil];
+        [[NSNotificationCenter defaultCenter] addObserver:self
+                                                 selector:@selector(didEnterBackground:)
+                                                     name:UIApplicationDidEnterBackgroundNotification
+                                                   object:nil];
     }
     return self;
 }
 
+- (void)dealloc
+{
+    [[NSNotificationCenter defaultCenter] removeObserver:self];
+    [_precomputeQueue cancelAllCells];
+}
+
+/**
+ * The precompute queue is only created once it is needed.
+ **/
+- (RZCellSizePrecomputeQueue *)precomputeQueue
+{
+    if (_precomputeQueue == nil)
+    {
+        _precomputeQueue = [[RZCellSizePrecomputeQueue alloc] initWithClockBlock:nil];
+    }
+    return _precomputeQueue;
+}
+
++ (NSString *)defaultDiskCacheSalt
+{
+    NSDictionary* info = [[NSBundle mainBundle] infoDictionary];
+    return [NSString stringWithFormat:@"%@-%@-%@",
+            [info objectForKey:@"CFBundleShortVersionString"],
+            [info objectForKey:(NSString *)kCFBundleVersionKey],
+            [[UIApplication sharedApplication] preferredContentSizeCategory]];
+}
+
 #pragma mark - Custom Setters
 
+- (CGFloat)estimatedCellHeight
+{
+    return self.cellSizeCache.estimatedHeight;
+}
+
+- (void)setEstimatedCellHeight:(CGFloat)estimatedCellHeight
+{
+    for (RZCellSizeCache* cache in [self.cellSizeCachesByWidth allValues])
+    {
+        cache.estimatedHeight = estimatedCellHeight;
+    }
+}
+
+- (void)setMaximumNumberOfCachedWidths:(NSUInteger)maximumNumberOfCachedWidths
+{
+    _maximumNumberOfCachedWidths = MAX(maximumNumberOfCachedWidths, 1);
+    [self evictCachedWidths];
+}
+
+- (void)setCellSizeCacheByteBudget:(NSUInteger)cellSizeCacheByteBudget
+{
+    _cellSizeCacheByteBudget = cellSizeCacheByteBudget;
+    for (RZCellSizeCache* cache in [self.cellSizeCachesByWidth allValues])
+    {
+        cache.byteBudget = cellSizeCacheByteBudget;
+        if (cellSizeCacheByteBudget > 0)
+        {
+            [cache trimToByteCount:cellSizeCacheByteBudget];
+        }
+    }
+}
+
+- (void)setVisibleIndexPath:(NSIndexPath *)visibleIndexPath
+{
+    _visibleIndexPath = visibleIndexPath;
+    NSUInteger row = visibleIndexPath ? visibleIndexPath.row : NSNotFound;
+    NSUInteger section = visibleIndexPath ? visibleIndexPath.section : NSNotFound;
+    [self.traceRecorder recordEvent:RZCellSizeTraceEventFocusChange row:row inSection:section];
+    for (RZCellSizeCache* cache in [self.cellSizeCachesByWidth allValues])
+    {
+        [cache setFocusRow:row inSection:section];
+    }
+}
+
+- (NSUInteger)cellSizeCacheByteCount
+{
+    NSUInteger byteCount = 0;
+    for (RZCellSizeCache* cache in [self.cellSizeCachesByWidth allValues])
+    {
+        byteCount += cache.byteCount;
+    }
+    return byteCount;
+}
+
+- (double)cellSizeCacheBytesPerSize
+{
+    NSUInteger count = 0;
+    for (RZCellSizeCache* cache in [self.cellSizeCachesByWidth allValues])
+    {
+        count += cache.countOfSizes;
+    }
+    return (count > 0) ? (double)self.cellSizeCacheByteCount / count : 0.0;
+}
+
+- (NSTimeInterval)precomputeTimeBudget
+{
+    return self.precomputeQueue.timeBudget;
+}
+
+- (void)setPrecomputeTimeBudget:(NSTimeInterval)precomputeTimeBudget
+{
+    self.precomputeQueue.timeBudget = precomputeTimeBudget;
+}
+
+- (NSIndexPath *)precomputeFocusIndexPath
+{
+    return self.precomputeQueue.focusIndexPath;
+}
+
+- (void)setPrecomputeFocusIndexPath:(NSIndexPath *)precomputeFocusIndexPath
+{
+    self.precomputeQueue.focusIndexPath = precomputeFocusIndexPath;
+}
+
 - (void)setOverideWidth:(CGFloat)overideWidth
 {
     if (overideWidth != _overideWidth)
     {
         _overideWidth = overideWidth;
+        [self.traceRecorder recordWidthChange:overideWidth];
         [self.cellConfigurations enumerateKeysAndObjectsUsingBlock:^(id key, RZCellSizeManagerCellConfiguration *obj, BOOL *stop) {
-            id cell = obj.cell;
-            CGRect overideFrame = [cell frame];
-            overideFrame.size.width = overideWidth;
-            [cell setFrame:overideFrame];
-            [cell setNeedsLayout];
-            [cell layoutIfNeeded];
+            obj.overideWidth = overideWidth;
         }];
-        [self invalidateCellSizeCache];
+        [self activateCellSizeCacheForWidth:overideWidth];
     }
 }
 
@@ -228,13 +496,11 @@
     NSParameterAssert(cellClass);
     NSParameterAssert(configurationBlock);
     
-    id cell = [self configureOffScreenCellWithCellClassName:cellClass nibName:nibNameOrNil];
-    
-    RZCellSizeManagerCellConfiguration* configuration = [RZCellSizeManagerCellConfiguration cellConfigurationWithCell:cell
-                                                                                                            cellClass:cellClass
-                                                                                                          objectClass:objectClass
-                                                                                                   configurationBlock:configurationBlock];
-    [self.cellConfigurations setObject:configuration forKey:cellClass];
+    RZCellSizeManagerCellConfiguration* configuration = [RZCellSizeManagerCellConfiguration cellConfigurationWithCellClass:cellClass
+                                                                                                                   nibName:nibNameOrNil
+                                                                                                               objectClass:objectClass
+                                                                                                        configurationBlock:configurationBlock];
+    [self addConfiguration:configuration];
 }
 
 - (void)registerCellClassName:(NSString *)cellClass
@@ -245,14 +511,12 @@
     NSParameterAssert(cellClass);
     NSParameterAssert(configurationBlock);
     
-    id cell = [self configureOffScreenCellWithCellClassName:cellClass nibName:nibNameOrNil];
-    
-    RZCellSizeManagerCellConfiguration* configuration = [RZCellSizeManagerCellConfiguration cellConfigurationWithCell:cell
-                                                                                                            cellClass:cellClass
-                                                                                                          objectClass:nil
-                                                                                                   configurationBlock:configurationBlock];
+    RZCellSizeManagerCellConfiguration* configuration = [RZCellSizeManagerCellConfiguration cellConfigurationWithCellClass:cellClass
+                                                                                                                   nibName:nibNameOrNil
+                                                                                                               objectClass:nil
+                                                                                                        configurationBlock:configurationBlock];
     configuration.reuseIdentifier = reuseIdentifier;
-    [self.cellConfigurations setObject:configuration forKey:cellClass];
+    [self addConfiguration:configuration];
 }
 
 
@@ -264,12 +528,11 @@
     NSParameterAssert(cellClass);
     NSParameterAssert(heightBlock);
     
-    id cell = [self configureOffScreenCellWithCellClassName:cellClass nibName:nibNameOrNil];
-    RZCellSizeManagerCellConfiguration* configuration = [RZCellSizeManagerCellConfiguration cellConfigurationWithCell:cell
-                                                                                                            cellClass:cellClass
-                                                                                                          objectClass:objectClass
-                                                                                                            heightBlock:heightBlock];
-    [self.cellConfigurations setObject:configuration forKey:cellClass];
+    RZCellSizeManagerCellConfiguration* configuration = [RZCellSizeManagerCellConfiguration cellConfigurationWithCellClass:cellClass
+                                                                                                                   nibName:nibNameOrNil
+                                                                                                               objectClass:objectClass
+                                                                                                               heightBlock:heightBlock];
+    [self addConfiguration:configuration];
 }
 
 - (void)registerCellClassName:(NSString *)cellClass
@@ -280,13 +543,12 @@
     NSParameterAssert(cellClass);
     NSParameterAssert(heightBlock);
     
-    id cell = [self configureOffScreenCellWithCellClassName:cellClass nibName:nibNameOrNil];
-    RZCellSizeManagerCellConfiguration* configuration = [RZCellSizeManagerCellConfiguration cellConfigurationWithCell:cell
-                                                                                                            cellClass:cellClass
-                                                                                                          objectClass:nil
-                                                                                                            heightBlock:heightBlock];
+    RZCellSizeManagerCellConfiguration* configuration = [RZCellSizeManagerCellConfiguration cellConfigurationWithCellClass:cellClass
+                                                                                                                   nibName:nibNameOrNil
+                                                                                                               objectClass:nil
+                                                                                                               heightBlock:heightBlock];
     configuration.reuseIdentifier = reuseIdentifier;
-    [self.cellConfigurations setObject:configuration forKey:cellClass];
+    [self addConfiguration:configuration];
 }
 
 - (void)registerCellClassName:(NSString *)cellClass
@@ -297,12 +559,11 @@
     NSParameterAssert(cellClass);
     NSParameterAssert(sizeBlock);
     
-    id cell = [self configureOffScreenCellWithCellClassName:cellClass nibName:nibNameOrNil];
-    RZCellSizeManagerCellConfiguration* configuration = [RZCellSizeManagerCellConfiguration cellConfigurationWithCell:cell
-                                                                                                            cellClass:cellClass
-                                                                                                          objectClass:objectClass
-                                                                                                            sizeBlock:sizeBlock];
-    [self.cellConfigurations setObject:configuration forKey:cellClass];
+    RZCellSizeManagerCellConfiguration* configuration = [RZCellSizeManagerCellConfiguration cellConfigurationWithCellClass:cellClass
+                                                                                                                   nibName:nibNameOrNil
+                                                                                                               objectClass:objectClass
+                                                                                                                 sizeBlock:sizeBlock];
+    [self addConfiguration:configuration];
 }
 
 - (void)registerCellClassName:(NSString *)cellClass
@@ -313,218 +574,1312 @@
     NSParameterAssert(cellClass);
     NSParameterAssert(sizeBlock);
     
-    id cell = [self configureOffScreenCellWithCellClassName:cellClass nibName:nibNameOrNil];
-    RZCellSizeManagerCellConfiguration* configuration = [RZCellSizeManagerCellConfiguration cellConfigurationWithCell:cell
-                                                                                                            cellClass:cellClass
-                                                                                                          objectClass:nil
-                                                                                                            sizeBlock:sizeBlock];
+    RZCellSizeManagerCellConfiguration* configuration = [RZCellSizeManagerCellConfiguration cellConfigurationWithCellClass:cellClass
+                                                                                                                   nibName:nibNameOrNil
+                                                                                                               objectClass:nil
+                                                                                                                 sizeBlock:sizeBlock];
     configuration.reuseIdentifier = reuseIdentifier;
-    [self.cellConfigurations setObject:configuration forKey:cellClass];
+    [self addConfiguration:configuration];
 }
 
-#pragma mark - Other Public Methods
-
-- (void)invalidateCellSizeCache
+- (void)setContentKeyBlock:(RZCellSizeManagerContentKeyBlock)contentKeyBlock forCellClassName:(NSString *)cellClass
 {
-    [self.cellSizeCache removeAllObjects];
+    NSParameterAssert(cellClass);
+    
+    RZCellSizeManagerCellConfiguration* configuration = [self.cellConfigurations objectForKey:cellClass];
+    NSAssert(configuration != nil, @"Cell class %@ must be registered before setting a content key block", cellClass);
+    
+    configuration.contentKeyBlock = contentKeyBlock;
+    [self updateContentKeyedConfigurationCount];
 }
 
-- (void)invalidateCellSizeAtIndexPath:(NSIndexPath *)indexPath
+- (void)setLayoutSignatureBlock:(RZCellSizeManagerLayoutSignatureBlock)layoutSignatureBlock forCellClassName:(NSString *)cellClass
 {
-    NSParameterAssert(indexPath);
-    [self.cellSizeCache removeObjectForKey:indexPath];
+    NSParameterAssert(cellClass);
+    
+    RZCellSizeManagerCellConfiguration* configuration = [self.cellConfigurations objectForKey:cellClass];
+    NSAssert(configuration != nil, @"Cell class %@ must be registered before setting a layout signature block", cellClass);
+    
+    configuration.layoutSignatureBlock = layoutSignatureBlock;
+    for (RZCellSizeCache* cache in [self.cellSizeCachesByWidth allValues])
+    {
+        [cache removeLayoutSignatureSizesForCellClassName:cellClass];
+    }
 }
 
-- (void)invalidateCellSizesAtIndexPaths:(NSArray *)indexPaths
+- (void)setThreadSafe:(BOOL)threadSafe forCellClassName:(NSString *)cellClass
 {
-    NSParameterAssert(indexPaths);
-    [indexPaths enumerateObjectsUsingBlock:^(NSIndexPath* obj, NSUInteger idx, BOOL *stop) {
-        [self.cellSizeCache removeObjectForKey:obj];
-    }];
+    NSParameterAssert(cellClass);
+    
+    RZCellSizeManagerCellConfiguration* configuration = [self.cellConfigurations objectForKey:cellClass];
+    NSAssert(configuration != nil, @"Cell class %@ must be registered before setting it thread safe", cellClass);
+    NSAssert(!threadSafe || configuration.heightBlock || configuration.sizeBlock, @"Only height and size block registrations can be thread safe");
+    
+    configuration.threadSafe = threadSafe;
 }
 
-- (CGFloat)cellHeightForObject:(id)object indexPath:(NSIndexPath *)indexPath
+- (void)setEstimationFeatureBlock:(RZCellSizeManagerEstimationFeatureBlock)featureBlock forCellClassName:(NSString *)cellClass
 {
-    return [self cellHeightForObject:object indexPath:indexPath cellReuseIdentifier:nil];
+    NSParameterAssert(cellClass);
+    
+    RZCellSizeManagerCellConfiguration* configuration = [self.cellConfigurations objectForKey:cellClass];
+    NSAssert(configuration != nil, @"Cell class %@ must be registered before setting an estimation feature block", cellClass);
+    
+    // Heights learned without the feature say nothing about how it relates to them.
+    configuration.estimationFeatureBlock = featureBlock;
+    [configuration.estimator reset];
 }
 
-- (CGFloat)cellHeightForObject:(id)object indexPath:(NSIndexPath *)indexPath cellReuseIdentifier:(NSString *)reuseIdentifier
+- (void)setTextStack:(RZCellSizeTextStack *)textStack forCellClassName:(NSString *)cellClass
 {
-    NSParameterAssert(indexPath);
+    NSParameterAssert(cellClass);
+    
+    RZCellSizeManagerCellConfiguration* configuration = [self.cellConfigurations objectForKey:cellClass];
+    NSAssert(configuration != nil, @"Cell class %@ must be registered before setting a text stack", cellClass);
+    
+    configuration.textStack = textStack;
+}
 
-    NSNumber * height = [self.cellSizeCache objectForKey:indexPath];
-    if (height == nil)
-    {
-        RZCellSizeManagerCellConfiguration* configuration = [self configurationForObject:object reuseIdentifier:reuseIdentifier];
-        
-        height = [self cellHeightForObject:object configuration:configuration];
-        
-        if (height)
++ (RZCellSizeCharacterMetrics *)characterMetricsForFont:(UIFont *)font
+{
+    NSParameterAssert(font);
+    
+    // Thread safe height blocks may ask for metrics from the workers of computeCellSizesForObjects:.
+    static NSMutableDictionary* s_metricsByFont = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        s_metricsByFont = [NSMutableDictionary dictionary];
+    });
+    
+    @synchronized(s_metricsByFont) {
+        RZCellSizeCharacterMetrics* metrics = [s_metricsByFont objectForKey:font];
+        if (metrics == nil)
         {
-            [self.cellSizeCache setObject:height forKey:indexPath];
+            NSDictionary* attributes = @{ NSFontAttributeName : font };
+            metrics = [[RZCellSizeCharacterMetrics alloc] initWithLineHeight:font.lineHeight advanceBlock:^CGFloat(unichar character) {
+                return [[NSString stringWithCharacters:&character length:1] sizeWithAttributes:attributes].width;
+            } sequenceAdvanceBlock:^CGFloat(NSString *sequence) {
+                return [sequence sizeWithAttributes:attributes].width;
+            }];
+            [s_metricsByFont setObject:metrics forKey:font];
         }
+        return metrics;
     }
-    return [height floatValue];
 }
 
-- (CGSize)cellSizeForObject:(id)object indexPath:(NSIndexPath *)indexPath
+#pragma mark - Other Public Methods
+
+- (void)invalidateCellSizeCache
 {
-    return [self cellSizeForObject:object indexPath:indexPath cellReuseIdentifier:nil];
+    [self.traceRecorder recordEvent:RZCellSizeTraceEventInvalidateAll row:0 inSection:0];
+    if (self.collectsStatistics)
+    {
+        self.sizesDroppedByCacheInvalidation += self.cellSizeCache.countOfValidSizes;
+    }
+    for (RZCellSizeCache* cache in [self.cellSizeCachesByWidth allValues])
+    {
+        [cache invalidateAllSizes];
+    }
 }
 
-- (CGSize)cellSizeForObject:(id)object indexPath:(NSIndexPath *)indexPath cellReuseIdentifier:(NSString *)reuseIdentifier
+- (void)invalidateCellSizesInSection:(NSInteger)section
 {
-    NSParameterAssert(indexPath);
+    [self.traceRecorder recordEvent:RZCellSizeTraceEventInvalidateSection row:0 inSection:section];
+    if (self.pendingUpdates)
+    {
+        [self.pendingUpdates.invalidatedSections addIndex:section];
+        return;
+    }
+    for (RZCellSizeCache* cache in [self.cellSizeCachesByWidth allValues])
+    {
+        [cache invalidateSizesInSection:section];
+    }
+}
+
+- (void)invalidateCellSizesForCellClassName:(NSString *)cellClass
+{
+    NSParameterAssert(cellClass);
     
-    id obj = [self.cellSizeCache objectForKey:indexPath];
-    CGSize size = CGSizeZero;
-    if (obj == nil)
+    RZCellSizeManagerCellConfiguration* configuration = [self.cellConfigurations objectForKey:cellClass];
+    NSAssert(configuration != nil, @"Cell class %@ must be registered before invalidating its sizes", cellClass);
+    
+    [self.traceRecorder recordEvent:RZCellSizeTraceEventInvalidateClass classTag:configuration.classTag];
+    for (RZCellSizeCache* cache in [self.cellSizeCachesByWidth allValues])
     {
-        RZCellSizeManagerCellConfiguration* configuration = [self configurationForObject:object reuseIdentifier:reuseIdentifier];
-        
-        BOOL validSize = NO;
-        if (configuration)
-        {
-            if (configuration.configurationBlock)
-            {
-                [configuration.cell prepareForReuse];
-                configuration.configurationBlock(configuration.cell, object);
-                UIView* contentView = [configuration.cell contentView];
-                size = [contentView systemLayoutSizeFittingSize:UILayoutFittingCompressedSize];
-                validSize = YES;
-                
-            }
-            else if (configuration.sizeBlock)
-            {
-                size = configuration.sizeBlock(configuration.cell, object);
-                validSize = YES;
-                
-            }
-            
-        }
-        
-        
-        if (validSize)
-        {
-            [self.cellSizeCache setObject:[NSValue valueWithCGSize:size] forKey:indexPath];
-        }
-        
+        [cache invalidateSizesWithClassTag:configuration.classTag];
+        [cache removeContentKeyedSizesForCellClassName:cellClass];
+        [cache removeLayoutSignatureSizesForCellClassName:cellClass];
     }
-    else
+    [configuration.estimator reset];
+}
+
+- (CGFloat)estimatedCellHeightForIndexPath:(NSIndexPath *)indexPath
+{
+    CGSize size;
+    if ([self.cellSizeCache getEstimatedSize:&size forRow:indexPath.row inSection:indexPath.section])
     {
-        // Hopefully we have an NSValue object that has a CGSize value
-        if ([obj isKindOfClass:[NSValue class]])
-        {
-            size = [obj CGSizeValue];
-        }
+        return size.height;
     }
-    return size;
+    return self.estimatedCellHeight;
 }
 
-#pragma mark - Private Methods
+- (CGFloat)estimatedCellHeightForObject:(id)object indexPath:(NSIndexPath *)indexPath
+{
+    return [self estimatedCellHeightForObject:object indexPath:indexPath cellReuseIdentifier:nil];
+}
 
-/**
- * Creates a cell to be stored offscreen to use for AutoLayout.
- * The cell is initially created from a nib that shares the same name as the class passed in.
- *  It will then just allocate an instance using the default init.
- **/
-- (id)configureOffScreenCellWithCellClassName:(NSString *)className nibName:(NSString *)nibNameOrNil
+- (CGFloat)estimatedCellHeightForObject:(id)object indexPath:(NSIndexPath *)indexPath cellReuseIdentifier:(NSString *)reuseIdentifier
 {
-    if ([self.cellConfigurations objectForKey:className])
+    NSParameterAssert(indexPath);
+    
+    CGSize size;
+    if ([self.cellSizeCache getEstimatedSize:&size forRow:indexPath.row inSection:indexPath.section])
     {
-        [self.cellConfigurations removeObjectForKey:className];
+        return size.height;
     }
     
-    //Configure the static cell
-    id cell = nil;
-    if (className)
+    RZCellSizeManagerCellConfiguration* configuration = [self configurationForObject:object reuseIdentifier:reuseIdentifier];
+    RZCellSizeEstimator* estimator = configuration.estimator;
+    if (estimator.count == 0)
     {
-        NSString *nibName = nibNameOrNil != nil ? nibNameOrNil : className;
-        BOOL nibExists = ([[NSBundle mainBundle] pathForResource:nibName ofType:@"nib"] != nil);
-        UINib *nib = [UINib nibWithNibName:nibName bundle:nil];
-        
-        // Try and instantiate the cell from the nib.  If not we shall just call init on it.
-        if ( nibExists ) {
-            cell = [[nib instantiateWithOwner:nil options:nil] objectAtIndex:0];
-        }
-        else {
-            // There is a chance that we want to just create it with init.
-            cell = [[NSClassFromString(className) alloc] init];
-        }
+        return self.estimatedCellHeight;
+    }
+    double feature = configuration.estimationFeatureBlock ? configuration.estimationFeatureBlock(object) : 0.0;
+    return [estimator estimatedHeightForFeature:feature];
+}
 
-        [cell moveConstraintsToContentView];
+- (void)invalidateContentKeyedCellSizeCache
+{
+    [self.traceRecorder recordEvent:RZCellSizeTraceEventInvalidateContentKeyed row:0 inSection:0];
+    if (self.collectsStatistics)
+    {
+        self.sizesDroppedByCacheInvalidation += self.cellSizeCache.countOfContentKeyedSizes;
     }
-    
-    
-    if (self.overideWidth != 0)
+    for (RZCellSizeCache* cache in [self.cellSizeCachesByWidth allValues])
     {
-        CGRect overideFrame = [cell frame];
-        overideFrame.size.width = self.overideWidth;
-        [cell setFrame:overideFrame];
-        [cell setNeedsLayout];
-        [cell layoutIfNeeded];
+        [cache removeAllContentKeyedSizes];
     }
-    
-    NSAssert(cell != nil, @"Cell not created successfully.  Make sure there is a cell with your class name in your project:%@",className);
-    return cell;
+    [self.diskCache removeAllSizes];
 }
 
-/** 
- * returns the configuration object that is associated with either the object or the reuseIdentifier
- * This will first check to see if we are sending in a reuseIdentifier.  If we do, it will not try and
- *  object match, otherwise it will see if we have an object class regiserted to match the object.
- **/
-- (RZCellSizeManagerCellConfiguration *)configurationForObject:(id)object reuseIdentifier:(NSString *)reuseIdentifier
+- (void)invalidateCellSizeAtIndexPath:(NSIndexPath *)indexPath
 {
-    __block RZCellSizeManagerCellConfiguration* configuration = nil;
-    if (reuseIdentifier)
+    NSParameterAssert(indexPath);
+    [self invalidateCellSizesAtIndexPaths:@[indexPath]];
+}
+
+- (void)invalidateCellSizesAtIndexPaths:(NSArray *)indexPaths
+{
+    NSParameterAssert(indexPaths);
+    [self recordEvent:RZCellSizeTraceEventInvalidateRow forIndexPaths:indexPaths];
+    if (self.pendingUpdates)
     {
-        [self.cellConfigurations enumerateKeysAndObjectsUsingBlock:^(id key, RZCellSizeManagerCellConfiguration* obj, BOOL *stop) {
-            if ([reuseIdentifier isEqualToString:obj.reuseIdentifier])
-            {
-                configuration = obj;
-                *stop = YES;
-            }
-        }];
+        [self.pendingUpdates.invalidatedIndexPaths addObjectsFromArray:indexPaths];
+        return;
     }
-    else
+    for (RZCellSizeCache* cache in [self.cellSizeCachesByWidth allValues])
     {
-        [self.cellConfigurations enumerateKeysAndObjectsUsingBlock:^(id key, RZCellSizeManagerCellConfiguration* obj, BOOL *stop) {
-            if ([object isKindOfClass:obj.objectClass])
+        for (NSIndexPath* indexPath in indexPaths)
+        {
+            BOOL invalidated = [cache invalidateSizeForRow:indexPath.row inSection:indexPath.section];
+            if (invalidated && cache == self.cellSizeCache && self.collectsStatistics)
             {
-                configuration = obj;
-                *stop = YES;
+                self.sizesDroppedByIndexPathInvalidation++;
             }
-        }];
+        }
     }
-    
-    if (!configuration)
+}
+
+- (void)insertCellSizesAtIndexPaths:(NSArray *)indexPaths
+{
+    NSParameterAssert(indexPaths);
+    [self recordEvent:RZCellSizeTraceEventInsertRow forIndexPaths:indexPaths];
+    if (self.pendingUpdates)
     {
-        configuration = [[self.cellConfigurations allValues] firstObject];
+        [self.pendingUpdates.insertedIndexPaths addObjectsFromArray:indexPaths];
+        return;
+    }
+    NSDictionary* rowsBySection = [RZCellSizeCacheUpdates rowsBySectionForIndexPaths:indexPaths];
+    for (RZCellSizeCache* cache in [self.cellSizeCachesByWidth allValues])
+    {
+        [rowsBySection enumerateKeysAndObjectsUsingBlock:^(NSNumber* section, NSIndexSet* rows, BOOL *stop) {
+            [cache insertRowsAtIndexes:rows inSection:[section unsignedIntegerValue]];
+        }];
     }
-    
-    return configuration;
-
 }
 
-- (NSNumber *)cellHeightForObject:(id)object configuration:(RZCellSizeManagerCellConfiguration *)configuration
+- (void)deleteCellSizesAtIndexPaths:(NSArray *)indexPaths
 {
-    NSNumber* height = nil;
-    if (configuration)
+    NSParameterAssert(indexPaths);
+    [self recordEvent:RZCellSizeTraceEventDeleteRow forIndexPaths:indexPaths];
+    if (self.pendingUpdates)
     {
-        if (configuration.configurationBlock)
-        {
-            [configuration.cell prepareForReuse];
+        [self.pendingUpdates.deletedIndexPaths addObjectsFromArray:indexPaths];
+        return;
+    }
+    NSUInteger countBefore = self.collectsStatistics ? self.cellSizeCache.countOfValidSizes : 0;
+    NSDictionary* rowsBySection = [RZCellSizeCacheUpdates rowsBySectionForIndexPaths:indexPaths];
+    for (RZCellSizeCache* cache in [self.cellSizeCachesByWidth allValues])
+    {
+        [rowsBySection enumerateKeysAndObjectsUsingBlock:^(NSNumber* section, NSIndexSet* rows, BOOL *stop) {
+            [cache deleteRowsAtIndexes:rows inSection:[section unsignedIntegerValue]];
+        }];
+    }
+    [self recordSizesDroppedByStructuralChangeFromCount:countBefore];
+}
+
+- (void)moveCellSizeAtIndexPath:(NSIndexPath *)indexPath toIndexPath:(NSIndexPath *)newIndexPath
+{
+    NSParameterAssert(indexPath);
+    NSParameterAssert(newIndexPath);
+    [self.traceRecorder recordMoveOfRow:indexPath.row inSection:indexPath.section toRow:newIndexPath.row inSection:newIndexPath.section];
+    if (self.pendingUpdates)
+    {
+        [self.pendingUpdates.movedFromIndexPaths addObject:indexPath];
+        [self.pendingUpdates.movedToIndexPaths addObject:newIndexPath];
+        return;
+    }
+    for (RZCellSizeCache* cache in [self.cellSizeCachesByWidth allValues])
+    {
+        [cache moveRow:indexPath.row inSection:indexPath.section toRow:newIndexPath.row inSection:newIndexPath.section];
+    }
+}
+
+- (void)moveCellSizeAtIndexPath:(NSIndexPath *)indexPath toIndexPath:(NSIndexPath *)newIndexPath invalidate:(BOOL)invalidate
+{
+    // A batch applies invalidations before moves, in old index paths, so the row is invalidated where it starts.
+    if (invalidate && self.pendingUpdates)
+    {
+        [self invalidateCellSizeAtIndexPath:indexPath];
+    }
+    [self moveCellSizeAtIndexPath:indexPath toIndexPath:newIndexPath];
+    if (invalidate && !self.pendingUpdates)
+    {
+        [self invalidateCellSizeAtIndexPath:newIndexPath];
+    }
+}
+
+- (RZCellSizeArrayDiff *)migrateCellSizesInSection:(NSInteger)section fromIdentities:(NSArray *)oldIdentities toIdentities:(NSArray *)newIdentities
+{
+    NSParameterAssert(oldIdentities);
+    NSParameterAssert(newIdentities);
+    NSAssert(self.pendingUpdates == nil, @"Cell sizes can not be migrated during a batch of updates");
+    
+    RZCellSizeArrayDiff* diff = [[RZCellSizeArrayDiff alloc] initWithOldIdentities:oldIdentities newIdentities:newIdentities];
+    RZCellSizeTraceRecorder* recorder = self.traceRecorder;
+    if (recorder)
+    {
+        // Recorded as a batch, which a replay applies with the same result as the migration.  Matched objects that
+        // are not moved keep their order, so they only shift with the deletions and insertions.
+        [recorder recordEvent:RZCellSizeTraceEventBeginUpdates row:0 inSection:0];
+        [diff.deletedIndexes enumerateIndexesUsingBlock:^(NSUInteger row, BOOL *stop) {
+            [recorder recordEvent:RZCellSizeTraceEventDeleteRow row:row inSection:section];
+        }];
+        [diff.insertedIndexes enumerateIndexesUsingBlock:^(NSUInteger row, BOOL *stop) {
+            [recorder recordEvent:RZCellSizeTraceEventInsertRow row:row inSection:section];
+        }];
+        [diff.movedIndexes enumerateIndexesUsingBlock:^(NSUInteger row, BOOL *stop) {
+            [recorder recordMoveOfRow:[diff oldIndexForNewIndex:row] inSection:section toRow:row inSection:section];
+        }];
+        [recorder recordEvent:RZCellSizeTraceEventEndUpdates row:0 inSection:0];
+    }
+    
+    NSUInteger countBefore = self.collectsStatistics ? self.cellSizeCache.countOfValidSizes : 0;
+    for (RZCellSizeCache* cache in [self.cellSizeCachesByWidth allValues])
+    {
+        [cache moveRowsInSection:section fromOldRows:diff.oldIndexes count:diff.newCount];
+    }
+    [self recordSizesDroppedByStructuralChangeFromCount:countBefore];
+    return diff;
+}
+
+- (void)insertCellSizesForSections:(NSIndexSet *)sections
+{
+    NSParameterAssert(sections);
+    [self recordEvent:RZCellSizeTraceEventInsertSection forSections:sections];
+    if (self.pendingUpdates)
+    {
+        [self.pendingUpdates.insertedSections addIndexes:sections];
+        return;
+    }
+    for (RZCellSizeCache* cache in [self.cellSizeCachesByWidth allValues])
+    {
+        [cache insertSections:sections];
+    }
+}
+
+- (void)deleteCellSizesForSections:(NSIndexSet *)sections
+{
+    NSParameterAssert(sections);
+    [self recordEvent:RZCellSizeTraceEventDeleteSection forSections:sections];
+    if (self.pendingUpdates)
+    {
+        [self.pendingUpdates.deletedSections addIndexes:sections];
+        return;
+    }
+    NSUInteger countBefore = self.collectsStatistics ? self.cellSizeCache.countOfValidSizes : 0;
+    for (RZCellSizeCache* cache in [self.cellSizeCachesByWidth allValues])
+    {
+        [cache deleteSections:sections];
+    }
+    [self recordSizesDroppedByStructuralChangeFromCount:countBefore];
+}
+
+- (void)beginCellSizeUpdates
+{
+    [self.traceRecorder recordEvent:RZCellSizeTraceEventBeginUpdates row:0 inSection:0];
+    if (self.updatesNestingLevel == 0)
+    {
+        self.pendingUpdates = [[RZCellSizeCacheUpdates alloc] init];
+    }
+    self.updatesNestingLevel++;
+}
+
+- (void)endCellSizeUpdates
+{
+    NSAssert(self.updatesNestingLevel > 0, @"endCellSizeUpdates called without a matching beginCellSizeUpdates");
+    [self.traceRecorder recordEvent:RZCellSizeTraceEventEndUpdates row:0 inSection:0];
+    self.updatesNestingLevel--;
+    if (self.updatesNestingLevel == 0)
+    {
+        RZCellSizeCacheUpdates* updates = self.pendingUpdates;
+        self.pendingUpdates = nil;
+        NSUInteger countBefore = 0;
+        if (self.collectsStatistics)
+        {
+            // Sizes invalidated by the batch are counted as invalidations rather than as structural drops.
+            NSUInteger invalidatedCount = 0;
+            for (NSIndexPath* indexPath in [NSSet setWithArray:updates.invalidatedIndexPaths])
+            {
+                if ([self.cellSizeCache getSize:NULL forRow:indexPath.row inSection:indexPath.section])
+                {
+                    invalidatedCount++;
+                }
+            }
+            self.sizesDroppedByIndexPathInvalidation += invalidatedCount;
+            countBefore = self.cellSizeCache.countOfValidSizes - invalidatedCount;
+        }
+        for (RZCellSizeCache* cache in [self.cellSizeCachesByWidth allValues])
+        {
+            [updates applyToCache:cache];
+        }
+        [self recordSizesDroppedByStructuralChangeFromCount:countBefore];
+    }
+}
+
+- (CGFloat)cellHeightForObject:(id)object indexPath:(NSIndexPath *)indexPath
+{
+    return [self cellHeightForObject:object indexPath:indexPath cellReuseIdentifier:nil];
+}
+
+- (CGFloat)cellHeightForObject:(id)object indexPath:(NSIndexPath *)indexPath cellReuseIdentifier:(NSString *)reuseIdentifier
+{
+    NSParameterAssert(indexPath);
+
+    RZCellSizeManagerCellConfiguration* configuration = nil;
+    id<NSCopying> contentKey = nil;
+    if (self.contentKeyedConfigurationCount > 0)
+    {
+        configuration = [self configurationForObject:object reuseIdentifier:reuseIdentifier];
+        contentKey = [self contentKeyForObject:object configuration:configuration];
+    }
+    
+    CGSize cachedSize;
+    if ([self getCachedSize:&cachedSize row:indexPath.row section:indexPath.section contentKey:contentKey configuration:configuration])
+    {
+        if (self.collectsStatistics)
+        {
+            [self recordLookupHit:YES forConfiguration:configuration ?: [self configurationForObject:object reuseIdentifier:reuseIdentifier]];
+        }
+        [self.traceRecorder recordLookupOfRow:indexPath.row inSection:indexPath.section classTag:configuration.classTag hit:YES size:cachedSize];
+        return cachedSize.height;
+    }
+
+    if (!configuration)
+    {
+        configuration = [self configurationForObject:object reuseIdentifier:reuseIdentifier];
+    }
+    if (self.collectsStatistics)
+    {
+        [self recordLookupHit:NO forConfiguration:configuration];
+    }
+    
+    NSNumber* height = [self cellHeightForObject:object configuration:configuration];
+    
+    if (height)
+    {
+        [self cacheSize:CGSizeMake(0.0f, [height floatValue]) row:indexPath.row section:indexPath.section contentKey:contentKey configuration:configuration];
+        [self addEstimationHeight:[height floatValue] ofObject:object forConfiguration:configuration];
+        [self.traceRecorder recordLookupOfRow:indexPath.row inSection:indexPath.section classTag:configuration.classTag hit:NO size:CGSizeMake(0.0f, [height floatValue])];
+    }
+    return [height floatValue];
+}
+
+- (CGSize)cellSizeForObject:(id)object indexPath:(NSIndexPath *)indexPath
+{
+    return [self cellSizeForObject:object indexPath:indexPath cellReuseIdentifier:nil];
+}
+
+- (CGSize)cellSizeForObject:(id)object indexPath:(NSIndexPath *)indexPath cellReuseIdentifier:(NSString *)reuseIdentifier
+{
+    NSParameterAssert(indexPath);
+    return [self cellSizeForObject:object row:indexPath.row section:indexPath.section cellReuseIdentifier:reuseIdentifier];
+}
+
+- (BOOL)getCachedCellSize:(CGSize *)size forIndexPath:(NSIndexPath *)indexPath
+{
+    NSParameterAssert(indexPath);
+    
+    // The atomic property hands back a strong reference, so a width change on the main thread cannot release the cache mid read.
+    RZCellSizeCache* cache = self.readableCellSizeCache;
+    return [cache getSizeFromAnyThread:size forRow:indexPath.row inSection:indexPath.section];
+}
+
+- (void)getCellSizes:(CGSize *)sizes forObjects:(NSArray *)objects inSection:(NSInteger)section cellReuseIdentifier:(NSString *)reuseIdentifier
+{
+    NSParameterAssert(sizes);
+    NSParameterAssert(objects);
+    
+    NSRange rows = NSMakeRange(0, objects.count);
+    NSIndexSet* missingRows = nil;
+    if (self.contentKeyedConfigurationCount == 0)
+    {
+        missingRows = [self.cellSizeCache getSizes:sizes forRowsInRange:rows inSection:section];
+        if (self.collectsStatistics || self.traceRecorder)
+        {
+            NSMutableIndexSet* cachedRows = [NSMutableIndexSet indexSetWithIndexesInRange:rows];
+            [cachedRows removeIndexes:missingRows];
+            [cachedRows enumerateIndexesUsingBlock:^(NSUInteger row, BOOL *stop) {
+                id object = [objects objectAtIndex:row];
+                object = (object == [NSNull null]) ? nil : object;
+                RZCellSizeManagerCellConfiguration* configuration = [self configurationForObject:object reuseIdentifier:reuseIdentifier];
+                if (self.collectsStatistics)
+                {
+                    [self recordLookupHit:YES forConfiguration:configuration];
+                }
+                [self.traceRecorder recordLookupOfRow:row inSection:section classTag:configuration.classTag hit:YES size:sizes[row]];
+            }];
+        }
+    }
+    else
+    {
+        // Sizes cached by content key take priority over the rows, so every row goes through the full lookup.
+        missingRows = [NSIndexSet indexSetWithIndexesInRange:rows];
+    }
+    
+    [missingRows enumerateIndexesUsingBlock:^(NSUInteger row, BOOL *stop) {
+        id object = [objects objectAtIndex:row];
+        object = (object == [NSNull null]) ? nil : object;
+        sizes[row] = [self cellSizeForObject:object row:row section:section cellReuseIdentifier:reuseIdentifier];
+    }];
+}
+
+- (RZCellSizeManagerStatistics *)statistics
+{
+    NSMutableDictionary* configurationStatistics = [NSMutableDictionary dictionary];
+    for (RZCellSizeManagerCellConfiguration* configuration in self.orderedCellConfigurations)
+    {
+        RZCellSizeConfigurationStatistics* statistics = [[RZCellSizeConfigurationStatistics alloc] initWithCellClassName:configuration.cellClass
+                                                                                                               counters:*[configuration counters]];
+        [configurationStatistics setObject:statistics forKey:configuration.cellClass];
+    }
+    return [[RZCellSizeManagerStatistics alloc] initWithConfigurationStatistics:configurationStatistics
+                                                  sizesDroppedByCacheInvalidation:self.sizesDroppedByCacheInvalidation
+                                              sizesDroppedByIndexPathInvalidation:self.sizesDroppedByIndexPathInvalidation
+                                                 sizesDroppedByStructuralChanges:self.sizesDroppedByStructuralChanges];
+}
+
+- (void)resetStatistics
+{
+    for (RZCellSizeManagerCellConfiguration* configuration in self.orderedCellConfigurations)
+    {
+        RZCellSizeConfigurationCounters* counters = [configuration counters];
+        uint64_t registrationNanoseconds = counters->registrationNanoseconds;
+        uint64_t prototypeNanoseconds = counters->prototypeNanoseconds;
+        uint64_t firstMeasurementNanoseconds = counters->firstMeasurementNanoseconds;
+        memset(counters, 0, sizeof(RZCellSizeConfigurationCounters));
+        counters->registrationNanoseconds = registrationNanoseconds;
+        counters->prototypeNanoseconds = prototypeNanoseconds;
+        counters->firstMeasurementNanoseconds = firstMeasurementNanoseconds;
+    }
+    self.sizesDroppedByCacheInvalidation = 0;
+    self.sizesDroppedByIndexPathInvalidation = 0;
+    self.sizesDroppedByStructuralChanges = 0;
+}
+
+- (CGFloat)cellOffsetForIndexPath:(NSIndexPath *)indexPath
+{
+    NSParameterAssert(indexPath);
+    return [self.cellSizeCache offsetOfRow:indexPath.row inSection:indexPath.section];
+}
+
+- (CGFloat)totalCellHeightForSection:(NSInteger)section numberOfRows:(NSInteger)numberOfRows
+{
+    return [self.cellSizeCache heightOfSection:section numberOfRows:numberOfRows];
+}
+
+- (NSIndexPath *)indexPathForCellAtOffset:(CGFloat)offset inSection:(NSInteger)section numberOfRows:(NSInteger)numberOfRows
+{
+    NSUInteger row = [self.cellSizeCache rowAtOffset:offset inSection:section numberOfRows:numberOfRows];
+    return (row != NSNotFound) ? [NSIndexPath indexPathForRow:row inSection:section] : nil;
+}
+
+- (void)precomputeCellHeightsForObjects:(NSArray *)objects
+                             indexPaths:(NSArray *)indexPaths
+                    cellReuseIdentifier:(NSString *)reuseIdentifier
+                             completion:(void (^)(NSArray *indexPaths))completion
+{
+    NSParameterAssert(objects);
+    NSParameterAssert(indexPaths);
+    
+    __weak __typeof(self) weakSelf = self;
+    [self.precomputeQueue enqueueObjects:objects indexPaths:indexPaths measureBlock:^BOOL(id object, NSIndexPath *indexPath) {
+        RZCellSizeManager* strongSelf = weakSelf;
+        if (strongSelf == nil)
+        {
+            return NO;
+        }
+        [strongSelf cellHeightForObject:object indexPath:indexPath cellReuseIdentifier:reuseIdentifier];
+        return [strongSelf.cellSizeCache getSize:NULL forRow:indexPath.row inSection:indexPath.section];
+    } completion:completion];
+}
+
+/**
+ * The parallel part only reads plain C arrays set up beforehand and writes to its own slots of the results, so none
+ *  of the manager or the cache is touched off the calling thread.  dispatch_apply spreads the chunks across the
+ *  cores and lets idle threads pick up chunks that others have not started.
+ * Everything else follows the serial path on the calling thread: signature sizes are looked up before the workers
+ *  start, a cell whose signature is already being measured in this batch takes the size of that cell as a signature
+ *  hit, and text stacks are measured here since their line counts are not safe to share between threads.
+ **/
+- (void)computeCellSizesForObjects:(NSArray *)objects indexPaths:(NSArray *)indexPaths cellReuseIdentifier:(NSString *)reuseIdentifier
+{
+    NSParameterAssert(objects);
+    NSParameterAssert(indexPaths);
+    NSAssert(objects.count == indexPaths.count, @"There must be one object for each index path");
+    
+    NSUInteger count = objects.count;
+    NSUInteger parallelCount = 0;
+    NSUInteger* parallelIndexes = malloc(count * sizeof(NSUInteger));
+    __unsafe_unretained id* parallelObjects = (__unsafe_unretained id *)malloc(count * sizeof(id));
+    __unsafe_unretained RZCellSizeManagerCellConfiguration** parallelConfigurations = (__unsafe_unretained RZCellSizeManagerCellConfiguration **)malloc(count * sizeof(id));
+    CGSize* sizes = malloc(count * sizeof(CGSize));
+    NSUInteger* sharedIndexes = malloc(count * sizeof(NSUInteger));
+    BOOL* measured = malloc(count * sizeof(BOOL));
+    BOOL* measuredOnWorker = malloc(count * sizeof(BOOL));
+    uint64_t* startTimes = malloc(count * sizeof(uint64_t));
+    uint64_t* endTimes = malloc(count * sizeof(uint64_t));
+    NSMutableArray* contentKeys = [NSMutableArray arrayWithCapacity:count];
+    NSMutableArray* layoutSignatures = [NSMutableArray arrayWithCapacity:count];
+    NSMutableDictionary* pendingSignaturesByCellClass = [NSMutableDictionary dictionary];
+    CGFloat cellHeightPadding = self.cellHeightPadding;
+    CGFloat cellSizePadding = self.cellSizePadding;
+    
+    for (NSUInteger i = 0; i < count; i++)
+    {
+        id object = [objects objectAtIndex:i];
+        object = (object == [NSNull null]) ? nil : object;
+        NSIndexPath* indexPath = [indexPaths objectAtIndex:i];
+        RZCellSizeManagerCellConfiguration* configuration = [self configurationForObject:object reuseIdentifier:reuseIdentifier];
+        id<NSCopying> contentKey = [self contentKeyForObject:object configuration:configuration];
+        CGSize cachedSize;
+        if (configuration.isThreadSafe && ![self getCachedSize:&cachedSize row:indexPath.row section:indexPath.section contentKey:contentKey configuration:configuration])
+        {
+            RZCellSizeConfigurationCounters* counters = self.collectsStatistics ? [configuration counters] : NULL;
+            if (counters)
+            {
+                [self recordLookupHit:NO forConfiguration:configuration];
+            }
+            
+            id<NSCopying> layoutSignature = [self layoutSignatureForObject:object configuration:configuration];
+            NSMutableDictionary* pendingSignatures = nil;
+            if (layoutSignature)
+            {
+                pendingSignatures = [pendingSignaturesByCellClass objectForKey:configuration.cellClass];
+                if (!pendingSignatures)
+                {
+                    pendingSignatures = [NSMutableDictionary dictionary];
+                    [pendingSignaturesByCellClass setObject:pendingSignatures forKey:configuration.cellClass];
+                }
+            }
+            NSNumber* pendingIndex = layoutSignature ? [pendingSignatures objectForKey:layoutSignature] : nil;
+            
+            parallelIndexes[parallelCount] = i;
+            parallelObjects[parallelCount] = object;
+            parallelConfigurations[parallelCount] = configuration;
+            sharedIndexes[parallelCount] = NSNotFound;
+            measured[parallelCount] = NO;
+            measuredOnWorker[parallelCount] = NO;
+            [contentKeys addObject:contentKey ?: [NSNull null]];
+            [layoutSignatures addObject:layoutSignature ?: [NSNull null]];
+            
+            CGFloat textHeight = 0.0f;
+            if (layoutSignature && [self.cellSizeCache getSize:&sizes[parallelCount] forLayoutSignature:layoutSignature cellClassName:configuration.cellClass])
+            {
+                if (!configuration.sizeBlock)
+                {
+                    sizes[parallelCount] = CGSizeMake(0.0f, sizes[parallelCount].height);
+                }
+                if (counters)
+                {
+                    counters->signatureHits++;
+                }
+            }
+            else if (pendingIndex)
+            {
+                sharedIndexes[parallelCount] = [pendingIndex unsignedIntegerValue];
+                if (counters)
+                {
+                    counters->signatureHits++;
+                }
+            }
+            else
+            {
+                if (layoutSignature)
+                {
+                    [pendingSignatures setObject:@(parallelCount) forKey:layoutSignature];
+                }
+                measured[parallelCount] = YES;
+                startTimes[parallelCount] = RZCellSizeStatisticsNow();
+                if (configuration.textStack && [configuration.textStack getHeight:&textHeight forObject:object width:[configuration cellWidth]])
+                {
+                    sizes[parallelCount] = configuration.sizeBlock ? CGSizeMake([configuration cellWidth], textHeight + cellSizePadding) : CGSizeMake(0.0f, textHeight + cellHeightPadding);
+                    endTimes[parallelCount] = RZCellSizeStatisticsNow();
+                }
+                else
+                {
+                    measuredOnWorker[parallelCount] = YES;
+                }
+            }
+            parallelCount++;
+        }
+        else if (configuration.sizeBlock)
+        {
+            [self cellSizeForObject:object indexPath:indexPath cellReuseIdentifier:reuseIdentifier];
+        }
+        else
+        {
+            [self cellHeightForObject:object indexPath:indexPath cellReuseIdentifier:reuseIdentifier];
+        }
+    }
+    
+    if (parallelCount > 0)
+    {
+        NSUInteger chunkCount = MIN(parallelCount, [[NSProcessInfo processInfo] activeProcessorCount] * 8);
+        NSUInteger chunkLength = (parallelCount + chunkCount - 1) / chunkCount;
+        dispatch_apply(chunkCount, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0), ^(size_t chunk) {
+            NSUInteger end = MIN((chunk + 1) * chunkLength, parallelCount);
+            for (NSUInteger i = chunk * chunkLength; i < end; i++)
+            {
+                if (!measuredOnWorker[i])
+                {
+                    continue;
+                }
+                __unsafe_unretained RZCellSizeManagerCellConfiguration* configuration = parallelConfigurations[i];
+                if (configuration.sizeBlock)
+                {
+                    sizes[i] = configuration.sizeBlock(nil, parallelObjects[i]);
+                    sizes[i].height += cellSizePadding;
+                }
+                else
+                {
+                    sizes[i] = CGSizeMake(0.0f, configuration.heightBlock(nil, parallelObjects[i]) + cellHeightPadding);
+                }
+                endTimes[i] = RZCellSizeStatisticsNow();
+            }
+        });
+        
+        for (NSUInteger i = 0; i < parallelCount; i++)
+        {
+            RZCellSizeManagerCellConfiguration* configuration = parallelConfigurations[i];
+            if (sharedIndexes[i] != NSNotFound)
+            {
+                sizes[i] = sizes[sharedIndexes[i]];
+            }
+            if (measured[i])
+            {
+                if (self.collectsStatistics)
+                {
+                    RZCellSizeConfigurationCounters* counters = [configuration counters];
+                    counters->measurements++;
+                    RZCellSizeLatencyCountersRecord(&counters->configurationTime, startTimes[i], endTimes[i]);
+                }
+                if (!configuration.hasMeasured)
+                {
+                    [configuration counters]->firstMeasurementNanoseconds = endTimes[i] - startTimes[i];
+                    configuration.hasMeasured = YES;
+                }
+                id layoutSignature = [layoutSignatures objectAtIndex:i];
+                if (layoutSignature != [NSNull null])
+                {
+                    [self.cellSizeCache setSize:sizes[i] forLayoutSignature:layoutSignature cellClassName:configuration.cellClass];
+                }
+            }
+            
+            id contentKey = [contentKeys objectAtIndex:i];
+            NSIndexPath* indexPath = [indexPaths objectAtIndex:parallelIndexes[i]];
+            [self cacheSize:sizes[i]
+                        row:indexPath.row
+                    section:indexPath.section
+                 contentKey:(contentKey == [NSNull null]) ? nil : contentKey
+              configuration:configuration];
+            [self addEstimationHeight:sizes[i].height ofObject:parallelObjects[i] forConfiguration:configuration];
+            [self.traceRecorder recordLookupOfRow:indexPath.row inSection:indexPath.section classTag:configuration.classTag hit:NO size:sizes[i]];
+        }
+    }
+    
+    free(parallelIndexes);
+    free(parallelObjects);
+    free(parallelConfigurations);
+    free(sizes);
+    free(sharedIndexes);
+    free(measured);
+    free(measuredOnWorker);
+    free(startTimes);
+    free(endTimes);
+}
+
+- (void)cancelCellSizePrecomputation
+{
+    [_precomputeQueue cancelAllCells];
+}
+
+#pragma mark - Private Methods
+
+/**
+ * Other widths can be measured again if they come back, and the content-keyed sizes are still in the disk cache if
+ *  there is one.  The current width keeps the sizes around the visible cells, so scrolling does not stall afterwards.
+ **/
+- (void)didReceiveMemoryWarning:(NSNotification *)notification
+{
+    [self.traceRecorder recordEvent:RZCellSizeTraceEventMemoryWarning row:0 inSection:0];
+    NSNumber* activeWidth = [self.cachedWidths firstObject];
+    [self.cellSizeCachesByWidth removeAllObjects];
+    [self.cellSizeCachesByWidth setObject:self.cellSizeCache forKey:activeWidth];
+    [self.cachedWidths setArray:@[activeWidth]];
+    
+    NSUInteger countBefore = self.collectsStatistics ? self.cellSizeCache.countOfValidSizes + self.cellSizeCache.countOfContentKeyedSizes : 0;
+    [self.cellSizeCache trimToByteCount:self.cellSizeCache.byteCount / 2];
+    [self.cellSizeCache removeAllContentKeyedSizes];
+    [self.cellSizeCache removeAllLayoutSignatureSizes];
+    if (self.collectsStatistics)
+    {
+        self.sizesDroppedByCacheInvalidation += countBefore - self.cellSizeCache.countOfValidSizes;
+    }
+}
+
+- (void)didEnterBackground:(NSNotification *)notification
+{
+    [self.diskCache flush];
+    [self.traceRecorder flush];
+}
+
+/**
+ * Makes the cache for a width the active one, creating it if needed.  The most recently used widths are kept.
+ **/
+- (void)activateCellSizeCacheForWidth:(CGFloat)width
+{
+    NSNumber* widthKey = @(width);
+    RZCellSizeCache* cache = [self.cellSizeCachesByWidth objectForKey:widthKey];
+    if (cache == nil)
+    {
+        cache = [[RZCellSizeCache alloc] init];
+        cache.estimatedHeight = self.cellSizeCache.estimatedHeight;
+        cache.byteBudget = self.cellSizeCacheByteBudget;
+        if (self.visibleIndexPath)
+        {
+            [cache setFocusRow:self.visibleIndexPath.row inSection:self.visibleIndexPath.section];
+        }
+        [self.cellSizeCachesByWidth setObject:cache forKey:widthKey];
+    }
+    self.cellSizeCache = cache;
+    self.readableCellSizeCache = cache;
+    
+    [self.cachedWidths removeObject:widthKey];
+    [self.cachedWidths insertObject:widthKey atIndex:0];
+    [self evictCachedWidths];
+}
+
+- (void)evictCachedWidths
+{
+    while (self.cachedWidths.count > self.maximumNumberOfCachedWidths)
+    {
+        [self.cellSizeCachesByWidth removeObjectForKey:[self.cachedWidths lastObject]];
+        [self.cachedWidths removeLastObject];
+    }
+}
+
+- (void)updateContentKeyedConfigurationCount
+{
+    NSUInteger count = 0;
+    for (RZCellSizeManagerCellConfiguration* configuration in self.orderedCellConfigurations)
+    {
+        if (configuration.contentKeyBlock)
+        {
+            count++;
+        }
+    }
+    self.contentKeyedConfigurationCount = count;
+}
+
+- (void)recordLookupHit:(BOOL)hit forConfiguration:(RZCellSizeManagerCellConfiguration *)configuration
+{
+    RZCellSizeConfigurationCounters* counters = [configuration counters];
+    if (counters)
+    {
+        if (hit)
+        {
+            counters->hits++;
+        }
+        else
+        {
+            counters->misses++;
+        }
+    }
+}
+
+- (void)recordEvent:(RZCellSizeTraceEventType)type forIndexPaths:(NSArray *)indexPaths
+{
+    RZCellSizeTraceRecorder* recorder = self.traceRecorder;
+    if (recorder)
+    {
+        for (NSIndexPath* indexPath in indexPaths)
+        {
+            [recorder recordEvent:type row:indexPath.row inSection:indexPath.section];
+        }
+    }
+}
+
+- (void)recordEvent:(RZCellSizeTraceEventType)type forSections:(NSIndexSet *)sections
+{
+    RZCellSizeTraceRecorder* recorder = self.traceRecorder;
+    if (recorder)
+    {
+        [sections enumerateIndexesUsingBlock:^(NSUInteger section, BOOL *stop) {
+            [recorder recordEvent:type row:0 inSection:section];
+        }];
+    }
+}
+
+/**
+ * Stale sizes are already counted when they are invalidated, so only valid sizes are compared.
+ **/
+- (void)recordSizesDroppedByStructuralChangeFromCount:(NSUInteger)countBefore
+{
+    if (self.collectsStatistics)
+    {
+        NSUInteger countAfter = self.cellSizeCache.countOfValidSizes;
+        if (countBefore > countAfter)
+        {
+            self.sizesDroppedByStructuralChanges += countBefore - countAfter;
+        }
+    }
+}
+
+/**
+ * Feeds a height that was just computed for an object to the estimator of its configuration.
+ **/
+- (void)addEstimationHeight:(CGFloat)height ofObject:(id)object forConfiguration:(RZCellSizeManagerCellConfiguration *)configuration
+{
+    if (!configuration.estimator)
+    {
+        configuration.estimator = [[RZCellSizeEstimator alloc] init];
+    }
+    double feature = configuration.estimationFeatureBlock ? configuration.estimationFeatureBlock(object) : 0.0;
+    [configuration.estimator addHeight:height feature:feature];
+}
+
+- (id<NSCopying>)contentKeyForObject:(id)object configuration:(RZCellSizeManagerCellConfiguration *)configuration
+{
+    return configuration.contentKeyBlock ? configuration.contentKeyBlock(object) : nil;
+}
+
+- (id<NSCopying>)layoutSignatureForObject:(id)object configuration:(RZCellSizeManagerCellConfiguration *)configuration
+{
+    return configuration.layoutSignatureBlock ? configuration.layoutSignatureBlock(object) : nil;
+}
+
+/**
+ * Shared by the single and batch size lookups, so a batch does not create an index path for every row.
+ **/
+- (CGSize)cellSizeForObject:(id)object row:(NSUInteger)row section:(NSUInteger)section cellReuseIdentifier:(NSString *)reuseIdentifier
+{
+    RZCellSizeManagerCellConfiguration* configuration = nil;
+    id<NSCopying> contentKey = nil;
+    if (self.contentKeyedConfigurationCount > 0)
+    {
+        configuration = [self configurationForObject:object reuseIdentifier:reuseIdentifier];
+        contentKey = [self contentKeyForObject:object configuration:configuration];
+    }
+    
+    CGSize size = CGSizeZero;
+    if ([self getCachedSize:&size row:row section:section contentKey:contentKey configuration:configuration])
+    {
+        if (self.collectsStatistics)
+        {
+            [self recordLookupHit:YES forConfiguration:configuration ?: [self configurationForObject:object reuseIdentifier:reuseIdentifier]];
+        }
+        [self.traceRecorder recordLookupOfRow:row inSection:section classTag:configuration.classTag hit:YES size:size];
+    }
+    else
+    {
+        if (!configuration)
+        {
+            configuration = [self configurationForObject:object reuseIdentifier:reuseIdentifier];
+        }
+        if (self.collectsStatistics)
+        {
+            [self recordLookupHit:NO forConfiguration:configuration];
+        }
+        
+        if ([self getCellSize:&size forObject:object configuration:configuration])
+        {
+            [self cacheSize:size row:row section:section contentKey:contentKey configuration:configuration];
+            [self addEstimationHeight:size.height ofObject:object forConfiguration:configuration];
+            [self.traceRecorder recordLookupOfRow:row inSection:section classTag:configuration.classTag hit:NO size:size];
+        }
+    }
+    return size;
+}
+
+/**
+ * Looks up a cached size.  When there is a content key it is the primary lookup and the index path is only
+ *  updated from it, so a size follows its object when the objects are reordered.
+ **/
+- (BOOL)getCachedSize:(CGSize *)size row:(NSUInteger)row section:(NSUInteger)section contentKey:(id<NSCopying>)contentKey configuration:(RZCellSizeManagerCellConfiguration *)configuration
+{
+    if (contentKey)
+    {
+        BOOL cached = [self.cellSizeCache getSize:size forContentKey:contentKey cellClassName:configuration.cellClass];
+        if (!cached && self.diskCache)
+        {
+            // Keyed by the overide width rather than the measured one, so a lookup never loads the prototype.
+            cached = [self.diskCache getSize:size
+                               forContentKey:contentKey
+                               cellClassName:configuration.cellClass
+                                       width:configuration.overideWidth];
+            if (cached)
+            {
+                [self.cellSizeCache setSize:*size forContentKey:contentKey cellClassName:configuration.cellClass];
+            }
+        }
+        if (cached)
+        {
+            // Writing the row moves the cache focus and can trim it, so a row that already holds the size is left alone.
+            CGSize rowSize;
+            uint8_t rowClassTag = 0;
+            BOOL rowIsCurrent = ([self.cellSizeCache getSize:&rowSize classTag:&rowClassTag forRow:row inSection:section] &&
+                                 rowClassTag == configuration.classTag &&
+                                 rowSize.width == (float)size->width &&
+                                 rowSize.height == (float)size->height);
+            if (!rowIsCurrent)
+            {
+                [self.cellSizeCache setSize:*size forRow:row inSection:section classTag:configuration.classTag];
+            }
+        }
+        return cached;
+    }
+    return [self.cellSizeCache getSize:size forRow:row inSection:section];
+}
+
+- (void)cacheSize:(CGSize)size row:(NSUInteger)row section:(NSUInteger)section contentKey:(id<NSCopying>)contentKey configuration:(RZCellSizeManagerCellConfiguration *)configuration
+{
+    [self.cellSizeCache setSize:size forRow:row inSection:section classTag:configuration.classTag];
+    if (contentKey)
+    {
+        [self.cellSizeCache setSize:size forContentKey:contentKey cellClassName:configuration.cellClass];
+        [self.diskCache setSize:size
+                  forContentKey:contentKey
+                  cellClassName:configuration.cellClass
+                          width:configuration.overideWidth];
+    }
+}
+
+/**
+ * Registers a configuration, replacing any earlier registration of the same cell class.
+ * A new cell class only adds its own entries to the lookup tables, and the tables are only rebuilt when a
+ *  registration is replaced, so registering many classes at launch stays linear.  Each cell class keeps the same tag
+ *  for the life of the manager, so sizes cached before it was registered again can still be invalidated by class.
+ *  Classes past the last tag share tag 0, which invalidates everything.
+ **/
+- (void)addConfiguration:(RZCellSizeManagerCellConfiguration *)configuration
+{
+    uint64_t startTime = RZCellSizeStatisticsNow();
+    
+    RZCellSizeManagerCellConfiguration* existingConfiguration = [self.cellConfigurations objectForKey:configuration.cellClass];
+    if (existingConfiguration)
+    {
+        [self.orderedCellConfigurations removeObject:existingConfiguration];
+    }
+    
+    configuration.overideWidth = self.overideWidth;
+    
+    NSNumber* classTag = [self.classTagsByCellClass objectForKey:configuration.cellClass];
+    if (classTag == nil)
+    {
+        NSUInteger nextClassTag = self.classTagsByCellClass.count + 1;
+        classTag = @((nextClassTag <= kRZCellSizeCacheMaximumClassTag) ? nextClassTag : 0);
+        [self.classTagsByCellClass setObject:classTag forKey:configuration.cellClass];
+    }
+    configuration.classTag = [classTag unsignedCharValue];
+    [self.traceRecorder recordEvent:RZCellSizeTraceEventRegistration classTag:configuration.classTag];
+    
+    [self.cellConfigurations setObject:configuration forKey:configuration.cellClass];
+    [self.orderedCellConfigurations addObject:configuration];
+    if (existingConfiguration)
+    {
+        [self rebuildConfigurationLookup];
+    }
+    else
+    {
+        [self addConfigurationToLookup:configuration];
+    }
+    
+    [configuration counters]->registrationNanoseconds = RZCellSizeStatisticsNow() - startTime;
+}
+
+/**
+ * Adds the entries for a configuration registered after all the others, with the same rules as a rebuild.
+ **/
+- (void)addConfigurationToLookup:(RZCellSizeManagerCellConfiguration *)configuration
+{
+    if (configuration.reuseIdentifier && ![self.configurationsByReuseIdentifier objectForKey:configuration.reuseIdentifier])
+    {
+        [self.configurationsByReuseIdentifier setObject:configuration forKey:configuration.reuseIdentifier];
+    }
+    if (configuration.objectClass && ![self.configurationsByObjectClass objectForKey:configuration.objectClass])
+    {
+        [self.configurationsByObjectClass setObject:configuration forKey:(id<NSCopying>)configuration.objectClass];
+        [self.resolvedConfigurationsByClass removeAllObjects];
+    }
+    
+    BOOL appliesToEveryCell = (!configuration.objectClass && !configuration.reuseIdentifier);
+    BOOL fallbackAppliesToEveryCell = (self.fallbackConfiguration && !self.fallbackConfiguration.objectClass && !self.fallbackConfiguration.reuseIdentifier);
+    if (!self.fallbackConfiguration || (appliesToEveryCell && !fallbackAppliesToEveryCell))
+    {
+        self.fallbackConfiguration = configuration;
+    }
+    
+    if (configuration.contentKeyBlock)
+    {
+        self.contentKeyedConfigurationCount++;
+    }
+}
+
+/**
+ * Rebuilds the reuse identifier and object class tables from the registered configurations.
+ * When several configurations claim the same key, the first one registered wins.
+ * The fallback is the first registration that applies to every cell (no object class and no reuse identifier),
+ *  or the first registration if there is none.
+ **/
+- (void)rebuildConfigurationLookup
+{
+    [self.configurationsByReuseIdentifier removeAllObjects];
+    [self.configurationsByObjectClass removeAllObjects];
+    [self.resolvedConfigurationsByClass removeAllObjects];
+    self.fallbackConfiguration = nil;
+    
+    for (RZCellSizeManagerCellConfiguration* configuration in self.orderedCellConfigurations)
+    {
+        if (configuration.reuseIdentifier && ![self.configurationsByReuseIdentifier objectForKey:configuration.reuseIdentifier])
+        {
+            [self.configurationsByReuseIdentifier setObject:configuration forKey:configuration.reuseIdentifier];
+        }
+        if (configuration.objectClass && ![self.configurationsByObjectClass objectForKey:configuration.objectClass])
+        {
+            [self.configurationsByObjectClass setObject:configuration forKey:(id<NSCopying>)configuration.objectClass];
+        }
+        if (!self.fallbackConfiguration && !configuration.objectClass && !configuration.reuseIdentifier)
+        {
+            self.fallbackConfiguration = configuration;
+        }
+    }
+    
+    if (!self.fallbackConfiguration)
+    {
+        self.fallbackConfiguration = [self.orderedCellConfigurations firstObject];
+    }
+    
+    [self updateContentKeyedConfigurationCount];
+}
+
+/** 
+ * returns the configuration object that is associated with either the object or the reuseIdentifier
+ * This will first check to see if we are sending in a reuseIdentifier.  If we do, it will not try and
+ *  object match, otherwise it will find the registered object class closest to the object's class.
+ *  The result for each concrete class is remembered, so the superclass chain is only walked once per class.
+ **/
+- (RZCellSizeManagerCellConfiguration *)configurationForObject:(id)object reuseIdentifier:(NSString *)reuseIdentifier
+{
+    RZCellSizeManagerCellConfiguration* configuration = nil;
+    if (reuseIdentifier)
+    {
+        configuration = [self.configurationsByReuseIdentifier objectForKey:reuseIdentifier];
+    }
+    else if (object)
+    {
+        Class objectClass = [object class];
+        id resolved = [self.resolvedConfigurationsByClass objectForKey:objectClass];
+        if (resolved == nil)
+        {
+            for (Class cls = objectClass; cls != Nil && resolved == nil; cls = [cls superclass])
+            {
+                resolved = [self.configurationsByObjectClass objectForKey:cls];
+            }
+            [self.resolvedConfigurationsByClass setObject:(resolved ?: [NSNull null]) forKey:(id<NSCopying>)objectClass];
+        }
+        if (resolved != [NSNull null])
+        {
+            configuration = resolved;
+        }
+    }
+    
+    if (!configuration)
+    {
+        configuration = self.fallbackConfiguration;
+    }
+    
+    return configuration;
+
+}
+
+- (BOOL)getCellSize:(CGSize *)size forObject:(id)object configuration:(RZCellSizeManagerCellConfiguration *)configuration
+{
+    BOOL validSize = NO;
+    if (configuration)
+    {
+        RZCellSizeConfigurationCounters* counters = self.collectsStatistics ? [configuration counters] : NULL;
+        uint64_t startTime = counters ? RZCellSizeStatisticsNow() : 0;
+        uint64_t firstMeasurementStartTime = configuration.hasMeasured ? 0 : RZCellSizeStatisticsNow();
+        CGFloat textHeight = 0.0f;
+        id<NSCopying> layoutSignature = [self layoutSignatureForObject:object configuration:configuration];
+        if (layoutSignature && [self.cellSizeCache getSize:size forLayoutSignature:layoutSignature cellClassName:configuration.cellClass])
+        {
+            if (counters)
+            {
+                counters->signatureHits++;
+            }
+            return YES;
+        }
+        else if (configuration.textStack && [configuration.textStack getHeight:&textHeight forObject:object width:[configuration cellWidth]])
+        {
+            *size = CGSizeMake([configuration cellWidth], textHeight);
+            validSize = YES;
+            if (counters)
+            {
+                RZCellSizeLatencyCountersRecord(&counters->configurationTime, startTime, RZCellSizeStatisticsNow());
+            }
+        }
+        else if (configuration.configurationBlock)
+        {
+            [configuration.cell prepareForReuse];
+            configuration.configurationBlock(configuration.cell, object);
+            uint64_t configuredTime = counters ? RZCellSizeStatisticsNow() : 0;
+            UIView* contentView = [configuration.cell contentView];
+            *size = [contentView systemLayoutSizeFittingSize:UILayoutFittingCompressedSize];
+            validSize = YES;
+            if (counters)
+            {
+                RZCellSizeLatencyCountersRecord(&counters->configurationTime, startTime, configuredTime);
+                RZCellSizeLatencyCountersRecord(&counters->fittingTime, configuredTime, RZCellSizeStatisticsNow());
+            }
+        }
+        else if (configuration.sizeBlock)
+        {
+            *size = configuration.sizeBlock([configuration blockCell], object);
+            validSize = YES;
+            if (counters)
+            {
+                RZCellSizeLatencyCountersRecord(&counters->configurationTime, startTime, RZCellSizeStatisticsNow());
+            }
+        }
+        if (validSize)
+        {
+            size->height += self.cellSizePadding;
+        }
+        if (counters && validSize)
+        {
+            counters->measurements++;
+        }
+        if (validSize && !configuration.hasMeasured)
+        {
+            [configuration counters]->firstMeasurementNanoseconds = RZCellSizeStatisticsNow() - firstMeasurementStartTime;
+            configuration.hasMeasured = YES;
+        }
+        if (layoutSignature && validSize)
+        {
+            [self.cellSizeCache setSize:*size forLayoutSignature:layoutSignature cellClassName:configuration.cellClass];
+        }
+    }
+    return validSize;
+}
+
+- (NSNumber *)cellHeightForObject:(id)object configuration:(RZCellSizeManagerCellConfiguration *)configuration
+{
+    NSNumber* height = nil;
+    if (configuration)
+    {
+        RZCellSizeConfigurationCounters* counters = self.collectsStatistics ? [configuration counters] : NULL;
+        uint64_t startTime = counters ? RZCellSizeStatisticsNow() : 0;
+        uint64_t firstMeasurementStartTime = configuration.hasMeasured ? 0 : RZCellSizeStatisticsNow();
+        CGFloat textHeight = 0.0f;
+        CGSize signatureSize;
+        id<NSCopying> layoutSignature = [self layoutSignatureForObject:object configuration:configuration];
+        if (layoutSignature && [self.cellSizeCache getSize:&signatureSize forLayoutSignature:layoutSignature cellClassName:configuration.cellClass])
+        {
+            if (counters)
+            {
+                counters->signatureHits++;
+            }
+            return @(signatureSize.height);
+        }
+        else if (configuration.textStack && [configuration.textStack getHeight:&textHeight forObject:object width:[configuration cellWidth]])
+        {
+            height = @(textHeight + self.cellHeightPadding);
+            if (counters)
+            {
+                RZCellSizeLatencyCountersRecord(&counters->configurationTime, startTime, RZCellSizeStatisticsNow());
+            }
+        }
+        else if (configuration.configurationBlock)
+        {
+            [configuration.cell prepareForReuse];
             configuration.configurationBlock(configuration.cell, object);
+            uint64_t configuredTime = counters ? RZCellSizeStatisticsNow() : 0;
             [configuration.cell layoutIfNeeded];
+            uint64_t laidOutTime = counters ? RZCellSizeStatisticsNow() : 0;
             UIView* contentView = [configuration.cell contentView];
             height = @([contentView systemLayoutSizeFittingSize:UILayoutFittingCompressedSize].height + self.cellHeightPadding);
+            if (counters)
+            {
+                RZCellSizeLatencyCountersRecord(&counters->configurationTime, startTime, configuredTime);
+                RZCellSizeLatencyCountersRecord(&counters->layoutTime, configuredTime, laidOutTime);
+                RZCellSizeLatencyCountersRecord(&counters->fittingTime, laidOutTime, RZCellSizeStatisticsNow());
+            }
         }
         else if (configuration.heightBlock)
         {
-            height = @(configuration.heightBlock(configuration.cell, object) + self.cellHeightPadding);
+            height = @(configuration.heightBlock([configuration blockCell], object) + self.cellHeightPadding);
+            if (counters)
+            {
+                RZCellSizeLatencyCountersRecord(&counters->configurationTime, startTime, RZCellSizeStatisticsNow());
+            }
+        }
+        if (counters && height)
+        {
+            counters->measurements++;
+        }
+        if (height && !configuration.hasMeasured)
+        {
+            [configuration counters]->firstMeasurementNanoseconds = RZCellSizeStatisticsNow() - firstMeasurementStartTime;
+            configuration.hasMeasured = YES;
+        }
+        if (layoutSignature && height)
+        {
+            // Height blocks never serve width lookups, so they are not made to load the prototype for a width.
+            CGFloat signatureWidth = configuration.heightBlock ? 0.0f : [configuration cellWidth];
+            [self.cellSizeCache setSize:CGSizeMake(signatureWidth, [height floatValue]) forLayoutSignature:layoutSignature cellClassName:configuration.cellClass];
         }
-        
     }
     return height;
 
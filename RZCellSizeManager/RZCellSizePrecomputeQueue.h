@@ -0,0 +1,101 @@
+//
+//  RZCellSizePrecomputeQueue.h
+//
+
+
+// Copyright 2014 Raizlabs and other contributors
+// http://raizlabs.com/
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+#import <Foundation/Foundation.h>
+
+typedef BOOL           (^RZCellSizePrecomputeMeasureBlock)(id object, NSIndexPath *indexPath);
+typedef NSTimeInterval (^RZCellSizePrecomputeClockBlock)(void);
+typedef void           (^RZCellSizePrecomputeCompletionBlock)(NSArray *indexPaths);
+
+/**
+ *  RZCellSizePrecomputeQueue
+ *
+ *  Measures cells ahead of time in small slices so that no single run loop turn spends more than a fixed time budget.
+ *  Pending cells are measured closest to a focus index path first, which should be kept at the visible range.
+ *
+ *  The queue does not know how to measure anything itself.  It calls the measure block given with each cell, and reads
+ *  time from a clock block, so it only depends on Foundation and can be driven by hand with processSlice.
+ **/
+@interface RZCellSizePrecomputeQueue : NSObject
+
+/**
+ *  Create a queue.
+ *
+ *  @param clockBlock Block which returns a monotonic time in seconds, or nil to use the system uptime.
+ *
+ *  @return A new queue.
+ */
+- (instancetype)initWithClockBlock:(RZCellSizePrecomputeClockBlock)clockBlock;
+
+/**
+ *  Maximum time spent measuring in a single slice.  At least one cell is measured per slice.  Defaults to 2 ms.
+ */
+@property (nonatomic, assign) NSTimeInterval timeBudget;
+
+/**
+ *  Index path that pending cells are prioritized around.  Cells in the same section, nearest this row, are measured first.
+ *  Setting it is cheap.  Pending cells are reordered as they are taken, inside the time budget of a slice.
+ */
+@property (nonatomic, strong) NSIndexPath* focusIndexPath;
+
+/**
+ *  If YES, a slice is run on each turn of the current run loop while there are pending cells. Defaults to YES.
+ *  Set to NO to drive the queue manually with processSlice.
+ */
+@property (nonatomic, assign) BOOL schedulesAutomatically;
+
+/**
+ *  Number of cells that have not been measured yet.
+ */
+@property (nonatomic, readonly) NSUInteger pendingCount;
+
+/**
+ *  Add cells to be measured.
+ *
+ *  @param objects      Model objects, one per index path.  Use NSNull for cells that have no object. Must not be nil.
+ *  @param indexPaths   Index paths of the cells. Must not be nil.
+ *  @param measureBlock Block which measures and caches the size of one cell, returning YES if it produced a size. Must not be nil.
+ *  @param completion   Optional block called once every cell of this call has been measured, with the index paths that produced a size.
+ */
+- (void)enqueueObjects:(NSArray *)objects
+            indexPaths:(NSArray *)indexPaths
+          measureBlock:(RZCellSizePrecomputeMeasureBlock)measureBlock
+            completion:(RZCellSizePrecomputeCompletionBlock)completion;
+
+/**
+ *  Measure pending cells until the time budget is used up.
+ *
+ *  @return YES if there are still pending cells.
+ */
+- (BOOL)processSlice;
+
+/**
+ *  Drop every pending cell.  Completion blocks of unfinished calls are not called.
+ */
+- (void)cancelAllCells;
+
+@end
@@ -0,0 +1,344 @@
+//
+//  RZCellSizePrecomputeQueue.m
+//
+
+
+// Copyright 2014 Raizlabs and other contributors
+// http://raizlabs.com/
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#import "RZCellSizePrecomputeQueue.h"
+
+#define kRZCellSizePrecomputeDefaultTimeBudget  0.002
+
+/**
+ *  RZCellSizePrecomputeBatch
+ *
+ *  Tracks the cells from a single enqueue call so its completion block can be called.
+ **/
+@interface RZCellSizePrecomputeBatch : NSObject
+@property (nonatomic, assign) NSUInteger remainingCount;
+@property (nonatomic, strong) NSMutableArray* measuredIndexPaths;
+@property (nonatomic, copy) RZCellSizePrecomputeMeasureBlock measureBlock;
+@property (nonatomic, copy) RZCellSizePrecomputeCompletionBlock completion;
+@end
+
+@implementation RZCellSizePrecomputeBatch
+@end
+
+/**
+ *  RZCellSizePrecomputeItem
+ *
+ *  The section and row are read once with indexAtPosition:, so the queue does not need UIKit's NSIndexPath additions.
+ **/
+@interface RZCellSizePrecomputeItem : NSObject
+@property (nonatomic, strong) id object;
+@property (nonatomic, strong) NSIndexPath* indexPath;
+@property (nonatomic, assign) NSUInteger section;
+@property (nonatomic, assign) NSUInteger row;
+@property (nonatomic, strong) RZCellSizePrecomputeBatch* batch;
+@end
+
+@implementation RZCellSizePrecomputeItem
+@end
+
+/**
+ *  RZCellSizePrecomputeSection
+ *
+ *  The pending items of one section, sorted by row.  Items are taken outwards from the anchor row, so the items
+ *  already taken are always the range from lowerIndex up to upperIndex, and the nearest pending item is on one side
+ *  of it or the other.
+ **/
+@interface RZCellSizePrecomputeSection : NSObject
+@property (nonatomic, strong) NSMutableArray* items;
+@property (nonatomic, assign) NSUInteger lowerIndex;
+@property (nonatomic, assign) NSUInteger upperIndex;
+@property (nonatomic, assign) NSUInteger anchorRow;
+@property (nonatomic, assign) BOOL needsSort;
+@property (nonatomic, assign) BOOL needsAnchor;
+@end
+
+@implementation RZCellSizePrecomputeSection
+@end
+
+
+@interface RZCellSizePrecomputeQueue ()
+
+@property (nonatomic, copy) RZCellSizePrecomputeClockBlock clockBlock;
+
+@property (nonatomic, strong) NSMutableDictionary* pendingItemsBySection;
+@property (nonatomic, strong) NSMutableIndexSet* pendingSections;
+@property (nonatomic, assign, readwrite) NSUInteger pendingCount;
+@property (nonatomic, assign) BOOL sliceScheduled;
+
+@end
+
+@implementation RZCellSizePrecomputeQueue
+
+- (instancetype)init
+{
+    return [self initWithClockBlock:nil];
+}
+
+- (instancetype)initWithClockBlock:(RZCellSizePrecomputeClockBlock)clockBlock
+{
+    self = [super init];
+    if ( self ) {
+        _clockBlock = clockBlock ? [clockBlock copy] : ^NSTimeInterval{
+            return [[NSProcessInfo processInfo] systemUptime];
+        };
+        _timeBudget = kRZCellSizePrecomputeDefaultTimeBudget;
+        _schedulesAutomatically = YES;
+        _pendingItemsBySection = [NSMutableDictionary dictionary];
+        _pendingSections = [NSMutableIndexSet indexSet];
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    [NSObject cancelPreviousPerformRequestsWithTarget:self];
+}
+
+#pragma mark - Public Methods
+
+- (void)enqueueObjects:(NSArray *)objects
+            indexPaths:(NSArray *)indexPaths
+          measureBlock:(RZCellSizePrecomputeMeasureBlock)measureBlock
+            completion:(RZCellSizePrecomputeCompletionBlock)completion
+{
+    NSParameterAssert(objects);
+    NSParameterAssert(indexPaths);
+    NSParameterAssert(measureBlock);
+    NSAssert(objects.count == indexPaths.count, @"There must be one object for each index path");
+    
+    RZCellSizePrecomputeBatch* batch = [RZCellSizePrecomputeBatch new];
+    batch.remainingCount = indexPaths.count;
+    batch.measuredIndexPaths = [NSMutableArray arrayWithCapacity:indexPaths.count];
+    batch.measureBlock = measureBlock;
+    batch.completion = completion;
+    
+    if (batch.remainingCount == 0)
+    {
+        [self finishBatch:batch];
+        return;
+    }
+    
+    [indexPaths enumerateObjectsUsingBlock:^(NSIndexPath* indexPath, NSUInteger idx, BOOL *stop) {
+        RZCellSizePrecomputeItem* item = [RZCellSizePrecomputeItem new];
+        id object = [objects objectAtIndex:idx];
+        item.object = (object == [NSNull null]) ? nil : object;
+        item.indexPath = indexPath;
+        item.section = [indexPath indexAtPosition:0];
+        item.row = [indexPath indexAtPosition:1];
+        item.batch = batch;
+        
+        NSNumber* sectionKey = @(item.section);
+        RZCellSizePrecomputeSection* pendingSection = [self.pendingItemsBySection objectForKey:sectionKey];
+        if (pendingSection == nil)
+        {
+            pendingSection = [RZCellSizePrecomputeSection new];
+            pendingSection.items = [NSMutableArray array];
+            [self.pendingItemsBySection setObject:pendingSection forKey:sectionKey];
+            [self.pendingSections addIndex:item.section];
+        }
+        // Rows are usually enqueued in order, so appending only needs a sort when it breaks the order.
+        RZCellSizePrecomputeItem* lastItem = [pendingSection.items lastObject];
+        if (lastItem && lastItem.row > item.row)
+        {
+            pendingSection.needsSort = YES;
+        }
+        [pendingSection.items addObject:item];
+        pendingSection.needsAnchor = YES;
+    }];
+    self.pendingCount += indexPaths.count;
+    
+    [self scheduleSliceIfNeeded];
+}
+
+/**
+ *  Changing the focus only takes effect when the next item is taken, so the work of ordering the pending items is
+ *  done inside a slice and counted against its time budget.
+ **/
+- (BOOL)processSlice
+{
+    NSTimeInterval start = self.clockBlock();
+    do {
+        RZCellSizePrecomputeItem* item = [self takeNearestItem];
+        if (item == nil)
+        {
+            break;
+        }
+        
+        RZCellSizePrecomputeBatch* batch = item.batch;
+        if (batch.measureBlock(item.object, item.indexPath))
+        {
+            [batch.measuredIndexPaths addObject:item.indexPath];
+        }
+        batch.remainingCount--;
+        if (batch.remainingCount == 0)
+        {
+            [self finishBatch:batch];
+        }
+    } while (self.clockBlock() - start < self.timeBudget);
+    
+    return (self.pendingCount > 0);
+}
+
+- (void)cancelAllCells
+{
+    [self.pendingItemsBySection removeAllObjects];
+    [self.pendingSections removeAllIndexes];
+    self.pendingCount = 0;
+}
+
+#pragma mark - Private Methods
+
+- (void)scheduleSliceIfNeeded
+{
+    if (self.schedulesAutomatically && !self.sliceScheduled && self.pendingCount > 0)
+    {
+        self.sliceScheduled = YES;
+        [self performSelector:@selector(runScheduledSlice) withObject:nil afterDelay:0.0 inModes:@[NSRunLoopCommonModes]];
+    }
+}
+
+- (void)runScheduledSlice
+{
+    self.sliceScheduled = NO;
+    [self processSlice];
+    [self scheduleSliceIfNeeded];
+}
+
+- (void)finishBatch:(RZCellSizePrecomputeBatch *)batch
+{
+    if (batch.completion)
+    {
+        batch.completion([batch.measuredIndexPaths copy]);
+    }
+}
+
+/**
+ *  Removes and returns the pending item nearest the focus index path.  The nearest section with pending items comes
+ *  first, and the section after the focus wins a tie.  Within the focus section rows nearest the focus row come
+ *  first, and within other sections rows nearest the edge that faces the focus.
+ **/
+- (RZCellSizePrecomputeItem *)takeNearestItem
+{
+    if (self.pendingCount == 0)
+    {
+        return nil;
+    }
+    
+    NSIndexPath* focus = self.focusIndexPath;
+    NSUInteger focusSection = focus ? [focus indexAtPosition:0] : 0;
+    NSUInteger focusRow = focus ? [focus indexAtPosition:1] : 0;
+    
+    NSUInteger section = focusSection;
+    if (![self.pendingSections containsIndex:focusSection])
+    {
+        NSUInteger sectionAfter = [self.pendingSections indexGreaterThanIndex:focusSection];
+        NSUInteger sectionBefore = [self.pendingSections indexLessThanIndex:focusSection];
+        if (sectionBefore == NSNotFound || (sectionAfter != NSNotFound && sectionAfter - focusSection <= focusSection - sectionBefore))
+        {
+            section = sectionAfter;
+        }
+        else
+        {
+            section = sectionBefore;
+        }
+    }
+    
+    // Sections before the focus are reached from their last row, and sections after it from their first.
+    NSUInteger anchorRow = (section == focusSection) ? focusRow : ((section > focusSection) ? 0 : NSUIntegerMax);
+    RZCellSizePrecomputeSection* pendingSection = [self.pendingItemsBySection objectForKey:@(section)];
+    if (pendingSection.needsAnchor || pendingSection.anchorRow != anchorRow)
+    {
+        [self anchorSection:pendingSection atRow:anchorRow];
+    }
+    
+    NSMutableArray* items = pendingSection.items;
+    RZCellSizePrecomputeItem* lowerItem = (pendingSection.lowerIndex > 0) ? [items objectAtIndex:pendingSection.lowerIndex - 1] : nil;
+    RZCellSizePrecomputeItem* upperItem = (pendingSection.upperIndex < items.count) ? [items objectAtIndex:pendingSection.upperIndex] : nil;
+    RZCellSizePrecomputeItem* item = nil;
+    if (upperItem && (lowerItem == nil || upperItem.row - anchorRow <= anchorRow - lowerItem.row))
+    {
+        item = upperItem;
+        pendingSection.upperIndex++;
+    }
+    else
+    {
+        item = lowerItem;
+        pendingSection.lowerIndex--;
+    }
+    
+    if (pendingSection.lowerIndex == 0 && pendingSection.upperIndex == items.count)
+    {
+        [self.pendingItemsBySection removeObjectForKey:@(section)];
+        [self.pendingSections removeIndex:section];
+    }
+    self.pendingCount--;
+    return item;
+}
+
+/**
+ *  Drops the items that have been taken, sorts the rest by row if items were added out of order, and finds where the
+ *  anchor row falls among them.
+ **/
+- (void)anchorSection:(RZCellSizePrecomputeSection *)pendingSection atRow:(NSUInteger)anchorRow
+{
+    NSMutableArray* items = pendingSection.items;
+    [items removeObjectsInRange:NSMakeRange(pendingSection.lowerIndex, pendingSection.upperIndex - pendingSection.lowerIndex)];
+    if (pendingSection.needsSort)
+    {
+        [items sortWithOptions:NSSortStable usingComparator:^NSComparisonResult(RZCellSizePrecomputeItem* item1, RZCellSizePrecomputeItem* item2) {
+            if (item1.row != item2.row)
+            {
+                return (item1.row < item2.row) ? NSOrderedAscending : NSOrderedDescending;
+            }
+            return NSOrderedSame;
+        }];
+        pendingSection.needsSort = NO;
+    }
+    
+    NSUInteger low = 0;
+    NSUInteger high = items.count;
+    while (low < high)
+    {
+        NSUInteger middle = (low + high) / 2;
+        RZCellSizePrecomputeItem* middleItem = [items objectAtIndex:middle];
+        if (middleItem.row < anchorRow)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    pendingSection.lowerIndex = low;
+    pendingSection.upperIndex = low;
+    pendingSection.anchorRow = anchorRow;
+    pendingSection.needsAnchor = NO;
+}
+
+@end
@@ -0,0 +1,229 @@
+//
+//  RZCellSizeStatistics.h
+//
+
+
+// Copyright 2014 Raizlabs and other contributors
+// http://raizlabs.com/
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+#import <Foundation/Foundation.h>
+
+#define kRZCellSizeLatencyBucketCount 16
+
+/**
+ *  Raw counters kept while statistics are being collected.  Updating them is a handful of integer operations
+ *  so they can be left on in production builds.  The registration, prototype and first measurement times are
+ *  one-time costs, so they are recorded even when statistics are off and survive resetting the statistics.
+ *
+ *  Latencies are bucketed by powers of two in microseconds: bucket 0 holds times under 1 µs, bucket n holds
+ *  times under 2^n µs, and the last bucket holds everything longer.
+ **/
+typedef struct {
+    uint64_t count;
+    uint64_t totalNanoseconds;
+    uint64_t buckets[kRZCellSizeLatencyBucketCount];
+} RZCellSizeLatencyCounters;
+
+typedef struct {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t measurements;
+    uint64_t signatureHits;
+    RZCellSizeLatencyCounters configurationTime;
+    RZCellSizeLatencyCounters layoutTime;
+    RZCellSizeLatencyCounters fittingTime;
+    uint64_t registrationNanoseconds;
+    uint64_t prototypeNanoseconds;
+    uint64_t firstMeasurementNanoseconds;
+} RZCellSizeConfigurationCounters;
+
+/**
+ *  Current time in nanoseconds on a monotonic clock.
+ */
+uint64_t RZCellSizeStatisticsNow(void);
+
+/**
+ *  Record a latency measured from a start time returned by RZCellSizeStatisticsNow.
+ */
+void RZCellSizeLatencyCountersRecord(RZCellSizeLatencyCounters *counters, uint64_t startTime, uint64_t endTime);
+
+
+/**
+ *  RZCellSizeLatencyHistogram
+ *
+ *  A snapshot of the distribution of one kind of latency.
+ **/
+@interface RZCellSizeLatencyHistogram : NSObject
+
+- (instancetype)initWithCounters:(RZCellSizeLatencyCounters)counters;
+
+/**
+ *  Number of samples.
+ */
+@property (nonatomic, readonly) NSUInteger count;
+
+/**
+ *  Sum of all samples, in seconds.
+ */
+@property (nonatomic, readonly) NSTimeInterval totalTime;
+
+/**
+ *  Mean sample, in seconds.
+ */
+@property (nonatomic, readonly) NSTimeInterval averageTime;
+
+/**
+ *  Number of samples in a bucket.
+ *
+ *  @param bucket Index of the bucket, less than kRZCellSizeLatencyBucketCount.
+ */
+- (NSUInteger)countInBucket:(NSUInteger)bucket;
+
+/**
+ *  Exclusive upper bound of a bucket in seconds.  The last bucket has no upper bound and returns DBL_MAX.
+ *
+ *  @param bucket Index of the bucket, less than kRZCellSizeLatencyBucketCount.
+ */
++ (NSTimeInterval)upperBoundOfBucket:(NSUInteger)bucket;
+
+/**
+ *  Upper bound of the bucket that contains a percentile of the samples, in seconds.
+ *
+ *  @param percentile Percentile between 0 and 100.
+ */
+- (NSTimeInterval)timeAtPercentile:(double)percentile;
+
+@end
+
+
+/**
+ *  RZCellSizeConfigurationStatistics
+ *
+ *  A snapshot of the statistics for one registered cell class.
+ **/
+@interface RZCellSizeConfigurationStatistics : NSObject
+
+- (instancetype)initWithCellClassName:(NSString *)cellClassName counters:(RZCellSizeConfigurationCounters)counters;
+
+@property (nonatomic, readonly) NSString* cellClassName;
+
+/**
+ *  Lookups answered from the cache.
+ */
+@property (nonatomic, readonly) NSUInteger hits;
+
+/**
+ *  Lookups that were not in the cache.
+ */
+@property (nonatomic, readonly) NSUInteger misses;
+
+/**
+ *  Sizes computed with a configuration, height or size block.
+ */
+@property (nonatomic, readonly) NSUInteger measurements;
+
+/**
+ *  Cache misses answered by a size measured for another object with the same layout signature.
+ */
+@property (nonatomic, readonly) NSUInteger signatureHits;
+
+/**
+ *  Time spent in the configuration, height or size block.
+ */
+@property (nonatomic, readonly) RZCellSizeLatencyHistogram* configurationTime;
+
+/**
+ *  Time spent in layoutIfNeeded on the prototype cell.
+ */
+@property (nonatomic, readonly) RZCellSizeLatencyHistogram* layoutTime;
+
+/**
+ *  Time spent in systemLayoutSizeFittingSize: on the prototype cell.
+ */
+@property (nonatomic, readonly) RZCellSizeLatencyHistogram* fittingTime;
+
+/**
+ *  Time spent registering the cell class, in seconds.
+ */
+@property (nonatomic, readonly) NSTimeInterval registrationTime;
+
+/**
+ *  Time spent loading the prototype cell, in seconds, or 0 if it has not been needed yet.
+ */
+@property (nonatomic, readonly) NSTimeInterval prototypeTime;
+
+/**
+ *  Time spent on the first size computed for the cell class, including loading the prototype cell, in seconds.
+ */
+@property (nonatomic, readonly) NSTimeInterval firstMeasurementTime;
+
+@end
+
+
+/**
+ *  RZCellSizeManagerStatistics
+ *
+ *  A snapshot of the statistics collected by an RZCellSizeManager.
+ **/
+@interface RZCellSizeManagerStatistics : NSObject
+
+- (instancetype)initWithConfigurationStatistics:(NSDictionary *)configurationStatistics
+                   sizesDroppedByCacheInvalidation:(NSUInteger)cacheInvalidationCount
+               sizesDroppedByIndexPathInvalidation:(NSUInteger)indexPathInvalidationCount
+                  sizesDroppedByStructuralChanges:(NSUInteger)structuralChangeCount;
+
+/**
+ *  RZCellSizeConfigurationStatistics for each registered cell class that has been used, keyed by cell class name.
+ */
+@property (nonatomic, readonly) NSDictionary* configurationStatistics;
+
+/**
+ *  Totals across all cell classes.
+ */
+@property (nonatomic, readonly) NSUInteger hits;
+@property (nonatomic, readonly) NSUInteger misses;
+@property (nonatomic, readonly) NSUInteger measurements;
+@property (nonatomic, readonly) NSUInteger signatureHits;
+@property (nonatomic, readonly) NSTimeInterval registrationTime;
+@property (nonatomic, readonly) NSTimeInterval prototypeTime;
+
+/**
+ *  Fraction of lookups answered from the cache, or 0 if there have been no lookups.
+ */
+@property (nonatomic, readonly) double hitRate;
+
+/**
+ *  Cached sizes thrown away by invalidateCellSizeCache, invalidateContentKeyedCellSizeCache and memory warnings.
+ */
+@property (nonatomic, readonly) NSUInteger sizesDroppedByCacheInvalidation;
+
+/**
+ *  Cached sizes thrown away by invalidating index paths.
+ */
+@property (nonatomic, readonly) NSUInteger sizesDroppedByIndexPathInvalidation;
+
+/**
+ *  Cached sizes thrown away by deleting rows and sections, including through the CoreData and RZCollectionList extensions.
+ */
+@property (nonatomic, readonly) NSUInteger sizesDroppedByStructuralChanges;
+
+@end
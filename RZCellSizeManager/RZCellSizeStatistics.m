@@ -0,0 +1,208 @@
+//
+//  RZCellSizeStatistics.m
+//
+
+
+// Copyright 2014 Raizlabs and other contributors
+// http://raizlabs.com/
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#import "RZCellSizeStatistics.h"
+#import <mach/mach_time.h>
+
+uint64_t RZCellSizeStatisticsNow(void)
+{
+    static mach_timebase_info_data_t s_timebase;
+    if (s_timebase.denom == 0)
+    {
+        mach_timebase_info(&s_timebase);
+    }
+    return mach_absolute_time() * s_timebase.numer / s_timebase.denom;
+}
+
+void RZCellSizeLatencyCountersRecord(RZCellSizeLatencyCounters *counters, uint64_t startTime, uint64_t endTime)
+{
+    uint64_t nanoseconds = (endTime > startTime) ? endTime - startTime : 0;
+    uint64_t microseconds = nanoseconds / 1000;
+    
+    NSUInteger bucket = 0;
+    while (microseconds > 0 && bucket < kRZCellSizeLatencyBucketCount - 1)
+    {
+        microseconds >>= 1;
+        bucket++;
+    }
+    
+    counters->count++;
+    counters->totalNanoseconds += nanoseconds;
+    counters->buckets[bucket]++;
+}
+
+
+@interface RZCellSizeLatencyHistogram ()
+{
+    RZCellSizeLatencyCounters _counters;
+}
+@end
+
+@implementation RZCellSizeLatencyHistogram
+
+- (instancetype)initWithCounters:(RZCellSizeLatencyCounters)counters
+{
+    self = [super init];
+    if ( self ) {
+        _counters = counters;
+    }
+    return self;
+}
+
+- (NSUInteger)count
+{
+    return (NSUInteger)_counters.count;
+}
+
+- (NSTimeInterval)totalTime
+{
+    return _counters.totalNanoseconds / (double)NSEC_PER_SEC;
+}
+
+- (NSTimeInterval)averageTime
+{
+    return (_counters.count > 0) ? self.totalTime / _counters.count : 0.0;
+}
+
+- (NSUInteger)countInBucket:(NSUInteger)bucket
+{
+    NSParameterAssert(bucket < kRZCellSizeLatencyBucketCount);
+    return (NSUInteger)_counters.buckets[bucket];
+}
+
++ (NSTimeInterval)upperBoundOfBucket:(NSUInteger)bucket
+{
+    NSParameterAssert(bucket < kRZCellSizeLatencyBucketCount);
+    if (bucket == kRZCellSizeLatencyBucketCount - 1)
+    {
+        return DBL_MAX;
+    }
+    return (double)(1ULL << bucket) / USEC_PER_SEC;
+}
+
+- (NSTimeInterval)timeAtPercentile:(double)percentile
+{
+    uint64_t target = (uint64_t)ceil(_counters.count * MIN(MAX(percentile, 0.0), 100.0) / 100.0);
+    uint64_t seen = 0;
+    for (NSUInteger bucket = 0; bucket < kRZCellSizeLatencyBucketCount; bucket++)
+    {
+        seen += _counters.buckets[bucket];
+        if (seen >= target && seen > 0)
+        {
+            return [[self class] upperBoundOfBucket:bucket];
+        }
+    }
+    return 0.0;
+}
+
+- (NSString *)description
+{
+    return [NSString stringWithFormat:@"<%@: %p count=%lu avg=%.1fus p50<%.0fus p99<%.0fus>",
+            NSStringFromClass([self class]), self, (unsigned long)self.count, self.averageTime * USEC_PER_SEC,
+            [self timeAtPercentile:50.0] * USEC_PER_SEC, [self timeAtPercentile:99.0] * USEC_PER_SEC];
+}
+
+@end
+
+
+@implementation RZCellSizeConfigurationStatistics
+
+- (instancetype)initWithCellClassName:(NSString *)cellClassName counters:(RZCellSizeConfigurationCounters)counters
+{
+    self = [super init];
+    if ( self ) {
+        _cellClassName = [cellClassName copy];
+        _hits = (NSUInteger)counters.hits;
+        _misses = (NSUInteger)counters.misses;
+        _measurements = (NSUInteger)counters.measurements;
+        _signatureHits = (NSUInteger)counters.signatureHits;
+        _configurationTime = [[RZCellSizeLatencyHistogram alloc] initWithCounters:counters.configurationTime];
+        _layoutTime = [[RZCellSizeLatencyHistogram alloc] initWithCounters:counters.layoutTime];
+        _fittingTime = [[RZCellSizeLatencyHistogram alloc] initWithCounters:counters.fittingTime];
+        _registrationTime = counters.registrationNanoseconds / (double)NSEC_PER_SEC;
+        _prototypeTime = counters.prototypeNanoseconds / (double)NSEC_PER_SEC;
+        _firstMeasurementTime = counters.firstMeasurementNanoseconds / (double)NSEC_PER_SEC;
+    }
+    return self;
+}
+
+- (NSString *)description
+{
+    return [NSString stringWithFormat:@"<%@: %p %@ hits=%lu misses=%lu measurements=%lu signatureHits=%lu registration=%.1fus prototype=%.1fus firstMeasurement=%.1fus configuration=%@ layout=%@ fitting=%@>",
+            NSStringFromClass([self class]), self, self.cellClassName, (unsigned long)self.hits, (unsigned long)self.misses,
+            (unsigned long)self.measurements, (unsigned long)self.signatureHits, self.registrationTime * USEC_PER_SEC,
+            self.prototypeTime * USEC_PER_SEC, self.firstMeasurementTime * USEC_PER_SEC, self.configurationTime, self.layoutTime, self.fittingTime];
+}
+
+@end
+
+
+@implementation RZCellSizeManagerStatistics
+
+- (instancetype)initWithConfigurationStatistics:(NSDictionary *)configurationStatistics
+                   sizesDroppedByCacheInvalidation:(NSUInteger)cacheInvalidationCount
+               sizesDroppedByIndexPathInvalidation:(NSUInteger)indexPathInvalidationCount
+                  sizesDroppedByStructuralChanges:(NSUInteger)structuralChangeCount
+{
+    self = [super init];
+    if ( self ) {
+        _configurationStatistics = [configurationStatistics copy];
+        _sizesDroppedByCacheInvalidation = cacheInvalidationCount;
+        _sizesDroppedByIndexPathInvalidation = indexPathInvalidationCount;
+        _sizesDroppedByStructuralChanges = structuralChangeCount;
+        
+        for (RZCellSizeConfigurationStatistics* statistics in [_configurationStatistics allValues])
+        {
+            _hits += statistics.hits;
+            _misses += statistics.misses;
+            _measurements += statistics.measurements;
+            _signatureHits += statistics.signatureHits;
+            _registrationTime += statistics.registrationTime;
+            _prototypeTime += statistics.prototypeTime;
+        }
+    }
+    return self;
+}
+
+- (double)hitRate
+{
+    NSUInteger lookups = self.hits + self.misses;
+    return (lookups > 0) ? (double)self.hits / lookups : 0.0;
+}
+
+- (NSString *)description
+{
+    return [NSString stringWithFormat:@"<%@: %p hits=%lu misses=%lu hitRate=%.3f measurements=%lu signatureHits=%lu registration=%.1fus prototypes=%.1fus dropped(cache=%lu indexPaths=%lu structural=%lu) %@>",
+            NSStringFromClass([self class]), self, (unsigned long)self.hits, (unsigned long)self.misses, self.hitRate,
+            (unsigned long)self.measurements, (unsigned long)self.signatureHits, self.registrationTime * USEC_PER_SEC,
+            self.prototypeTime * USEC_PER_SEC, (unsigned long)self.sizesDroppedByCacheInvalidation,
+            (unsigned long)self.sizesDroppedByIndexPathInvalidation, (unsigned long)self.sizesDroppedByStructuralChanges,
+            [self.configurationStatistics allValues]];
+}
+
+@end
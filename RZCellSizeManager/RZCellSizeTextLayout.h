@@ -0,0 +1,197 @@
+//
+//  RZCellSizeTextLayout.h
+//
+
+
+// Copyright 2014 Raizlabs and other contributors
+// http://raizlabs.com/
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#import <Foundation/Foundation.h>
+#import <CoreGraphics/CoreGraphics.h>
+
+typedef CGFloat (^RZCellSizeCharacterAdvanceBlock)(unichar character);
+typedef CGFloat (^RZCellSizeSequenceAdvanceBlock)(NSString *sequence);
+typedef id      (^RZCellSizeTextBlockStringBlock)(id object);
+
+/**
+ *  RZCellSizeFontMetrics
+ *
+ *  The measurements of a single font that the text layout needs.
+ **/
+@protocol RZCellSizeFontMetrics <NSObject>
+
+/**
+ *  Height of one line of text.
+ */
+@property (nonatomic, readonly) CGFloat lineHeight;
+
+/**
+ *  Width of a run of characters set on a single line.
+ *
+ *  @param characters The characters to measure.
+ *  @param length     Number of characters.
+ *
+ *  @return The width of the characters.
+ */
+- (CGFloat)widthOfCharacters:(const unichar *)characters length:(NSUInteger)length;
+
+@end
+
+/**
+ *  RZCellSizeCharacterMetrics
+ *
+ *  Font metrics made of a line height and the advance of each character.  Advances are asked for once per character
+ *  and kept in tables of 256 characters that are only allocated when one of their characters is used.
+ *
+ *  A composed character sequence of more than one UTF-16 unit, such as a surrogate pair, an emoji with a modifier or a
+ *  letter followed by combining marks, is measured as a whole with the sequence advance block and its advance is kept
+ *  by sequence.
+ *
+ *  Summing advances ignores kerning and ligatures, which is close enough for most body text but may wrap a word
+ *  differently from UIKit near the edge of a line.  Metrics may be used from several threads at once.
+ **/
+@interface RZCellSizeCharacterMetrics : NSObject <RZCellSizeFontMetrics>
+
+/**
+ *  Create character metrics.
+ *
+ *  @param lineHeight   Height of one line of text.
+ *  @param advanceBlock Block which returns the advance of a character.  Must not be nil.
+ *
+ *  @return New character metrics.
+ */
+- (instancetype)initWithLineHeight:(CGFloat)lineHeight advanceBlock:(RZCellSizeCharacterAdvanceBlock)advanceBlock;
+
+/**
+ *  Create character metrics which measure composed character sequences as a whole.
+ *
+ *  @param lineHeight           Height of one line of text.
+ *  @param advanceBlock         Block which returns the advance of a single UTF-16 character.  Must not be nil.
+ *  @param sequenceAdvanceBlock Block which returns the advance of a composed character sequence of more than one
+ *                              UTF-16 unit.  If nil, the advances of its units are added up.
+ *
+ *  @return New character metrics.
+ */
+- (instancetype)initWithLineHeight:(CGFloat)lineHeight
+                      advanceBlock:(RZCellSizeCharacterAdvanceBlock)advanceBlock
+              sequenceAdvanceBlock:(RZCellSizeSequenceAdvanceBlock)sequenceAdvanceBlock;
+
+@end
+
+/**
+ *  Count the lines a string wraps to at a width, breaking at spaces and tabs the same way a label that wraps by word
+ *  does.  Line breaks always start a new line, spaces at a wrap are dropped, and words wider than a line are broken
+ *  between composed character sequences.
+ *
+ *  @param string  The string to lay out.
+ *  @param metrics Metrics of the font the string is set in.
+ *  @param width   Width of a line.
+ *
+ *  @return The number of lines, or 0 for an empty string.
+ */
+NSUInteger RZCellSizeTextLayoutNumberOfLines(NSString *string, id<RZCellSizeFontMetrics> metrics, CGFloat width);
+
+/**
+ *  RZCellSizeTextBlock
+ *
+ *  A block of text in a single font, such as a multiline label.  Line counts are cached by string and width.
+ **/
+@interface RZCellSizeTextBlock : NSObject
+
+/**
+ *  Create a text block.
+ *
+ *  @param metrics     Metrics of the font of the text.  Must not be nil.
+ *  @param stringBlock Block which is passed the model object and returns the text of the block.  It may return nil for
+ *                     no text, or an object which is not an NSString, such as an NSAttributedString, to have the cell
+ *                     measured by the normal registration instead.  Must not be nil.
+ *
+ *  @return A new text block.
+ */
++ (instancetype)textBlockWithMetrics:(id<RZCellSizeFontMetrics>)metrics stringBlock:(RZCellSizeTextBlockStringBlock)stringBlock;
+
+@property (nonatomic, strong, readonly) id<RZCellSizeFontMetrics> metrics;
+@property (nonatomic, copy, readonly) RZCellSizeTextBlockStringBlock stringBlock;
+
+/**
+ *  Maximum number of lines, or 0 for no limit.  Defaults to 0.
+ */
+@property (nonatomic, assign) NSUInteger numberOfLines;
+
+/**
+ *  Space between the bottom of this block and the top of the next one.  Only added between blocks that have text, so
+ *  it is ignored for an empty block and for the last block with text.  Defaults to 0.
+ */
+@property (nonatomic, assign) CGFloat spacingAfter;
+
+/**
+ *  Height of a string set in this block, rounded up to a whole point.
+ *
+ *  @param string The string to measure.
+ *  @param width  Width of the block.
+ *
+ *  @return The height of the text.
+ */
+- (CGFloat)heightOfString:(NSString *)string width:(CGFloat)width;
+
+@end
+
+/**
+ *  RZCellSizeTextStack
+ *
+ *  Describes a cell as a vertical stack of text blocks inside fixed insets, so its height can be computed from the
+ *  text alone without configuring the cell or running Auto Layout.
+ **/
+@interface RZCellSizeTextStack : NSObject
+
+/**
+ *  Create a text stack.
+ *
+ *  @param textBlocks The RZCellSizeTextBlocks of the cell from top to bottom.  Must not be nil.
+ *
+ *  @return A new text stack.
+ */
+- (instancetype)initWithTextBlocks:(NSArray *)textBlocks;
+
+@property (nonatomic, copy, readonly) NSArray* textBlocks;
+
+/**
+ *  Space between the edges of the cell and the text.  All default to 0.
+ */
+@property (nonatomic, assign) CGFloat topInset;
+@property (nonatomic, assign) CGFloat bottomInset;
+@property (nonatomic, assign) CGFloat leadingInset;
+@property (nonatomic, assign) CGFloat trailingInset;
+
+/**
+ *  Compute the height of a cell for a model object.
+ *
+ *  @param height On return, the height of the cell if it could be computed.  Must not be NULL.
+ *  @param object The model object of the cell.
+ *  @param width  Width of the cell.
+ *
+ *  @return YES if the height was computed, or NO if a text block returned something other than a string.
+ */
+- (BOOL)getHeight:(CGFloat *)height forObject:(id)object width:(CGFloat)width;
+
+@end
@@ -0,0 +1,402 @@
+//
+//  RZCellSizeTextLayout.m
+//
+
+
+// Copyright 2014 Raizlabs and other contributors
+// http://raizlabs.com/
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#import "RZCellSizeTextLayout.h"
+
+#define kRZCellSizeCharacterMetricsPageSize     256
+#define kRZCellSizeCharacterMetricsPageCount    256
+#define kRZCellSizeCharacterMetricsNotMeasured  -1.0f
+#define kRZCellSizeTextLayoutStackBufferLength  256
+
+static inline BOOL RZCellSizeTextLayoutIsSpace(unichar character)
+{
+    return (character == ' ' || character == '\t');
+}
+
+static inline BOOL RZCellSizeTextLayoutIsLineBreak(unichar character)
+{
+    return (character == '\n' || character == '\r' || character == 0x2028 || character == 0x2029);
+}
+
+/**
+ * Whether a UTF-16 unit belongs to the composed character sequence before it: the second half of a surrogate pair, a
+ *  combining mark, a variation selector or a zero width joiner.  Nothing below the combining diacritical marks does.
+ **/
+static inline BOOL RZCellSizeTextLayoutIsExtending(unichar character)
+{
+    static NSCharacterSet* s_nonBaseCharacters = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        s_nonBaseCharacters = [NSCharacterSet nonBaseCharacterSet];
+    });
+    return (character >= 0x300 &&
+            (CFStringIsSurrogateLowCharacter(character) || character == 0x200D || [s_nonBaseCharacters characterIsMember:character]));
+}
+
+/**
+ * Number of UTF-16 units in the composed character sequence at the start of a run of characters.  Foundation only
+ *  finds the end of the sequence when the first two units do not settle it.
+ **/
+static NSUInteger RZCellSizeTextLayoutSequenceLength(const unichar *characters, NSUInteger length)
+{
+    if (length < 2 || (!CFStringIsSurrogateHighCharacter(characters[0]) && !RZCellSizeTextLayoutIsExtending(characters[1])))
+    {
+        return MIN(length, 1);
+    }
+    NSString* string = [[NSString alloc] initWithCharactersNoCopy:(unichar *)characters length:length freeWhenDone:NO];
+    return [string rangeOfComposedCharacterSequenceAtIndex:0].length;
+}
+
+NSUInteger RZCellSizeTextLayoutNumberOfLines(NSString *string, id<RZCellSizeFontMetrics> metrics, CGFloat width)
+{
+    NSUInteger length = string.length;
+    if (length == 0)
+    {
+        return 0;
+    }
+    
+    unichar stackBuffer[kRZCellSizeTextLayoutStackBufferLength];
+    unichar *characters = (length <= kRZCellSizeTextLayoutStackBufferLength) ? stackBuffer : malloc(length * sizeof(unichar));
+    [string getCharacters:characters range:NSMakeRange(0, length)];
+    
+    NSUInteger lines = 1;
+    CGFloat lineWidth = 0.0f;
+    BOOL lineIsEmpty = YES;
+    NSUInteger i = 0;
+    while (i < length)
+    {
+        unichar character = characters[i];
+        if (RZCellSizeTextLayoutIsLineBreak(character))
+        {
+            i += (character == '\r' && i + 1 < length && characters[i + 1] == '\n') ? 2 : 1;
+            if (i < length)
+            {
+                lines++;
+                lineWidth = 0.0f;
+                lineIsEmpty = YES;
+            }
+            continue;
+        }
+        
+        // The spaces before a word only take up room if the word stays on the same line.
+        NSUInteger spaceStart = i;
+        while (i < length && RZCellSizeTextLayoutIsSpace(characters[i]))
+        {
+            i++;
+        }
+        NSUInteger wordStart = i;
+        while (i < length && !RZCellSizeTextLayoutIsSpace(characters[i]) && !RZCellSizeTextLayoutIsLineBreak(characters[i]))
+        {
+            i++;
+        }
+        if (i == wordStart)
+        {
+            continue;
+        }
+        
+        CGFloat spaceWidth = (wordStart > spaceStart) ? [metrics widthOfCharacters:&characters[spaceStart] length:wordStart - spaceStart] : 0.0f;
+        CGFloat wordWidth = [metrics widthOfCharacters:&characters[wordStart] length:i - wordStart];
+        if (lineWidth + spaceWidth + wordWidth <= width)
+        {
+            lineWidth += spaceWidth + wordWidth;
+        }
+        else
+        {
+            if (!lineIsEmpty)
+            {
+                lines++;
+            }
+            if (wordWidth <= width)
+            {
+                lineWidth = wordWidth;
+            }
+            else
+            {
+                lineWidth = 0.0f;
+                NSUInteger j = wordStart;
+                while (j < i)
+                {
+                    NSUInteger sequenceLength = RZCellSizeTextLayoutSequenceLength(&characters[j], i - j);
+                    CGFloat characterWidth = [metrics widthOfCharacters:&characters[j] length:sequenceLength];
+                    if (lineWidth > 0.0f && lineWidth + characterWidth > width)
+                    {
+                        lines++;
+                        lineWidth = 0.0f;
+                    }
+                    lineWidth += characterWidth;
+                    j += sequenceLength;
+                }
+            }
+        }
+        lineIsEmpty = NO;
+    }
+    
+    if (characters != stackBuffer)
+    {
+        free(characters);
+    }
+    return lines;
+}
+
+#pragma mark - RZCellSizeCharacterMetrics
+
+@interface RZCellSizeCharacterMetrics ()
+{
+    float *_pages[kRZCellSizeCharacterMetricsPageCount];
+}
+
+@property (nonatomic, copy) RZCellSizeCharacterAdvanceBlock advanceBlock;
+@property (nonatomic, copy) RZCellSizeSequenceAdvanceBlock sequenceAdvanceBlock;
+@property (nonatomic, strong) NSMutableDictionary* sequenceAdvances;
+
+@end
+
+@implementation RZCellSizeCharacterMetrics
+
+@synthesize lineHeight = _lineHeight;
+
+- (instancetype)initWithLineHeight:(CGFloat)lineHeight advanceBlock:(RZCellSizeCharacterAdvanceBlock)advanceBlock
+{
+    return [self initWithLineHeight:lineHeight advanceBlock:advanceBlock sequenceAdvanceBlock:nil];
+}
+
+- (instancetype)initWithLineHeight:(CGFloat)lineHeight
+                      advanceBlock:(RZCellSizeCharacterAdvanceBlock)advanceBlock
+              sequenceAdvanceBlock:(RZCellSizeSequenceAdvanceBlock)sequenceAdvanceBlock
+{
+    NSParameterAssert(advanceBlock);
+    self = [super init];
+    if ( self ) {
+        _lineHeight = lineHeight;
+        _advanceBlock = [advanceBlock copy];
+        _sequenceAdvanceBlock = [sequenceAdvanceBlock copy];
+        _sequenceAdvances = [NSMutableDictionary dictionary];
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    for (NSUInteger i = 0; i < kRZCellSizeCharacterMetricsPageCount; i++)
+    {
+        free(_pages[i]);
+    }
+}
+
+- (CGFloat)widthOfCharacters:(const unichar *)characters length:(NSUInteger)length
+{
+    CGFloat width = 0.0f;
+    NSUInteger i = 0;
+    while (i < length)
+    {
+        NSUInteger sequenceLength = RZCellSizeTextLayoutSequenceLength(&characters[i], length - i);
+        if (sequenceLength == 1)
+        {
+            width += [self advanceOfCharacter:characters[i]];
+        }
+        else
+        {
+            width += [self advanceOfSequence:&characters[i] length:sequenceLength];
+        }
+        i += sequenceLength;
+    }
+    return width;
+}
+
+#pragma mark - Private Methods
+
+/**
+ * Pages are published with a compare and swap, so two threads allocating the same page keep only one of them.  An
+ *  advance may be measured twice by racing threads, but both store the same value.
+ **/
+- (CGFloat)advanceOfCharacter:(unichar)character
+{
+    float **page = &_pages[character / kRZCellSizeCharacterMetricsPageSize];
+    float *advances = __atomic_load_n(page, __ATOMIC_ACQUIRE);
+    if (advances == NULL)
+    {
+        float *newAdvances = malloc(kRZCellSizeCharacterMetricsPageSize * sizeof(float));
+        NSAssert(newAdvances != NULL, @"Unable to allocate character advances");
+        for (NSUInteger j = 0; j < kRZCellSizeCharacterMetricsPageSize; j++)
+        {
+            newAdvances[j] = kRZCellSizeCharacterMetricsNotMeasured;
+        }
+        if (__atomic_compare_exchange_n(page, &advances, newAdvances, NO, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        {
+            advances = newAdvances;
+        }
+        else
+        {
+            free(newAdvances);
+        }
+    }
+    
+    float *advance = &advances[character % kRZCellSizeCharacterMetricsPageSize];
+    float value;
+    __atomic_load(advance, &value, __ATOMIC_RELAXED);
+    if (value == kRZCellSizeCharacterMetricsNotMeasured)
+    {
+        value = (float)self.advanceBlock(character);
+        __atomic_store(advance, &value, __ATOMIC_RELAXED);
+    }
+    return value;
+}
+
+- (CGFloat)advanceOfSequence:(const unichar *)characters length:(NSUInteger)length
+{
+    if (self.sequenceAdvanceBlock == nil)
+    {
+        CGFloat advance = 0.0f;
+        for (NSUInteger i = 0; i < length; i++)
+        {
+            advance += [self advanceOfCharacter:characters[i]];
+        }
+        return advance;
+    }
+    
+    NSString* sequence = [NSString stringWithCharacters:characters length:length];
+    NSNumber* advance = nil;
+    @synchronized(self.sequenceAdvances) {
+        advance = [self.sequenceAdvances objectForKey:sequence];
+    }
+    if (advance == nil)
+    {
+        advance = @(self.sequenceAdvanceBlock(sequence));
+        @synchronized(self.sequenceAdvances) {
+            [self.sequenceAdvances setObject:advance forKey:sequence];
+        }
+    }
+    return [advance doubleValue];
+}
+
+@end
+
+#pragma mark - RZCellSizeTextBlock
+
+@interface RZCellSizeTextBlock ()
+
+@property (nonatomic, strong, readwrite) id<RZCellSizeFontMetrics> metrics;
+@property (nonatomic, copy, readwrite) RZCellSizeTextBlockStringBlock stringBlock;
+@property (nonatomic, strong) NSCache* lineCounts;
+
+@end
+
+@implementation RZCellSizeTextBlock
+
++ (instancetype)textBlockWithMetrics:(id<RZCellSizeFontMetrics>)metrics stringBlock:(RZCellSizeTextBlockStringBlock)stringBlock
+{
+    NSParameterAssert(metrics);
+    NSParameterAssert(stringBlock);
+    RZCellSizeTextBlock* textBlock = [[self alloc] init];
+    textBlock.metrics = metrics;
+    textBlock.stringBlock = stringBlock;
+    textBlock.lineCounts = [[NSCache alloc] init];
+    return textBlock;
+}
+
+/**
+ * Line counts are kept for each string in a small dictionary of width to count, since a string is usually only laid
+ *  out at one or two widths.
+ **/
+- (CGFloat)heightOfString:(NSString *)string width:(CGFloat)width
+{
+    if (string.length == 0)
+    {
+        return 0.0f;
+    }
+    
+    NSMutableDictionary* lineCountsByWidth = [self.lineCounts objectForKey:string];
+    NSNumber* lineCount = [lineCountsByWidth objectForKey:@(width)];
+    if (lineCount == nil)
+    {
+        lineCount = @(RZCellSizeTextLayoutNumberOfLines(string, self.metrics, width));
+        if (lineCountsByWidth == nil)
+        {
+            lineCountsByWidth = [NSMutableDictionary dictionary];
+            [self.lineCounts setObject:lineCountsByWidth forKey:[string copy]];
+        }
+        [lineCountsByWidth setObject:lineCount forKey:@(width)];
+    }
+    
+    NSUInteger lines = [lineCount unsignedIntegerValue];
+    if (self.numberOfLines > 0)
+    {
+        lines = MIN(lines, self.numberOfLines);
+    }
+    return ceil(lines * self.metrics.lineHeight);
+}
+
+@end
+
+#pragma mark - RZCellSizeTextStack
+
+@interface RZCellSizeTextStack ()
+
+@property (nonatomic, copy, readwrite) NSArray* textBlocks;
+
+@end
+
+@implementation RZCellSizeTextStack
+
+- (instancetype)initWithTextBlocks:(NSArray *)textBlocks
+{
+    NSParameterAssert(textBlocks);
+    self = [super init];
+    if ( self ) {
+        _textBlocks = [textBlocks copy];
+    }
+    return self;
+}
+
+- (BOOL)getHeight:(CGFloat *)height forObject:(id)object width:(CGFloat)width
+{
+    NSParameterAssert(height);
+    
+    CGFloat textWidth = width - self.leadingInset - self.trailingInset;
+    CGFloat totalHeight = self.topInset + self.bottomInset;
+    CGFloat spacing = 0.0f;
+    for (RZCellSizeTextBlock* textBlock in self.textBlocks)
+    {
+        id string = textBlock.stringBlock(object);
+        if (string != nil && ![string isKindOfClass:[NSString class]])
+        {
+            return NO;
+        }
+        // An empty block takes no space, so the spacing only goes between blocks that have text.
+        CGFloat blockHeight = [textBlock heightOfString:string width:textWidth];
+        if (blockHeight > 0.0f)
+        {
+            totalHeight += spacing + blockHeight;
+            spacing = textBlock.spacingAfter;
+        }
+    }
+    *height = totalHeight;
+    return YES;
+}
+
+@end
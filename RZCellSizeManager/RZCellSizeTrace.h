@@ -0,0 +1,252 @@
+//
+//  RZCellSizeTrace.h
+//
+
+
+// Copyright 2014 Raizlabs and other contributors
+// http://raizlabs.com/
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#import <Foundation/Foundation.h>
+#import <CoreGraphics/CoreGraphics.h>
+
+typedef NS_ENUM(uint8_t, RZCellSizeTraceEventType) {
+    RZCellSizeTraceEventRegistration = 1,
+    RZCellSizeTraceEventWidthChange,
+    RZCellSizeTraceEventLookup,
+    RZCellSizeTraceEventInvalidateAll,
+    RZCellSizeTraceEventInvalidateContentKeyed,
+    RZCellSizeTraceEventInvalidateSection,
+    RZCellSizeTraceEventInvalidateClass,
+    RZCellSizeTraceEventInvalidateRow,
+    RZCellSizeTraceEventInsertRow,
+    RZCellSizeTraceEventDeleteRow,
+    RZCellSizeTraceEventMoveRow,
+    RZCellSizeTraceEventInsertSection,
+    RZCellSizeTraceEventDeleteSection,
+    RZCellSizeTraceEventBeginUpdates,
+    RZCellSizeTraceEventEndUpdates,
+    RZCellSizeTraceEventMemoryWarning,
+    RZCellSizeTraceEventFocusChange
+};
+
+/**
+ *  Set on a lookup that was answered from the cache when it was recorded.
+ */
+#define kRZCellSizeTraceFlagHit (1 << 0)
+
+/**
+ *  One event of a trace, 32 bytes on disk.
+ *
+ *  row and section locate the cell of lookups, invalidations and structural changes, or the visible index path of a
+ *  focus change, which is UINT32_MAX when the visible index path was cleared; toRow and toSection are the destination
+ *  of a move.  width and height are the size returned by a lookup, or the new width of a width change.  classTag is
+ *  the cell class of lookups, registrations and class invalidations.  time is the number of microseconds since
+ *  recording started, which wraps after about 71 minutes.
+ **/
+typedef struct {
+    uint8_t type;
+    uint8_t flags;
+    uint8_t classTag;
+    uint8_t reserved;
+    uint32_t section;
+    uint32_t row;
+    uint32_t toSection;
+    uint32_t toRow;
+    float width;
+    float height;
+    uint32_t time;
+} RZCellSizeTraceRecord;
+
+/**
+ *  Parameters of a synthetic trace modelled on the demo's random Core Data movement.  Each movement is an insert,
+ *  delete or update of a random row, chosen with the relative rates, followed by lookups of the visible rows
+ *  around a scroll position that wanders through the list.
+ **/
+typedef struct {
+    NSUInteger numberOfRows;
+    NSUInteger numberOfMovements;
+    double insertRate;
+    double deleteRate;
+    double updateRate;
+    NSUInteger numberOfVisibleRows;
+    uint32_t seed;
+} RZCellSizeTraceRandomMovementOptions;
+
+/**
+ *  Options that match the demo: 100 rows, equal insert, delete and update rates and 10 visible rows.
+ */
+RZCellSizeTraceRandomMovementOptions RZCellSizeTraceDefaultRandomMovementOptions(NSUInteger numberOfMovements);
+
+/**
+ *  RZCellSizeTraceRecorder
+ *
+ *  Writes the calls made to an RZCellSizeManager to a compact binary file that RZCellSizeTraceReplayer can run
+ *  again offline.  The changes made by the Core Data and RZCollectionList extensions are recorded through the manager
+ *  calls they make.  Not thread safe; like the manager, it should only be used from the main thread.
+ **/
+@interface RZCellSizeTraceRecorder : NSObject
+
+/**
+ *  Create a recorder, replacing any file at the path.
+ *
+ *  @param path Path of the trace file. Must not be nil.
+ *
+ *  @return New recorder, or nil if the file could not be created.
+ */
+- (instancetype)initWithPath:(NSString *)path;
+
+@property (nonatomic, readonly) NSString* path;
+
+/**
+ *  Number of events recorded.
+ */
+@property (nonatomic, readonly) NSUInteger count;
+
+/**
+ *  Record an event that only has a type and a position.  Unused fields are 0.
+ *
+ *  @param type    Type of the event.
+ *  @param row     Row of the event.
+ *  @param section Section of the event.
+ */
+- (void)recordEvent:(RZCellSizeTraceEventType)type row:(NSUInteger)row inSection:(NSUInteger)section;
+
+/**
+ *  Record a registration or an invalidation of a cell class.
+ *
+ *  @param type     RZCellSizeTraceEventRegistration or RZCellSizeTraceEventInvalidateClass.
+ *  @param classTag Tag of the cell class.
+ */
+- (void)recordEvent:(RZCellSizeTraceEventType)type classTag:(uint8_t)classTag;
+
+/**
+ *  Record a size lookup.
+ *
+ *  @param row      Row of the cell.
+ *  @param section  Section of the cell.
+ *  @param classTag Tag of the cell class.
+ *  @param hit      YES if the size was in the cache.
+ *  @param size     Size returned.
+ */
+- (void)recordLookupOfRow:(NSUInteger)row inSection:(NSUInteger)section classTag:(uint8_t)classTag hit:(BOOL)hit size:(CGSize)size;
+
+/**
+ *  Record a move of a row.
+ */
+- (void)recordMoveOfRow:(NSUInteger)row inSection:(NSUInteger)section toRow:(NSUInteger)newRow inSection:(NSUInteger)newSection;
+
+/**
+ *  Record a change of the width the sizes are computed at.
+ */
+- (void)recordWidthChange:(CGFloat)width;
+
+/**
+ *  Record a synthetic trace, for benchmarking cache changes without a device.  Sizes are random heights from 44 to
+ *  200 points, and the same options always produce the same trace.
+ *
+ *  @param options Parameters of the trace.
+ */
+- (void)recordRandomMovementWithOptions:(RZCellSizeTraceRandomMovementOptions)options;
+
+/**
+ *  Write buffered events to the file.
+ */
+- (void)flush;
+
+@end
+
+
+/**
+ *  RZCellSizeTraceReplayResult
+ *
+ *  What happened while a trace was replayed.
+ **/
+@interface RZCellSizeTraceReplayResult : NSObject
+
+@property (nonatomic, assign) NSUInteger events;
+@property (nonatomic, assign) NSUInteger lookups;
+@property (nonatomic, assign) NSUInteger hits;
+
+/**
+ *  Lookups that were hits when the trace was recorded.  Comparing it to hits shows how a change to the cache
+ *  affected the hit rate.
+ */
+@property (nonatomic, assign) NSUInteger recordedHits;
+
+/**
+ *  Time spent replaying, in seconds, not counting loading the trace.
+ */
+@property (nonatomic, assign) NSTimeInterval duration;
+
+/**
+ *  Largest number of bytes used by the caches of every width, sampled every 1024 events and at the end.
+ */
+@property (nonatomic, assign) NSUInteger peakByteCount;
+
+@property (nonatomic, readonly) double eventsPerSecond;
+@property (nonatomic, readonly) double hitRate;
+
+@end
+
+
+/**
+ *  RZCellSizeTraceReplayer
+ *
+ *  Drives RZCellSizeCache from a trace the way RZCellSizeManager would, without cells or UIKit: a lookup that misses
+ *  stores the size that was measured when the trace was recorded.  Replaying the same trace before and after a change
+ *  to the cache compares their throughput, hit rate and memory.
+ **/
+@interface RZCellSizeTraceReplayer : NSObject
+
+/**
+ *  Load a trace.
+ *
+ *  @param path Path of a file written by RZCellSizeTraceRecorder. Must not be nil.
+ *
+ *  @return New replayer, or nil if the file is missing or is not a trace.
+ */
+- (instancetype)initWithPath:(NSString *)path;
+
+/**
+ *  Number of events in the trace.
+ */
+@property (nonatomic, readonly) NSUInteger count;
+
+/**
+ *  Byte budget of each cache, as set by cellSizeCacheByteBudget on the manager.  Defaults to 0, for no limit.
+ */
+@property (nonatomic, assign) NSUInteger byteBudget;
+
+/**
+ *  Number of widths kept, as set by maximumNumberOfCachedWidths on the manager.  Defaults to 2.
+ */
+@property (nonatomic, assign) NSUInteger maximumNumberOfCachedWidths;
+
+/**
+ *  Replay the whole trace against new caches.
+ *
+ *  @return The results of the replay.
+ */
+- (RZCellSizeTraceReplayResult *)replay;
+
+@end
@@ -0,0 +1,530 @@
+//
+//  RZCellSizeTrace.m
+//
+
+
+// Copyright 2014 Raizlabs and other contributors
+// http://raizlabs.com/
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#import "RZCellSizeTrace.h"
+#import "RZCellSizeCache.h"
+#import "RZCellSizeStatistics.h"
+
+static const uint32_t kRZCellSizeTraceMagic = 0x54435a52; // "RZCT"
+static const uint32_t kRZCellSizeTraceVersion = 1;
+static const NSUInteger kRZCellSizeTraceSampleInterval = 1024;
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t recordSize;
+} RZCellSizeTraceHeader;
+
+/**
+ *  xorshift32, so a seed always produces the same trace.  The state must not be 0.
+ **/
+static uint32_t RZCellSizeTraceRandom(uint32_t *state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+static NSIndexPath *RZCellSizeTraceIndexPath(NSUInteger section, NSUInteger row)
+{
+    NSUInteger indexes[] = { section, row };
+    return [NSIndexPath indexPathWithIndexes:indexes length:2];
+}
+
+RZCellSizeTraceRandomMovementOptions RZCellSizeTraceDefaultRandomMovementOptions(NSUInteger numberOfMovements)
+{
+    RZCellSizeTraceRandomMovementOptions options;
+    options.numberOfRows = 100;
+    options.numberOfMovements = numberOfMovements;
+    options.insertRate = 1.0;
+    options.deleteRate = 1.0;
+    options.updateRate = 1.0;
+    options.numberOfVisibleRows = 10;
+    options.seed = 1;
+    return options;
+}
+
+
+@interface RZCellSizeTraceRecorder ()
+{
+    FILE *_file;
+    uint64_t _startTime;
+}
+
+@end
+
+@implementation RZCellSizeTraceRecorder
+
+- (instancetype)initWithPath:(NSString *)path
+{
+    NSParameterAssert(path);
+    
+    self = [super init];
+    if ( self ) {
+        _path = [path copy];
+        _file = fopen([path fileSystemRepresentation], "wb");
+        if (_file == NULL)
+        {
+            return nil;
+        }
+        
+        RZCellSizeTraceHeader header = { kRZCellSizeTraceMagic, kRZCellSizeTraceVersion, sizeof(RZCellSizeTraceRecord) };
+        fwrite(&header, sizeof(header), 1, _file);
+        _startTime = RZCellSizeStatisticsNow();
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    if (_file)
+    {
+        fclose(_file);
+    }
+}
+
+#pragma mark - Public Methods
+
+- (void)recordEvent:(RZCellSizeTraceEventType)type row:(NSUInteger)row inSection:(NSUInteger)section
+{
+    RZCellSizeTraceRecord record = { 0 };
+    record.type = type;
+    record.row = (uint32_t)row;
+    record.section = (uint32_t)section;
+    [self writeRecord:&record];
+}
+
+- (void)recordEvent:(RZCellSizeTraceEventType)type classTag:(uint8_t)classTag
+{
+    RZCellSizeTraceRecord record = { 0 };
+    record.type = type;
+    record.classTag = classTag;
+    [self writeRecord:&record];
+}
+
+- (void)recordLookupOfRow:(NSUInteger)row inSection:(NSUInteger)section classTag:(uint8_t)classTag hit:(BOOL)hit size:(CGSize)size
+{
+    RZCellSizeTraceRecord record = { 0 };
+    record.type = RZCellSizeTraceEventLookup;
+    record.flags = hit ? kRZCellSizeTraceFlagHit : 0;
+    record.classTag = classTag;
+    record.row = (uint32_t)row;
+    record.section = (uint32_t)section;
+    record.width = size.width;
+    record.height = size.height;
+    [self writeRecord:&record];
+}
+
+- (void)recordMoveOfRow:(NSUInteger)row inSection:(NSUInteger)section toRow:(NSUInteger)newRow inSection:(NSUInteger)newSection
+{
+    RZCellSizeTraceRecord record = { 0 };
+    record.type = RZCellSizeTraceEventMoveRow;
+    record.row = (uint32_t)row;
+    record.section = (uint32_t)section;
+    record.toRow = (uint32_t)newRow;
+    record.toSection = (uint32_t)newSection;
+    [self writeRecord:&record];
+}
+
+- (void)recordWidthChange:(CGFloat)width
+{
+    RZCellSizeTraceRecord record = { 0 };
+    record.type = RZCellSizeTraceEventWidthChange;
+    record.width = width;
+    [self writeRecord:&record];
+}
+
+/**
+ *  Keeps a list of which rows have been measured, as an unlimited cache would, so the lookups are recorded as hits
+ *  or misses the way the manager would have recorded them.
+ **/
+- (void)recordRandomMovementWithOptions:(RZCellSizeTraceRandomMovementOptions)options
+{
+    uint32_t state = options.seed ?: 1;
+    BOOL notMeasured = NO;
+    double totalRate = options.insertRate + options.deleteRate + options.updateRate;
+    NSUInteger visibleRows = MAX(options.numberOfVisibleRows, 1);
+    
+    NSMutableData* heights = [NSMutableData dataWithLength:options.numberOfRows * sizeof(float)];
+    NSMutableData* measured = [NSMutableData dataWithLength:options.numberOfRows * sizeof(BOOL)];
+    for (NSUInteger row = 0; row < options.numberOfRows; row++)
+    {
+        ((float *)[heights mutableBytes])[row] = 44 + RZCellSizeTraceRandom(&state) % 157;
+    }
+    
+    [self recordEvent:RZCellSizeTraceEventRegistration classTag:1];
+    
+    NSUInteger scrollRow = 0;
+    for (NSUInteger movement = 0; movement < options.numberOfMovements; movement++)
+    {
+        NSUInteger rowCount = [heights length] / sizeof(float);
+        double action = (totalRate > 0.0) ? (RZCellSizeTraceRandom(&state) / (double)UINT32_MAX) * totalRate : totalRate;
+        float height = 44 + RZCellSizeTraceRandom(&state) % 157;
+        
+        [self recordEvent:RZCellSizeTraceEventBeginUpdates row:0 inSection:0];
+        if (action < options.insertRate)
+        {
+            NSUInteger row = RZCellSizeTraceRandom(&state) % (rowCount + 1);
+            [heights replaceBytesInRange:NSMakeRange(row * sizeof(float), 0) withBytes:&height length:sizeof(float)];
+            [measured replaceBytesInRange:NSMakeRange(row * sizeof(BOOL), 0) withBytes:&notMeasured length:sizeof(BOOL)];
+            [self recordEvent:RZCellSizeTraceEventInsertRow row:row inSection:0];
+        }
+        else if (action < options.insertRate + options.deleteRate)
+        {
+            if (rowCount > 0)
+            {
+                NSUInteger row = RZCellSizeTraceRandom(&state) % rowCount;
+                [heights replaceBytesInRange:NSMakeRange(row * sizeof(float), sizeof(float)) withBytes:NULL length:0];
+                [measured replaceBytesInRange:NSMakeRange(row * sizeof(BOOL), sizeof(BOOL)) withBytes:NULL length:0];
+                [self recordEvent:RZCellSizeTraceEventDeleteRow row:row inSection:0];
+            }
+        }
+        else if (rowCount > 0)
+        {
+            NSUInteger row = RZCellSizeTraceRandom(&state) % rowCount;
+            ((float *)[heights mutableBytes])[row] = height;
+            ((BOOL *)[measured mutableBytes])[row] = NO;
+            [self recordEvent:RZCellSizeTraceEventInvalidateRow row:row inSection:0];
+        }
+        [self recordEvent:RZCellSizeTraceEventEndUpdates row:0 inSection:0];
+        
+        // Scroll up or down by up to a screen, then look up every visible row.
+        rowCount = [heights length] / sizeof(float);
+        NSInteger scrollDelta = (NSInteger)(RZCellSizeTraceRandom(&state) % (2 * visibleRows + 1)) - (NSInteger)visibleRows;
+        NSUInteger maximumScrollRow = (rowCount > visibleRows) ? rowCount - visibleRows : 0;
+        scrollRow = (NSUInteger)MIN(MAX((NSInteger)scrollRow + scrollDelta, 0), (NSInteger)maximumScrollRow);
+        [self recordEvent:RZCellSizeTraceEventFocusChange row:scrollRow inSection:0];
+        
+        for (NSUInteger row = scrollRow; row < MIN(scrollRow + visibleRows, rowCount); row++)
+        {
+            BOOL* rowMeasured = &((BOOL *)[measured mutableBytes])[row];
+            [self recordLookupOfRow:row
+                          inSection:0
+                           classTag:1
+                                hit:*rowMeasured
+                               size:CGSizeMake(0.0f, ((float *)[heights mutableBytes])[row])];
+            *rowMeasured = YES;
+        }
+    }
+}
+
+- (void)flush
+{
+    fflush(_file);
+}
+
+#pragma mark - Private Methods
+
+- (void)writeRecord:(RZCellSizeTraceRecord *)record
+{
+    record->time = (uint32_t)((RZCellSizeStatisticsNow() - _startTime) / 1000);
+    if (fwrite(record, sizeof(RZCellSizeTraceRecord), 1, _file) == 1)
+    {
+        _count++;
+    }
+}
+
+@end
+
+
+@implementation RZCellSizeTraceReplayResult
+
+- (double)eventsPerSecond
+{
+    return (self.duration > 0.0) ? self.events / self.duration : 0.0;
+}
+
+- (double)hitRate
+{
+    return (self.lookups > 0) ? (double)self.hits / self.lookups : 0.0;
+}
+
+- (NSString *)description
+{
+    return [NSString stringWithFormat:@"<%@: %p events=%lu eventsPerSecond=%.0f lookups=%lu hitRate=%.3f recordedHitRate=%.3f peakBytes=%lu>",
+            NSStringFromClass([self class]), self, (unsigned long)self.events, self.eventsPerSecond, (unsigned long)self.lookups,
+            self.hitRate, (self.lookups > 0) ? (double)self.recordedHits / self.lookups : 0.0, (unsigned long)self.peakByteCount];
+}
+
+@end
+
+
+@interface RZCellSizeTraceReplayer ()
+
+@property (nonatomic, strong) NSData* data;
+@property (nonatomic, strong) NSMutableArray* caches;
+@property (nonatomic, strong) NSMutableArray* cachedWidths;
+@property (nonatomic, strong) RZCellSizeCache* cache;
+@property (nonatomic, strong) RZCellSizeCacheUpdates* pendingUpdates;
+@property (nonatomic, assign) NSUInteger updatesNestingLevel;
+@property (nonatomic, assign) NSUInteger focusRow;
+@property (nonatomic, assign) NSUInteger focusSection;
+
+@end
+
+@implementation RZCellSizeTraceReplayer
+
+- (instancetype)initWithPath:(NSString *)path
+{
+    NSParameterAssert(path);
+    
+    self = [super init];
+    if ( self ) {
+        _data = [NSData dataWithContentsOfFile:path options:NSDataReadingMappedIfSafe error:NULL];
+        const RZCellSizeTraceHeader *header = [_data bytes];
+        if ([_data length] < sizeof(RZCellSizeTraceHeader) ||
+            header->magic != kRZCellSizeTraceMagic ||
+            header->version != kRZCellSizeTraceVersion ||
+            header->recordSize != sizeof(RZCellSizeTraceRecord))
+        {
+            return nil;
+        }
+        
+        // A trace cut short by a crash ends with part of a record, which is ignored.
+        _count = ([_data length] - sizeof(RZCellSizeTraceHeader)) / sizeof(RZCellSizeTraceRecord);
+        _maximumNumberOfCachedWidths = 2;
+    }
+    return self;
+}
+
+#pragma mark - Public Methods
+
+- (RZCellSizeTraceReplayResult *)replay
+{
+    RZCellSizeTraceReplayResult* result = [[RZCellSizeTraceReplayResult alloc] init];
+    const RZCellSizeTraceRecord *records = (const RZCellSizeTraceRecord *)((const uint8_t *)[self.data bytes] + sizeof(RZCellSizeTraceHeader));
+    
+    self.caches = [NSMutableArray array];
+    self.cachedWidths = [NSMutableArray array];
+    self.pendingUpdates = nil;
+    self.updatesNestingLevel = 0;
+    self.focusRow = NSNotFound;
+    self.focusSection = NSNotFound;
+    [self activateCacheForWidth:0.0f];
+    
+    uint64_t startTime = RZCellSizeStatisticsNow();
+    for (NSUInteger i = 0; i < self.count; i++)
+    {
+        [self replayRecord:&records[i] result:result];
+        if (i % kRZCellSizeTraceSampleInterval == 0)
+        {
+            result.peakByteCount = MAX(result.peakByteCount, [self byteCount]);
+        }
+    }
+    result.duration = (RZCellSizeStatisticsNow() - startTime) / (double)NSEC_PER_SEC;
+    result.peakByteCount = MAX(result.peakByteCount, [self byteCount]);
+    result.events = self.count;
+    
+    self.caches = nil;
+    self.cachedWidths = nil;
+    self.cache = nil;
+    return result;
+}
+
+#pragma mark - Private Methods
+
+/**
+ *  Mirrors what RZCellSizeManager does for each call.  Changes between begin and end updates are collected and
+ *  applied together, and structural changes apply to the caches of every width.
+ **/
+- (void)replayRecord:(const RZCellSizeTraceRecord *)record result:(RZCellSizeTraceReplayResult *)result
+{
+    switch (record->type) {
+        case RZCellSizeTraceEventWidthChange:
+            [self activateCacheForWidth:record->width];
+            break;
+        case RZCellSizeTraceEventFocusChange:
+            // A cleared focus is recorded as NSNotFound, truncated to 32 bits.
+            self.focusRow = (record->row == UINT32_MAX) ? NSNotFound : record->row;
+            self.focusSection = (record->section == UINT32_MAX) ? NSNotFound : record->section;
+            for (RZCellSizeCache* cache in self.caches)
+            {
+                [cache setFocusRow:self.focusRow inSection:self.focusSection];
+            }
+            break;
+        case RZCellSizeTraceEventLookup:
+            result.lookups++;
+            if (record->flags & kRZCellSizeTraceFlagHit)
+            {
+                result.recordedHits++;
+            }
+            if ([self.cache getSize:NULL forRow:record->row inSection:record->section])
+            {
+                result.hits++;
+            }
+            else
+            {
+                [self.cache setSize:CGSizeMake(record->width, record->height) forRow:record->row inSection:record->section classTag:record->classTag];
+            }
+            break;
+        case RZCellSizeTraceEventInvalidateAll:
+            for (RZCellSizeCache* cache in self.caches)
+            {
+                [cache invalidateAllSizes];
+            }
+            break;
+        case RZCellSizeTraceEventInvalidateContentKeyed:
+            for (RZCellSizeCache* cache in self.caches)
+            {
+                [cache removeAllContentKeyedSizes];
+            }
+            break;
+        case RZCellSizeTraceEventInvalidateClass:
+            for (RZCellSizeCache* cache in self.caches)
+            {
+                [cache invalidateSizesWithClassTag:record->classTag];
+            }
+            break;
+        case RZCellSizeTraceEventInvalidateSection:
+        case RZCellSizeTraceEventInvalidateRow:
+        case RZCellSizeTraceEventInsertRow:
+        case RZCellSizeTraceEventDeleteRow:
+        case RZCellSizeTraceEventMoveRow:
+        case RZCellSizeTraceEventInsertSection:
+        case RZCellSizeTraceEventDeleteSection:
+        {
+            // Outside a batch, a change is a batch of its own, which gives the same result as applying it directly.
+            BOOL batched = (self.pendingUpdates != nil);
+            RZCellSizeCacheUpdates* updates = batched ? self.pendingUpdates : [[RZCellSizeCacheUpdates alloc] init];
+            [self addRecord:record toUpdates:updates];
+            if (!batched)
+            {
+                [self applyUpdates:updates];
+            }
+        }
+            break;
+        case RZCellSizeTraceEventBeginUpdates:
+            if (self.updatesNestingLevel == 0)
+            {
+                self.pendingUpdates = [[RZCellSizeCacheUpdates alloc] init];
+            }
+            self.updatesNestingLevel++;
+            break;
+        case RZCellSizeTraceEventEndUpdates:
+            if (self.updatesNestingLevel > 0)
+            {
+                self.updatesNestingLevel--;
+                if (self.updatesNestingLevel == 0)
+                {
+                    [self applyUpdates:self.pendingUpdates];
+                    self.pendingUpdates = nil;
+                }
+            }
+            break;
+        case RZCellSizeTraceEventMemoryWarning:
+            [self.caches setArray:@[self.cache]];
+            [self.cachedWidths setArray:@[[self.cachedWidths firstObject]]];
+            [self.cache trimToByteCount:self.cache.byteCount / 2];
+            [self.cache removeAllContentKeyedSizes];
+            [self.cache removeAllLayoutSignatureSizes];
+            break;
+        default:
+            break;
+    }
+}
+
+- (void)addRecord:(const RZCellSizeTraceRecord *)record toUpdates:(RZCellSizeCacheUpdates *)updates
+{
+    switch (record->type) {
+        case RZCellSizeTraceEventInvalidateSection:
+            [updates.invalidatedSections addIndex:record->section];
+            break;
+        case RZCellSizeTraceEventInvalidateRow:
+            [updates.invalidatedIndexPaths addObject:RZCellSizeTraceIndexPath(record->section, record->row)];
+            break;
+        case RZCellSizeTraceEventInsertRow:
+            [updates.insertedIndexPaths addObject:RZCellSizeTraceIndexPath(record->section, record->row)];
+            break;
+        case RZCellSizeTraceEventDeleteRow:
+            [updates.deletedIndexPaths addObject:RZCellSizeTraceIndexPath(record->section, record->row)];
+            break;
+        case RZCellSizeTraceEventMoveRow:
+            [updates.movedFromIndexPaths addObject:RZCellSizeTraceIndexPath(record->section, record->row)];
+            [updates.movedToIndexPaths addObject:RZCellSizeTraceIndexPath(record->toSection, record->toRow)];
+            break;
+        case RZCellSizeTraceEventInsertSection:
+            [updates.insertedSections addIndex:record->section];
+            break;
+        case RZCellSizeTraceEventDeleteSection:
+            [updates.deletedSections addIndex:record->section];
+            break;
+        default:
+            break;
+    }
+}
+
+- (void)applyUpdates:(RZCellSizeCacheUpdates *)updates
+{
+    for (RZCellSizeCache* cache in self.caches)
+    {
+        [updates applyToCache:cache];
+    }
+}
+
+- (void)activateCacheForWidth:(CGFloat)width
+{
+    NSNumber* widthKey = @(width);
+    NSUInteger index = [self.cachedWidths indexOfObject:widthKey];
+    RZCellSizeCache* cache = nil;
+    if (index == NSNotFound)
+    {
+        cache = [[RZCellSizeCache alloc] init];
+        cache.byteBudget = self.byteBudget;
+        [cache setFocusRow:self.focusRow inSection:self.focusSection];
+    }
+    else
+    {
+        cache = [self.caches objectAtIndex:index];
+        [self.caches removeObjectAtIndex:index];
+        [self.cachedWidths removeObjectAtIndex:index];
+    }
+    [self.caches insertObject:cache atIndex:0];
+    [self.cachedWidths insertObject:widthKey atIndex:0];
+    self.cache = cache;
+    
+    while (self.caches.count > MAX(self.maximumNumberOfCachedWidths, 1))
+    {
+        [self.caches removeLastObject];
+        [self.cachedWidths removeLastObject];
+    }
+}
+
+- (NSUInteger)byteCount
+{
+    NSUInteger byteCount = 0;
+    for (RZCellSizeCache* cache in self.caches)
+    {
+        byteCount += cache.byteCount;
+    }
+    return byteCount;
+}
+
+@end
@@ -149,6 +149,7 @@
 #pragma mark - NSFetchedResultsControllerDelegate
 - (void)controllerWillChangeContent:(NSFetchedResultsController *)controller
 {
+    [self.sizeManager beginCellSizeUpdates];
     [self.tableView beginUpdates];
 }
 
@@ -173,6 +174,7 @@
 
 - (void)controllerDidChangeContent:(NSFetchedResultsController *)controller
 {
+    [self.sizeManager endCellSizeUpdates];
     [self.tableView endUpdates];
 }
 
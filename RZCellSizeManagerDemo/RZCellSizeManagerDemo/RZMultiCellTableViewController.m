@@ -18,6 +18,7 @@
 #define kRZMaxCells             100
 #define kRZMaxTitleLength       50
 #define kRZMaxDescriptionLength 200
+#define kRZRefreshedCells       10
 
 @interface RZMultiCellTableViewController () <UITableViewDataSource, UITableViewDelegate>
 @property (weak, nonatomic) IBOutlet UITableView *tableView;
@@ -45,23 +46,23 @@
     NSMutableArray* arry = [NSMutableArray array];
     for (int i = 0; i<kRZMaxCells; i++)
     {
-        int rando = arc4random_uniform(2);
-        // We are going to add two different objects to the datasource.  One fore the regular cell and one for our secondCell
-        switch (rando) {
-            case 0:
-                [arry addObject:[RZCellData cellDataWithTitle:[NSString randomStringOfMaxLength:kRZMaxTitleLength] subTitle:[NSString randomStringOfMaxLength:kRZMaxDescriptionLength]]];
-                break;
-            case 1:
-                [arry addObject:[RZOtherCellData otherCellDataWithTitle:[NSString randomStringOfMaxLength:kRZMaxTitleLength]]];
-                break;
-            default:
-                break;
-        }
-        
+        [arry addObject:[self randomObject]];
     }
     self.dataArray = [NSArray arrayWithArray:arry];
 }
 
+- (id)randomObject
+{
+    int rando = arc4random_uniform(2);
+    // We are going to add two different objects to the datasource.  One fore the regular cell and one for our secondCell
+    switch (rando) {
+        case 0:
+            return [RZCellData cellDataWithTitle:[NSString randomStringOfMaxLength:kRZMaxTitleLength] subTitle:[NSString randomStringOfMaxLength:kRZMaxDescriptionLength]];
+        default:
+            return [RZOtherCellData otherCellDataWithTitle:[NSString randomStringOfMaxLength:kRZMaxTitleLength]];
+    }
+}
+
 - (void)configureSizeManager
 {
     // Initialize the size manager.  In this case we are using a configuration block to compute the height.
@@ -109,11 +110,19 @@
 
 - (void)reloadPressed
 {
-    [self configureDataSource];
+    // Replace a few objects and shuffle a few others, which is all that changes between most refreshes.
+    NSMutableArray* refreshedData = [self.dataArray mutableCopy];
+    for (int i = 0; i < kRZRefreshedCells; i++)
+    {
+        [refreshedData replaceObjectAtIndex:arc4random_uniform((u_int32_t)refreshedData.count) withObject:[self randomObject]];
+        [refreshedData exchangeObjectAtIndex:arc4random_uniform((u_int32_t)refreshedData.count)
+                           withObjectAtIndex:arc4random_uniform((u_int32_t)refreshedData.count)];
+    }
     
-    // In this case we are going to invalidate our entire height cache since we are changing the entire datasource.  It is possible
-    //  to just invalidate a speific indexpath or an array of them, and you should so long as you know what is being invalidated.
-    [self.sizeManager invalidateCellSizeCache];
+    // Rather than invalidating the whole height cache, the cached heights follow their objects to their new rows and only
+    //  the new objects are measured again.  The diff could also be used to animate the changes.
+    [self.sizeManager migrateCellSizesInSection:0 fromIdentities:self.dataArray toIdentities:refreshedData];
+    self.dataArray = refreshedData;
     
     [self.tableView reloadData];
 }
@@ -160,9 +169,11 @@
 }
 
 // If you have very complex cells or a large number implementing this method speeds up initial load time.
+//  The two cell types are estimated separately, from the heights measured so far for each of them.
 - (CGFloat)tableView:(UITableView *)tableView estimatedHeightForRowAtIndexPath:(NSIndexPath *)indexPath
 {
-    return [RZTableViewCell estimatedCellHeight];
+    id object = [self.dataArray objectAtIndex:indexPath.row];
+    return [self.sizeManager estimatedCellHeightForObject:object indexPath:indexPath];
 }
 @end
 
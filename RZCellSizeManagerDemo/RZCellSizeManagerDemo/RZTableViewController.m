@@ -9,6 +9,7 @@
 #import "RZTableViewController.h"
 #import "RZCellData.h"
 #import "RZCellSizeManager.h"
+#import "RZCellSizeTextLayout.h"
 
 #import "RZTableViewCell.h"
 
@@ -17,6 +18,7 @@
 #define kRZMaxCells             100
 #define kRZMaxTitleLength       50
 #define kRZMaxDescriptionLength 200
+#define kRZRefreshedCells       10
 
 @interface RZTableViewController () <UITableViewDataSource, UITableViewDelegate>
 @property (weak, nonatomic) IBOutlet UITableView *tableView;
@@ -42,7 +44,7 @@
     NSMutableArray* arry = [NSMutableArray array];
     for (int i = 0; i<kRZMaxCells; i++)
     {
-        [arry addObject:[RZCellData cellDataWithTitle:[NSString randomStringOfMaxLength:kRZMaxTitleLength] subTitle:[NSString randomStringOfMaxLength:kRZMaxDescriptionLength]]];
+        [arry addObject:[self randomCellData]];
     }
     self.dataArray = [NSArray arrayWithArray:arry];
     
@@ -60,6 +62,36 @@
                      withConfigurationBlock:^(RZTableViewCell* cell, id object) {
                          [cell setCellData:object];
                      }];
+    
+    // The cell is just two labels inside fixed margins, so its height can be computed from the text alone.  The
+    //  configuration block above is only used for objects the text stack can not measure.
+    RZCellSizeTextBlock* titleBlock = [RZCellSizeTextBlock textBlockWithMetrics:[RZCellSizeManager characterMetricsForFont:[UIFont systemFontOfSize:17.0f]]
+                                                                    stringBlock:^id(RZCellData* object) {
+                                                                        return object.title;
+                                                                    }];
+    titleBlock.spacingAfter = 8.0f;
+    RZCellSizeTextBlock* subTitleBlock = [RZCellSizeTextBlock textBlockWithMetrics:[RZCellSizeManager characterMetricsForFont:[UIFont fontWithName:@"HelveticaNeue-Light" size:17.0f]]
+                                                                       stringBlock:^id(RZCellData* object) {
+                                                                           return object.subTitle;
+                                                                       }];
+    RZCellSizeTextStack* textStack = [[RZCellSizeTextStack alloc] initWithTextBlocks:@[titleBlock, subTitleBlock]];
+    textStack.topInset = 15.0f;
+    textStack.bottomInset = 13.0f;
+    textStack.leadingInset = 20.0f;
+    textStack.trailingInset = 20.0f;
+    [self.sizeManager setTextStack:textStack forCellClassName:@"RZTableViewCell"];
+    
+    // Longer text wraps onto more lines, so the length of the text predicts the height of rows that have not been
+    //  measured yet much better than a constant does.
+    self.sizeManager.estimatedCellHeight = [RZTableViewCell estimatedCellHeight];
+    [self.sizeManager setEstimationFeatureBlock:^double(RZCellData* object) {
+        return object.title.length + object.subTitle.length;
+    } forCellClassName:@"RZTableViewCell"];
+}
+
+- (RZCellData *)randomCellData
+{
+    return [RZCellData cellDataWithTitle:[NSString randomStringOfMaxLength:kRZMaxTitleLength] subTitle:[NSString randomStringOfMaxLength:kRZMaxDescriptionLength]];
 }
 
 - (void)configureTableView
@@ -72,11 +104,17 @@
 
 - (void)reloadPressed
 {
-    [self configureDataSource];
+    // Replace a few objects, the way a refreshed page of results usually differs only a little from the last one.
+    NSMutableArray* refreshedData = [self.dataArray mutableCopy];
+    for (int i = 0; i < kRZRefreshedCells; i++)
+    {
+        [refreshedData replaceObjectAtIndex:arc4random_uniform((u_int32_t)refreshedData.count) withObject:[self randomCellData]];
+    }
     
-    // In this case we are going to invalidate our entire height cache since we are changing the entire datasource.  It is possible
-    //  to just invalidate a speific indexpath or an array of them, and you should so long as you know what is being invalidated.
-    [self.sizeManager invalidateCellSizeCache];
+    // The objects are their own identities here, since a changed object is a new one.  Every object that is still in the
+    //  array keeps its cached height at its new row, so only the replaced ones are measured again.
+    [self.sizeManager migrateCellSizesInSection:0 fromIdentities:self.dataArray toIdentities:refreshedData];
+    self.dataArray = refreshedData;
     
     [self.tableView reloadData];
 }
@@ -114,9 +152,11 @@
 }
 
 // If you have very complex cells or a large number implementing this method speeds up initial load time.
+//  The closer the estimates are to the real heights, the less the scroll indicator jumps as rows are measured.
 - (CGFloat)tableView:(UITableView *)tableView estimatedHeightForRowAtIndexPath:(NSIndexPath *)indexPath
 {
-    return [RZTableViewCell estimatedCellHeight];
+    id object = [self.dataArray objectAtIndex:indexPath.row];
+    return [self.sizeManager estimatedCellHeightForObject:object indexPath:indexPath];
 }
 @end
 
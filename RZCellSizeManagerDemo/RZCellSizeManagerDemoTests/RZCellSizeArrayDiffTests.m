@@ -0,0 +1,188 @@
+//
+//  RZCellSizeArrayDiffTests.m
+//
+
+
+// Copyright 2014 Raizlabs and other contributors
+// http://raizlabs.com/
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+#import <XCTest/XCTest.h>
+#import <UIKit/UIKit.h>
+#import "RZCellSizeArrayDiff.h"
+#import "RZCellSizeCache.h"
+
+#define kRZDiffRoundCount       200
+#define kRZDiffMaximumCount     40
+// Identities are drawn from a small range so that some of them repeat.
+#define kRZDiffIdentityRange    60
+
+@interface RZCellSizeArrayDiffTests : XCTestCase
+
+@end
+
+@implementation RZCellSizeArrayDiffTests
+
+#pragma mark - Helpers
+
+- (NSArray *)randomIdentitiesWithCount:(NSUInteger)count
+{
+    NSMutableArray* identities = [NSMutableArray arrayWithCapacity:count];
+    for (NSUInteger i = 0; i < count; i++)
+    {
+        [identities addObject:@(random() % kRZDiffIdentityRange)];
+    }
+    return identities;
+}
+
+/**
+ *  Deletes, inserts and moves a few identities, the way a refetch would.
+ **/
+- (NSArray *)identitiesByChangingIdentities:(NSArray *)oldIdentities
+{
+    NSMutableArray* identities = [oldIdentities mutableCopy];
+    for (NSUInteger i = random() % 4; i > 0 && identities.count > 0; i--)
+    {
+        [identities removeObjectAtIndex:random() % identities.count];
+    }
+    for (NSUInteger i = random() % 4; i > 0; i--)
+    {
+        [identities insertObject:@(random() % kRZDiffIdentityRange) atIndex:random() % (identities.count + 1)];
+    }
+    for (NSUInteger i = random() % 4; i > 0 && identities.count > 1; i--)
+    {
+        NSUInteger index = random() % identities.count;
+        id identity = [identities objectAtIndex:index];
+        [identities removeObjectAtIndex:index];
+        [identities insertObject:identity atIndex:random() % (identities.count + 1)];
+    }
+    return identities;
+}
+
+/**
+ *  Length of the longest run of increasing old indexes, by brute force.
+ **/
+- (NSUInteger)longestOrderedRunOfDiff:(RZCellSizeArrayDiff *)diff
+{
+    NSUInteger newCount = diff.newCount;
+    NSUInteger* lengths = calloc(MAX(newCount, 1), sizeof(NSUInteger));
+    NSUInteger longest = 0;
+    for (NSUInteger i = 0; i < newCount; i++)
+    {
+        if (diff.oldIndexes[i] == NSNotFound)
+        {
+            continue;
+        }
+        lengths[i] = 1;
+        for (NSUInteger j = 0; j < i; j++)
+        {
+            if (diff.oldIndexes[j] != NSNotFound && diff.oldIndexes[j] < diff.oldIndexes[i])
+            {
+                lengths[i] = MAX(lengths[i], lengths[j] + 1);
+            }
+        }
+        longest = MAX(longest, lengths[i]);
+    }
+    free(lengths);
+    return longest;
+}
+
+#pragma mark - Tests
+
+- (void)testMovedIndexesAreTheFewestMoves
+{
+    srandom(1984);
+    for (NSUInteger round = 0; round < kRZDiffRoundCount; round++)
+    {
+        NSArray* oldIdentities = [self randomIdentitiesWithCount:random() % kRZDiffMaximumCount];
+        NSArray* newIdentities = [self identitiesByChangingIdentities:oldIdentities];
+        RZCellSizeArrayDiff* diff = [[RZCellSizeArrayDiff alloc] initWithOldIdentities:oldIdentities newIdentities:newIdentities];
+        
+        NSUInteger matchedCount = diff.newCount - diff.insertedIndexes.count;
+        XCTAssertEqual(diff.movedIndexes.count, matchedCount - [self longestOrderedRunOfDiff:diff], @"Round %lu", (unsigned long)round);
+        
+        NSUInteger previousOldIndex = NSNotFound;
+        for (NSUInteger i = 0; i < diff.newCount; i++)
+        {
+            NSUInteger oldIndex = diff.oldIndexes[i];
+            if (oldIndex == NSNotFound || [diff.movedIndexes containsIndex:i])
+            {
+                continue;
+            }
+            XCTAssertTrue(previousOldIndex == NSNotFound || previousOldIndex < oldIndex, @"Round %lu", (unsigned long)round);
+            previousOldIndex = oldIndex;
+        }
+        XCTAssertFalse([diff.movedIndexes intersectsIndexSet:diff.insertedIndexes]);
+    }
+}
+
+/**
+ *  A migration is traced as a batch of its deletions, insertions and moves.  Applying that batch must leave every
+ *  size where migrating the cache directly leaves it, so replays of a trace match the session.
+ **/
+- (void)testRecordedBatchMatchesMigration
+{
+    srandom(2001);
+    for (NSUInteger round = 0; round < kRZDiffRoundCount; round++)
+    {
+        NSArray* oldIdentities = [self randomIdentitiesWithCount:random() % kRZDiffMaximumCount];
+        NSArray* newIdentities = [self identitiesByChangingIdentities:oldIdentities];
+        RZCellSizeArrayDiff* diff = [[RZCellSizeArrayDiff alloc] initWithOldIdentities:oldIdentities newIdentities:newIdentities];
+        
+        RZCellSizeCache* migratedCache = [[RZCellSizeCache alloc] init];
+        RZCellSizeCache* batchedCache = [[RZCellSizeCache alloc] init];
+        for (NSUInteger row = 0; row < diff.oldCount; row++)
+        {
+            if (random() % 4 != 0)
+            {
+                [migratedCache setSize:CGSizeMake(320.0f, 10.0f + row) forRow:row inSection:0];
+                [batchedCache setSize:CGSizeMake(320.0f, 10.0f + row) forRow:row inSection:0];
+            }
+        }
+        
+        [migratedCache moveRowsInSection:0 fromOldRows:diff.oldIndexes count:diff.newCount];
+        
+        RZCellSizeCacheUpdates* updates = [[RZCellSizeCacheUpdates alloc] init];
+        [diff.deletedIndexes enumerateIndexesUsingBlock:^(NSUInteger row, BOOL *stop) {
+            [updates.deletedIndexPaths addObject:[NSIndexPath indexPathForRow:row inSection:0]];
+        }];
+        [diff.insertedIndexes enumerateIndexesUsingBlock:^(NSUInteger row, BOOL *stop) {
+            [updates.insertedIndexPaths addObject:[NSIndexPath indexPathForRow:row inSection:0]];
+        }];
+        [diff.movedIndexes enumerateIndexesUsingBlock:^(NSUInteger row, BOOL *stop) {
+            [updates.movedFromIndexPaths addObject:[NSIndexPath indexPathForRow:[diff oldIndexForNewIndex:row] inSection:0]];
+            [updates.movedToIndexPaths addObject:[NSIndexPath indexPathForRow:row inSection:0]];
+        }];
+        [updates applyToCache:batchedCache];
+        
+        for (NSUInteger row = 0; row < diff.newCount; row++)
+        {
+            CGSize migratedSize = CGSizeZero;
+            CGSize batchedSize = CGSizeZero;
+            BOOL migrated = [migratedCache getSize:&migratedSize forRow:row inSection:0];
+            BOOL batched = [batchedCache getSize:&batchedSize forRow:row inSection:0];
+            XCTAssertEqual(batched, migrated, @"Row %lu in round %lu", (unsigned long)row, (unsigned long)round);
+            XCTAssertEqual(batchedSize.height, migratedSize.height, @"Row %lu in round %lu", (unsigned long)row, (unsigned long)round);
+        }
+    }
+}
+
+@end
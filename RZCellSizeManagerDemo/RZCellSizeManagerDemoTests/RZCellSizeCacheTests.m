@@ -0,0 +1,688 @@
+//
+//  RZCellSizeCacheTests.m
+//
+
+
+// Copyright 2014 Raizlabs and other contributors
+// http://raizlabs.com/
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#import <XCTest/XCTest.h>
+#import <UIKit/UIKit.h>
+#import "RZCellSizeCache.h"
+
+#define kRZBenchmarkRowCount    1000000
+#define kRZModelSectionCount    3
+#define kRZModelOperationCount  2000
+#define kRZModelBatchCount      300
+#define kRZOffsetRowCount       200
+#define kRZTrimByteBudget       4096
+#define kRZTrimRowCount         10000
+#define kRZStressOperationCount 50000
+#define kRZStressRowCount       500
+#define kRZStressReaderCount    3
+#define kRZRetiredArrayBound    1024
+
+/**
+ *  Returns count distinct random indexes below range, or every index below range if there are not that many.
+ **/
+static NSIndexSet *RZRandomIndexes(NSUInteger count, NSUInteger range)
+{
+    NSMutableIndexSet* indexes = [NSMutableIndexSet indexSet];
+    while (indexes.count < MIN(count, range))
+    {
+        [indexes addIndex:random() % range];
+    }
+    return indexes;
+}
+
+@interface RZCellSizeCacheTests : XCTestCase
+
+@end
+
+@implementation RZCellSizeCacheTests
+
+#pragma mark - Helpers
+
+/**
+ *  The model holds an array of rows for each section.  A row is the height it was cached with, or NSNull if it has
+ *  not been measured since it was inserted or invalidated.
+ **/
+- (void)assertCache:(RZCellSizeCache *)cache matchesModel:(NSArray *)model step:(NSUInteger)step
+{
+    [model enumerateObjectsUsingBlock:^(NSArray* rows, NSUInteger section, BOOL *stop) {
+        [rows enumerateObjectsUsingBlock:^(id height, NSUInteger row, BOOL *stop) {
+            CGSize size = CGSizeZero;
+            BOOL cached = [cache getSize:&size forRow:row inSection:section];
+            if (height == [NSNull null])
+            {
+                XCTAssertFalse(cached, @"Row %lu in section %lu should not be cached after step %lu", (unsigned long)row, (unsigned long)section, (unsigned long)step);
+            }
+            else
+            {
+                XCTAssertTrue(cached, @"Row %lu in section %lu should be cached after step %lu", (unsigned long)row, (unsigned long)section, (unsigned long)step);
+                XCTAssertEqual(size.height, (CGFloat)[height doubleValue], @"Row %lu in section %lu has the wrong size after step %lu", (unsigned long)row, (unsigned long)section, (unsigned long)step);
+            }
+        }];
+    }];
+}
+
+/**
+ *  Checks every offset of a section, and the row at every row boundary, against sums over the model.  Rows that are
+ *  NSNull in the model have not been measured and count as the estimated height.
+ **/
+- (void)assertOffsetsOfCache:(RZCellSizeCache *)cache matchHeights:(NSArray *)heights step:(NSUInteger)step
+{
+    NSUInteger rowCount = heights.count;
+    double* offsets = malloc((rowCount + 1) * sizeof(double));
+    offsets[0] = 0.0;
+    for (NSUInteger row = 0; row < rowCount; row++)
+    {
+        id height = [heights objectAtIndex:row];
+        offsets[row + 1] = offsets[row] + ((height == [NSNull null]) ? cache.estimatedHeight : [height doubleValue]);
+    }
+    
+    for (NSUInteger row = 0; row <= rowCount; row++)
+    {
+        XCTAssertEqualWithAccuracy([cache offsetOfRow:row inSection:0], (CGFloat)offsets[row], 0.001, @"Offset of row %lu after step %lu", (unsigned long)row, (unsigned long)step);
+    }
+    XCTAssertEqualWithAccuracy([cache heightOfSection:0 numberOfRows:rowCount], (CGFloat)offsets[rowCount], 0.001, @"Height after step %lu", (unsigned long)step);
+    
+    if (rowCount == 0)
+    {
+        XCTAssertEqual([cache rowAtOffset:0.0f inSection:0 numberOfRows:0], (NSUInteger)NSNotFound);
+    }
+    for (NSUInteger row = 0; row < rowCount; row++)
+    {
+        NSUInteger rowAtTop = [cache rowAtOffset:offsets[row] inSection:0 numberOfRows:rowCount];
+        NSUInteger rowInside = [cache rowAtOffset:(offsets[row] + offsets[row + 1]) / 2.0 inSection:0 numberOfRows:rowCount];
+        XCTAssertEqual(rowAtTop, row, @"Row at the top of row %lu after step %lu", (unsigned long)row, (unsigned long)step);
+        XCTAssertEqual(rowInside, row, @"Row at the middle of row %lu after step %lu", (unsigned long)row, (unsigned long)step);
+    }
+    if (rowCount > 0)
+    {
+        XCTAssertEqual([cache rowAtOffset:-10.0f inSection:0 numberOfRows:rowCount], (NSUInteger)0);
+        XCTAssertEqual([cache rowAtOffset:offsets[rowCount] + 100.0 inSection:0 numberOfRows:rowCount], rowCount - 1);
+    }
+    free(offsets);
+}
+
+#pragma mark - Offsets
+
+/**
+ *  Offsets and rows at offsets are answered from a Fenwick tree that is updated in place by sets and rebuilt after
+ *  shifts and estimate changes.  Queries run after every step so both paths are checked against plain sums.
+ **/
+- (void)testOffsetsMatchBruteForceSums
+{
+    srandom(1969);
+    RZCellSizeCache* cache = [[RZCellSizeCache alloc] init];
+    cache.estimatedHeight = 44.0f;
+    NSMutableArray* heights = [NSMutableArray array];
+    for (NSUInteger row = 0; row < kRZOffsetRowCount; row++)
+    {
+        [heights addObject:[NSNull null]];
+    }
+    
+    for (NSUInteger step = 0; step < kRZModelOperationCount; step++)
+    {
+        switch (random() % 6)
+        {
+            case 0:
+            case 1:
+            case 2:
+            {
+                if (heights.count > 0)
+                {
+                    NSUInteger row = random() % heights.count;
+                    float height = 1 + random() % 100;
+                    [cache setSize:CGSizeMake(320.0f, height) forRow:row inSection:0];
+                    [heights replaceObjectAtIndex:row withObject:@(height)];
+                }
+                break;
+            }
+            case 3:
+            {
+                NSUInteger insertedCount = 1 + random() % 3;
+                NSIndexSet* insertedRows = RZRandomIndexes(insertedCount, heights.count + insertedCount);
+                [cache insertRowsAtIndexes:insertedRows inSection:0];
+                [insertedRows enumerateIndexesUsingBlock:^(NSUInteger row, BOOL *stop) {
+                    [heights insertObject:[NSNull null] atIndex:row];
+                }];
+                break;
+            }
+            case 4:
+            {
+                NSIndexSet* deletedRows = RZRandomIndexes(random() % 3, heights.count);
+                [cache deleteRowsAtIndexes:deletedRows inSection:0];
+                [heights removeObjectsAtIndexes:deletedRows];
+                break;
+            }
+            default:
+            {
+                if (random() % 4 == 0)
+                {
+                    cache.estimatedHeight = 20 + random() % 50;
+                }
+                else if (heights.count > 0)
+                {
+                    NSUInteger row = random() % heights.count;
+                    [cache removeSizeForRow:row inSection:0];
+                    [heights replaceObjectAtIndex:row withObject:[NSNull null]];
+                }
+                break;
+            }
+        }
+        
+        [self assertOffsetsOfCache:cache matchHeights:heights step:step];
+    }
+}
+
+#pragma mark - Remapping
+
+/**
+ *  Random sets, inserts, deletes and moves, checked against an array model after every step.  Sets at random rows
+ *  give sections a stored range that does not start at row 0, so both the stored and the skipped rows are shifted.
+ **/
+- (void)testRemapMatchesReferenceModel
+{
+    srandom(2014);
+    RZCellSizeCache* cache = [[RZCellSizeCache alloc] init];
+    NSMutableArray* model = [NSMutableArray array];
+    for (NSUInteger section = 0; section < kRZModelSectionCount; section++)
+    {
+        [model addObject:[NSMutableArray array]];
+    }
+    
+    float nextHeight = 1.0f;
+    for (NSUInteger step = 0; step < kRZModelOperationCount; step++)
+    {
+        NSUInteger section = random() % kRZModelSectionCount;
+        NSMutableArray* rows = [model objectAtIndex:section];
+        switch (random() % 4)
+        {
+            case 0:
+            {
+                if (rows.count > 0)
+                {
+                    NSUInteger row = random() % rows.count;
+                    [cache setSize:CGSizeMake(320.0f, nextHeight) forRow:row inSection:section];
+                    [rows replaceObjectAtIndex:row withObject:@(nextHeight)];
+                    nextHeight += 1.0f;
+                }
+                break;
+            }
+            case 1:
+            {
+                NSUInteger insertedCount = 1 + random() % 3;
+                NSIndexSet* insertedRows = RZRandomIndexes(insertedCount, rows.count + insertedCount);
+                [cache insertRowsAtIndexes:insertedRows inSection:section];
+                [insertedRows enumerateIndexesUsingBlock:^(NSUInteger row, BOOL *stop) {
+                    [rows insertObject:[NSNull null] atIndex:row];
+                }];
+                break;
+            }
+            case 2:
+            {
+                NSIndexSet* deletedRows = RZRandomIndexes(random() % 3, rows.count);
+                [cache deleteRowsAtIndexes:deletedRows inSection:section];
+                [rows removeObjectsAtIndexes:deletedRows];
+                break;
+            }
+            default:
+            {
+                if (rows.count > 0)
+                {
+                    NSUInteger row = random() % rows.count;
+                    NSUInteger newSection = random() % kRZModelSectionCount;
+                    id height = [rows objectAtIndex:row];
+                    [rows removeObjectAtIndex:row];
+                    NSMutableArray* newRows = [model objectAtIndex:newSection];
+                    NSUInteger newRow = random() % (newRows.count + 1);
+                    [newRows insertObject:height atIndex:newRow];
+                    [cache moveRow:row inSection:section toRow:newRow inSection:newSection];
+                }
+                break;
+            }
+        }
+        
+        [self assertCache:cache matchesModel:model step:step];
+        NSUInteger cachedCount = 0;
+        for (NSArray* sectionRows in model)
+        {
+            cachedCount += [[sectionRows indexesOfObjectsPassingTest:^BOOL(id height, NSUInteger idx, BOOL *stop) {
+                return height != [NSNull null];
+            }] count];
+        }
+        XCTAssertEqual(cache.countOfSizes, cachedCount, @"Wrong number of sizes after step %lu", (unsigned long)step);
+    }
+}
+
+/**
+ *  Random batches of invalidations, deletions, moves and insertions applied with UITableView semantics: invalidations
+ *  and deletions in old rows, insertions and move destinations in new rows.
+ **/
+- (void)testBatchUpdatesMatchReferenceModel
+{
+    srandom(1138);
+    RZCellSizeCache* cache = [[RZCellSizeCache alloc] init];
+    NSMutableArray* rows = [NSMutableArray array];
+    float nextHeight = 1.0f;
+    for (NSUInteger batch = 0; batch < kRZModelBatchCount; batch++)
+    {
+        // Measure some rows, as scrolling would.
+        for (NSUInteger i = 0; i < 8 && rows.count > 0; i++)
+        {
+            NSUInteger row = random() % rows.count;
+            [cache setSize:CGSizeMake(320.0f, nextHeight) forRow:row inSection:0];
+            [rows replaceObjectAtIndex:row withObject:@(nextHeight)];
+            nextHeight += 1.0f;
+        }
+        
+        RZCellSizeCacheUpdates* updates = [[RZCellSizeCacheUpdates alloc] init];
+        NSUInteger oldCount = rows.count;
+        [RZRandomIndexes(random() % 3, oldCount) enumerateIndexesUsingBlock:^(NSUInteger row, BOOL *stop) {
+            [updates.invalidatedIndexPaths addObject:[NSIndexPath indexPathForRow:row inSection:0]];
+            [rows replaceObjectAtIndex:row withObject:[NSNull null]];
+        }];
+        
+        NSIndexSet* changedRows = RZRandomIndexes(random() % 6, oldCount);
+        NSMutableArray* movedRows = [NSMutableArray array];
+        [changedRows enumerateIndexesUsingBlock:^(NSUInteger row, BOOL *stop) {
+            if (random() % 2)
+            {
+                [updates.deletedIndexPaths addObject:[NSIndexPath indexPathForRow:row inSection:0]];
+            }
+            else
+            {
+                [movedRows addObject:@(row)];
+            }
+        }];
+        
+        // New positions are shuffled, then the first ones are taken by the moved rows and the rest are inserted.
+        NSUInteger insertedCount = random() % 6;
+        NSUInteger newCount = oldCount - changedRows.count + movedRows.count + insertedCount;
+        NSMutableArray* newPositions = [NSMutableArray array];
+        [RZRandomIndexes(movedRows.count + insertedCount, newCount) enumerateIndexesUsingBlock:^(NSUInteger row, BOOL *stop) {
+            [newPositions addObject:@(row)];
+        }];
+        for (NSUInteger i = newPositions.count; i > 1; i--)
+        {
+            [newPositions exchangeObjectAtIndex:i - 1 withObjectAtIndex:random() % i];
+        }
+        
+        NSMutableDictionary* heightsByNewRow = [NSMutableDictionary dictionary];
+        [newPositions enumerateObjectsUsingBlock:^(NSNumber* newRow, NSUInteger idx, BOOL *stop) {
+            NSIndexPath* indexPath = [NSIndexPath indexPathForRow:[newRow unsignedIntegerValue] inSection:0];
+            if (idx < movedRows.count)
+            {
+                NSUInteger oldRow = [[movedRows objectAtIndex:idx] unsignedIntegerValue];
+                [updates.movedFromIndexPaths addObject:[NSIndexPath indexPathForRow:oldRow inSection:0]];
+                [updates.movedToIndexPaths addObject:indexPath];
+                [heightsByNewRow setObject:[rows objectAtIndex:oldRow] forKey:newRow];
+            }
+            else
+            {
+                [updates.insertedIndexPaths addObject:indexPath];
+                [heightsByNewRow setObject:[NSNull null] forKey:newRow];
+            }
+        }];
+        
+        [updates applyToCache:cache];
+        
+        NSMutableArray* survivingRows = [rows mutableCopy];
+        [survivingRows removeObjectsAtIndexes:changedRows];
+        [rows removeAllObjects];
+        NSUInteger survivor = 0;
+        for (NSUInteger row = 0; row < newCount; row++)
+        {
+            id height = [heightsByNewRow objectForKey:@(row)];
+            [rows addObject:height ?: [survivingRows objectAtIndex:survivor++]];
+        }
+        XCTAssertEqual(survivor, survivingRows.count);
+        
+        [self assertCache:cache matchesModel:@[rows] step:batch];
+    }
+}
+
+#pragma mark - Invalidation
+
+- (void)testCountOfValidSizesSkipsInvalidatedSizes
+{
+    RZCellSizeCache* cache = [[RZCellSizeCache alloc] init];
+    for (NSUInteger row = 0; row < 10; row++)
+    {
+        [cache setSize:CGSizeMake(320.0f, 44.0f) forRow:row inSection:row % 2];
+    }
+    XCTAssertEqual(cache.countOfValidSizes, (NSUInteger)10);
+    
+    [cache invalidateSizesInSection:1];
+    XCTAssertEqual(cache.countOfValidSizes, (NSUInteger)5);
+    
+    [cache invalidateAllSizes];
+    XCTAssertEqual(cache.countOfSizes, (NSUInteger)10);
+    XCTAssertEqual(cache.countOfValidSizes, (NSUInteger)0);
+    
+    // Invalidating again drops nothing more.
+    [cache invalidateAllSizes];
+    XCTAssertEqual(cache.countOfValidSizes, (NSUInteger)0);
+    
+    [cache setSize:CGSizeMake(320.0f, 44.0f) forRow:3 inSection:1];
+    XCTAssertEqual(cache.countOfValidSizes, (NSUInteger)1);
+}
+
+- (void)testMovingAcrossSectionsLeavesStaleSizesBehind
+{
+    RZCellSizeCache* cache = [[RZCellSizeCache alloc] init];
+    [cache setSize:CGSizeMake(320.0f, 44.0f) forRow:0 inSection:0];
+    [cache setSize:CGSizeMake(320.0f, 60.0f) forRow:0 inSection:1];
+    [cache invalidateSizesInSection:0];
+    
+    [cache moveRow:0 inSection:0 toRow:1 inSection:1];
+    CGSize size = CGSizeZero;
+    XCTAssertFalse([cache getSize:&size forRow:1 inSection:1]);
+    XCTAssertTrue([cache getSize:&size forRow:0 inSection:1]);
+    XCTAssertEqual(size.height, (CGFloat)60.0f);
+}
+
+- (void)testMovingAcrossSectionsKeepsValidSizesValid
+{
+    RZCellSizeCache* cache = [[RZCellSizeCache alloc] init];
+    [cache setSize:CGSizeMake(320.0f, 44.0f) forRow:0 inSection:0];
+    [cache setSize:CGSizeMake(320.0f, 60.0f) forRow:0 inSection:1];
+    
+    // The section is invalidated after the moving size was stored, which must not make the moved size stale.
+    [cache invalidateSizesInSection:1];
+    [cache moveRow:0 inSection:0 toRow:1 inSection:1];
+    CGSize size = CGSizeZero;
+    XCTAssertTrue([cache getSize:&size forRow:1 inSection:1]);
+    XCTAssertEqual(size.height, (CGFloat)44.0f);
+    XCTAssertFalse([cache getSize:&size forRow:0 inSection:1]);
+}
+
+#pragma mark - Trimming
+
+- (void)testTrimKeepsTheRowJustWritten
+{
+    RZCellSizeCache* cache = [[RZCellSizeCache alloc] init];
+    cache.byteBudget = kRZTrimByteBudget;
+    CGSize size = CGSizeZero;
+    for (NSUInteger section = 0; section < 2; section++)
+    {
+        for (NSUInteger row = 0; row < kRZTrimRowCount; row++)
+        {
+            [cache setSize:CGSizeMake(320.0f, 44.0f) forRow:row inSection:section];
+            XCTAssertTrue([cache getSize:&size forRow:row inSection:section], @"row %lu in section %lu", (unsigned long)row, (unsigned long)section);
+            XCTAssertLessThanOrEqual(cache.byteCount, (NSUInteger)kRZTrimByteBudget);
+        }
+    }
+    XCTAssertFalse([cache getSize:&size forRow:0 inSection:0]);
+}
+
+- (void)testTrimKeepsTheFocusRow
+{
+    RZCellSizeCache* cache = [[RZCellSizeCache alloc] init];
+    cache.byteBudget = kRZTrimByteBudget;
+    [cache setFocusRow:0 inSection:0];
+    CGSize size = CGSizeZero;
+    for (NSUInteger row = 0; row < kRZTrimRowCount; row++)
+    {
+        [cache setSize:CGSizeMake(320.0f, 44.0f) forRow:row inSection:0];
+    }
+    XCTAssertTrue([cache getSize:&size forRow:0 inSection:0]);
+    XCTAssertLessThan(cache.countOfSizes, (NSUInteger)kRZTrimRowCount / 2);
+    XCTAssertLessThanOrEqual(cache.byteCount, (NSUInteger)kRZTrimByteBudget);
+    
+    // Clearing the focus makes it follow the writes again.
+    [cache setFocusRow:NSNotFound inSection:NSNotFound];
+    for (NSUInteger row = 0; row < kRZTrimRowCount; row++)
+    {
+        [cache setSize:CGSizeMake(320.0f, 44.0f) forRow:row inSection:0];
+        XCTAssertTrue([cache getSize:&size forRow:row inSection:0], @"row %lu", (unsigned long)row);
+    }
+}
+
+/**
+ *  With the focus on the first row of a section, the last rows of the section before are as near as the rows just
+ *  after the focus, so a tight budget trims the far ends of both sections rather than releasing the one before.
+ **/
+- (void)testTrimKeepsRowsJustAcrossASectionBoundary
+{
+    RZCellSizeCache* cache = [[RZCellSizeCache alloc] init];
+    for (NSUInteger section = 0; section < 2; section++)
+    {
+        for (NSUInteger row = 0; row < 1000; row++)
+        {
+            [cache setSize:CGSizeMake(320.0f, 44.0f) forRow:row inSection:section];
+        }
+    }
+    [cache setFocusRow:0 inSection:1];
+    [cache trimToByteCount:kRZTrimByteBudget];
+    XCTAssertLessThanOrEqual(cache.byteCount, (NSUInteger)kRZTrimByteBudget);
+    
+    CGSize size = CGSizeZero;
+    XCTAssertTrue([cache getSize:&size forRow:0 inSection:1]);
+    XCTAssertTrue([cache getSize:&size forRow:999 inSection:0]);
+    XCTAssertTrue([cache getSize:&size forRow:100 inSection:1]);
+    XCTAssertTrue([cache getSize:&size forRow:900 inSection:0]);
+    XCTAssertFalse([cache getSize:&size forRow:999 inSection:1]);
+    XCTAssertFalse([cache getSize:&size forRow:0 inSection:0]);
+    
+    // The kept rows are centered on the focus, one more after it than before it.
+    NSUInteger keptBefore = 0;
+    NSUInteger keptAfter = 0;
+    for (NSUInteger row = 0; row < 1000; row++)
+    {
+        keptBefore += [cache getSize:&size forRow:row inSection:0] ? 1 : 0;
+        keptAfter += [cache getSize:&size forRow:row inSection:1] ? 1 : 0;
+    }
+    XCTAssertEqual(keptAfter, keptBefore + 1);
+    XCTAssertEqual(cache.countOfSizes, keptBefore + keptAfter);
+}
+
+#pragma mark - Concurrency
+
+/**
+ *  Readers on other threads look up sizes while this thread stores, moves, inserts, deletes, invalidates and trims.
+ *  Every stored size is one point taller than it is wide, so a torn read shows up as a size that breaks the rule.
+ *  Run it with the Thread Sanitizer or Address Sanitizer enabled in the scheme's diagnostics to catch races and use of
+ *  released arrays that do not happen to tear a size.
+ **/
+- (void)testReadersOnOtherThreadsNeverSeeTornSizes
+{
+    srandom(42);
+    RZCellSizeCache* cache = [[RZCellSizeCache alloc] init];
+    cache.byteBudget = 16 * 1024;
+    __block BOOL finished = NO;
+    __block NSUInteger tornCount = 0;
+    __block NSUInteger hitCount = 0;
+    dispatch_group_t readers = dispatch_group_create();
+    for (NSUInteger reader = 0; reader < kRZStressReaderCount; reader++)
+    {
+        dispatch_group_async(readers, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+            uint32_t state = (uint32_t)reader + 1;
+            NSUInteger torn = 0;
+            NSUInteger hits = 0;
+            while (!__atomic_load_n(&finished, __ATOMIC_ACQUIRE))
+            {
+                state = state * 1664525u + 1013904223u;
+                CGSize size = CGSizeZero;
+                if ([cache getSizeFromAnyThread:&size forRow:(state >> 8) % kRZStressRowCount inSection:(state >> 4) % 3])
+                {
+                    hits++;
+                    if (size.height != size.width + 1.0f)
+                    {
+                        torn++;
+                    }
+                }
+            }
+            __atomic_fetch_add(&tornCount, torn, __ATOMIC_RELAXED);
+            __atomic_fetch_add(&hitCount, hits, __ATOMIC_RELAXED);
+        });
+    }
+    
+    for (NSUInteger operation = 0; operation < kRZStressOperationCount; operation++)
+    {
+        NSUInteger row = random() % kRZStressRowCount;
+        NSUInteger section = random() % 3;
+        CGFloat width = (CGFloat)(random() % 1000);
+        switch (random() % 16) {
+            case 0:
+                [cache insertRowsAtIndexes:RZRandomIndexes(random() % 4 + 1, kRZStressRowCount) inSection:section];
+                break;
+            case 1:
+                [cache deleteRowsAtIndexes:RZRandomIndexes(random() % 4 + 1, kRZStressRowCount) inSection:section];
+                break;
+            case 2:
+                [cache moveRow:row inSection:section toRow:random() % kRZStressRowCount inSection:random() % 3];
+                break;
+            case 3:
+                [cache invalidateSizesInSection:section];
+                break;
+            case 4:
+                [cache beginUpdates];
+                [cache deleteSections:[NSIndexSet indexSetWithIndex:section]];
+                [cache insertSections:[NSIndexSet indexSetWithIndex:section]];
+                [cache endUpdates];
+                break;
+            case 5:
+                if (operation % 64 == 5)
+                {
+                    [cache invalidateAllSizes];
+                }
+                break;
+            default:
+                [cache setSize:CGSizeMake(width, width + 1.0f) forRow:row inSection:section];
+                break;
+        }
+    }
+    
+    __atomic_store_n(&finished, YES, __ATOMIC_RELEASE);
+    dispatch_group_wait(readers, DISPATCH_TIME_FOREVER);
+    XCTAssertEqual(tornCount, (NSUInteger)0);
+    NSLog(@"%lu sizes read while writing", (unsigned long)hitCount);
+}
+
+/**
+ *  Readers on other threads keep reading while this thread replaces a section on every update, which releases its
+ *  array each time.  A read is always in progress somewhere, so the released arrays must be freed by epoch rather
+ *  than when no read is in progress, or they pile up for as long as the reads go on.
+ **/
+- (void)testRetiredArraysStayBoundedUnderContinuousReads
+{
+    RZCellSizeCache* cache = [[RZCellSizeCache alloc] init];
+    __block BOOL finished = NO;
+    __block NSUInteger startedCount = 0;
+    dispatch_group_t readers = dispatch_group_create();
+    for (NSUInteger reader = 0; reader < kRZStressReaderCount; reader++)
+    {
+        dispatch_group_async(readers, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+            __atomic_fetch_add(&startedCount, 1, __ATOMIC_RELEASE);
+            uint32_t state = (uint32_t)reader + 1;
+            CGSize size;
+            while (!__atomic_load_n(&finished, __ATOMIC_ACQUIRE))
+            {
+                state = state * 1664525u + 1013904223u;
+                [cache getSizeFromAnyThread:&size forRow:(state >> 8) % kRZStressRowCount inSection:0];
+            }
+        });
+    }
+    while (__atomic_load_n(&startedCount, __ATOMIC_ACQUIRE) < kRZStressReaderCount)
+    {
+    }
+    
+    NSUInteger peakRetiredCount = 0;
+    for (NSUInteger operation = 0; operation < kRZStressOperationCount; operation++)
+    {
+        [cache beginUpdates];
+        [cache deleteSections:[NSIndexSet indexSetWithIndex:0]];
+        [cache insertSections:[NSIndexSet indexSetWithIndex:0]];
+        [cache setSize:CGSizeMake(320.0f, 44.0f) forRow:operation % kRZStressRowCount inSection:0];
+        [cache endUpdates];
+        peakRetiredCount = MAX(peakRetiredCount, cache.countOfRetiredArrays);
+    }
+    
+    __atomic_store_n(&finished, YES, __ATOMIC_RELEASE);
+    dispatch_group_wait(readers, DISPATCH_TIME_FOREVER);
+    NSLog(@"At most %lu arrays waiting for readers over %lu updates", (unsigned long)peakRetiredCount, (unsigned long)kRZStressOperationCount);
+    XCTAssertTrue(peakRetiredCount < kRZRetiredArrayBound);
+    
+    // With no reads left, the next update frees everything.
+    [cache beginUpdates];
+    [cache deleteSections:[NSIndexSet indexSetWithIndex:0]];
+    [cache endUpdates];
+    XCTAssertEqual(cache.countOfRetiredArrays, (NSUInteger)0);
+}
+
+#pragma mark - Benchmarks
+
+/**
+ *  Random lookups into a million cached rows.  The rate of each run is logged, and the average time is reported by
+ *  measureBlock:.
+ **/
+- (void)testLookupThroughputWithOneMillionRows
+{
+    RZCellSizeCache* cache = [[RZCellSizeCache alloc] init];
+    for (NSUInteger row = 0; row < kRZBenchmarkRowCount; row++)
+    {
+        [cache setSize:CGSizeMake(320.0f, 44.0f + row % 64) forRow:row inSection:0];
+    }
+    XCTAssertEqual(cache.countOfSizes, (NSUInteger)kRZBenchmarkRowCount);
+    
+    [self measureBlock:^{
+        CGSize size;
+        NSUInteger hits = 0;
+        uint32_t state = 1;
+        CFAbsoluteTime startTime = CFAbsoluteTimeGetCurrent();
+        for (NSUInteger i = 0; i < kRZBenchmarkRowCount; i++)
+        {
+            state = state * 1664525u + 1013904223u;
+            if ([cache getSize:&size forRow:state % kRZBenchmarkRowCount inSection:0])
+            {
+                hits++;
+            }
+        }
+        CFAbsoluteTime elapsedTime = CFAbsoluteTimeGetCurrent() - startTime;
+        XCTAssertEqual(hits, (NSUInteger)kRZBenchmarkRowCount);
+        NSLog(@"%.0f lookups/s", kRZBenchmarkRowCount / elapsedTime);
+    }];
+}
+
+/**
+ *  Rows are 12 bytes, with the storage grown by doubling, and the offset index adds 8 bytes per row once it is built.
+ **/
+- (void)testBytesPerRowWithOneMillionRows
+{
+    RZCellSizeCache* cache = [[RZCellSizeCache alloc] init];
+    for (NSUInteger row = 0; row < kRZBenchmarkRowCount; row++)
+    {
+        [cache setSize:CGSizeMake(320.0f, 44.0f) forRow:row inSection:0];
+    }
+    NSLog(@"%.2f bytes per row", cache.bytesPerSize);
+    XCTAssertLessThan(cache.bytesPerSize, 13.0);
+    
+    [cache offsetOfRow:kRZBenchmarkRowCount / 2 inSection:0];
+    NSLog(@"%.2f bytes per row with the offset index", cache.bytesPerSize);
+    XCTAssertLessThan(cache.bytesPerSize, 21.0);
+}
+
+@end
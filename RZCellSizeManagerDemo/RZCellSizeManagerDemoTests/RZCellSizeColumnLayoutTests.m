@@ -0,0 +1,422 @@
+//
+//  RZCellSizeColumnLayoutTests.m
+//
+
+
+// Copyright 2014 Raizlabs and other contributors
+// http://raizlabs.com/
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+#import <XCTest/XCTest.h>
+#import "RZCellSizeColumnLayout.h"
+
+#define kRZColumnLayoutStepCount        300
+#define kRZColumnLayoutColumnCount      3
+#define kRZColumnLayoutWidth            328.0f
+#define kRZColumnLayoutInteritemSpacing 4.0f
+#define kRZSmallGridItemCount           1000
+#define kRZLargeGridItemCount           1000000
+#define kRZGridAppendCount              1000
+
+/**
+ *  Every operation is applied to a layout and to a plain model of the heights of each section, and the frames of
+ *  the layout are checked against frames computed from the model from scratch.  Heights and spacings are whole
+ *  numbers and the columns are 100 points wide, so the frames must match exactly.
+ *
+ *  Masonry items keep their column when their size changes, so the model remembers the column of each item and
+ *  only places items when they are appended or when the line spacing changes.
+ **/
+@interface RZCellSizeColumnLayoutTests : XCTestCase
+
+@property (nonatomic, strong) RZCellSizeColumnLayout* layout;
+@property (nonatomic, strong) NSMutableArray* heights;
+@property (nonatomic, strong) NSMutableArray* columns;
+@property (nonatomic, assign) BOOL placedFromScratch;
+
+@end
+
+@implementation RZCellSizeColumnLayoutTests
+
+- (void)tearDown
+{
+    self.layout = nil;
+    self.heights = nil;
+    self.columns = nil;
+    [super tearDown];
+}
+
+#pragma mark - Helpers
+
+- (RZCellSizeColumnLayout *)newLayoutWithStyle:(RZCellSizeColumnLayoutStyle)style lineSpacing:(CGFloat)lineSpacing
+{
+    RZCellSizeColumnLayout* layout = [[RZCellSizeColumnLayout alloc] initWithStyle:style numberOfColumns:kRZColumnLayoutColumnCount width:kRZColumnLayoutWidth];
+    layout.interitemSpacing = kRZColumnLayoutInteritemSpacing;
+    layout.sectionInset = UIEdgeInsetsMake(6.0f, 10.0f, 8.0f, 10.0f);
+    layout.lineSpacing = lineSpacing;
+    return layout;
+}
+
+- (void)startWithStyle:(RZCellSizeColumnLayoutStyle)style
+{
+    self.layout = [self newLayoutWithStyle:style lineSpacing:0.0f];
+    self.heights = [NSMutableArray array];
+    self.columns = [NSMutableArray array];
+    self.placedFromScratch = YES;
+}
+
+- (BOOL)isMasonry
+{
+    return (self.layout.style == RZCellSizeColumnLayoutStyleMasonry);
+}
+
+/**
+ *  Bottom of each column of a masonry section in the model, including the line spacing after its last item.  Only
+ *  the items that have been given a column yet are counted.
+ **/
+- (void)getColumnBottoms:(CGFloat *)bottoms ofSection:(NSUInteger)section
+{
+    NSArray* heights = [self.heights objectAtIndex:section];
+    NSArray* columns = [self.columns objectAtIndex:section];
+    for (NSUInteger column = 0; column < kRZColumnLayoutColumnCount; column++)
+    {
+        bottoms[column] = 0.0f;
+    }
+    for (NSUInteger item = 0; item < columns.count; item++)
+    {
+        bottoms[[[columns objectAtIndex:item] unsignedIntegerValue]] += [[heights objectAtIndex:item] floatValue] + self.layout.lineSpacing;
+    }
+}
+
+/**
+ *  Gives each item from an index on the shortest column at the time, the first one if several are as short.
+ **/
+- (void)placeItemsInSection:(NSUInteger)section fromIndex:(NSUInteger)first
+{
+    NSArray* heights = [self.heights objectAtIndex:section];
+    NSMutableArray* columns = [self.columns objectAtIndex:section];
+    [columns removeObjectsInRange:NSMakeRange(first, columns.count - first)];
+    for (NSUInteger item = first; item < heights.count; item++)
+    {
+        CGFloat bottoms[kRZColumnLayoutColumnCount];
+        [self getColumnBottoms:bottoms ofSection:section];
+        NSUInteger column = 0;
+        for (NSUInteger i = 1; i < kRZColumnLayoutColumnCount; i++)
+        {
+            if (bottoms[i] < bottoms[column])
+            {
+                column = i;
+            }
+        }
+        [columns addObject:@(column)];
+    }
+}
+
+- (void)appendHeights:(NSArray *)heights toSection:(NSUInteger)section
+{
+    while (self.heights.count <= section)
+    {
+        [self.heights addObject:[NSMutableArray array]];
+        [self.columns addObject:[NSMutableArray array]];
+    }
+    
+    CGSize* sizes = malloc(heights.count * sizeof(CGSize));
+    for (NSUInteger i = 0; i < heights.count; i++)
+    {
+        sizes[i] = CGSizeMake(0.0f, [[heights objectAtIndex:i] floatValue]);
+    }
+    [self.layout appendItemsWithSizes:sizes count:heights.count toSection:section];
+    free(sizes);
+    
+    NSMutableArray* sectionHeights = [self.heights objectAtIndex:section];
+    NSUInteger first = sectionHeights.count;
+    [sectionHeights addObjectsFromArray:heights];
+    [self placeItemsInSection:section fromIndex:first];
+}
+
+- (CGFloat)columnWidth
+{
+    return (kRZColumnLayoutWidth - 20.0f - kRZColumnLayoutInteritemSpacing * (kRZColumnLayoutColumnCount - 1)) / kRZColumnLayoutColumnCount;
+}
+
+- (CGFloat)heightOfRow:(NSUInteger)row inSection:(NSUInteger)section
+{
+    NSArray* heights = [self.heights objectAtIndex:section];
+    CGFloat rowHeight = 0.0f;
+    for (NSUInteger item = row * kRZColumnLayoutColumnCount; item < MIN((row + 1) * kRZColumnLayoutColumnCount, heights.count); item++)
+    {
+        rowHeight = MAX(rowHeight, [[heights objectAtIndex:item] floatValue]);
+    }
+    return rowHeight;
+}
+
+- (CGFloat)contentHeightOfSection:(NSUInteger)section
+{
+    NSArray* heights = [self.heights objectAtIndex:section];
+    if (heights.count == 0)
+    {
+        return 0.0f;
+    }
+    if ([self isMasonry])
+    {
+        CGFloat bottoms[kRZColumnLayoutColumnCount];
+        [self getColumnBottoms:bottoms ofSection:section];
+        CGFloat height = 0.0f;
+        for (NSUInteger column = 0; column < kRZColumnLayoutColumnCount; column++)
+        {
+            height = MAX(height, bottoms[column]);
+        }
+        return height - self.layout.lineSpacing;
+    }
+    NSUInteger rowCount = (heights.count + kRZColumnLayoutColumnCount - 1) / kRZColumnLayoutColumnCount;
+    CGFloat height = 0.0f;
+    for (NSUInteger row = 0; row < rowCount; row++)
+    {
+        height += [self heightOfRow:row inSection:section] + ((row + 1 < rowCount) ? self.layout.lineSpacing : 0.0f);
+    }
+    return height;
+}
+
+- (CGFloat)topOfSection:(NSUInteger)section
+{
+    CGFloat top = 0.0f;
+    for (NSUInteger previous = 0; previous < section; previous++)
+    {
+        if ([[self.heights objectAtIndex:previous] count] > 0)
+        {
+            top += self.layout.sectionInset.top + [self contentHeightOfSection:previous] + self.layout.sectionInset.bottom;
+        }
+    }
+    return top;
+}
+
+- (CGRect)modelFrameForItem:(NSUInteger)item inSection:(NSUInteger)section
+{
+    NSArray* heights = [self.heights objectAtIndex:section];
+    NSUInteger column = 0;
+    CGFloat top = 0.0f;
+    if ([self isMasonry])
+    {
+        NSArray* columns = [self.columns objectAtIndex:section];
+        column = [[columns objectAtIndex:item] unsignedIntegerValue];
+        for (NSUInteger previous = 0; previous < item; previous++)
+        {
+            if ([[columns objectAtIndex:previous] unsignedIntegerValue] == column)
+            {
+                top += [[heights objectAtIndex:previous] floatValue] + self.layout.lineSpacing;
+            }
+        }
+    }
+    else
+    {
+        column = item % kRZColumnLayoutColumnCount;
+        for (NSUInteger row = 0; row < item / kRZColumnLayoutColumnCount; row++)
+        {
+            top += [self heightOfRow:row inSection:section] + self.layout.lineSpacing;
+        }
+    }
+    return CGRectMake(10.0f + column * ([self columnWidth] + kRZColumnLayoutInteritemSpacing),
+                      [self topOfSection:section] + self.layout.sectionInset.top + top,
+                      [self columnWidth],
+                      [[heights objectAtIndex:item] floatValue]);
+}
+
+/**
+ *  A layout of the current heights built with one append per section, for when the model has placed every item
+ *  from scratch as well.
+ **/
+- (RZCellSizeColumnLayout *)layoutBuiltFromScratch
+{
+    RZCellSizeColumnLayout* layout = [self newLayoutWithStyle:self.layout.style lineSpacing:self.layout.lineSpacing];
+    [self.heights enumerateObjectsUsingBlock:^(NSArray* heights, NSUInteger section, BOOL *stop) {
+        CGSize* sizes = malloc(MAX(heights.count, 1) * sizeof(CGSize));
+        for (NSUInteger i = 0; i < heights.count; i++)
+        {
+            sizes[i] = CGSizeMake(0.0f, [[heights objectAtIndex:i] floatValue]);
+        }
+        [layout appendItemsWithSizes:sizes count:heights.count toSection:section];
+        free(sizes);
+    }];
+    return layout;
+}
+
+- (void)assertLayoutMatchesModelAfterStep:(NSUInteger)step
+{
+    RZCellSizeColumnLayout* scratchLayout = self.placedFromScratch ? [self layoutBuiltFromScratch] : nil;
+    NSMutableSet* indexPathsInRect = [NSMutableSet set];
+    CGFloat contentHeight = [self topOfSection:self.heights.count];
+    CGRect rect = CGRectMake(0.0f, random() % (NSUInteger)(contentHeight + 1), kRZColumnLayoutWidth, 1 + random() % 300);
+    
+    XCTAssertEqual(self.layout.numberOfSections, self.heights.count, @"Wrong number of sections after step %lu", (unsigned long)step);
+    XCTAssertEqual(self.layout.contentSize.height, contentHeight, @"Wrong content height after step %lu", (unsigned long)step);
+    [self.heights enumerateObjectsUsingBlock:^(NSArray* heights, NSUInteger section, BOOL *stop) {
+        XCTAssertEqual([self.layout numberOfItemsInSection:section], heights.count, @"Wrong number of items after step %lu", (unsigned long)step);
+        for (NSUInteger item = 0; item < heights.count; item++)
+        {
+            CGRect frame = [self.layout frameForItem:item inSection:section];
+            CGRect modelFrame = [self modelFrameForItem:item inSection:section];
+            XCTAssertTrue(CGRectEqualToRect(frame, modelFrame), @"Item %lu of section %lu is at %@ instead of %@ after step %lu",
+                          (unsigned long)item, (unsigned long)section, NSStringFromCGRect(frame), NSStringFromCGRect(modelFrame), (unsigned long)step);
+            if (scratchLayout)
+            {
+                XCTAssertTrue(CGRectEqualToRect(frame, [scratchLayout frameForItem:item inSection:section]),
+                              @"Item %lu of section %lu differs from a layout built from scratch after step %lu", (unsigned long)item, (unsigned long)section, (unsigned long)step);
+            }
+            if (CGRectIntersectsRect(modelFrame, rect))
+            {
+                [indexPathsInRect addObject:[NSIndexPath indexPathForItem:item inSection:section]];
+            }
+        }
+    }];
+    
+    NSArray* attributes = [self.layout layoutAttributesForElementsInRect:rect];
+    XCTAssertEqualObjects([NSSet setWithArray:[attributes valueForKey:@"indexPath"]], indexPathsInRect, @"Wrong items in %@ after step %lu", NSStringFromCGRect(rect), (unsigned long)step);
+}
+
+/**
+ *  Appends, resizes and removes items of two sections and changes the line spacing at random.
+ **/
+- (void)runRandomOperations
+{
+    for (NSUInteger step = 0; step < kRZColumnLayoutStepCount; step++)
+    {
+        NSUInteger section = random() % 2;
+        NSUInteger itemCount = (section < self.heights.count) ? [[self.heights objectAtIndex:section] count] : 0;
+        switch (itemCount > 0 ? random() % 5 : 0)
+        {
+            case 0:
+            case 1:
+            {
+                NSMutableArray* heights = [NSMutableArray array];
+                for (NSUInteger i = 0, count = 1 + random() % 5; i < count; i++)
+                {
+                    [heights addObject:@(10 + random() % 50)];
+                }
+                [self appendHeights:heights toSection:section];
+                break;
+            }
+            case 2:
+            {
+                NSUInteger item = random() % itemCount;
+                CGFloat height = 10 + random() % 50;
+                [self.layout setSize:CGSizeMake(0.0f, height) forItem:item inSection:section];
+                [[self.heights objectAtIndex:section] replaceObjectAtIndex:item withObject:@(height)];
+                self.placedFromScratch = ![self isMasonry];
+                break;
+            }
+            case 3:
+            {
+                NSUInteger item = random() % itemCount;
+                [self.layout removeItemsFromIndex:item inSection:section];
+                NSMutableArray* heights = [self.heights objectAtIndex:section];
+                [heights removeObjectsInRange:NSMakeRange(item, heights.count - item)];
+                NSMutableArray* columns = [self.columns objectAtIndex:section];
+                [columns removeObjectsInRange:NSMakeRange(item, columns.count - item)];
+                break;
+            }
+            default:
+            {
+                self.layout.lineSpacing = random() % 9;
+                for (NSUInteger placedSection = 0; placedSection < self.heights.count; placedSection++)
+                {
+                    [self placeItemsInSection:placedSection fromIndex:0];
+                }
+                self.placedFromScratch = YES;
+                break;
+            }
+        }
+        [self assertLayoutMatchesModelAfterStep:step];
+    }
+}
+
+#pragma mark - Model Tests
+
+- (void)testGridMatchesFramesComputedFromScratch
+{
+    srandom(1618);
+    [self startWithStyle:RZCellSizeColumnLayoutStyleGrid];
+    [self runRandomOperations];
+}
+
+- (void)testMasonryMatchesFramesComputedFromScratch
+{
+    srandom(2718);
+    [self startWithStyle:RZCellSizeColumnLayoutStyleMasonry];
+    [self runRandomOperations];
+}
+
+- (void)testRemovingSectionsKeepsTheOthers
+{
+    [self startWithStyle:RZCellSizeColumnLayoutStyleGrid];
+    [self appendHeights:@[ @10, @20, @30, @40 ] toSection:0];
+    [self appendHeights:@[ @15 ] toSection:2];
+    [self assertLayoutMatchesModelAfterStep:0];
+    
+    [self.layout removeSectionsFromIndex:1];
+    [self.heights removeObjectsInRange:NSMakeRange(1, 2)];
+    [self.columns removeObjectsInRange:NSMakeRange(1, 2)];
+    [self assertLayoutMatchesModelAfterStep:1];
+    
+    [self.layout removeAllSections];
+    XCTAssertEqual(self.layout.numberOfSections, (NSUInteger)0);
+    XCTAssertEqual(self.layout.contentSize.height, (CGFloat)0.0f);
+}
+
+#pragma mark - Benchmarks
+
+/**
+ *  Appends items one at a time to a small grid and to a large one, asking for the frame of each new item.  Only the
+ *  rows after the append point are placed, so the large grid is about as fast as the small one, where placing every
+ *  row again would make it a thousand times slower.
+ **/
+- (void)testAppendingToALargeGridOnlyPlacesTheNewRows
+{
+    NSUInteger itemCounts[2] = { kRZSmallGridItemCount, kRZLargeGridItemCount };
+    CFAbsoluteTime elapsedTimes[2];
+    for (NSUInteger i = 0; i < 2; i++)
+    {
+        RZCellSizeColumnLayout* layout = [self newLayoutWithStyle:RZCellSizeColumnLayoutStyleGrid lineSpacing:2.0f];
+        CGSize* sizes = malloc(itemCounts[i] * sizeof(CGSize));
+        for (NSUInteger item = 0; item < itemCounts[i]; item++)
+        {
+            sizes[item] = CGSizeMake(0.0f, 10 + item % 50);
+        }
+        [layout appendItemsWithSizes:sizes count:itemCounts[i] toSection:0];
+        free(sizes);
+        CGRect lastFrame = [layout frameForItem:itemCounts[i] - 1 inSection:0];
+        
+        CGSize size = CGSizeMake(0.0f, 44.0f);
+        CFAbsoluteTime startTime = CFAbsoluteTimeGetCurrent();
+        for (NSUInteger append = 0; append < kRZGridAppendCount; append++)
+        {
+            [layout appendItemsWithSizes:&size count:1 toSection:0];
+            [layout frameForItem:itemCounts[i] + append inSection:0];
+        }
+        elapsedTimes[i] = CFAbsoluteTimeGetCurrent() - startTime;
+        
+        XCTAssertTrue(CGRectEqualToRect([layout frameForItem:itemCounts[i] - 1 inSection:0], lastFrame));
+        XCTAssertEqual(layout.contentSize.height, [layout frameForItem:itemCounts[i] + kRZGridAppendCount - 1 inSection:0].origin.y + 44.0f + 8.0f);
+    }
+    NSLog(@"%lu appends: %.2f ms after %lu items, %.2f ms after %lu items", (unsigned long)kRZGridAppendCount,
+          elapsedTimes[0] * 1000.0, (unsigned long)itemCounts[0], elapsedTimes[1] * 1000.0, (unsigned long)itemCounts[1]);
+    XCTAssertTrue(elapsedTimes[1] < elapsedTimes[0] * 10.0 + 0.01);
+}
+
+@end
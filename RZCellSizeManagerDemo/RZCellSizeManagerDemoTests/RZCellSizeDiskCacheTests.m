@@ -0,0 +1,249 @@
+//
+//  RZCellSizeDiskCacheTests.m
+//
+
+
+// Copyright 2014 Raizlabs and other contributors
+// http://raizlabs.com/
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+#import <XCTest/XCTest.h>
+#import <UIKit/UIKit.h>
+#import "RZCellSizeDiskCache.h"
+
+// Sizes of the header and of a record in the file format.
+#define kRZHeaderLength 24
+#define kRZRecordLength 24
+
+#define kRZCellClassName @"RZTestCell"
+#define kRZWidth         320.0f
+#define kRZSalt          @"salt"
+
+@interface RZCellSizeDiskCacheTests : XCTestCase
+
+@property (nonatomic, copy) NSString* path;
+
+@end
+
+@implementation RZCellSizeDiskCacheTests
+
+- (void)setUp
+{
+    [super setUp];
+    NSString* fileName = [NSString stringWithFormat:@"%@.bin", [[NSUUID UUID] UUIDString]];
+    self.path = [NSTemporaryDirectory() stringByAppendingPathComponent:fileName];
+}
+
+- (void)tearDown
+{
+    [[NSFileManager defaultManager] removeItemAtPath:self.path error:NULL];
+    [super tearDown];
+}
+
+#pragma mark - Helpers
+
+- (RZCellSizeDiskCache *)openCacheWithSalt:(NSString *)salt
+{
+    RZCellSizeDiskCache* cache = [[RZCellSizeDiskCache alloc] initWithPath:self.path salt:salt];
+    XCTAssertNotNil(cache);
+    [cache synchronize];
+    return cache;
+}
+
+/**
+ *  Stores one size per key, with heights counting up from 10, and waits until they are written.
+ **/
+- (void)writeSizeCount:(NSUInteger)count
+{
+    RZCellSizeDiskCache* cache = [self openCacheWithSalt:kRZSalt];
+    for (NSUInteger i = 0; i < count; i++)
+    {
+        [cache setSize:CGSizeMake(kRZWidth, 10.0f + i) forContentKey:[self keyAtIndex:i] cellClassName:kRZCellClassName width:kRZWidth];
+    }
+    [cache synchronize];
+}
+
+- (NSString *)keyAtIndex:(NSUInteger)index
+{
+    return [NSString stringWithFormat:@"key-%lu", (unsigned long)index];
+}
+
+- (unsigned long long)fileLength
+{
+    return [[[NSFileManager defaultManager] attributesOfItemAtPath:self.path error:NULL] fileSize];
+}
+
+- (void)changeByteAtOffset:(NSUInteger)offset
+{
+    NSMutableData* data = [NSMutableData dataWithContentsOfFile:self.path];
+    ((uint8_t *)data.mutableBytes)[offset] ^= 0x5a;
+    [data writeToFile:self.path atomically:NO];
+}
+
+#pragma mark - Tests
+
+- (void)testSizesPersistBetweenOpens
+{
+    [self writeSizeCount:3];
+    XCTAssertEqual([self fileLength], (unsigned long long)(kRZHeaderLength + 3 * kRZRecordLength));
+    
+    RZCellSizeDiskCache* cache = [self openCacheWithSalt:kRZSalt];
+    XCTAssertEqual(cache.count, (NSUInteger)3);
+    for (NSUInteger i = 0; i < 3; i++)
+    {
+        CGSize size = CGSizeZero;
+        XCTAssertTrue([cache getSize:&size forContentKey:[self keyAtIndex:i] cellClassName:kRZCellClassName width:kRZWidth]);
+        XCTAssertEqual(size.height, (CGFloat)(10.0f + i));
+    }
+    
+    CGSize size = CGSizeZero;
+    XCTAssertFalse([cache getSize:&size forContentKey:[self keyAtIndex:0] cellClassName:kRZCellClassName width:kRZWidth + 1.0f]);
+    XCTAssertFalse([cache getSize:&size forContentKey:[self keyAtIndex:0] cellClassName:@"RZOtherCell" width:kRZWidth]);
+}
+
+- (void)testLatestRecordWins
+{
+    RZCellSizeDiskCache* cache = [self openCacheWithSalt:kRZSalt];
+    [cache setSize:CGSizeMake(kRZWidth, 10.0f) forContentKey:@"key" cellClassName:kRZCellClassName width:kRZWidth];
+    [cache setSize:CGSizeMake(kRZWidth, 20.0f) forContentKey:@"key" cellClassName:kRZCellClassName width:kRZWidth];
+    [cache synchronize];
+    cache = nil;
+    
+    cache = [self openCacheWithSalt:kRZSalt];
+    CGSize size = CGSizeZero;
+    XCTAssertTrue([cache getSize:&size forContentKey:@"key" cellClassName:kRZCellClassName width:kRZWidth]);
+    XCTAssertEqual(size.height, (CGFloat)20.0f);
+    XCTAssertEqual(cache.count, (NSUInteger)1);
+}
+
+- (void)testStringAndDataKeysDoNotCollide
+{
+    RZCellSizeDiskCache* cache = [self openCacheWithSalt:kRZSalt];
+    NSData* data = [@"key" dataUsingEncoding:NSUTF8StringEncoding];
+    [cache setSize:CGSizeMake(kRZWidth, 10.0f) forContentKey:@"key" cellClassName:kRZCellClassName width:kRZWidth];
+    [cache setSize:CGSizeMake(kRZWidth, 20.0f) forContentKey:data cellClassName:kRZCellClassName width:kRZWidth];
+    
+    CGSize size = CGSizeZero;
+    XCTAssertTrue([cache getSize:&size forContentKey:@"key" cellClassName:kRZCellClassName width:kRZWidth]);
+    XCTAssertEqual(size.height, (CGFloat)10.0f);
+    XCTAssertTrue([cache getSize:&size forContentKey:data cellClassName:kRZCellClassName width:kRZWidth]);
+    XCTAssertEqual(size.height, (CGFloat)20.0f);
+}
+
+- (void)testCorruptRecordCutsTheFile
+{
+    [self writeSizeCount:4];
+    
+    // Damage the height of the third record, so it and everything after it is dropped.
+    [self changeByteAtOffset:kRZHeaderLength + 2 * kRZRecordLength + 12];
+    
+    RZCellSizeDiskCache* cache = [self openCacheWithSalt:kRZSalt];
+    XCTAssertEqual(cache.count, (NSUInteger)2);
+    XCTAssertEqual([self fileLength], (unsigned long long)(kRZHeaderLength + 2 * kRZRecordLength));
+    
+    CGSize size = CGSizeZero;
+    XCTAssertTrue([cache getSize:&size forContentKey:[self keyAtIndex:1] cellClassName:kRZCellClassName width:kRZWidth]);
+    XCTAssertFalse([cache getSize:&size forContentKey:[self keyAtIndex:2] cellClassName:kRZCellClassName width:kRZWidth]);
+    XCTAssertFalse([cache getSize:&size forContentKey:[self keyAtIndex:3] cellClassName:kRZCellClassName width:kRZWidth]);
+    
+    // New records go after the last good one.
+    [cache setSize:CGSizeMake(kRZWidth, 50.0f) forContentKey:[self keyAtIndex:3] cellClassName:kRZCellClassName width:kRZWidth];
+    [cache synchronize];
+    cache = nil;
+    
+    cache = [self openCacheWithSalt:kRZSalt];
+    XCTAssertEqual(cache.count, (NSUInteger)3);
+    XCTAssertTrue([cache getSize:&size forContentKey:[self keyAtIndex:3] cellClassName:kRZCellClassName width:kRZWidth]);
+    XCTAssertEqual(size.height, (CGFloat)50.0f);
+}
+
+- (void)testPartialRecordIsDropped
+{
+    [self writeSizeCount:3];
+    NSData* data = [NSData dataWithContentsOfFile:self.path];
+    [[data subdataWithRange:NSMakeRange(0, data.length - kRZRecordLength / 2)] writeToFile:self.path atomically:NO];
+    
+    RZCellSizeDiskCache* cache = [self openCacheWithSalt:kRZSalt];
+    XCTAssertEqual(cache.count, (NSUInteger)2);
+    XCTAssertEqual([self fileLength], (unsigned long long)(kRZHeaderLength + 2 * kRZRecordLength));
+}
+
+- (void)testVersionMismatchDiscardsTheFile
+{
+    [self writeSizeCount:3];
+    
+    // The version follows the four byte magic number.
+    [self changeByteAtOffset:4];
+    
+    RZCellSizeDiskCache* cache = [self openCacheWithSalt:kRZSalt];
+    XCTAssertEqual(cache.count, (NSUInteger)0);
+    XCTAssertEqual([self fileLength], (unsigned long long)kRZHeaderLength);
+    
+    CGSize size = CGSizeZero;
+    XCTAssertFalse([cache getSize:&size forContentKey:[self keyAtIndex:0] cellClassName:kRZCellClassName width:kRZWidth]);
+}
+
+- (void)testSaltMismatchDiscardsTheFile
+{
+    [self writeSizeCount:3];
+    
+    RZCellSizeDiskCache* cache = [self openCacheWithSalt:@"another salt"];
+    XCTAssertEqual(cache.count, (NSUInteger)0);
+    XCTAssertEqual([self fileLength], (unsigned long long)kRZHeaderLength);
+}
+
+- (void)testShortHeaderDiscardsTheFile
+{
+    [[NSData dataWithBytes:"RZCS" length:4] writeToFile:self.path atomically:NO];
+    
+    RZCellSizeDiskCache* cache = [self openCacheWithSalt:kRZSalt];
+    XCTAssertEqual(cache.count, (NSUInteger)0);
+    XCTAssertEqual([self fileLength], (unsigned long long)kRZHeaderLength);
+}
+
+- (void)testSizesStoredWhileLoadingWin
+{
+    [self writeSizeCount:3];
+    
+    RZCellSizeDiskCache* cache = [[RZCellSizeDiskCache alloc] initWithPath:self.path salt:kRZSalt];
+    [cache setSize:CGSizeMake(kRZWidth, 50.0f) forContentKey:[self keyAtIndex:0] cellClassName:kRZCellClassName width:kRZWidth];
+    [cache synchronize];
+    
+    CGSize size = CGSizeZero;
+    XCTAssertEqual(cache.count, (NSUInteger)3);
+    XCTAssertTrue([cache getSize:&size forContentKey:[self keyAtIndex:0] cellClassName:kRZCellClassName width:kRZWidth]);
+    XCTAssertEqual(size.height, (CGFloat)50.0f);
+    XCTAssertTrue([cache getSize:&size forContentKey:[self keyAtIndex:2] cellClassName:kRZCellClassName width:kRZWidth]);
+    XCTAssertEqual(size.height, (CGFloat)12.0f);
+}
+
+- (void)testRemoveAllSizesWhileLoading
+{
+    [self writeSizeCount:3];
+    
+    RZCellSizeDiskCache* cache = [[RZCellSizeDiskCache alloc] initWithPath:self.path salt:kRZSalt];
+    [cache removeAllSizes];
+    [cache synchronize];
+    XCTAssertEqual(cache.count, (NSUInteger)0);
+    XCTAssertEqual([self fileLength], (unsigned long long)kRZHeaderLength);
+}
+
+@end
@@ -0,0 +1,189 @@
+//
+//  RZCellSizeEstimatorTests.m
+//
+
+
+// Copyright 2014 Raizlabs and other contributors
+// http://raizlabs.com/
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+#import <XCTest/XCTest.h>
+#import <UIKit/UIKit.h>
+#import "RZCellSizeEstimator.h"
+
+typedef struct {
+    double textLength;
+    CGFloat height;
+} RZEstimatorSample;
+
+/**
+ *  Samples shaped like the demo's cells: the length of the text and the height of a cell that wraps it at 38
+ *  characters a line, with 21 points a line on top of 26 points of margins.
+ **/
+static const RZEstimatorSample kRZEstimatorSamples[] = {
+    {  87,  89 }, {  43,  68 }, { 106,  89 }, { 171, 131 }, {  17,  47 }, {  23,  47 }, { 142, 110 }, {  29,  47 },
+    {  98,  89 }, { 154, 131 }, {  19,  47 }, { 134, 110 }, {  59,  68 }, {  14,  47 }, {  27,  47 }, { 116, 110 },
+    { 112,  89 }, {  22,  47 }, {  66,  68 }, {  28,  47 }, { 146, 110 }, { 113,  89 }, {  20,  47 }, { 149, 110 },
+    {  36,  47 }, {  62,  68 }, { 166, 131 }, { 165, 131 }, { 154, 131 }, {  20,  47 }, { 152, 110 }, { 154, 131 },
+};
+
+#define kRZEstimatorSampleCount (sizeof(kRZEstimatorSamples) / sizeof(kRZEstimatorSamples[0]))
+#define kRZEstimatorAccuracy    0.0001
+
+@interface RZCellSizeEstimatorTests : XCTestCase
+
+@end
+
+@implementation RZCellSizeEstimatorTests
+
+#pragma mark - Helpers
+
+- (RZCellSizeEstimator *)estimatorWithSamplesAndWindow:(NSUInteger)sampleWindow
+{
+    RZCellSizeEstimator* estimator = [[RZCellSizeEstimator alloc] init];
+    estimator.sampleWindow = sampleWindow;
+    for (NSUInteger i = 0; i < kRZEstimatorSampleCount; i++)
+    {
+        [estimator addHeight:kRZEstimatorSamples[i].height feature:kRZEstimatorSamples[i].textLength];
+    }
+    return estimator;
+}
+
+#pragma mark - Tests
+
+- (void)testStatisticsMatchTwoPassSums
+{
+    RZCellSizeEstimator* estimator = [self estimatorWithSamplesAndWindow:0];
+    
+    double meanFeature = 0.0;
+    double meanHeight = 0.0;
+    for (NSUInteger i = 0; i < kRZEstimatorSampleCount; i++)
+    {
+        meanFeature += kRZEstimatorSamples[i].textLength / kRZEstimatorSampleCount;
+        meanHeight += kRZEstimatorSamples[i].height / kRZEstimatorSampleCount;
+    }
+    double featureVariance = 0.0;
+    double heightVariance = 0.0;
+    double covariance = 0.0;
+    double minimumHeight = kRZEstimatorSamples[0].height;
+    double maximumHeight = kRZEstimatorSamples[0].height;
+    for (NSUInteger i = 0; i < kRZEstimatorSampleCount; i++)
+    {
+        double featureDelta = kRZEstimatorSamples[i].textLength - meanFeature;
+        double heightDelta = kRZEstimatorSamples[i].height - meanHeight;
+        featureVariance += featureDelta * featureDelta / kRZEstimatorSampleCount;
+        heightVariance += heightDelta * heightDelta / kRZEstimatorSampleCount;
+        covariance += featureDelta * heightDelta / kRZEstimatorSampleCount;
+        minimumHeight = MIN(minimumHeight, kRZEstimatorSamples[i].height);
+        maximumHeight = MAX(maximumHeight, kRZEstimatorSamples[i].height);
+    }
+    
+    XCTAssertEqual(estimator.count, (NSUInteger)kRZEstimatorSampleCount);
+    XCTAssertEqualWithAccuracy(estimator.meanHeight, meanHeight, kRZEstimatorAccuracy);
+    XCTAssertEqualWithAccuracy(estimator.heightStandardDeviation, sqrt(heightVariance), kRZEstimatorAccuracy);
+    
+    double slope = covariance / featureVariance;
+    for (double feature = 0.0; feature <= 250.0; feature += 10.0)
+    {
+        double expected = MIN(MAX(meanHeight + slope * (feature - meanFeature), minimumHeight), maximumHeight);
+        XCTAssertEqualWithAccuracy([estimator estimatedHeightForFeature:feature], expected, kRZEstimatorAccuracy, @"Feature %.0f", feature);
+    }
+}
+
+- (void)testFeaturesPredictBetterThanTheMean
+{
+    RZCellSizeEstimator* estimator = [self estimatorWithSamplesAndWindow:0];
+    double lineError = 0.0;
+    double meanError = 0.0;
+    for (NSUInteger i = 0; i < kRZEstimatorSampleCount; i++)
+    {
+        lineError += fabs([estimator estimatedHeightForFeature:kRZEstimatorSamples[i].textLength] - kRZEstimatorSamples[i].height);
+        meanError += fabs(estimator.meanHeight - kRZEstimatorSamples[i].height);
+    }
+    lineError /= kRZEstimatorSampleCount;
+    meanError /= kRZEstimatorSampleCount;
+    
+    // One line of text is 21 points, so the line is off by less than half a line on average.
+    XCTAssertLessThan(lineError, 10.5);
+    XCTAssertLessThan(lineError, meanError / 4.0);
+}
+
+- (void)testEstimatesStayWithinTheHeightsSeen
+{
+    RZCellSizeEstimator* estimator = [self estimatorWithSamplesAndWindow:0];
+    XCTAssertEqual([estimator estimatedHeightForFeature:-1000.0], (CGFloat)47.0f);
+    XCTAssertEqual([estimator estimatedHeightForFeature:100000.0], (CGFloat)131.0f);
+}
+
+- (void)testSameFeatureGivesTheMean
+{
+    RZCellSizeEstimator* estimator = [[RZCellSizeEstimator alloc] init];
+    for (NSUInteger i = 0; i < kRZEstimatorSampleCount; i++)
+    {
+        [estimator addHeight:kRZEstimatorSamples[i].height];
+    }
+    XCTAssertEqualWithAccuracy([estimator estimatedHeightForFeature:0.0], estimator.meanHeight, kRZEstimatorAccuracy);
+    XCTAssertEqualWithAccuracy([estimator estimatedHeightForFeature:500.0], estimator.meanHeight, kRZEstimatorAccuracy);
+}
+
+- (void)testWindowFollowsDriftingHeights
+{
+    NSUInteger sampleWindow = 16;
+    RZCellSizeEstimator* estimator = [self estimatorWithSamplesAndWindow:sampleWindow];
+    
+    // The content changes so every cell is one line taller.  After ten windows the old heights weigh (15/16)^160.
+    for (NSUInteger round = 0; round < 10 * sampleWindow / kRZEstimatorSampleCount + 1; round++)
+    {
+        for (NSUInteger i = 0; i < kRZEstimatorSampleCount; i++)
+        {
+            [estimator addHeight:kRZEstimatorSamples[i].height + 21.0f feature:kRZEstimatorSamples[i].textLength];
+        }
+    }
+    RZCellSizeEstimator* shiftedEstimator = [[RZCellSizeEstimator alloc] init];
+    shiftedEstimator.sampleWindow = 0;
+    for (NSUInteger i = 0; i < kRZEstimatorSampleCount; i++)
+    {
+        [shiftedEstimator addHeight:kRZEstimatorSamples[i].height + 21.0f feature:kRZEstimatorSamples[i].textLength];
+    }
+    XCTAssertEqualWithAccuracy(estimator.meanHeight, shiftedEstimator.meanHeight, 21.0 / 2.0);
+    
+    // Without a window every height counts the same.
+    RZCellSizeEstimator* unweightedEstimator = [self estimatorWithSamplesAndWindow:0];
+    double meanHeight = unweightedEstimator.meanHeight;
+    [unweightedEstimator addHeight:1000.0f feature:0.0];
+    XCTAssertEqualWithAccuracy(unweightedEstimator.meanHeight, (meanHeight * kRZEstimatorSampleCount + 1000.0) / (kRZEstimatorSampleCount + 1), kRZEstimatorAccuracy);
+}
+
+- (void)testResetForgetsEverything
+{
+    RZCellSizeEstimator* estimator = [self estimatorWithSamplesAndWindow:0];
+    [estimator reset];
+    XCTAssertEqual(estimator.count, (NSUInteger)0);
+    XCTAssertEqual(estimator.meanHeight, (CGFloat)0.0f);
+    XCTAssertEqual(estimator.heightStandardDeviation, (CGFloat)0.0f);
+    XCTAssertEqual([estimator estimatedHeightForFeature:100.0], (CGFloat)0.0f);
+    
+    [estimator addHeight:44.0f feature:10.0];
+    XCTAssertEqual([estimator estimatedHeightForFeature:500.0], (CGFloat)44.0f);
+    XCTAssertEqual(estimator.heightStandardDeviation, (CGFloat)0.0f);
+}
+
+@end
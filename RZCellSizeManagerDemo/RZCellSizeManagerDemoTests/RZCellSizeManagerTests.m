@@ -0,0 +1,866 @@
+//
+//  RZCellSizeManagerTests.m
+//
+
+
+// Copyright 2014 Raizlabs and other contributors
+// http://raizlabs.com/
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+#import <XCTest/XCTest.h>
+#import <UIKit/UIKit.h>
+#import "RZCellSizeManager.h"
+#import "RZCellSizeManager+CoreData.h"
+#import "RZCellSizeDiskCache.h"
+#import "RZCellSizeStatistics.h"
+#import "RZCellSizeTextLayout.h"
+
+#define kRZModelBatchCount      200
+#define kRZParallelCellCount    600
+#define kRZScalingCellCount     2000
+
+static NSUInteger s_countingCellCount = 0;
+
+/**
+ *  Returns count distinct random indexes below range, or every index below range if there are not that many.
+ **/
+static NSIndexSet *RZRandomIndexes(NSUInteger count, NSUInteger range)
+{
+    NSMutableIndexSet* indexes = [NSMutableIndexSet indexSet];
+    while (indexes.count < MIN(count, range))
+    {
+        [indexes addIndex:random() % range];
+    }
+    return indexes;
+}
+
+/**
+ *  A model object whose height is whatever the test sets, so a size that lands on the wrong row shows up.
+ **/
+@interface RZManagerTestObject : NSObject
+
+@property (nonatomic, assign) CGFloat height;
+
+@end
+
+@implementation RZManagerTestObject
+
++ (instancetype)objectWithHeight:(CGFloat)height
+{
+    RZManagerTestObject* object = [[self alloc] init];
+    object.height = height;
+    return object;
+}
+
+@end
+
+@interface RZManagerTestSubObject : RZManagerTestObject
+
+@end
+
+@implementation RZManagerTestSubObject
+
+@end
+
+@interface RZManagerTestSubSubObject : RZManagerTestSubObject
+
+@end
+
+@implementation RZManagerTestSubSubObject
+
+@end
+
+@interface RZManagerTestCell : UITableViewCell
+
+@end
+
+@implementation RZManagerTestCell
+
+@end
+
+@interface RZManagerOtherTestCell : UITableViewCell
+
+@end
+
+@implementation RZManagerOtherTestCell
+
+@end
+
+@interface RZManagerThirdTestCell : UITableViewCell
+
+@end
+
+@implementation RZManagerThirdTestCell
+
+@end
+
+/**
+ *  Counts every prototype created, so tests can check that a path never loads one.
+ **/
+@interface RZManagerCountingTestCell : UITableViewCell
+
+@end
+
+@implementation RZManagerCountingTestCell
+
+- (instancetype)init
+{
+    self = [super init];
+    if ( self ) {
+        s_countingCellCount++;
+    }
+    return self;
+}
+
+@end
+
+@interface RZManagerOtherCountingTestCell : RZManagerCountingTestCell
+
+@end
+
+@implementation RZManagerOtherCountingTestCell
+
+@end
+
+@interface RZManagerThirdCountingTestCell : RZManagerCountingTestCell
+
+@end
+
+@implementation RZManagerThirdCountingTestCell
+
+@end
+
+@interface RZCellSizeManagerTests : XCTestCase
+
+@property (nonatomic, strong) RZCellSizeManager* manager;
+@property (nonatomic, assign) NSUInteger heightBlockCount;
+@property (nonatomic, assign) NSUInteger nextRow;
+
+@end
+
+@implementation RZCellSizeManagerTests
+
+- (void)setUp
+{
+    [super setUp];
+    self.manager = [[RZCellSizeManager alloc] init];
+    self.manager.cellHeightPadding = 0.0f;
+    self.heightBlockCount = 0;
+    self.nextRow = 0;
+}
+
+- (void)tearDown
+{
+    self.manager = nil;
+    [super tearDown];
+}
+
+#pragma mark - Helpers
+
+/**
+ *  A height block that counts its calls and answers with the height of the object.
+ **/
+- (RZCellSizeManagerHeightBlock)countingHeightBlock
+{
+    __weak __typeof(self) weakSelf = self;
+    return ^CGFloat(id cell, RZManagerTestObject* object) {
+        weakSelf.heightBlockCount++;
+        return object.height;
+    };
+}
+
+- (RZCellSizeManagerHeightBlock)heightBlockReturning:(CGFloat)height
+{
+    return ^CGFloat(id cell, id object) {
+        return height;
+    };
+}
+
+/**
+ *  Measures an object at a row that has not been used yet, so its configuration is resolved rather than a cached
+ *  height returned.
+ **/
+- (CGFloat)heightOfObject:(id)object reuseIdentifier:(NSString *)reuseIdentifier
+{
+    NSIndexPath* indexPath = [NSIndexPath indexPathForRow:self.nextRow++ inSection:0];
+    return [self.manager cellHeightForObject:object indexPath:indexPath cellReuseIdentifier:reuseIdentifier];
+}
+
+/**
+ *  Asks for the height of every row and checks that only the rows that were not cached are measured.
+ **/
+- (void)assertHeightsOfObjects:(NSArray *)objects areMeasuredOnlyForRows:(NSIndexSet *)uncachedRows step:(NSUInteger)step
+{
+    NSUInteger countBefore = self.heightBlockCount;
+    [objects enumerateObjectsUsingBlock:^(RZManagerTestObject* object, NSUInteger row, BOOL *stop) {
+        NSIndexPath* indexPath = [NSIndexPath indexPathForRow:row inSection:0];
+        CGFloat height = [self.manager cellHeightForObject:object indexPath:indexPath];
+        XCTAssertEqual(height, object.height, @"Row %lu has the wrong height after step %lu", (unsigned long)row, (unsigned long)step);
+    }];
+    XCTAssertEqual(self.heightBlockCount - countBefore, uncachedRows.count, @"Wrong number of measurements after step %lu", (unsigned long)step);
+}
+
+#pragma mark - Configuration Lookup
+
+- (void)testObjectsResolveToTheNearestRegisteredSuperclass
+{
+    [self.manager registerCellClassName:@"RZManagerTestCell" withNibNamed:nil forObjectClass:[RZManagerTestObject class] withHeightBlock:[self heightBlockReturning:10.0f]];
+    [self.manager registerCellClassName:@"RZManagerOtherTestCell" withNibNamed:nil forObjectClass:[RZManagerTestSubObject class] withHeightBlock:[self heightBlockReturning:20.0f]];
+    
+    XCTAssertEqual([self heightOfObject:[RZManagerTestObject new] reuseIdentifier:nil], (CGFloat)10.0f);
+    XCTAssertEqual([self heightOfObject:[RZManagerTestSubObject new] reuseIdentifier:nil], (CGFloat)20.0f);
+    XCTAssertEqual([self heightOfObject:[RZManagerTestSubSubObject new] reuseIdentifier:nil], (CGFloat)20.0f);
+    
+    // Asked twice so the second answer comes from the remembered resolution.
+    XCTAssertEqual([self heightOfObject:[RZManagerTestSubSubObject new] reuseIdentifier:nil], (CGFloat)20.0f);
+    
+    // Nothing is registered for strings, and no registration applies to every cell, so the first one is used.
+    XCTAssertEqual([self heightOfObject:@"string" reuseIdentifier:nil], (CGFloat)10.0f);
+    XCTAssertEqual([self heightOfObject:nil reuseIdentifier:nil], (CGFloat)10.0f);
+}
+
+- (void)testRegisteringASubclassLaterChangesRememberedResolutions
+{
+    [self.manager registerCellClassName:@"RZManagerTestCell" withNibNamed:nil forObjectClass:[RZManagerTestObject class] withHeightBlock:[self heightBlockReturning:10.0f]];
+    XCTAssertEqual([self heightOfObject:[RZManagerTestSubSubObject new] reuseIdentifier:nil], (CGFloat)10.0f);
+    
+    [self.manager registerCellClassName:@"RZManagerOtherTestCell" withNibNamed:nil forObjectClass:[RZManagerTestSubObject class] withHeightBlock:[self heightBlockReturning:20.0f]];
+    XCTAssertEqual([self heightOfObject:[RZManagerTestSubSubObject new] reuseIdentifier:nil], (CGFloat)20.0f);
+    XCTAssertEqual([self heightOfObject:[RZManagerTestObject new] reuseIdentifier:nil], (CGFloat)10.0f);
+}
+
+- (void)testReuseIdentifierWinsOverObjectClass
+{
+    [self.manager registerCellClassName:@"RZManagerTestCell" withNibNamed:nil forObjectClass:[RZManagerTestObject class] withHeightBlock:[self heightBlockReturning:10.0f]];
+    [self.manager registerCellClassName:@"RZManagerOtherTestCell" withNibNamed:nil forReuseIdentifier:@"other" withHeightBlock:[self heightBlockReturning:20.0f]];
+    
+    XCTAssertEqual([self heightOfObject:[RZManagerTestObject new] reuseIdentifier:@"other"], (CGFloat)20.0f);
+    XCTAssertEqual([self heightOfObject:[RZManagerTestObject new] reuseIdentifier:nil], (CGFloat)10.0f);
+    
+    // An unknown reuse identifier gets the fallback, which is the first registration here.
+    XCTAssertEqual([self heightOfObject:@"string" reuseIdentifier:@"unknown"], (CGFloat)10.0f);
+}
+
+/**
+ *  The fallback is the first registration that applies to every cell, or the first registration if there is none.
+ *  Registering more classes and replacing registrations must keep to that rule.
+ **/
+- (void)testFallbackIsTheFirstRegistrationForEveryCell
+{
+    [self.manager registerCellClassName:@"RZManagerTestCell" withNibNamed:nil forObjectClass:[RZManagerTestSubObject class] withHeightBlock:[self heightBlockReturning:10.0f]];
+    XCTAssertEqual([self heightOfObject:@"string" reuseIdentifier:nil], (CGFloat)10.0f);
+    
+    [self.manager registerCellClassName:@"RZManagerOtherTestCell" withNibNamed:nil forObjectClass:nil withHeightBlock:[self heightBlockReturning:20.0f]];
+    XCTAssertEqual([self heightOfObject:@"string" reuseIdentifier:nil], (CGFloat)20.0f);
+    XCTAssertEqual([self heightOfObject:[RZManagerTestObject new] reuseIdentifier:nil], (CGFloat)20.0f);
+    XCTAssertEqual([self heightOfObject:[RZManagerTestSubObject new] reuseIdentifier:nil], (CGFloat)10.0f);
+    
+    [self.manager registerCellClassName:@"RZManagerThirdTestCell" withNibNamed:nil forObjectClass:nil withHeightBlock:[self heightBlockReturning:30.0f]];
+    XCTAssertEqual([self heightOfObject:@"string" reuseIdentifier:nil], (CGFloat)20.0f);
+    
+    // Replacing another registration rebuilds the tables without changing the fallback.
+    [self.manager registerCellClassName:@"RZManagerTestCell" withNibNamed:nil forObjectClass:[RZManagerTestSubObject class] withHeightBlock:[self heightBlockReturning:15.0f]];
+    XCTAssertEqual([self heightOfObject:@"string" reuseIdentifier:nil], (CGFloat)20.0f);
+    XCTAssertEqual([self heightOfObject:[RZManagerTestSubObject new] reuseIdentifier:nil], (CGFloat)15.0f);
+    
+    // Replacing the fallback with a registration for one class hands the fallback to the next one for every cell.
+    [self.manager registerCellClassName:@"RZManagerOtherTestCell" withNibNamed:nil forObjectClass:[RZManagerTestObject class] withHeightBlock:[self heightBlockReturning:25.0f]];
+    XCTAssertEqual([self heightOfObject:@"string" reuseIdentifier:nil], (CGFloat)30.0f);
+    XCTAssertEqual([self heightOfObject:[RZManagerTestObject new] reuseIdentifier:nil], (CGFloat)25.0f);
+    XCTAssertEqual([self heightOfObject:[RZManagerTestSubSubObject new] reuseIdentifier:nil], (CGFloat)15.0f);
+}
+
+#pragma mark - Widths
+
+- (NSArray *)objectsWithCount:(NSUInteger)count
+{
+    NSMutableArray* objects = [NSMutableArray array];
+    for (NSUInteger row = 0; row < count; row++)
+    {
+        [objects addObject:[RZManagerTestObject objectWithHeight:10.0f + row]];
+    }
+    return objects;
+}
+
+- (void)testReturningToARecentWidthDoesNotMeasureAgain
+{
+    [self.manager registerCellClassName:@"RZManagerTestCell" withNibNamed:nil forObjectClass:nil withHeightBlock:[self countingHeightBlock]];
+    NSArray* objects = [self objectsWithCount:10];
+    NSIndexSet* allRows = [NSIndexSet indexSetWithIndexesInRange:NSMakeRange(0, objects.count)];
+    
+    self.manager.overideWidth = 320.0f;
+    [self assertHeightsOfObjects:objects areMeasuredOnlyForRows:allRows step:0];
+    self.manager.overideWidth = 480.0f;
+    [self assertHeightsOfObjects:objects areMeasuredOnlyForRows:allRows step:1];
+    self.manager.overideWidth = 320.0f;
+    [self assertHeightsOfObjects:objects areMeasuredOnlyForRows:[NSIndexSet indexSet] step:2];
+    self.manager.overideWidth = 480.0f;
+    [self assertHeightsOfObjects:objects areMeasuredOnlyForRows:[NSIndexSet indexSet] step:3];
+    XCTAssertEqual(self.heightBlockCount, 2 * objects.count);
+}
+
+- (void)testWidthsPastTheBoundAreMeasuredAgain
+{
+    [self.manager registerCellClassName:@"RZManagerTestCell" withNibNamed:nil forObjectClass:nil withHeightBlock:[self countingHeightBlock]];
+    NSArray* objects = [self objectsWithCount:10];
+    NSIndexSet* allRows = [NSIndexSet indexSetWithIndexesInRange:NSMakeRange(0, objects.count)];
+    self.manager.maximumNumberOfCachedWidths = 2;
+    
+    self.manager.overideWidth = 320.0f;
+    [self assertHeightsOfObjects:objects areMeasuredOnlyForRows:allRows step:0];
+    self.manager.overideWidth = 480.0f;
+    [self assertHeightsOfObjects:objects areMeasuredOnlyForRows:allRows step:1];
+    self.manager.overideWidth = 600.0f;
+    [self assertHeightsOfObjects:objects areMeasuredOnlyForRows:allRows step:2];
+    
+    // 320 was the least recently used of three widths, so its sizes were dropped.
+    self.manager.overideWidth = 320.0f;
+    [self assertHeightsOfObjects:objects areMeasuredOnlyForRows:allRows step:3];
+    self.manager.overideWidth = 600.0f;
+    [self assertHeightsOfObjects:objects areMeasuredOnlyForRows:[NSIndexSet indexSet] step:4];
+    
+    // Lowering the bound drops every width but the current one.
+    self.manager.maximumNumberOfCachedWidths = 1;
+    self.manager.overideWidth = 320.0f;
+    [self assertHeightsOfObjects:objects areMeasuredOnlyForRows:allRows step:5];
+}
+
+#pragma mark - Layout Signatures
+
+/**
+ *  Two managers measure the same objects through random height changes, width changes and class invalidations, one
+ *  with layout signatures and one without.  Heights depend on the width, so a signature size kept for the wrong width
+ *  shows up, and every height must match while the manager with signatures measures less.
+ **/
+- (void)testLayoutSignaturesDoNotChangeSizes
+{
+    srandom(2014);
+    RZCellSizeManager* managers[2];
+    NSUInteger measurementCounts[2] = { 0, 0 };
+    for (NSUInteger i = 0; i < 2; i++)
+    {
+        NSUInteger* measurementCount = &measurementCounts[i];
+        managers[i] = [[RZCellSizeManager alloc] init];
+        [managers[i] registerCellClassName:@"RZManagerTestCell" withNibNamed:nil forObjectClass:nil withHeightBlock:^CGFloat(id cell, RZManagerTestObject* object) {
+            (*measurementCount)++;
+            return object.height + CGRectGetWidth([cell bounds]) / 10.0f;
+        }];
+        managers[i].overideWidth = 320.0f;
+    }
+    [managers[1] setLayoutSignatureBlock:^id<NSCopying>(RZManagerTestObject* object) {
+        return @(object.height);
+    } forCellClassName:@"RZManagerTestCell"];
+    
+    NSMutableArray* objects = [NSMutableArray array];
+    for (NSUInteger row = 0; row < 100; row++)
+    {
+        [objects addObject:[RZManagerTestObject objectWithHeight:1 + random() % 10]];
+    }
+    
+    for (NSUInteger step = 0; step < kRZModelBatchCount; step++)
+    {
+        switch (random() % 4)
+        {
+            case 0:
+            {
+                NSUInteger row = random() % objects.count;
+                [[objects objectAtIndex:row] setHeight:1 + random() % 10];
+                for (NSUInteger i = 0; i < 2; i++)
+                {
+                    [managers[i] invalidateCellSizeAtIndexPath:[NSIndexPath indexPathForRow:row inSection:0]];
+                }
+                break;
+            }
+            case 1:
+            {
+                CGFloat width = (random() % 2) ? 480.0f : 320.0f;
+                for (NSUInteger i = 0; i < 2; i++)
+                {
+                    managers[i].overideWidth = width;
+                }
+                break;
+            }
+            case 2:
+            {
+                for (NSUInteger i = 0; i < 2; i++)
+                {
+                    [managers[i] invalidateCellSizesForCellClassName:@"RZManagerTestCell"];
+                }
+                break;
+            }
+            default:
+                break;
+        }
+        
+        for (NSUInteger lookup = 0; lookup < 10; lookup++)
+        {
+            NSUInteger row = random() % objects.count;
+            NSIndexPath* indexPath = [NSIndexPath indexPathForRow:row inSection:0];
+            CGFloat height = [managers[0] cellHeightForObject:[objects objectAtIndex:row] indexPath:indexPath];
+            CGFloat signatureHeight = [managers[1] cellHeightForObject:[objects objectAtIndex:row] indexPath:indexPath];
+            XCTAssertEqual(signatureHeight, height, @"Row %lu has a different height after step %lu", (unsigned long)row, (unsigned long)step);
+        }
+    }
+    XCTAssertTrue(measurementCounts[1] < measurementCounts[0]);
+}
+
+#pragma mark - Dropped Sizes
+
+/**
+ *  Sizes that are already stale were counted when they were invalidated, so a structural change that removes them
+ *  must not count them again.
+ **/
+- (void)testStructuralChangesOnlyCountValidSizes
+{
+    self.manager.collectsStatistics = YES;
+    [self.manager registerCellClassName:@"RZManagerTestCell" withNibNamed:nil forObjectClass:nil withHeightBlock:[self countingHeightBlock]];
+    NSArray* objects = [self objectsWithCount:10];
+    [self assertHeightsOfObjects:objects areMeasuredOnlyForRows:[NSIndexSet indexSetWithIndexesInRange:NSMakeRange(0, objects.count)] step:0];
+    
+    [self.manager invalidateCellSizesAtIndexPaths:@[ [NSIndexPath indexPathForRow:2 inSection:0], [NSIndexPath indexPathForRow:3 inSection:0] ]];
+    XCTAssertEqual([self.manager statistics].sizesDroppedByIndexPathInvalidation, (NSUInteger)2);
+    
+    // Row 2 is stale and row 5 is valid.
+    [self.manager deleteCellSizesAtIndexPaths:@[ [NSIndexPath indexPathForRow:2 inSection:0], [NSIndexPath indexPathForRow:5 inSection:0] ]];
+    XCTAssertEqual([self.manager statistics].sizesDroppedByStructuralChanges, (NSUInteger)1);
+    
+    // An invalidation inside a batch counts as one, and only the deletion is structural.
+    [self.manager beginCellSizeUpdates];
+    [self.manager invalidateCellSizeAtIndexPath:[NSIndexPath indexPathForRow:0 inSection:0]];
+    [self.manager deleteCellSizesAtIndexPaths:@[ [NSIndexPath indexPathForRow:1 inSection:0] ]];
+    [self.manager endCellSizeUpdates];
+    XCTAssertEqual([self.manager statistics].sizesDroppedByIndexPathInvalidation, (NSUInteger)3);
+    XCTAssertEqual([self.manager statistics].sizesDroppedByStructuralChanges, (NSUInteger)2);
+    
+    // Seven rows are left, and the two stale ones were counted when they were invalidated.
+    [self.manager deleteCellSizesForSections:[NSIndexSet indexSetWithIndex:0]];
+    XCTAssertEqual([self.manager statistics].sizesDroppedByStructuralChanges, (NSUInteger)7);
+}
+
+#pragma mark - Batches
+
+/**
+ *  Random fetched results changes reported as one batch, as a results controller delegate would between
+ *  controllerWillChangeContent: and controllerDidChangeContent:.  Updates, deletions and move sources are in old
+ *  rows, insertions and move destinations in new rows.  Updated and moved objects change height, so their sizes must
+ *  be measured again, and every other row must keep the size it had without being measured again.
+ **/
+- (void)testCoalescedBatchKeepsSizesOfUntouchedRows
+{
+    srandom(1986);
+    [self.manager registerCellClassName:@"RZManagerTestCell" withNibNamed:nil forObjectClass:nil withHeightBlock:[self countingHeightBlock]];
+    
+    NSMutableArray* objects = [NSMutableArray array];
+    CGFloat nextHeight = 1.0f;
+    for (NSUInteger row = 0; row < 40; row++)
+    {
+        [objects addObject:[RZManagerTestObject objectWithHeight:nextHeight++]];
+    }
+    [self assertHeightsOfObjects:objects areMeasuredOnlyForRows:[NSIndexSet indexSetWithIndexesInRange:NSMakeRange(0, objects.count)] step:0];
+    
+    for (NSUInteger batch = 1; batch <= kRZModelBatchCount; batch++)
+    {
+        NSUInteger oldCount = objects.count;
+        NSIndexSet* changedRows = RZRandomIndexes(random() % 6, oldCount);
+        NSMutableArray* movedObjects = [NSMutableArray array];
+        NSMutableArray* movedRows = [NSMutableArray array];
+        NSMutableIndexSet* deletedRows = [NSMutableIndexSet indexSet];
+        [changedRows enumerateIndexesUsingBlock:^(NSUInteger row, BOOL *stop) {
+            if (random() % 2)
+            {
+                [deletedRows addIndex:row];
+            }
+            else
+            {
+                [movedRows addObject:@(row)];
+                [movedObjects addObject:[objects objectAtIndex:row]];
+            }
+        }];
+        NSMutableIndexSet* unchangedRows = [NSMutableIndexSet indexSetWithIndexesInRange:NSMakeRange(0, oldCount)];
+        [unchangedRows removeIndexes:changedRows];
+        NSMutableIndexSet* updatedRows = [NSMutableIndexSet indexSet];
+        [unchangedRows enumerateIndexesUsingBlock:^(NSUInteger row, BOOL *stop) {
+            if (random() % 16 == 0)
+            {
+                [updatedRows addIndex:row];
+            }
+        }];
+        
+        // The surviving objects keep their order, and the moved and inserted objects go to shuffled new rows.
+        NSUInteger insertedCount = random() % 6;
+        NSMutableArray* survivingObjects = [[objects objectsAtIndexes:unchangedRows] mutableCopy];
+        NSUInteger newCount = survivingObjects.count + movedRows.count + insertedCount;
+        NSMutableArray* newPositions = [NSMutableArray array];
+        [RZRandomIndexes(movedRows.count + insertedCount, newCount) enumerateIndexesUsingBlock:^(NSUInteger row, BOOL *stop) {
+            [newPositions addObject:@(row)];
+        }];
+        for (NSUInteger i = newPositions.count; i > 1; i--)
+        {
+            [newPositions exchangeObjectAtIndex:i - 1 withObjectAtIndex:random() % i];
+        }
+        
+        NSMutableDictionary* objectsByNewRow = [NSMutableDictionary dictionary];
+        [self.manager beginCellSizeUpdates];
+        [updatedRows enumerateIndexesUsingBlock:^(NSUInteger row, BOOL *stop) {
+            [self.manager invalidateCellHeightsForResultsController:nil
+                                                         changeType:NSFetchedResultsChangeUpdate
+                                                          indexPath:[NSIndexPath indexPathForRow:row inSection:0]
+                                                       newIndexPath:nil];
+        }];
+        [deletedRows enumerateIndexesUsingBlock:^(NSUInteger row, BOOL *stop) {
+            [self.manager invalidateCellHeightsForResultsController:nil
+                                                         changeType:NSFetchedResultsChangeDelete
+                                                          indexPath:[NSIndexPath indexPathForRow:row inSection:0]
+                                                       newIndexPath:nil];
+        }];
+        [newPositions enumerateObjectsUsingBlock:^(NSNumber* newRow, NSUInteger idx, BOOL *stop) {
+            NSIndexPath* newIndexPath = [NSIndexPath indexPathForRow:[newRow unsignedIntegerValue] inSection:0];
+            if (idx < movedRows.count)
+            {
+                NSIndexPath* indexPath = [NSIndexPath indexPathForRow:[[movedRows objectAtIndex:idx] unsignedIntegerValue] inSection:0];
+                [self.manager invalidateCellHeightsForResultsController:nil
+                                                             changeType:NSFetchedResultsChangeMove
+                                                              indexPath:indexPath
+                                                           newIndexPath:newIndexPath];
+                [objectsByNewRow setObject:[movedObjects objectAtIndex:idx] forKey:newRow];
+            }
+            else
+            {
+                [self.manager invalidateCellHeightsForResultsController:nil
+                                                             changeType:NSFetchedResultsChangeInsert
+                                                              indexPath:nil
+                                                           newIndexPath:newIndexPath];
+                [objectsByNewRow setObject:[RZManagerTestObject objectWithHeight:nextHeight++] forKey:newRow];
+            }
+        }];
+        [self.manager endCellSizeUpdates];
+        
+        NSArray* updatedObjects = [objects objectsAtIndexes:updatedRows];
+        for (RZManagerTestObject* object in [updatedObjects arrayByAddingObjectsFromArray:movedObjects])
+        {
+            object.height = nextHeight++;
+        }
+        
+        NSMutableIndexSet* uncachedRows = [NSMutableIndexSet indexSet];
+        [objects removeAllObjects];
+        NSUInteger survivor = 0;
+        for (NSUInteger row = 0; row < newCount; row++)
+        {
+            RZManagerTestObject* object = [objectsByNewRow objectForKey:@(row)];
+            if (object)
+            {
+                [uncachedRows addIndex:row];
+            }
+            else
+            {
+                object = [survivingObjects objectAtIndex:survivor++];
+                if ([updatedObjects indexOfObjectIdenticalTo:object] != NSNotFound)
+                {
+                    [uncachedRows addIndex:row];
+                }
+            }
+            [objects addObject:object];
+        }
+        XCTAssertEqual(survivor, survivingObjects.count);
+        
+        [objects enumerateObjectsUsingBlock:^(RZManagerTestObject* object, NSUInteger row, BOOL *stop) {
+            CGSize size = CGSizeZero;
+            BOOL cached = [self.manager getCachedCellSize:&size forIndexPath:[NSIndexPath indexPathForRow:row inSection:0]];
+            if ([uncachedRows containsIndex:row])
+            {
+                XCTAssertFalse(cached, @"Row %lu should not be cached after batch %lu", (unsigned long)row, (unsigned long)batch);
+            }
+            else
+            {
+                XCTAssertTrue(cached, @"Row %lu should be cached after batch %lu", (unsigned long)row, (unsigned long)batch);
+                XCTAssertEqual(size.height, object.height, @"Row %lu has the wrong size after batch %lu", (unsigned long)row, (unsigned long)batch);
+            }
+        }];
+        [self assertHeightsOfObjects:objects areMeasuredOnlyForRows:uncachedRows step:batch];
+    }
+}
+
+
+#pragma mark - Prototype Loading
+
+/**
+ *  A manager with no overide width, so asking for the cell width loads a prototype.  The counting cells are
+ *  registered with a height block with layout signatures, a size block with layout signatures and a plain height
+ *  block.  With a disk cache every class is keyed by content.
+ **/
+- (RZCellSizeManager *)countingManagerWithDiskCache:(RZCellSizeDiskCache *)diskCache threadSafe:(BOOL)threadSafe
+{
+    RZCellSizeManager* manager = [[RZCellSizeManager alloc] init];
+    manager.collectsStatistics = YES;
+    manager.diskCache = diskCache;
+    
+    [manager registerCellClassName:@"RZManagerCountingTestCell" withNibNamed:nil forObjectClass:[RZManagerTestObject class] withHeightBlock:^CGFloat(id cell, RZManagerTestObject* object) {
+        return object.height;
+    }];
+    [manager registerCellClassName:@"RZManagerOtherCountingTestCell" withNibNamed:nil forObjectClass:[RZManagerTestSubObject class] withSizeBlock:^CGSize(id cell, RZManagerTestObject* object) {
+        return CGSizeMake(2.0f * object.height, object.height);
+    }];
+    [manager registerCellClassName:@"RZManagerThirdCountingTestCell" withNibNamed:nil forObjectClass:[RZManagerTestSubSubObject class] withHeightBlock:^CGFloat(id cell, RZManagerTestObject* object) {
+        return object.height;
+    }];
+    
+    for (NSString* cellClass in @[ @"RZManagerCountingTestCell", @"RZManagerOtherCountingTestCell" ])
+    {
+        [manager setLayoutSignatureBlock:^id<NSCopying>(RZManagerTestObject* object) {
+            return @(object.height);
+        } forCellClassName:cellClass];
+    }
+    for (NSString* cellClass in @[ @"RZManagerCountingTestCell", @"RZManagerOtherCountingTestCell", @"RZManagerThirdCountingTestCell" ])
+    {
+        if (diskCache)
+        {
+            [manager setContentKeyBlock:^id<NSCopying>(RZManagerTestObject* object) {
+                return [NSString stringWithFormat:@"%@-%g", NSStringFromClass([object class]), object.height];
+            } forCellClassName:cellClass];
+        }
+        [manager setThreadSafe:threadSafe forCellClassName:cellClass];
+    }
+    return manager;
+}
+
+/**
+ *  Looks up every object with the call that suits its cell, a size for the size block and a height otherwise.
+ **/
+- (void)lookUpObjects:(NSArray *)objects withManager:(RZCellSizeManager *)manager
+{
+    [objects enumerateObjectsUsingBlock:^(RZManagerTestObject* object, NSUInteger row, BOOL *stop) {
+        NSIndexPath* indexPath = [NSIndexPath indexPathForRow:row inSection:0];
+        if ([object isMemberOfClass:[RZManagerTestSubObject class]])
+        {
+            [manager cellSizeForObject:object indexPath:indexPath];
+        }
+        else
+        {
+            [manager cellHeightForObject:object indexPath:indexPath];
+        }
+    }];
+}
+
+- (void)testSignatureAndThreadSafeBlockLookupsDoNotLoadPrototypes
+{
+    RZCellSizeManager* manager = [self countingManagerWithDiskCache:nil threadSafe:YES];
+    
+    s_countingCellCount = 0;
+    [self lookUpObjects:[self parallelTestObjects] withManager:manager];
+    XCTAssertEqual(s_countingCellCount, (NSUInteger)0);
+    XCTAssertTrue([manager statistics].signatureHits > 0);
+    XCTAssertTrue([manager statistics].measurements > 0);
+}
+
+/**
+ *  One manager fills a disk cache and a second one, whose blocks are passed the prototype, reads every size back from
+ *  it without measuring.
+ **/
+- (void)testDiskCacheLookupsDoNotLoadPrototypes
+{
+    NSString* path = [NSTemporaryDirectory() stringByAppendingPathComponent:[[NSUUID UUID] UUIDString]];
+    RZCellSizeDiskCache* diskCache = [[RZCellSizeDiskCache alloc] initWithPath:path salt:@"RZCellSizeManagerTests"];
+    NSArray* objects = [self parallelTestObjects];
+    [self lookUpObjects:objects withManager:[self countingManagerWithDiskCache:diskCache threadSafe:YES]];
+    
+    RZCellSizeManager* manager = [self countingManagerWithDiskCache:diskCache threadSafe:NO];
+    s_countingCellCount = 0;
+    [self lookUpObjects:objects withManager:manager];
+    XCTAssertEqual(s_countingCellCount, (NSUInteger)0);
+    XCTAssertEqual([manager statistics].measurements, (NSUInteger)0);
+    
+    [[NSFileManager defaultManager] removeItemAtPath:path error:NULL];
+}
+
+#pragma mark - Parallel Measurement
+
+/**
+ *  A manager with a height block with layout signatures, a size block, and a height block with a text stack, all of
+ *  which only read the object, so they can be declared thread safe or not.
+ **/
+- (RZCellSizeManager *)managerMeasuringInParallel:(BOOL)parallel
+{
+    RZCellSizeManager* manager = [[RZCellSizeManager alloc] init];
+    manager.overideWidth = 320.0f;
+    manager.cellHeightPadding = 1.0f;
+    manager.cellSizePadding = 2.0f;
+    manager.collectsStatistics = YES;
+    
+    [manager registerCellClassName:@"RZManagerCountingTestCell" withNibNamed:nil forObjectClass:[RZManagerTestObject class] withHeightBlock:^CGFloat(id cell, RZManagerTestObject* object) {
+        return object.height;
+    }];
+    [manager setLayoutSignatureBlock:^id<NSCopying>(RZManagerTestObject* object) {
+        return @(object.height);
+    } forCellClassName:@"RZManagerCountingTestCell"];
+    
+    [manager registerCellClassName:@"RZManagerOtherCountingTestCell" withNibNamed:nil forObjectClass:[RZManagerTestSubObject class] withSizeBlock:^CGSize(id cell, RZManagerTestObject* object) {
+        return CGSizeMake(2.0f * object.height, object.height);
+    }];
+    
+    [manager registerCellClassName:@"RZManagerThirdCountingTestCell" withNibNamed:nil forObjectClass:[RZManagerTestSubSubObject class] withHeightBlock:^CGFloat(id cell, RZManagerTestObject* object) {
+        return object.height;
+    }];
+    RZCellSizeCharacterMetrics* metrics = [[RZCellSizeCharacterMetrics alloc] initWithLineHeight:20.0f advanceBlock:^CGFloat(unichar character) {
+        return 10.0f;
+    }];
+    RZCellSizeTextBlock* textBlock = [RZCellSizeTextBlock textBlockWithMetrics:metrics stringBlock:^id(RZManagerTestObject* object) {
+        return [@"" stringByPaddingToLength:(NSUInteger)object.height withString:@"word " startingAtIndex:0];
+    }];
+    [manager setTextStack:[[RZCellSizeTextStack alloc] initWithTextBlocks:@[ textBlock ]] forCellClassName:@"RZManagerThirdCountingTestCell"];
+    
+    for (NSString* cellClass in @[ @"RZManagerCountingTestCell", @"RZManagerOtherCountingTestCell", @"RZManagerThirdCountingTestCell" ])
+    {
+        [manager setThreadSafe:parallel forCellClassName:cellClass];
+    }
+    return manager;
+}
+
+/**
+ *  Objects of the three registered classes, with heights that repeat so layout signatures are shared.
+ **/
+- (NSArray *)parallelTestObjects
+{
+    NSArray* objectClasses = @[ [RZManagerTestObject class], [RZManagerTestSubObject class], [RZManagerTestSubSubObject class] ];
+    NSMutableArray* objects = [NSMutableArray array];
+    for (NSUInteger i = 0; i < kRZParallelCellCount; i++)
+    {
+        Class objectClass = [objectClasses objectAtIndex:i % objectClasses.count];
+        [objects addObject:[objectClass objectWithHeight:10.0f + (i * 7) % 40]];
+    }
+    return objects;
+}
+
+- (NSArray *)indexPathsWithCount:(NSUInteger)count
+{
+    NSMutableArray* indexPaths = [NSMutableArray array];
+    for (NSUInteger row = 0; row < count; row++)
+    {
+        [indexPaths addObject:[NSIndexPath indexPathForRow:row inSection:0]];
+    }
+    return indexPaths;
+}
+
+- (void)testParallelMeasurementMatchesSerialMeasurement
+{
+    RZCellSizeManager* serialManager = [self managerMeasuringInParallel:NO];
+    RZCellSizeManager* parallelManager = [self managerMeasuringInParallel:YES];
+    NSArray* objects = [self parallelTestObjects];
+    NSArray* indexPaths = [self indexPathsWithCount:objects.count];
+    
+    // The second pass finds every cell cached, so hits are compared as well as misses.
+    for (NSUInteger pass = 0; pass < 2; pass++)
+    {
+        [serialManager computeCellSizesForObjects:objects indexPaths:indexPaths cellReuseIdentifier:nil];
+        [parallelManager computeCellSizesForObjects:objects indexPaths:indexPaths cellReuseIdentifier:nil];
+    }
+    
+    for (NSIndexPath* indexPath in indexPaths)
+    {
+        CGSize serialSize = CGSizeZero;
+        CGSize parallelSize = CGSizeZero;
+        XCTAssertTrue([serialManager getCachedCellSize:&serialSize forIndexPath:indexPath]);
+        XCTAssertTrue([parallelManager getCachedCellSize:&parallelSize forIndexPath:indexPath]);
+        XCTAssertEqual(parallelSize.width, serialSize.width, @"Row %ld has a different width", (long)indexPath.row);
+        XCTAssertEqual(parallelSize.height, serialSize.height, @"Row %ld has a different height", (long)indexPath.row);
+    }
+    
+    RZCellSizeManagerStatistics* serialStatistics = [serialManager statistics];
+    RZCellSizeManagerStatistics* parallelStatistics = [parallelManager statistics];
+    for (NSString* cellClass in serialStatistics.configurationStatistics)
+    {
+        RZCellSizeConfigurationStatistics* serial = [serialStatistics.configurationStatistics objectForKey:cellClass];
+        RZCellSizeConfigurationStatistics* parallel = [parallelStatistics.configurationStatistics objectForKey:cellClass];
+        XCTAssertEqual(parallel.hits, serial.hits, @"%@", cellClass);
+        XCTAssertEqual(parallel.misses, serial.misses, @"%@", cellClass);
+        XCTAssertEqual(parallel.measurements, serial.measurements, @"%@", cellClass);
+        XCTAssertEqual(parallel.signatureHits, serial.signatureHits, @"%@", cellClass);
+    }
+    XCTAssertEqual(parallelStatistics.hits, objects.count);
+    XCTAssertEqual(parallelStatistics.misses, objects.count);
+    XCTAssertEqual(parallelStatistics.measurements + parallelStatistics.signatureHits, objects.count);
+    XCTAssertTrue(parallelStatistics.signatureHits > 0);
+}
+
+- (void)testParallelMeasurementDoesNotLoadPrototypes
+{
+    NSArray* objects = [self parallelTestObjects];
+    NSArray* indexPaths = [self indexPathsWithCount:objects.count];
+    
+    s_countingCellCount = 0;
+    [[self managerMeasuringInParallel:YES] computeCellSizesForObjects:objects indexPaths:indexPaths cellReuseIdentifier:nil];
+    XCTAssertEqual(s_countingCellCount, (NSUInteger)0);
+    
+    // Blocks that are not thread safe are passed the prototype, which shows the counting works.
+    [[self managerMeasuringInParallel:NO] computeCellSizesForObjects:objects indexPaths:indexPaths cellReuseIdentifier:nil];
+    XCTAssertTrue(s_countingCellCount > 0);
+}
+
+/**
+ *  Measures the same expensive cells on the calling thread alone and then on every core, and logs the speedup.
+ **/
+- (void)testParallelMeasurementScalesWithCores
+{
+    RZCellSizeManagerHeightBlock slowHeightBlock = ^CGFloat(id cell, RZManagerTestObject* object) {
+        double value = object.height;
+        for (NSUInteger i = 0; i < 20000; i++)
+        {
+            value = sqrt(value * value + 1.0);
+        }
+        return (CGFloat)floor(value);
+    };
+    NSMutableArray* objects = [NSMutableArray array];
+    for (NSUInteger row = 0; row < kRZScalingCellCount; row++)
+    {
+        [objects addObject:[RZManagerTestObject objectWithHeight:row % 100]];
+    }
+    NSArray* indexPaths = [self indexPathsWithCount:objects.count];
+    
+    CFAbsoluteTime elapsedTimes[2];
+    RZCellSizeManager* managers[2];
+    for (NSUInteger parallel = 0; parallel < 2; parallel++)
+    {
+        managers[parallel] = [[RZCellSizeManager alloc] init];
+        [managers[parallel] registerCellClassName:@"RZManagerCountingTestCell" withNibNamed:nil forObjectClass:nil withHeightBlock:slowHeightBlock];
+        [managers[parallel] setThreadSafe:(parallel == 1) forCellClassName:@"RZManagerCountingTestCell"];
+        CFAbsoluteTime startTime = CFAbsoluteTimeGetCurrent();
+        [managers[parallel] computeCellSizesForObjects:objects indexPaths:indexPaths cellReuseIdentifier:nil];
+        elapsedTimes[parallel] = CFAbsoluteTimeGetCurrent() - startTime;
+    }
+    
+    for (NSIndexPath* indexPath in indexPaths)
+    {
+        CGSize serialSize = CGSizeZero;
+        CGSize parallelSize = CGSizeZero;
+        [managers[0] getCachedCellSize:&serialSize forIndexPath:indexPath];
+        [managers[1] getCachedCellSize:&parallelSize forIndexPath:indexPath];
+        XCTAssertEqual(parallelSize.height, serialSize.height);
+    }
+    
+    NSUInteger coreCount = [[NSProcessInfo processInfo] activeProcessorCount];
+    NSLog(@"%lu cells: %.1f ms on 1 thread, %.1f ms on %lu cores, %.2fx", (unsigned long)objects.count,
+          elapsedTimes[0] * 1000.0, elapsedTimes[1] * 1000.0, (unsigned long)coreCount, elapsedTimes[0] / elapsedTimes[1]);
+    if (coreCount > 1)
+    {
+        XCTAssertTrue(elapsedTimes[1] < elapsedTimes[0]);
+    }
+}
+
+@end
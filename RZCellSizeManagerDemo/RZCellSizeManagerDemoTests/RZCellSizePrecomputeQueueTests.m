@@ -0,0 +1,255 @@
+//
+//  RZCellSizePrecomputeQueueTests.m
+//
+
+
+// Copyright 2014 Raizlabs and other contributors
+// http://raizlabs.com/
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#import <XCTest/XCTest.h>
+#import <UIKit/UIKit.h>
+#import "RZCellSizePrecomputeQueue.h"
+
+// Powers of two, so the fake clock adds up exactly.
+#define kRZFakeMeasurementTime  (1.0 / 1024.0)
+#define kRZFakeTimeBudget       (4.0 / 1024.0)
+
+#define kRZBenchmarkRowCount         100000
+#define kRZBenchmarkFocusChangeCount 1000
+
+/**
+ *  The queue is driven by hand with a fake clock that only moves when the fake measurer runs, so slices are
+ *  deterministic.
+ **/
+@interface RZCellSizePrecomputeQueueTests : XCTestCase
+
+@property (nonatomic, assign) NSTimeInterval now;
+@property (nonatomic, strong) NSMutableArray* measuredIndexPaths;
+@property (nonatomic, assign) NSTimeInterval measurementTime;
+@property (nonatomic, strong) RZCellSizePrecomputeQueue* queue;
+
+@end
+
+@implementation RZCellSizePrecomputeQueueTests
+
+- (void)setUp
+{
+    [super setUp];
+    self.now = 0.0;
+    self.measuredIndexPaths = [NSMutableArray array];
+    self.measurementTime = kRZFakeMeasurementTime;
+    
+    __weak __typeof(self) weakSelf = self;
+    self.queue = [[RZCellSizePrecomputeQueue alloc] initWithClockBlock:^NSTimeInterval{
+        return weakSelf.now;
+    }];
+    self.queue.schedulesAutomatically = NO;
+    self.queue.timeBudget = kRZFakeTimeBudget;
+}
+
+- (void)tearDown
+{
+    self.queue = nil;
+    [super tearDown];
+}
+
+#pragma mark - Helpers
+
+/**
+ *  Measures by advancing the fake clock.  Even rows produce a size and odd rows do not.
+ **/
+- (RZCellSizePrecomputeMeasureBlock)fakeMeasureBlock
+{
+    __weak __typeof(self) weakSelf = self;
+    return ^BOOL(id object, NSIndexPath *indexPath) {
+        weakSelf.now += weakSelf.measurementTime;
+        [weakSelf.measuredIndexPaths addObject:indexPath];
+        return (indexPath.row % 2 == 0);
+    };
+}
+
+- (void)enqueueRows:(NSUInteger)rowCount inSection:(NSUInteger)section completion:(RZCellSizePrecomputeCompletionBlock)completion
+{
+    NSMutableArray* objects = [NSMutableArray array];
+    NSMutableArray* indexPaths = [NSMutableArray array];
+    for (NSUInteger row = 0; row < rowCount; row++)
+    {
+        [objects addObject:[NSNull null]];
+        [indexPaths addObject:[NSIndexPath indexPathForRow:row inSection:section]];
+    }
+    [self.queue enqueueObjects:objects indexPaths:indexPaths measureBlock:[self fakeMeasureBlock] completion:completion];
+}
+
+#pragma mark - Tests
+
+- (void)testSliceStopsAtTimeBudget
+{
+    [self enqueueRows:20 inSection:0 completion:nil];
+    
+    XCTAssertTrue([self.queue processSlice]);
+    XCTAssertEqual(self.measuredIndexPaths.count, (NSUInteger)4, @"The budget fits four measurements");
+    XCTAssertEqual(self.queue.pendingCount, (NSUInteger)16);
+    
+    XCTAssertTrue([self.queue processSlice]);
+    XCTAssertEqual(self.measuredIndexPaths.count, (NSUInteger)8);
+}
+
+- (void)testSliceMeasuresAtLeastOneCell
+{
+    self.measurementTime = 2 * kRZFakeTimeBudget;
+    [self enqueueRows:3 inSection:0 completion:nil];
+    
+    XCTAssertTrue([self.queue processSlice]);
+    XCTAssertEqual(self.measuredIndexPaths.count, (NSUInteger)1);
+    XCTAssertTrue([self.queue processSlice]);
+    XCTAssertFalse([self.queue processSlice]);
+    XCTAssertEqual(self.measuredIndexPaths.count, (NSUInteger)3);
+}
+
+- (void)testCellsNearestTheFocusAreMeasuredFirst
+{
+    [self enqueueRows:10 inSection:0 completion:nil];
+    [self enqueueRows:100 inSection:1 completion:nil];
+    [self enqueueRows:10 inSection:2 completion:nil];
+    self.queue.focusIndexPath = [NSIndexPath indexPathForRow:50 inSection:1];
+    
+    while ([self.queue processSlice]);
+    XCTAssertEqual(self.measuredIndexPaths.count, (NSUInteger)120);
+    
+    // The focus section first, spreading out from the focus row.
+    NSIndexPath* first = [self.measuredIndexPaths firstObject];
+    XCTAssertEqual(first.section, (NSInteger)1);
+    XCTAssertEqual(first.row, (NSInteger)50);
+    for (NSUInteger i = 1; i < 100; i++)
+    {
+        NSIndexPath* previous = [self.measuredIndexPaths objectAtIndex:i - 1];
+        NSIndexPath* indexPath = [self.measuredIndexPaths objectAtIndex:i];
+        XCTAssertEqual(indexPath.section, (NSInteger)1);
+        XCTAssertTrue(labs(indexPath.row - 50) >= labs(previous.row - 50), @"Row %ld was measured after a farther row", (long)indexPath.row);
+    }
+    
+    // Then the neighbouring sections, starting from the edge that faces the focus.
+    NSIndexPath* afterFocusSection = [self.measuredIndexPaths objectAtIndex:100];
+    XCTAssertTrue((afterFocusSection.section == 0 && afterFocusSection.row == 9) ||
+                  (afterFocusSection.section == 2 && afterFocusSection.row == 0));
+}
+
+- (void)testMovingTheFocusReordersPendingCells
+{
+    [self enqueueRows:100 inSection:0 completion:nil];
+    self.queue.focusIndexPath = [NSIndexPath indexPathForRow:10 inSection:0];
+    [self.queue processSlice];
+    
+    self.queue.focusIndexPath = [NSIndexPath indexPathForRow:80 inSection:0];
+    [self.queue processSlice];
+    NSArray* expectedRows = @[@10, @11, @9, @12, @80, @81, @79, @82];
+    XCTAssertEqualObjects([self.measuredIndexPaths valueForKey:@"row"], expectedRows);
+}
+
+- (void)testCellsEnqueuedMidwayAreOrderedWithTheRest
+{
+    NSMutableArray* objects = [NSMutableArray array];
+    NSMutableArray* evenIndexPaths = [NSMutableArray array];
+    NSMutableArray* oddIndexPaths = [NSMutableArray array];
+    for (NSUInteger row = 0; row < 40; row++)
+    {
+        [((row % 2 == 0) ? evenIndexPaths : oddIndexPaths) addObject:[NSIndexPath indexPathForRow:row inSection:0]];
+        if (row % 2 == 0)
+        {
+            [objects addObject:[NSNull null]];
+        }
+    }
+    self.queue.focusIndexPath = [NSIndexPath indexPathForRow:20 inSection:0];
+    [self.queue enqueueObjects:objects indexPaths:evenIndexPaths measureBlock:[self fakeMeasureBlock] completion:nil];
+    [self.queue processSlice];
+    
+    // The odd rows are added in reverse, so they also have to be sorted in with the even rows that are left.
+    NSArray* reversedIndexPaths = [[oddIndexPaths reverseObjectEnumerator] allObjects];
+    [self.queue enqueueObjects:objects indexPaths:reversedIndexPaths measureBlock:[self fakeMeasureBlock] completion:nil];
+    [self.queue processSlice];
+    NSArray* expectedRows = @[@20, @22, @18, @24, @21, @19, @23, @17];
+    XCTAssertEqualObjects([self.measuredIndexPaths valueForKey:@"row"], expectedRows);
+    
+    while ([self.queue processSlice]);
+    XCTAssertEqual(self.measuredIndexPaths.count, (NSUInteger)40);
+    XCTAssertEqual([[NSSet setWithArray:self.measuredIndexPaths] count], (NSUInteger)40);
+}
+
+- (void)testCompletionReportsMeasuredCellsOnce
+{
+    __block NSUInteger completionCount = 0;
+    __block NSArray* completedIndexPaths = nil;
+    [self enqueueRows:10 inSection:0 completion:^(NSArray *indexPaths) {
+        completionCount++;
+        completedIndexPaths = indexPaths;
+    }];
+    
+    [self.queue processSlice];
+    XCTAssertEqual(completionCount, (NSUInteger)0);
+    while ([self.queue processSlice]);
+    XCTAssertEqual(completionCount, (NSUInteger)1);
+    XCTAssertEqual(completedIndexPaths.count, (NSUInteger)5, @"Only the even rows produce a size");
+    for (NSIndexPath* indexPath in completedIndexPaths)
+    {
+        XCTAssertEqual(indexPath.row % 2, (NSInteger)0);
+    }
+}
+
+- (void)testCancelDropsPendingCells
+{
+    __block BOOL completed = NO;
+    [self enqueueRows:10 inSection:0 completion:^(NSArray *indexPaths) {
+        completed = YES;
+    }];
+    
+    [self.queue processSlice];
+    [self.queue cancelAllCells];
+    XCTAssertEqual(self.queue.pendingCount, (NSUInteger)0);
+    XCTAssertFalse([self.queue processSlice]);
+    XCTAssertEqual(self.measuredIndexPaths.count, (NSUInteger)4);
+    XCTAssertFalse(completed);
+}
+
+#pragma mark - Benchmarks
+
+/**
+ *  A slice after each of many focus changes, with a hundred thousand cells pending.  Only the section the next cell
+ *  comes from is reordered, inside the slice, so the time per slice should not grow with the pending count.
+ **/
+- (void)testFocusChangesWithManyPendingCells
+{
+    [self enqueueRows:kRZBenchmarkRowCount inSection:0 completion:nil];
+    
+    __block uint32_t state = 1;
+    [self measureBlock:^{
+        for (NSUInteger i = 0; i < kRZBenchmarkFocusChangeCount; i++)
+        {
+            state = state * 1664525u + 1013904223u;
+            self.queue.focusIndexPath = [NSIndexPath indexPathForRow:state % kRZBenchmarkRowCount inSection:0];
+            [self.queue processSlice];
+        }
+    }];
+    XCTAssertEqual(self.queue.pendingCount + self.measuredIndexPaths.count, (NSUInteger)kRZBenchmarkRowCount);
+}
+
+@end
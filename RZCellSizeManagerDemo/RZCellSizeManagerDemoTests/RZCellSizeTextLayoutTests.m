@@ -0,0 +1,258 @@
+//
+//  RZCellSizeTextLayoutTests.m
+//
+
+
+// Copyright 2014 Raizlabs and other contributors
+// http://raizlabs.com/
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+#import <XCTest/XCTest.h>
+#import <UIKit/UIKit.h>
+#import "RZCellSizeManager.h"
+#import "RZCellSizeTextLayout.h"
+
+// Every character of the synthetic font is 10 points wide, except the halves of surrogate pairs, which are 30 so that
+// measuring a pair unit by unit is easy to tell from measuring it as one sequence of 20.
+#define kRZAdvance              10.0f
+#define kRZSurrogateAdvance     30.0f
+#define kRZSequenceAdvance      20.0f
+#define kRZLineHeight           14.5f
+
+#define kRZGrinningFace         @"\U0001F600"
+#define kRZAcuteE               @"e\u0301"
+
+@interface RZCellSizeTextLayoutTests : XCTestCase
+
+@property (nonatomic, strong) RZCellSizeCharacterMetrics* metrics;
+@property (nonatomic, strong) NSMutableArray* measuredSequences;
+@property (nonatomic, assign) NSUInteger measuredCharacterCount;
+
+@end
+
+@implementation RZCellSizeTextLayoutTests
+
+- (void)setUp
+{
+    [super setUp];
+    self.measuredSequences = [NSMutableArray array];
+    self.measuredCharacterCount = 0;
+    
+    __weak __typeof(self) weakSelf = self;
+    self.metrics = [[RZCellSizeCharacterMetrics alloc] initWithLineHeight:kRZLineHeight advanceBlock:^CGFloat(unichar character) {
+        weakSelf.measuredCharacterCount++;
+        return CFStringIsSurrogateHighCharacter(character) || CFStringIsSurrogateLowCharacter(character) ? kRZSurrogateAdvance : kRZAdvance;
+    } sequenceAdvanceBlock:^CGFloat(NSString *sequence) {
+        [weakSelf.measuredSequences addObject:sequence];
+        return kRZSequenceAdvance;
+    }];
+}
+
+#pragma mark - Helpers
+
+- (CGFloat)widthOfString:(NSString *)string
+{
+    unichar characters[64];
+    NSAssert(string.length <= 64, @"Test strings are short");
+    [string getCharacters:characters range:NSMakeRange(0, string.length)];
+    return [self.metrics widthOfCharacters:characters length:string.length];
+}
+
+- (NSUInteger)linesOfString:(NSString *)string width:(CGFloat)width
+{
+    return RZCellSizeTextLayoutNumberOfLines(string, self.metrics, width);
+}
+
+#pragma mark - Metrics
+
+- (void)testAdvancesAreMeasuredOnce
+{
+    XCTAssertEqual([self widthOfString:@"abab"], (CGFloat)(4 * kRZAdvance));
+    XCTAssertEqual([self widthOfString:@"ba"], (CGFloat)(2 * kRZAdvance));
+    XCTAssertEqual(self.measuredCharacterCount, (NSUInteger)2);
+}
+
+- (void)testSurrogatePairsAreMeasuredAsOneSequence
+{
+    NSString* string = [NSString stringWithFormat:@"a%@b%@", kRZGrinningFace, kRZGrinningFace];
+    XCTAssertEqual(string.length, (NSUInteger)6);
+    XCTAssertEqual([self widthOfString:string], (CGFloat)(2 * kRZAdvance + 2 * kRZSequenceAdvance));
+    XCTAssertEqualObjects(self.measuredSequences, @[ kRZGrinningFace ]);
+}
+
+- (void)testCombiningMarksAreMeasuredWithTheirBase
+{
+    NSString* string = [NSString stringWithFormat:@"%@t%@", kRZAcuteE, kRZAcuteE];
+    XCTAssertEqual([self widthOfString:string], (CGFloat)(kRZAdvance + 2 * kRZSequenceAdvance));
+    XCTAssertEqualObjects(self.measuredSequences, @[ kRZAcuteE ]);
+}
+
+- (void)testSequencesAddUpUnitsWithoutASequenceBlock
+{
+    RZCellSizeCharacterMetrics* metrics = [[RZCellSizeCharacterMetrics alloc] initWithLineHeight:kRZLineHeight advanceBlock:^CGFloat(unichar character) {
+        return kRZAdvance;
+    }];
+    unichar characters[2];
+    [kRZGrinningFace getCharacters:characters range:NSMakeRange(0, 2)];
+    XCTAssertEqual([metrics widthOfCharacters:characters length:2], (CGFloat)(2 * kRZAdvance));
+}
+
+- (void)testMetricsForFontAreSharedAcrossThreads
+{
+    UIFont* font = [UIFont systemFontOfSize:17.0f];
+    RZCellSizeCharacterMetrics* expectedMetrics = [RZCellSizeManager characterMetricsForFont:font];
+    NSUInteger count = 64;
+    __block NSUInteger matchingCount = 0;
+    dispatch_apply(count, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0), ^(size_t i) {
+        RZCellSizeCharacterMetrics* metrics = [RZCellSizeManager characterMetricsForFont:font];
+        unichar character = (unichar)('a' + i % 26);
+        if (metrics == expectedMetrics && [metrics widthOfCharacters:&character length:1] > 0.0f)
+        {
+            __sync_fetch_and_add(&matchingCount, 1);
+        }
+    });
+    XCTAssertEqual(matchingCount, count);
+}
+
+#pragma mark - Line Breaking
+
+- (void)testEmptyStringHasNoLines
+{
+    XCTAssertEqual([self linesOfString:@"" width:100.0f], (NSUInteger)0);
+}
+
+- (void)testWordsWrapAtTheWidth
+{
+    XCTAssertEqual([self linesOfString:@"aaaa bbbbb" width:100.0f], (NSUInteger)1);
+    XCTAssertEqual([self linesOfString:@"aaaa bbbb cccc" width:100.0f], (NSUInteger)2);
+    XCTAssertEqual([self linesOfString:@"aaaa bbbb cccc dddd eeee" width:100.0f], (NSUInteger)3);
+}
+
+- (void)testSpacesAtAWrapAreDropped
+{
+    XCTAssertEqual([self linesOfString:@"aaaaaaaaaa bbbbbbbbbb" width:100.0f], (NSUInteger)2);
+    XCTAssertEqual([self linesOfString:@"aaaaaaaaaa    bbbbbbbbbb" width:100.0f], (NSUInteger)2);
+}
+
+- (void)testLineBreaksStartNewLines
+{
+    XCTAssertEqual([self linesOfString:@"a\nb" width:100.0f], (NSUInteger)2);
+    XCTAssertEqual([self linesOfString:@"a\r\nb" width:100.0f], (NSUInteger)2);
+    XCTAssertEqual([self linesOfString:@"a\n\nb" width:100.0f], (NSUInteger)3);
+    XCTAssertEqual([self linesOfString:@"a\n" width:100.0f], (NSUInteger)1);
+}
+
+- (void)testLongWordsBreakBetweenCharacters
+{
+    XCTAssertEqual([self linesOfString:@"aaaaaaaaaaaaaaaaaaaaaaaaa" width:100.0f], (NSUInteger)3);
+    XCTAssertEqual([self linesOfString:@"aaaaaaaaaaaaaaa bb" width:100.0f], (NSUInteger)2);
+}
+
+- (void)testLongWordsBreakBetweenSequences
+{
+    NSString* string = [@"" stringByPaddingToLength:5 * kRZGrinningFace.length withString:kRZGrinningFace startingAtIndex:0];
+    XCTAssertEqual([self linesOfString:string width:100.0f], (NSUInteger)1);
+    XCTAssertEqual([self linesOfString:string width:50.0f], (NSUInteger)3);
+    for (NSString* sequence in self.measuredSequences)
+    {
+        XCTAssertEqualObjects(sequence, kRZGrinningFace);
+    }
+}
+
+#pragma mark - Text Blocks
+
+- (void)testTextBlockHeightIsRoundedAndLimited
+{
+    RZCellSizeTextBlock* textBlock = [RZCellSizeTextBlock textBlockWithMetrics:self.metrics stringBlock:^id(id object) {
+        return object;
+    }];
+    XCTAssertEqual([textBlock heightOfString:@"aaaa bbbb cccc dddd eeee" width:100.0f], (CGFloat)ceil(3 * kRZLineHeight));
+    textBlock.numberOfLines = 2;
+    XCTAssertEqual([textBlock heightOfString:@"aaaa bbbb cccc dddd eeee" width:100.0f], (CGFloat)ceil(2 * kRZLineHeight));
+    XCTAssertEqual([textBlock heightOfString:@"" width:100.0f], (CGFloat)0.0f);
+}
+
+- (void)testTextStackAddsInsetsAndSpacing
+{
+    RZCellSizeTextBlock* titleBlock = [RZCellSizeTextBlock textBlockWithMetrics:self.metrics stringBlock:^id(id object) {
+        return [object objectAtIndex:0];
+    }];
+    titleBlock.spacingAfter = 4.0f;
+    RZCellSizeTextBlock* bodyBlock = [RZCellSizeTextBlock textBlockWithMetrics:self.metrics stringBlock:^id(id object) {
+        return [object objectAtIndex:1];
+    }];
+    bodyBlock.spacingAfter = 100.0f;
+    
+    RZCellSizeTextStack* textStack = [[RZCellSizeTextStack alloc] initWithTextBlocks:@[ titleBlock, bodyBlock ]];
+    textStack.topInset = 8.0f;
+    textStack.bottomInset = 6.0f;
+    textStack.leadingInset = 15.0f;
+    textStack.trailingInset = 5.0f;
+    
+    // 120 points less the insets leaves 100 for the text.
+    CGFloat height = 0.0f;
+    XCTAssertTrue([textStack getHeight:&height forObject:@[ @"aaaa", @"aaaa bbbb cccc" ] width:120.0f]);
+    XCTAssertEqual(height, (CGFloat)(8.0f + ceil(kRZLineHeight) + 4.0f + ceil(2 * kRZLineHeight) + 6.0f));
+    
+    NSAttributedString* attributedString = [[NSAttributedString alloc] initWithString:@"aaaa"];
+    XCTAssertFalse([textStack getHeight:&height forObject:@[ @"aaaa", attributedString ] width:120.0f]);
+}
+
+- (void)testTextStackSkipsSpacingOfEmptyBlocks
+{
+    NSMutableArray* textBlocks = [NSMutableArray array];
+    NSArray* spacings = @[ @4.0f, @3.0f, @100.0f ];
+    [spacings enumerateObjectsUsingBlock:^(NSNumber* spacing, NSUInteger idx, BOOL *stop) {
+        RZCellSizeTextBlock* textBlock = [RZCellSizeTextBlock textBlockWithMetrics:self.metrics stringBlock:^id(id object) {
+            id string = [object objectAtIndex:idx];
+            return (string != [NSNull null]) ? string : nil;
+        }];
+        textBlock.spacingAfter = [spacing floatValue];
+        [textBlocks addObject:textBlock];
+    }];
+    RZCellSizeTextStack* textStack = [[RZCellSizeTextStack alloc] initWithTextBlocks:textBlocks];
+    textStack.topInset = 8.0f;
+    textStack.bottomInset = 6.0f;
+    CGFloat lineHeight = ceil(kRZLineHeight);
+    
+    CGFloat height = 0.0f;
+    XCTAssertTrue([textStack getHeight:&height forObject:@[ @"aaaa", @"aaaa", @"aaaa" ] width:100.0f]);
+    XCTAssertEqual(height, (CGFloat)(8.0f + lineHeight + 4.0f + lineHeight + 3.0f + lineHeight + 6.0f));
+    
+    // A nil or empty middle block drops its own spacing.
+    XCTAssertTrue([textStack getHeight:&height forObject:@[ @"aaaa", [NSNull null], @"aaaa" ] width:100.0f]);
+    XCTAssertEqual(height, (CGFloat)(8.0f + lineHeight + 4.0f + lineHeight + 6.0f));
+    XCTAssertTrue([textStack getHeight:&height forObject:@[ @"aaaa", @"", @"aaaa" ] width:100.0f]);
+    XCTAssertEqual(height, (CGFloat)(8.0f + lineHeight + 4.0f + lineHeight + 6.0f));
+    
+    // An empty last block leaves the block before it last, so its spacing is dropped too.
+    XCTAssertTrue([textStack getHeight:&height forObject:@[ @"aaaa", @"aaaa", @"" ] width:100.0f]);
+    XCTAssertEqual(height, (CGFloat)(8.0f + lineHeight + 4.0f + lineHeight + 6.0f));
+    
+    // An empty first block adds nothing above the next one.
+    XCTAssertTrue([textStack getHeight:&height forObject:@[ [NSNull null], @"aaaa", @"aaaa" ] width:100.0f]);
+    XCTAssertEqual(height, (CGFloat)(8.0f + lineHeight + 3.0f + lineHeight + 6.0f));
+    
+    XCTAssertTrue([textStack getHeight:&height forObject:@[ @"", [NSNull null], @"" ] width:100.0f]);
+    XCTAssertEqual(height, (CGFloat)(8.0f + 6.0f));
+}
+
+@end
@@ -0,0 +1,178 @@
+//
+//  RZCellSizeTraceTests.m
+//
+
+
+// Copyright 2014 Raizlabs and other contributors
+// http://raizlabs.com/
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+#import <XCTest/XCTest.h>
+#import <UIKit/UIKit.h>
+#import "RZCellSizeTrace.h"
+#import "RZCellSizeManager.h"
+
+// The default random movement with seed 1: a registration, then for each movement a batch of one change, a focus
+// change and ten lookups.  The hits were counted with a model of the generator.
+#define kRZMovementCount        500
+#define kRZMovementEventCount   7001
+#define kRZMovementLookupCount  5000
+#define kRZMovementHitCount     4721
+#define kRZMigrationCount       100
+
+@interface RZCellSizeTraceTests : XCTestCase
+
+@property (nonatomic, copy) NSString* path;
+
+@end
+
+@implementation RZCellSizeTraceTests
+
+- (void)setUp
+{
+    [super setUp];
+    NSString* fileName = [NSString stringWithFormat:@"%@.trace", [[NSUUID UUID] UUIDString]];
+    self.path = [NSTemporaryDirectory() stringByAppendingPathComponent:fileName];
+}
+
+- (void)tearDown
+{
+    [[NSFileManager defaultManager] removeItemAtPath:self.path error:NULL];
+    [super tearDown];
+}
+
+#pragma mark - Helpers
+
+- (RZCellSizeTraceReplayer *)recordRandomMovement
+{
+    RZCellSizeTraceRecorder* recorder = [[RZCellSizeTraceRecorder alloc] initWithPath:self.path];
+    XCTAssertNotNil(recorder);
+    [recorder recordRandomMovementWithOptions:RZCellSizeTraceDefaultRandomMovementOptions(kRZMovementCount)];
+    [recorder flush];
+    XCTAssertEqual(recorder.count, (NSUInteger)kRZMovementEventCount);
+    
+    RZCellSizeTraceReplayer* replayer = [[RZCellSizeTraceReplayer alloc] initWithPath:self.path];
+    XCTAssertNotNil(replayer);
+    XCTAssertEqual(replayer.count, (NSUInteger)kRZMovementEventCount);
+    return replayer;
+}
+
+#pragma mark - Tests
+
+/**
+ *  Without a byte budget the replay keeps every size the recording did, so it must hit exactly where the recording
+ *  hit.
+ **/
+- (void)testRandomMovementReplaysWithTheRecordedHits
+{
+    RZCellSizeTraceReplayResult* result = [[self recordRandomMovement] replay];
+    XCTAssertEqual(result.events, (NSUInteger)kRZMovementEventCount);
+    XCTAssertEqual(result.lookups, (NSUInteger)kRZMovementLookupCount);
+    XCTAssertEqual(result.recordedHits, (NSUInteger)kRZMovementHitCount);
+    XCTAssertEqual(result.hits, result.recordedHits);
+}
+
+- (void)testReplayingTwiceGivesTheSameResult
+{
+    RZCellSizeTraceReplayer* replayer = [self recordRandomMovement];
+    RZCellSizeTraceReplayResult* first = [replayer replay];
+    RZCellSizeTraceReplayResult* second = [replayer replay];
+    XCTAssertEqual(second.lookups, first.lookups);
+    XCTAssertEqual(second.hits, first.hits);
+    XCTAssertEqual(second.peakByteCount, first.peakByteCount);
+}
+
+/**
+ *  A byte budget can only drop sizes, so it can lose hits but never add any.
+ **/
+- (void)testByteBudgetOnlyLosesHits
+{
+    RZCellSizeTraceReplayer* replayer = [self recordRandomMovement];
+    replayer.byteBudget = 256;
+    RZCellSizeTraceReplayResult* result = [replayer replay];
+    XCTAssertEqual(result.lookups, (NSUInteger)kRZMovementLookupCount);
+    XCTAssertEqual(result.recordedHits, (NSUInteger)kRZMovementHitCount);
+    XCTAssertTrue(result.hits <= result.recordedHits);
+}
+
+/**
+ *  Records a manager session that migrates its sizes across random refetches, where objects are deleted, inserted
+ *  and reordered, and looks up every row after each one.  A migration is recorded as a batch of deletions,
+ *  insertions and moves, so the replay must find every size where the manager kept it.
+ **/
+- (void)testMigrationsReplayWithTheRecordedHits
+{
+    srandom(1989);
+    RZCellSizeManager* manager = [[RZCellSizeManager alloc] init];
+    manager.traceRecorder = [[RZCellSizeTraceRecorder alloc] initWithPath:self.path];
+    [manager registerCellClassName:@"UITableViewCell" withNibNamed:nil forObjectClass:nil withHeightBlock:^CGFloat(id cell, NSNumber* identity) {
+        return 44.0f + [identity unsignedIntegerValue] % 100;
+    }];
+    
+    NSUInteger nextIdentity = 0;
+    NSMutableArray* identities = [NSMutableArray array];
+    for (NSUInteger row = 0; row < 40; row++)
+    {
+        [identities addObject:@(nextIdentity++)];
+    }
+    NSUInteger lookupCount = 0;
+    for (NSUInteger migration = 0; migration < kRZMigrationCount; migration++)
+    {
+        NSMutableArray* newIdentities = [identities mutableCopy];
+        for (NSUInteger i = random() % 4; i > 0 && newIdentities.count > 0; i--)
+        {
+            [newIdentities removeObjectAtIndex:random() % newIdentities.count];
+        }
+        for (NSUInteger i = random() % 4; i > 0; i--)
+        {
+            [newIdentities insertObject:@(nextIdentity++) atIndex:random() % (newIdentities.count + 1)];
+        }
+        for (NSUInteger i = random() % 4; i > 0 && newIdentities.count > 1; i--)
+        {
+            NSNumber* identity = [newIdentities objectAtIndex:random() % newIdentities.count];
+            [newIdentities removeObject:identity];
+            [newIdentities insertObject:identity atIndex:random() % (newIdentities.count + 1)];
+        }
+        
+        [manager migrateCellSizesInSection:0 fromIdentities:identities toIdentities:newIdentities];
+        identities = newIdentities;
+        [identities enumerateObjectsUsingBlock:^(NSNumber* identity, NSUInteger row, BOOL *stop) {
+            [manager cellHeightForObject:identity indexPath:[NSIndexPath indexPathForRow:row inSection:0]];
+        }];
+        lookupCount += identities.count;
+    }
+    [manager.traceRecorder flush];
+    
+    RZCellSizeTraceReplayResult* result = [[[RZCellSizeTraceReplayer alloc] initWithPath:self.path] replay];
+    XCTAssertEqual(result.lookups, lookupCount);
+    XCTAssertTrue(result.recordedHits > lookupCount / 2);
+    XCTAssertEqual(result.hits, result.recordedHits);
+}
+
+- (void)testReplayerRejectsFilesThatAreNotTraces
+{
+    XCTAssertNil([[RZCellSizeTraceReplayer alloc] initWithPath:self.path]);
+    
+    [[@"not a trace" dataUsingEncoding:NSUTF8StringEncoding] writeToFile:self.path atomically:YES];
+    XCTAssertNil([[RZCellSizeTraceReplayer alloc] initWithPath:self.path]);
+}
+
+@end
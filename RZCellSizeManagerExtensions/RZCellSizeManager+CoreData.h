@@ -12,7 +12,11 @@
 @interface RZCellSizeManager (CoreData)
 
 /**
- *  Automatically invalidates cell heights based on a fetched results controller
+ *  Automatically invalidates cell heights based on a fetched results controller.
+ *  Inserts, deletes and moves shift the cached heights of the other cells rather than invalidating them.
+ *  A moved cell is invalidated, since the results controller only moves an object when it has changed.
+ *  Call beginCellSizeUpdates from controllerWillChangeContent: and endCellSizeUpdates from controllerDidChangeContent:
+ *  so the changes are applied as one batch.
  *
  *  @param controller   Results controller that is being observed
  *  @param type         Type of change
@@ -24,4 +28,15 @@
                                         indexPath:(NSIndexPath *)indexPath
                                      newIndexPath:(NSIndexPath *)newIndexPath;
 
+/**
+ *  Automatically shifts cell heights based on a section change from a fetched results controller
+ *
+ *  @param controller   Results controller that is being observed
+ *  @param type         Type of change
+ *  @param sectionIndex The index of the changed section
+ */
+- (void)invalidateCellHeightsForResultsController:(NSFetchedResultsController *)controller
+                                       changeType:(NSFetchedResultsChangeType)type
+                                     sectionIndex:(NSUInteger)sectionIndex;
+
 @end
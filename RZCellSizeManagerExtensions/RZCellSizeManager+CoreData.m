@@ -10,40 +10,18 @@
 
 @implementation RZCellSizeManager (CoreData)
 
-- (NSArray *)indexPathsInSectionAboveIndexPath:(NSIndexPath *)indexPath forController:(NSFetchedResultsController *)controller
-{
-    NSMutableArray* indexPaths = [NSMutableArray array];
-    NSInteger numberOfObjectes = [[controller.sections objectAtIndex:indexPath.section] numberOfObjects];
-    for (NSInteger i = indexPath.row; i <numberOfObjectes; i++)
-    {
-        [indexPaths addObject:[NSIndexPath indexPathForRow:i inSection:indexPath.section]];
-    }
-    return indexPaths;
-}
-
-// TODO:
-// There is potentially a good bit of optimization that could be done here where we move around index paths based on moves.  For now we are just invalidating everything that could be affected.
 - (void)invalidateCellHeightsForResultsController:(NSFetchedResultsController *)controller changeType:(NSFetchedResultsChangeType)type indexPath:(NSIndexPath *)indexPath newIndexPath:(NSIndexPath *)newIndexPath
 {
     switch (type) {
         case NSFetchedResultsChangeDelete:
-            [self invalidateCellSizesAtIndexPaths:[self indexPathsInSectionAboveIndexPath:indexPath forController:controller]];
+            [self deleteCellSizesAtIndexPaths:@[indexPath]];
             break;
         case NSFetchedResultsChangeInsert:
-            [self invalidateCellSizesAtIndexPaths:[self indexPathsInSectionAboveIndexPath:newIndexPath forController:controller]];
+            [self insertCellSizesAtIndexPaths:@[newIndexPath]];
             break;
         case NSFetchedResultsChangeMove:
-        {
-            if (indexPath.section == newIndexPath.section)
-            {
-                [self invalidateCellSizesAtIndexPaths:[self indexPathsInSectionAboveIndexPath:((indexPath.row > newIndexPath.row) ? newIndexPath : indexPath) forController:controller]];
-            }
-            else
-            {
-                // We are moving sections.  For now just invalidate everything
-                [self invalidateCellSizeCache];
-            }
-        }
+            // Moves are reported when a sort attribute changed, so the object has changed too.
+            [self moveCellSizeAtIndexPath:indexPath toIndexPath:newIndexPath invalidate:YES];
             break;
         case NSFetchedResultsChangeUpdate:
             [self invalidateCellSizeAtIndexPath:indexPath];
@@ -54,4 +32,19 @@
     }
 }
 
+- (void)invalidateCellHeightsForResultsController:(NSFetchedResultsController *)controller changeType:(NSFetchedResultsChangeType)type sectionIndex:(NSUInteger)sectionIndex
+{
+    switch (type) {
+        case NSFetchedResultsChangeDelete:
+            [self deleteCellSizesForSections:[NSIndexSet indexSetWithIndex:sectionIndex]];
+            break;
+        case NSFetchedResultsChangeInsert:
+            [self insertCellSizesForSections:[NSIndexSet indexSetWithIndex:sectionIndex]];
+            break;
+            
+        default:
+            break;
+    }
+}
+
 @end
@@ -35,8 +35,6 @@ static char s_RZAutoLayoutHeightManagerToken;
 
 @property (nonatomic, weak) id<RZCollectionList> collectionList;
 @property (nonatomic, weak) RZCellSizeManager *heightManager;
-@property (nonatomic, assign) BOOL shouldFlushCache;
-@property (nonatomic, strong) NSMutableSet* reloadableIndexPaths;
 @end
 
 @implementation RZAutoLayoutHeightManagerObserver
@@ -48,30 +46,27 @@ static char s_RZAutoLayoutHeightManagerToken;
 
 #pragma mark - Collection List Observer
 
+// The whole batch is recorded by the height manager and applied in one pass when the content finishes changing,
+//  so cells that only moved keep their cached heights.
 - (void)collectionListWillChangeContent:(id<RZCollectionList>)collectionList
 {
-    self.shouldFlushCache = NO;
-    self.reloadableIndexPaths = [[NSMutableSet alloc] init];
+    [self.heightManager beginCellSizeUpdates];
 }
 - (void)collectionList:(id<RZCollectionList>)collectionList didChangeObject:(id)object atIndexPath:(NSIndexPath *)indexPath forChangeType:(RZCollectionListChangeType)type newIndexPath:(NSIndexPath *)newIndexPath
 {
-    
-    // TODO: see if we can optimize what we reload a bit more for the Delete, Insert, Move notifications.
     switch (type) {
         case RZCollectionListChangeDelete:
-            self.shouldFlushCache = YES;
+            [self.heightManager deleteCellSizesAtIndexPaths:@[indexPath]];
             break;
         case RZCollectionListChangeInsert:
-            self.shouldFlushCache = YES;
+            [self.heightManager insertCellSizesAtIndexPaths:@[newIndexPath]];
             break;
         case RZCollectionListChangeMove:
-            self.shouldFlushCache = YES;
+            // Moves are reported when a sort attribute changed, so the object has changed too.
+            [self.heightManager moveCellSizeAtIndexPath:indexPath toIndexPath:newIndexPath invalidate:YES];
             break;
         case RZCollectionListChangeUpdate:
-            if (!self.shouldFlushCache)
-            {
-                [self.reloadableIndexPaths addObject:indexPath];
-            }
+            [self.heightManager invalidateCellSizeAtIndexPath:indexPath];
             break;
         default:
             break;
@@ -79,18 +74,20 @@ static char s_RZAutoLayoutHeightManagerToken;
 }
 - (void)collectionList:(id<RZCollectionList>)collectionList didChangeSection:(id<RZCollectionListSectionInfo>)sectionInfo atIndex:(NSUInteger)sectionIndex forChangeType:(RZCollectionListChangeType)type
 {
-    self.shouldFlushCache = YES;
+    switch (type) {
+        case RZCollectionListChangeDelete:
+            [self.heightManager deleteCellSizesForSections:[NSIndexSet indexSetWithIndex:sectionIndex]];
+            break;
+        case RZCollectionListChangeInsert:
+            [self.heightManager insertCellSizesForSections:[NSIndexSet indexSetWithIndex:sectionIndex]];
+            break;
+        default:
+            break;
+    }
 }
 - (void)collectionListDidChangeContent:(id<RZCollectionList>)collectionList
 {
-    if (self.shouldFlushCache)
-    {
-        [self.heightManager invalidateCellSizeCache];
-    }
-    else
-    {
-        [self.heightManager invalidateCellSizesAtIndexPaths:[self.reloadableIndexPaths allObjects]];
-    }
+    [self.heightManager endCellSizeUpdates];
 }
 
 @end